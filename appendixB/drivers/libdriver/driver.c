@@ -23,6 +23,14 @@
  * |------------+---------+---------+---------+---------+---------|
  * | DEV_SCATTER| device  | proc nr | iov len |  offset | iov ptr |
  * |------------+---------+---------+---------+---------+---------|
+ * | DEV_READ_S | device  | granter |  bytes  |  offset |  grant  |
+ * |------------+---------+---------+---------+---------+---------|
+ * | DEV_WRITE_S| device  | granter |  bytes  |  offset |  grant  |
+ * |------------+---------+---------+---------+---------+---------|
+ * |DEV_GATHER_S| device  | granter | iov len |  offset | iov ptr |
+ * |------------+---------+---------+---------+---------+---------|
+ * |DEV_SCATTER_S device  | granter | iov len |  offset | iov ptr |
+ * |------------+---------+---------+---------+---------+---------|
  * |  DEV_IOCTL | device  | proc nr |func code|         | buf ptr |
  * |------------+---------+---------+---------+---------+---------|
  * |  CANCEL    | device  | proc nr | r/w     |         |         |
@@ -30,6 +38,10 @@
  * |  HARD_STOP |         |         |         |         |         |
  * ----------------------------------------------------------------
  *
+ * The _S requests name the buffers with memory grants made by the process in
+ * PROC_NR, so the driver needs no right to copy the memory otherwise. Only
+ * drivers with a dr_transfer_s entry point take them.
+ *
  * The file contains one entry point:
  *
  *   driver_task:	called by the device dependent task entry
@@ -49,6 +61,8 @@ phys_bytes tmp_phys;		/* phys address of DMA buffer */
 FORWARD _PROTOTYPE( void init_buffer, (void) );
 FORWARD _PROTOTYPE( int do_rdwt, (struct driver *dr, message *mp) );
 FORWARD _PROTOTYPE( int do_vrdwt, (struct driver *dr, message *mp) );
+FORWARD _PROTOTYPE( int do_rdwt_s, (struct driver *dr, message *mp) );
+FORWARD _PROTOTYPE( int do_vrdwt_s, (struct driver *dr, message *mp) );
 
 int device_caller;
 
@@ -89,6 +103,10 @@ struct driver *dp;	/* Device dependent entry points. */
 	case DEV_WRITE:	  r = do_rdwt(dp, &mess);	break;
 	case DEV_GATHER: 
 	case DEV_SCATTER: r = do_vrdwt(dp, &mess);	break;
+	case DEV_READ_S:
+	case DEV_WRITE_S: r = do_rdwt_s(dp, &mess);	break;
+	case DEV_GATHER_S:
+	case DEV_SCATTER_S: r = do_vrdwt_s(dp, &mess);	break;
 
 	case HARD_INT:		/* leftover interrupt or expired timer. */
 				if(dp->dr_hw_int) {
@@ -224,6 +242,74 @@ message *mp;		/* pointer to read or write message */
   return(r);
 }
 
+/*===========================================================================*
+ *				do_rdwt_s				     *
+ *===========================================================================*/
+PRIVATE int do_rdwt_s(dp, mp)
+struct driver *dp;		/* device dependent entry points */
+message *mp;			/* pointer to read or write message */
+{
+/* Carry out a single read or write request to or from a memory grant. The
+ * kernel checks the grant on every copy, so there is nothing to check here.
+ */
+  iovec_s_t iovec1;
+  int r, opcode;
+
+  if (dp->dr_transfer_s == NULL) return(EINVAL);
+  if (mp->COUNT < 0) return(EINVAL);
+
+  /* Prepare for I/O. */
+  if ((*dp->dr_prepare)(mp->DEVICE) == NIL_DEV) return(ENXIO);
+
+  /* Create a one element scatter/gather vector for the grant. */
+  opcode = mp->m_type == DEV_READ_S ? DEV_GATHER_S : DEV_SCATTER_S;
+  iovec1.iov_grant = (cp_grant_id_t) mp->ADDRESS;
+  iovec1.iov_size = mp->COUNT;
+
+  /* Transfer bytes from/to the device. */
+  r = (*dp->dr_transfer_s)(mp->PROC_NR, opcode, mp->POSITION, &iovec1, 1);
+
+  /* Return the number of bytes transferred or an error code. */
+  return(r == OK ? (mp->COUNT - iovec1.iov_size) : r);
+}
+
+/*==========================================================================*
+ *				do_vrdwt_s				    *
+ *==========================================================================*/
+PRIVATE int do_vrdwt_s(dp, mp)
+struct driver *dp;	/* device dependent entry points */
+message *mp;		/* pointer to read or write message */
+{
+/* Carry out a device read or write to/from a vector of memory grants. The
+ * vector itself is in the caller's memory, as for DEV_GATHER.
+ */
+  static iovec_s_t iovec[NR_IOREQS];
+  phys_bytes iovec_size;
+  unsigned nr_req;
+  int r;
+
+  if (dp->dr_transfer_s == NULL) return(EINVAL);
+  nr_req = mp->COUNT;	/* Length of I/O vector */
+  if (nr_req > NR_IOREQS) nr_req = NR_IOREQS;
+  iovec_size = (phys_bytes) (nr_req * sizeof(iovec[0]));
+
+  if (OK != sys_datacopy(mp->m_source, (vir_bytes) mp->ADDRESS, 
+  		SELF, (vir_bytes) iovec, iovec_size))
+      panic((*dp->dr_name)(),"bad I/O vector by", mp->m_source);
+
+  /* Prepare for I/O. */
+  if ((*dp->dr_prepare)(mp->DEVICE) == NIL_DEV) return(ENXIO);
+
+  /* Transfer bytes from/to the device. */
+  r = (*dp->dr_transfer_s)(mp->PROC_NR, mp->m_type, mp->POSITION, iovec,
+  	nr_req);
+
+  /* Copy the I/O vector back to the caller. */
+  sys_datacopy(SELF, (vir_bytes) iovec, 
+  	mp->m_source, (vir_bytes) mp->ADDRESS, iovec_size);
+  return(r);
+}
+
 /*===========================================================================*
  *				no_name					     *
  *===========================================================================*/
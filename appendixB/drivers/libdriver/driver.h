@@ -43,6 +43,8 @@ struct driver {
   _PROTOTYPE( int (*dr_select), (struct driver *dp, message *m_ptr) );
   _PROTOTYPE( int (*dr_other), (struct driver *dp, message *m_ptr) );
   _PROTOTYPE( int (*dr_hw_int), (struct driver *dp, message *m_ptr) );
+  _PROTOTYPE( int (*dr_transfer_s), (int proc_nr, int opcode,
+			off_t position, iovec_s_t *iov, unsigned nr_req) );
 };
 
 #if (CHIP == INTEL)
@@ -38,6 +38,17 @@ FORWARD _PROTOTYPE( char *m_name, (void) 				);
 FORWARD _PROTOTYPE( struct device *m_prepare, (int device) 		);
 FORWARD _PROTOTYPE( int m_transfer, (int proc_nr, int opcode, off_t position,
 					iovec_t *iov, unsigned nr_req) 	);
+FORWARD _PROTOTYPE( int m_transfer_s, (int proc_nr, int opcode,
+			off_t position, iovec_s_t *iov, unsigned nr_req) );
+FORWARD _PROTOTYPE( int m_copy, (int proc_nr, int reading,
+			cp_grant_id_t grant, vir_bytes user_vir,
+			off_t position, unsigned count) );
+FORWARD _PROTOTYPE( int m_out, (int proc_nr, cp_grant_id_t grant,
+			vir_bytes user_vir, int seg, vir_bytes dev_vir,
+			unsigned count) );
+FORWARD _PROTOTYPE( int m_in, (int proc_nr, cp_grant_id_t grant,
+			vir_bytes user_vir, int seg, vir_bytes dev_vir,
+			unsigned count) );
 FORWARD _PROTOTYPE( int m_do_open, (struct driver *dp, message *m_ptr) 	);
 FORWARD _PROTOTYPE( void m_init, (void) );
 FORWARD _PROTOTYPE( int m_ioctl, (struct driver *dp, message *m_ptr) 	);
@@ -58,7 +69,8 @@ PRIVATE struct driver m_dtab = {
   nop_cancel,
   nop_select,
   NULL,
-  NULL
+  NULL,
+  m_transfer_s	/* do the I/O to or from grants */
 };
 
 /* Buffer for the /dev/zero null byte feed. */
@@ -113,10 +125,74 @@ iovec_t *iov;			/* pointer to read or write request vector */
 unsigned nr_req;		/* length of request vector */
 {
 /* Read or write one the driver's minor devices. */
+  int r;
+
+  while (nr_req > 0) {
+	if (iov->iov_size > 0) {
+	    r = m_copy(proc_nr, opcode == DEV_GATHER, GRANT_INVALID,
+	    	iov->iov_addr, position, iov->iov_size);
+	    if (r <= 0) return(r);		/* error or EOF */
+
+	    /* Book the number of bytes transferred. */
+	    position += r;
+	    iov->iov_addr += r;
+	    iov->iov_size -= r;
+	}
+  	if (iov->iov_size == 0) { iov++; nr_req--; }
+  }
+  return(OK);
+}
+
+/*===========================================================================*
+ *				m_transfer_s				     *
+ *===========================================================================*/
+PRIVATE int m_transfer_s(proc_nr, opcode, position, iov, nr_req)
+int proc_nr;			/* process that made the grants */
+int opcode;			/* DEV_GATHER_S or DEV_SCATTER_S */
+off_t position;			/* offset on device to read or write */
+iovec_s_t *iov;			/* pointer to read or write request vector */
+unsigned nr_req;		/* length of request vector */
+{
+/* Read or write one the driver's minor devices, to or from memory grants.
+ * A grant doesn't move as the request is done, so keep the offset in it.
+ */
+  vir_bytes offset;
+  int r;
+
+  offset = 0;
+  while (nr_req > 0) {
+	if (iov->iov_size > 0) {
+	    r = m_copy(proc_nr, opcode == DEV_GATHER_S, iov->iov_grant,
+	    	offset, position, iov->iov_size);
+	    if (r <= 0) return(r);		/* error or EOF */
+
+	    /* Book the number of bytes transferred. */
+	    position += r;
+	    offset += r;
+	    iov->iov_size -= r;
+	}
+  	if (iov->iov_size == 0) { iov++; nr_req--; offset = 0; }
+  }
+  return(OK);
+}
+
+/*===========================================================================*
+ *				m_copy					     *
+ *===========================================================================*/
+PRIVATE int m_copy(proc_nr, reading, grant, user_vir, position, count)
+int proc_nr;			/* process doing the request, or granter */
+int reading;			/* TRUE for a read from the device */
+cp_grant_id_t grant;		/* grant, or GRANT_INVALID for an address */
+vir_bytes user_vir;		/* user address, or offset in the grant */
+off_t position;			/* offset on device to read or write */
+unsigned count;			/* number of bytes */
+{
+/* Copy between the current device and the user, for one element of an I/O
+ * vector. Return the number of bytes done, 0 at EOF, or an error.
+ */
   phys_bytes mem_phys;
   int seg;
-  unsigned count, left, chunk;
-  vir_bytes user_vir;
+  unsigned left, chunk;
   struct device *dv;
   unsigned long dv_size;
   int s;
@@ -124,77 +200,101 @@ unsigned nr_req;		/* length of request vector */
   /* Get minor device number and check for /dev/null. */
   dv = &m_geom[m_device];
   dv_size = cv64ul(dv->dv_size);
+  s = OK;
+
+  switch (m_device) {
+
+  /* No copying; ignore request. */
+  case NULL_DEV:
+      if (reading) return(0);			/* always at EOF */
+      break;
+
+  /* Virtual copying. For RAM disk, kernel memory and boot device. */
+  case RAM_DEV:
+  case KMEM_DEV:
+  case BOOT_DEV:
+      if (position >= dv_size) return(0); 	/* check for EOF */
+      if (position + count > dv_size) count = dv_size - position;
+      seg = m_seg[m_device];
+
+      if (reading) {				/* copy actual data */
+          s = m_out(proc_nr, grant, user_vir, seg, (vir_bytes) position, count);
+      } else {
+          s = m_in(proc_nr, grant, user_vir, seg, (vir_bytes) position, count);
+      }
+      break;
+
+  /* Physical copying. Only used to access entire memory. */
+  case MEM_DEV:
+      if (position >= dv_size) return(0); 	/* check for EOF */
+      if (position + count > dv_size) count = dv_size - position;
+      mem_phys = cv64ul(dv->dv_base) + position;
+
+      if (reading) {				/* copy data */
+          s = m_out(proc_nr, grant, user_vir, PHYS_SEG, mem_phys, count);
+      } else {
+          s = m_in(proc_nr, grant, user_vir, PHYS_SEG, mem_phys, count);
+      }
+      break;
+
+  /* Null byte stream generator. */
+  case ZERO_DEV:
+      if (reading) {
+          left = count;
+      	  while (left > 0) {
+      	      chunk = (left > ZERO_BUF_SIZE) ? ZERO_BUF_SIZE : left;
+      	      if (OK != (s=m_out(proc_nr, grant, user_vir, D,
+      	              (vir_bytes) dev_zero, chunk)))
+      	          break;
+      	      left -= chunk;
+              user_vir += chunk;
+      	  }
+      }
+      break;
 
-  while (nr_req > 0) {
-
-	/* How much to transfer and where to / from. */
-	count = iov->iov_size;
-	user_vir = iov->iov_addr;
-
-	switch (m_device) {
-
-	/* No copying; ignore request. */
-	case NULL_DEV:
-	    if (opcode == DEV_GATHER) return(OK);	/* always at EOF */
-	    break;
-
-	/* Virtual copying. For RAM disk, kernel memory and boot device. */
-	case RAM_DEV:
-	case KMEM_DEV:
-	case BOOT_DEV:
-	    if (position >= dv_size) return(OK); 	/* check for EOF */
-	    if (position + count > dv_size) count = dv_size - position;
-	    seg = m_seg[m_device];
-
-	    if (opcode == DEV_GATHER) {			/* copy actual data */
-	        sys_vircopy(SELF,seg,position, proc_nr,D,user_vir, count);
-	    } else {
-	        sys_vircopy(proc_nr,D,user_vir, SELF,seg,position, count);
-	    }
-	    break;
-
-	/* Physical copying. Only used to access entire memory. */
-	case MEM_DEV:
-	    if (position >= dv_size) return(OK); 	/* check for EOF */
-	    if (position + count > dv_size) count = dv_size - position;
-	    mem_phys = cv64ul(dv->dv_base) + position;
-
-	    if (opcode == DEV_GATHER) {			/* copy data */
-	        sys_physcopy(NONE, PHYS_SEG, mem_phys, 
-	        	proc_nr, D, user_vir, count);
-	    } else {
-	        sys_physcopy(proc_nr, D, user_vir, 
-	        	NONE, PHYS_SEG, mem_phys, count);
-	    }
-	    break;
-
-	/* Null byte stream generator. */
-	case ZERO_DEV:
-	    if (opcode == DEV_GATHER) {
-	        left = count;
-	    	while (left > 0) {
-	    	    chunk = (left > ZERO_BUF_SIZE) ? ZERO_BUF_SIZE : left;
-	    	    if (OK != (s=sys_vircopy(SELF, D, (vir_bytes) dev_zero, 
-	    	            proc_nr, D, user_vir, chunk)))
-	    	        report("MEM","sys_vircopy failed", s);
-	    	    left -= chunk;
- 	            user_vir += chunk;
-	    	}
-	    }
-	    break;
-
-	/* Unknown (illegal) minor device. */
-	default:
-	    return(EINVAL);
-	}
+  /* Unknown (illegal) minor device. */
+  default:
+      return(EINVAL);
+  }
+  return(s == OK ? count : s);
+}
 
-	/* Book the number of bytes transferred. */
-	position += count;
-	iov->iov_addr += count;
-  	if ((iov->iov_size -= count) == 0) { iov++; nr_req--; }
+/*===========================================================================*
+ *				m_out					     *
+ *===========================================================================*/
+PRIVATE int m_out(proc_nr, grant, user_vir, seg, dev_vir, count)
+int proc_nr;			/* process doing the request, or granter */
+cp_grant_id_t grant;		/* grant, or GRANT_INVALID for an address */
+vir_bytes user_vir;		/* user address, or offset in the grant */
+int seg;			/* segment of the device memory */
+vir_bytes dev_vir;		/* address of the device memory */
+unsigned count;			/* number of bytes */
+{
+/* Copy from the device memory to the user. */
+  if (grant != GRANT_INVALID)
+      return(sys_safecopyto(proc_nr, grant, user_vir, dev_vir, count, seg));
+  if (seg == PHYS_SEG)
+      return(sys_physcopy(NONE, PHYS_SEG, dev_vir, proc_nr, D, user_vir, count));
+  return(sys_vircopy(SELF, seg, dev_vir, proc_nr, D, user_vir, count));
+}
 
-  }
-  return(OK);
+/*===========================================================================*
+ *				m_in					     *
+ *===========================================================================*/
+PRIVATE int m_in(proc_nr, grant, user_vir, seg, dev_vir, count)
+int proc_nr;			/* process doing the request, or granter */
+cp_grant_id_t grant;		/* grant, or GRANT_INVALID for an address */
+vir_bytes user_vir;		/* user address, or offset in the grant */
+int seg;			/* segment of the device memory */
+vir_bytes dev_vir;		/* address of the device memory */
+unsigned count;			/* number of bytes */
+{
+/* Copy from the user to the device memory. */
+  if (grant != GRANT_INVALID)
+      return(sys_safecopyfrom(proc_nr, grant, user_vir, dev_vir, count, seg));
+  if (seg == PHYS_SEG)
+      return(sys_physcopy(proc_nr, D, user_vir, NONE, PHYS_SEG, dev_vir, count));
+  return(sys_vircopy(proc_nr, D, user_vir, SELF, seg, dev_vir, count));
 }
 
 /*===========================================================================*
@@ -107,6 +107,10 @@
 #define TTY_EXIT	(DEV_RQ_BASE + 11) /* process group leader exited */	
 #define DEV_SELECT	(DEV_RQ_BASE + 12) /* request select() attention */
 #define DEV_STATUS   	(DEV_RQ_BASE + 13) /* request driver status */
+#define DEV_READ_S	(DEV_RQ_BASE + 14) /* DEV_READ, ADDRESS is a grant */
+#define DEV_WRITE_S	(DEV_RQ_BASE + 15) /* DEV_WRITE, ADDRESS is a grant */
+#define DEV_SCATTER_S	(DEV_RQ_BASE + 16) /* DEV_SCATTER with iovec_s_t */
+#define DEV_GATHER_S	(DEV_RQ_BASE + 17) /* DEV_GATHER with iovec_s_t */
 
 #define DEV_REPLY       (DEV_RS_BASE + 0) /* general task reply */
 #define DEV_CLONED      (DEV_RS_BASE + 1) /* return cloned minor */
@@ -237,8 +241,13 @@
 #  define SYS_GETINFO    (KERNEL_CALL + 26) 	/* sys_getinfo() */
 #  define SYS_ABORT      (KERNEL_CALL + 27)	/* sys_abort() */
 
+#  define SYS_SETGRANT     (KERNEL_CALL + 28)	/* sys_setgrant() */
+#  define SYS_SAFECOPYFROM (KERNEL_CALL + 29)	/* sys_safecopyfrom() */
+#  define SYS_SAFECOPYTO   (KERNEL_CALL + 30)	/* sys_safecopyto() */
+#  define SYS_BATCH        (KERNEL_CALL + 31)	/* sys_batch() */
+
 // 系统调用的数量
-#define NR_SYS_CALLS	28	/* number of system calls */ 
+#define NR_SYS_CALLS	32	/* number of system calls */ 
 
 /* Field names for SYS_MEMSET, SYS_SEGCTL. */
 #define MEM_PTR		m2_p1	/* base */
@@ -317,6 +326,25 @@
 #define CP_DST_ADDR	m5_l2	/* address where data go to */
 #define CP_NR_BYTES	m5_l3	/* number of bytes to copy */
 
+/* Field names for SYS_SETGRANT. */
+#define SG_ADDR		m2_p1	/* address of the grant table */
+#define SG_SIZE		m2_i2	/* number of entries in it */
+
+/* Field names for SYS_SAFECOPYFROM, SYS_SAFECOPYTO. */
+#define SCP_FROM_TO	m2_i1	/* process that made the grant */
+#define SCP_INFO	m2_i2	/* segment of SCP_ADDRESS at the caller */
+#define SCP_GID		m2_i3	/* grant id */
+#define SCP_OFFSET	m2_l1	/* offset within the grant */
+#define SCP_BYTES	m2_l2	/* number of bytes to copy */
+#define SCP_ADDRESS	m2_p1	/* address at the caller */
+
+/* Field names for SYS_BATCH. */
+#define BAT_ADDR	m1_p1	/* vector of request messages */
+#define BAT_COUNT	m1_i1	/* number of requests in it */
+#define BAT_FLAGS	m1_i2	/* flags, see below */
+#  define BAT_STOPERR	0x01	/* stop at the first call that fails */
+#define BAT_NR_DONE	m1_i3	/* number of requests carried out */
+
 /* Field names for SYS_VCOPY and SYS_VVIRCOPY. */
 #define VCP_NR_OK	m1_i2	/* number of successfull copies */
 #define VCP_VEC_SIZE	m1_i3	/* size of copy vector */
@@ -339,6 +367,7 @@
 #   define GET_MACHINE 	  12	/* get machine information */
 #   define GET_LOCKTIMING 13	/* get lock()/unlock() latency timing */
 #   define GET_BIOSBUFFER 14	/* get a buffer for BIOS calls */
+#   define GET_KCALLSTATS 15	/* get kernel call counters */
 #define I_PROC_NR      m7_i4	/* calling process */
 #define I_VAL_PTR      m7_p1	/* virtual address at caller */ 
 #define I_VAL_LEN      m7_i1	/* max length of value */
@@ -51,8 +51,13 @@
 // 系统进程数
 #define NR_SYS_PROCS      _NR_SYS_PROCS
 
-#define NR_BUFS	128
-#define NR_BUF_HASH 128
+/* FS sizes its block cache at boot from the memory that is free, between
+ * these limits.  The boot parameter 'bufs' overrides it.
+ */
+/* FS 在启动时根据空闲内存确定块缓存的大小, 在以下范围之内. */
+#define NR_BUFS	128		/* fewest buffers */
+#define NR_BUFS_MAX 1024	/* most buffers */
+#define BUF_MEM_SHARE 32	/* use about 1/32 of the free memory */
 
 /* Number of controller tasks (/dev/cN device classes). */
 #define NR_CTRLRS          2
@@ -83,6 +83,26 @@ typedef struct {
 #define m8_p3  m_u.m_m8.m8p3
 #define m8_p4  m_u.m_m8.m8p4
 
+/* Asynchronous messages. A system process hands the kernel a table of these
+ * with senda(). Each valid entry is delivered when its destination next
+ * receives, without blocking the sender, and the kernel then marks it done
+ * and fills in the result.
+ */
+// 异步消息. 系统进程通过 senda() 把一张这样的表交给内核. 每个有效的表项
+// 在目标进程下一次接收时被递送, 发送者不会阻塞. 递送后内核将表项标记为
+// 完成, 并填入结果.
+typedef struct asynmsg {
+  unsigned flags;		/* AMF_VALID etc. */
+  int dst;			/* destination process */
+  int result;			/* OK or error, once AMF_DONE is set */
+  message msg;			/* the message itself */
+} asynmsg_t;
+
+#define AMF_EMPTY	0	/* slot is not in use */
+#define AMF_VALID	1	/* message waits to be delivered */
+#define AMF_DONE	2	/* delivered or failed, see result */
+#define AMF_NOTIFY	4	/* notify the sender from dst when delivered */
+
 /*==========================================================================* 
  * Minix run-time system (IPC). 					    *
  *==========================================================================*/ 
@@ -97,6 +117,8 @@ typedef struct {
 #define nb_receive	_nb_receive
 // 以非阻塞的方式发送消息. _nb_send ???
 #define nb_send		_nb_send
+// 异步发送一组消息, 不阻塞
+#define senda		_senda
 
 _PROTOTYPE( int echo, (message *m_ptr)					);
 _PROTOTYPE( int notify, (int dest)					);
@@ -105,5 +127,6 @@ _PROTOTYPE( int receive, (int src, message *m_ptr)			);
 _PROTOTYPE( int send, (int dest, message *m_ptr)			);
 _PROTOTYPE( int nb_receive, (int src, message *m_ptr)			);
 _PROTOTYPE( int nb_send, (int dest, message *m_ptr)			);
+_PROTOTYPE( int senda, (asynmsg_t *table, int size)			);
 
 #endif /* _IPC_H */
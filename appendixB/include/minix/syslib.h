@@ -88,6 +88,19 @@ _PROTOTYPE(int sys_physcopy, (int src_proc, int src_seg, vir_bytes src_vir,
 _PROTOTYPE(int sys_memset, (unsigned long pattern, 
 		phys_bytes base, phys_bytes bytes));
 
+/* Several kernel calls in one. Each message in 'vec' is a request, and gets
+ * the reply in its place, with the result in m_type.
+ */
+_PROTOTYPE(int sys_batch, (message *vec, int count, int flags,
+	int *nr_done));
+
+/* Memory grants. 'seg' and 'address' give the caller's side of the copy. */
+_PROTOTYPE(int sys_setgrant, (cp_grant_t *table, int entries));
+_PROTOTYPE(int sys_safecopyfrom, (int granter, cp_grant_id_t grant,
+	vir_bytes offset, vir_bytes address, size_t bytes, int seg));
+_PROTOTYPE(int sys_safecopyto, (int granter, cp_grant_id_t grant,
+	vir_bytes offset, vir_bytes address, size_t bytes, int seg));
+
 /* Vectored virtual / physical copy calls. */
 #if DEAD_CODE		/* library part not yet implemented */
 _PROTOTYPE(int sys_virvcopy, (phys_cp_req *vec_ptr,int vec_size,int *nr_ok));
@@ -68,6 +68,38 @@ typedef struct {
   vir_bytes iov_size;		/* sizeof an I/O buffer */
 } iovec_t;
 
+/* Memory grants. A system process keeps a table of these in its own address
+ * space and registers it with sys_setgrant(). Another process may then copy
+ * to or from the granted bytes with sys_safecopyfrom() and sys_safecopyto(),
+ * naming the grant by its index in the table. The kernel reads the entry on
+ * every copy, so clearing CPF_USED revokes a grant at once.
+ */
+// 内存授权. 系统进程在自己的地址空间中保存一个授权表, 用 sys_setgrant()
+// 登记. 其他进程用授权号(表中的下标)复制被授权的字节. 内核每次复制都
+// 重新读取表项, 所以清除 CPF_USED 即可立即撤销授权.
+typedef int cp_grant_id_t;
+
+typedef struct {
+  int cp_flags;			/* CPF_USED etc. */
+  int cp_who;			/* process that may use the grant, or ANY */
+  int cp_from;			/* CPF_MAGIC: process whose memory it is */
+  vir_bytes cp_start;		/* first byte granted, in D space */
+  vir_bytes cp_len;		/* number of bytes granted */
+} cp_grant_t;
+
+#define CPF_READ	0x01	/* grantee may copy from the memory */
+#define CPF_WRITE	0x02	/* grantee may copy to the memory */
+#define CPF_USED	0x04	/* entry is in use; clear it to revoke */
+#define CPF_MAGIC	0x08	/* memory of cp_from instead of the granter */
+
+#define GRANT_INVALID	((cp_grant_id_t) -1)
+
+/* I/O vector of grants for DEV_GATHER_S and DEV_SCATTER_S. */
+typedef struct {
+  cp_grant_id_t iov_grant;	/* grant for an I/O buffer */
+  vir_bytes iov_size;		/* sizeof an I/O buffer */
+} iovec_s_t;
+
 /* PM passes the address of a structure of this type to KERNEL when
  * sys_sendsig() is invoked as part of the signal catching mechanism.
  * The structure contain all the information that KERNEL needs to build
@@ -118,6 +150,48 @@ struct kinfo {
   int relocking;		/* relocking check (for debugging) */
 };
 
+/* PM's memory statistics, obtained with getsysinfo(PM_PROC_NR, SI_MEM_STATS).
+ * Fragmentation is the part of the free memory, in percent, that is not in
+ * the largest hole.
+ */
+/* 通过 getsysinfo(PM_PROC_NR, SI_MEM_STATS) 获取的 PM 内存统计信息. */
+struct memstats {
+  phys_clicks ms_free;		/* total free memory */
+  phys_clicks ms_largest;	/* largest hole */
+  unsigned ms_holes;		/* number of holes */
+  unsigned ms_frag;		/* 100 - 100 * ms_largest / ms_free */
+  unsigned long ms_allocs;	/* successful alloc_mem() calls */
+  unsigned long ms_failed;	/* alloc_mem() calls that found no hole */
+  unsigned long ms_frees;	/* free_mem() calls */
+};
+
+/* FS's block cache statistics, obtained with getsysinfo(FS_PROC_NR,
+ * SI_CACHE_STATS).
+ */
+/* 通过 getsysinfo(FS_PROC_NR, SI_CACHE_STATS) 获取的 FS 块缓存统计信息. */
+struct cachestats {
+  int cs_bufs;			/* number of buffers */
+  int cs_probation;		/* buffers in the probation queue */
+  int cs_in_use;		/* buffers in use */
+  unsigned long cs_hits;	/* get_block() found the block */
+  unsigned long cs_misses;	/* get_block() had to take a buffer */
+  unsigned long cs_evictions;	/* ... and the buffer held another block */
+  unsigned long cs_ghost_hits;	/* misses on blocks evicted on probation */
+};
+
+/* FS's directory entry cache statistics, obtained with
+ * getsysinfo(FS_PROC_NR, SI_NAME_STATS).
+ */
+/* 通过 getsysinfo(FS_PROC_NR, SI_NAME_STATS) 获取的 FS 目录项缓存统计信息. */
+struct namestats {
+  int ns_slots;			/* number of slots */
+  int ns_used;			/* slots holding a name */
+  unsigned long ns_hits;	/* lookups answered with an inode number */
+  unsigned long ns_neg_hits;	/* lookups answered with "no such name" */
+  unsigned long ns_misses;	/* lookups that searched the directory */
+  unsigned long ns_purged;	/* names dropped because they changed */
+};
+
 // 跟机器有关的数据
 struct machine {
   int pc_at;		// ibm pc at 兼容机
@@ -42,6 +42,9 @@
 #define SI_PROC_ADDR	   1	/* address of process table */
 #define SI_PROC_TAB	   2	/* copy of entire process table */
 #define SI_DMAP_TAB	   3	/* get device <-> driver mappings */
+#define SI_MEM_STATS	   4	/* PM's free memory and fragmentation */
+#define SI_CACHE_STATS	   5	/* FS's block cache hits and misses */
+#define SI_NAME_STATS	   6	/* FS's directory entry cache hit rate */
 
 /* NULL must be defined in <unistd.h> according to POSIX Sec. 2.7.1. */
 #define NULL    ((void *)0)
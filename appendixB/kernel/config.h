@@ -48,6 +48,9 @@
 #define USE_PHYSCOPY  	   1 	/* copy using physical addressing */
 #define USE_PHYSVCOPY  	   1	/* vector with physical copy requests */
 #define USE_MEMSET  	   1	/* write char to a given memory area */
+#define USE_SETGRANT	   1	/* register a table of memory grants */
+#define USE_SAFECOPY	   1	/* copy by means of a memory grant */
+#define USE_BATCH	   1	/* make a vector of kernel calls */
 
 /* Length of program names stored in the process table. This is only used
  * for the debugging dumps that can be generated with the IS server. The PM
@@ -79,6 +82,8 @@
 #define NR_IRQ_HOOKS	  16		/* number of interrupt hooks */
 #define VDEVIO_BUF_SIZE   64		/* max elements per VDEVIO request */
 #define VCOPY_VEC_SIZE    16		/* max elements per VCOPY request */
+#define BATCH_VEC_SIZE    64		/* max elements per BATCH request */
+#define NR_ASYNMSGS	  64		/* max elements per SENDA table */
 
 /* How many bytes for the kernel stack. Space allocated in mpx.s. */
 #define K_STACK_BYTES   1024	
@@ -29,6 +29,7 @@ EXTERN struct machine machine;		/* machine information for users */
 EXTERN struct kmessages kmess;  	/* diagnostic messages in kernel */
 /* 搜集内核的随机信息 */
 EXTERN struct randomness krandom;	/* gather kernel random information */
+EXTERN struct kcallstats kcallstats;	/* kernel call counters */
 
 /* Process scheduling information and the kernel reentry count. */
 // 上一次运行的进程
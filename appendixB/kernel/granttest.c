@@ -0,0 +1,379 @@
+/* Host-side test of the memory grant checks in system/do_safecopy.c.  This is
+ * an ordinary user program, not part of the kernel.
+ *
+ * A few processes get a data segment each, a privilege structure and, for
+ * system processes, a grant table in their own memory, as in the kernel.
+ * The kernel's own system/do_safecopy.c is compiled in, on top of stand-ins
+ * for the bits of the kernel it uses, and do_setgrant() and do_safecopy() are
+ * run through copies that must succeed, copies that must fail, and
+ * revocations.  Every case prints a line; the exit status is the number of
+ * failures.
+ *
+ * usage: granttest
+ */
+#include <stdio.h>
+#include <string.h>
+
+/* Keep out the kernel headers that do_safecopy.c includes; what it needs
+ * from them is defined here.
+ */
+#define SYSTEM_H
+#define _TYPE_H
+
+#define PUBLIC
+#define PRIVATE		static
+#define FORWARD		static
+#define _PROTOTYPE(function, params)	function params
+
+#define OK		   0
+#define EPERM		   1
+#define EINVAL		  22
+#define EFAULT		  14
+#define EDEADDST	 105
+
+#define ANY		0x7ace
+#define NR_PROCS	   6
+#define SEG_SIZE	4096
+
+#define USE_SETGRANT	   1
+#define USE_SAFECOPY	   1
+#define KERNEL_CALL	0x600
+#define SYS_VIRCOPY	(KERNEL_CALL + 15)
+#define SYS_PHYSCOPY	(KERNEL_CALL + 16)
+#define SYS_SAFECOPYFROM (KERNEL_CALL + 29)
+#define SYS_SAFECOPYTO	(KERNEL_CALL + 30)
+#define CALL_VIRCOPY	(1UL << (SYS_VIRCOPY - KERNEL_CALL))
+#define CALL_PHYSCOPY	(1UL << (SYS_PHYSCOPY - KERNEL_CALL))
+
+#define SYS_PROC	0x10
+#define T		   0
+#define D		   1
+#define SEGMENT_TYPE	0xFF00
+#define LOCAL_SEG	0x0000
+#define REMOTE_SEG	0x0100
+#define BIOS_SEG	0x0200
+#define PHYS_SEG	0x0400
+#define _SRC_		   0
+#define _DST_		   1
+
+typedef unsigned long vir_bytes;
+typedef unsigned long phys_bytes;	/* here, a host address */
+typedef int cp_grant_id_t;
+
+typedef struct {
+  int cp_flags;
+  int cp_who;
+  int cp_from;
+  vir_bytes cp_start;
+  vir_bytes cp_len;
+} cp_grant_t;
+
+#define CPF_READ	0x01
+#define CPF_WRITE	0x02
+#define CPF_USED	0x04
+#define CPF_MAGIC	0x08
+
+struct vir_addr {
+  int proc_nr;
+  int segment;
+  vir_bytes offset;
+};
+
+/* The fields of message that do_safecopy.c uses, by their com.h names. */
+typedef struct {
+  int m_source;
+  int m_type;
+  int m2_i1, m2_i2, m2_i3;
+  long m2_l1, m2_l2;
+  char *m2_p1;
+} message;
+
+#define SG_ADDR		m2_p1
+#define SG_SIZE		m2_i2
+#define SCP_FROM_TO	m2_i1
+#define SCP_INFO	m2_i2
+#define SCP_GID		m2_i3
+#define SCP_OFFSET	m2_l1
+#define SCP_BYTES	m2_l2
+#define SCP_ADDRESS	m2_p1
+
+struct priv {
+  short s_flags;
+  unsigned long s_call_mask;
+  vir_bytes s_grant_table;
+  int s_grant_entries;
+};
+
+struct proc {
+  int p_live;
+  struct priv p_priv;
+  unsigned char p_mem[SEG_SIZE];	/* the data segment */
+};
+
+static struct proc procs[NR_PROCS];
+static unsigned char physmem[SEG_SIZE];
+
+#define proc_addr(n)	(&procs[n])
+#define priv(rp)	(&(rp)->p_priv)
+#define isokprocn(n)	((unsigned) (n) < NR_PROCS)
+#define isemptyn(n)	(! procs[n].p_live)
+#define vir2phys(p)	((phys_bytes) (p))
+#define phys_copy(src, dst, bytes) \
+	memcpy((void *) (dst), (void *) (src), (bytes))
+
+/* umap_local() for the data segment: the host address, or 0 if the range
+ * isn't in the segment.
+ */
+static phys_bytes umap_local(struct proc *rp, int seg, vir_bytes vir,
+	vir_bytes bytes)
+{
+  if (seg != D || vir > SEG_SIZE || bytes > SEG_SIZE - vir) return(0);
+  return((phys_bytes) &rp->p_mem[vir]);
+}
+
+static phys_bytes numap_local(int proc_nr, vir_bytes vir, vir_bytes bytes)
+{
+  return(umap_local(proc_addr(proc_nr), D, vir, bytes));
+}
+
+/* virtual_copy() for the data segment and physical memory; there are no
+ * remote segments here.
+ */
+static int virtual_copy(struct vir_addr *src, struct vir_addr *dst,
+	vir_bytes bytes)
+{
+  struct vir_addr *va[2];
+  phys_bytes phys[2];
+  int i;
+
+  va[_SRC_] = src;
+  va[_DST_] = dst;
+  for (i = _SRC_; i <= _DST_; i++) {
+      if (va[i]->segment == PHYS_SEG)
+          phys[i] = va[i]->offset <= SEG_SIZE &&
+              bytes <= SEG_SIZE - va[i]->offset ?
+              (phys_bytes) &physmem[va[i]->offset] : 0;
+      else
+          phys[i] = umap_local(proc_addr(va[i]->proc_nr), va[i]->segment,
+              va[i]->offset, bytes);
+      if (phys[i] == 0) return(EFAULT);
+  }
+  phys_copy(phys[_SRC_], phys[_DST_], bytes);
+  return(OK);
+}
+
+#include "system/do_safecopy.c"
+
+/* The kernel calls, as the system library would send them. */
+static int setgrant(int caller, vir_bytes addr, int size)
+{
+  message m;
+
+  m.m_source = caller;
+  m.SG_ADDR = (char *) addr;
+  m.SG_SIZE = size;
+  return(do_setgrant(&m));
+}
+
+static int safecopy(int caller, int to, int granter, cp_grant_id_t grant,
+	vir_bytes offset, vir_bytes address, long nbytes, int seg)
+{
+  message m;
+
+  m.m_source = caller;
+  m.m_type = to ? SYS_SAFECOPYTO : SYS_SAFECOPYFROM;
+  m.SCP_FROM_TO = granter;
+  m.SCP_GID = grant;
+  m.SCP_OFFSET = (long) offset;
+  m.SCP_BYTES = nbytes;
+  m.SCP_ADDRESS = (char *) address;
+  m.SCP_INFO = seg;
+  return(do_safecopy(&m));
+}
+
+/*===========================================================================*
+ *				test cases				     *
+ *===========================================================================*/
+#define FS	0		/* system process, may SYS_VIRCOPY */
+#define DRV	1		/* system process, grantee */
+#define DRV2	2		/* another driver */
+#define SRV	3		/* system process without SYS_VIRCOPY */
+#define USR	4		/* user process */
+#define GONE	5		/* empty slot */
+
+#define TABLE	 0		/* grant tables are at the start of D */
+#define NGRANTS	 8
+#define BUF	1024		/* granted buffers */
+#define DBUF	2048		/* the drivers' own buffers */
+
+static int failures;
+
+static cp_grant_t *grants(int proc_nr)
+{
+  return((cp_grant_t *) &procs[proc_nr].p_mem[TABLE]);
+}
+
+static void setg(int granter, int g, int flags, int who, int from,
+	vir_bytes start, vir_bytes len)
+{
+  cp_grant_t *gp = &grants(granter)[g];
+
+  gp->cp_flags = flags;
+  gp->cp_who = who;
+  gp->cp_from = from;
+  gp->cp_start = start;
+  gp->cp_len = len;
+}
+
+static void expect(const char *what, int got, int want)
+{
+  printf("%-52s %s", what, got == want ? "ok" : "FAILED");
+  if (got != want) {
+      printf(" (got %d, want %d)", got, want);
+      failures++;
+  }
+  printf("\n");
+}
+
+static void setup(void)
+{
+  int i;
+
+  memset(procs, 0, sizeof(procs));
+  for (i = 0; i < NR_PROCS; i++) {
+      procs[i].p_live = i != GONE;
+      if (i != USR && i != GONE) procs[i].p_priv.s_flags = SYS_PROC;
+  }
+  priv(proc_addr(FS))->s_call_mask = CALL_VIRCOPY;
+  priv(proc_addr(DRV))->s_call_mask = CALL_PHYSCOPY;
+  for (i = 0; i < SEG_SIZE; i++) {
+      procs[FS].p_mem[i] = i;
+      procs[SRV].p_mem[i] = i;
+      procs[USR].p_mem[i] = 255 - i;
+      physmem[i] = i ^ 0x5a;
+  }
+  memset(grants(FS), 0, NGRANTS * sizeof(cp_grant_t));
+  memset(grants(SRV), 0, NGRANTS * sizeof(cp_grant_t));
+  expect("register grant table", setgrant(FS, TABLE, NGRANTS), OK);
+  expect("register table past the segment",
+      setgrant(SRV, SEG_SIZE - 8, NGRANTS), EFAULT);
+  expect("register table of negative size", setgrant(SRV, TABLE, -1),
+      EINVAL);
+  expect("register second table", setgrant(SRV, TABLE, NGRANTS), OK);
+}
+
+int main(void)
+{
+  unsigned char *dbuf;
+  int r;
+
+  setup();
+  dbuf = &procs[DRV].p_mem[DBUF];
+
+  /* Plain reads and writes within a grant. */
+  setg(FS, 0, CPF_USED | CPF_READ, DRV, 0, BUF, 512);
+  r = safecopy(DRV, 0, FS, 0, 100, DBUF, 200, D);
+  expect("read within grant", r, OK);
+  expect("  data arrived", dbuf[0] == (unsigned char) (BUF + 100) &&
+      dbuf[199] == (unsigned char) (BUF + 299), 1);
+  expect("read whole grant", safecopy(DRV, 0, FS, 0, 0, DBUF, 512, D), OK);
+  expect("write to read-only grant",
+      safecopy(DRV, 1, FS, 0, 0, DBUF, 16, D), EPERM);
+  setg(FS, 1, CPF_USED | CPF_WRITE, DRV, 0, BUF + 512, 256);
+  memset(dbuf, 0xee, 256);
+  expect("write within grant", safecopy(DRV, 1, FS, 1, 0, DBUF, 256, D),
+      OK);
+  expect("  data arrived", procs[FS].p_mem[BUF + 512] == 0xee &&
+      procs[FS].p_mem[BUF + 767] == 0xee &&
+      procs[FS].p_mem[BUF + 768] == (unsigned char) (BUF + 768), 1);
+  expect("read from write-only grant",
+      safecopy(DRV, 0, FS, 1, 0, DBUF, 16, D), EPERM);
+  expect("zero bytes", safecopy(DRV, 0, FS, 0, 0, DBUF, 0, D), EINVAL);
+
+  /* Bounds. */
+  expect("read one byte past the end",
+      safecopy(DRV, 0, FS, 0, 0, DBUF, 513, D), EPERM);
+  expect("read at offset past the end",
+      safecopy(DRV, 0, FS, 0, 513, DBUF, 1, D), EPERM);
+  expect("read ending exactly at the end",
+      safecopy(DRV, 0, FS, 0, 511, DBUF, 1, D), OK);
+  expect("offset + bytes wraps around",
+      safecopy(DRV, 0, FS, 0, (vir_bytes) -16, DBUF, 0x20, D), EPERM);
+  expect("huge byte count", safecopy(DRV, 0, FS, 0, 16, DBUF,
+      0x7ffffff0L, D), EPERM);
+  setg(FS, 2, CPF_USED | CPF_READ, DRV, 0, SEG_SIZE - 16, 64);
+  expect("grant itself past the granter's segment",
+      safecopy(DRV, 0, FS, 2, 0, DBUF, 32, D), EFAULT);
+  expect("own buffer past the caller's segment",
+      safecopy(DRV, 0, FS, 0, 0, SEG_SIZE - 8, 16, D), EFAULT);
+
+  /* Who may use it. */
+  expect("grant for another process",
+      safecopy(DRV2, 0, FS, 0, 0, DBUF, 16, D), EPERM);
+  setg(FS, 3, CPF_USED | CPF_READ, ANY, 0, BUF, 16);
+  expect("grant for ANY", safecopy(DRV2, 0, FS, 3, 0, DBUF, 16, D), OK);
+  expect("negative grant id", safecopy(DRV, 0, FS, -1, 0, DBUF, 16, D),
+      EPERM);
+  expect("grant id past the table",
+      safecopy(DRV, 0, FS, NGRANTS, 0, DBUF, 16, D), EPERM);
+  expect("unused entry", safecopy(DRV, 0, FS, 4, 0, DBUF, 16, D), EPERM);
+  expect("granter is a user process",
+      safecopy(DRV, 0, USR, 0, 0, DBUF, 16, D), EPERM);
+  expect("granter is not a process",
+      safecopy(DRV, 0, NR_PROCS, 0, 0, DBUF, 16, D), EDEADDST);
+
+  /* Revocation takes effect at once, without a kernel call. */
+  grants(FS)[0].cp_flags &= ~CPF_USED;
+  expect("revoked grant", safecopy(DRV, 0, FS, 0, 0, DBUF, 16, D), EPERM);
+  setg(FS, 0, CPF_USED | CPF_READ, DRV2, 0, BUF, 512);
+  expect("slot reused for another process, old grantee",
+      safecopy(DRV, 0, FS, 0, 0, DBUF, 16, D), EPERM);
+  expect("slot reused for another process, new grantee",
+      safecopy(DRV2, 0, FS, 0, 0, DBUF, 16, D), OK);
+  grants(FS)[3].cp_len = 8;
+  expect("grant shrunk", safecopy(DRV2, 0, FS, 3, 0, DBUF, 16, D), EPERM);
+  expect("table withdrawn", (setgrant(FS, TABLE, 0),
+      safecopy(DRV2, 0, FS, 0, 0, DBUF, 16, D)), EPERM);
+  setgrant(FS, TABLE, NGRANTS);
+  expect("table registered again",
+      safecopy(DRV2, 0, FS, 0, 0, DBUF, 16, D), OK);
+  procs[FS].p_live = 0;
+  expect("granter exited", safecopy(DRV2, 0, FS, 0, 0, DBUF, 16, D),
+      EDEADDST);
+  procs[FS].p_live = 1;
+
+  /* Magic grants: FS grants a user buffer straight to the driver. */
+  setg(FS, 5, CPF_USED | CPF_READ | CPF_WRITE | CPF_MAGIC, DRV, USR, BUF, 64);
+  expect("magic grant of a user buffer",
+      safecopy(DRV, 0, FS, 5, 0, DBUF, 64, D), OK);
+  expect("  data came from the user", dbuf[0] == (unsigned char) (255 - BUF), 1);
+  memset(dbuf, 0x11, 64);
+  expect("magic grant, write", safecopy(DRV, 1, FS, 5, 0, DBUF, 64, D), OK);
+  expect("  data went to the user, not FS",
+      procs[USR].p_mem[BUF] == 0x11 && procs[FS].p_mem[BUF] != 0x11, 1);
+  setg(SRV, 0, CPF_USED | CPF_READ | CPF_MAGIC, DRV, USR, BUF, 64);
+  expect("magic grant by a process without SYS_VIRCOPY",
+      safecopy(DRV, 0, SRV, 0, 0, DBUF, 64, D), EPERM);
+  setg(FS, 6, CPF_USED | CPF_READ | CPF_MAGIC, DRV, GONE, BUF, 64);
+  expect("magic grant of an exited process",
+      safecopy(DRV, 0, FS, 6, 0, DBUF, 64, D), EPERM);
+
+  /* Physical addressing on the caller's side needs the right to it. */
+  expect("to physical memory, with SYS_PHYSCOPY",
+      safecopy(DRV, 0, FS, 5, 0, 128, 64, PHYS_SEG), OK);
+  expect("to physical memory, without",
+      safecopy(DRV2, 0, FS, 0, 0, 128, 64, PHYS_SEG), EPERM);
+
+  /* Only those segments are the caller's to copy. */
+  expect("to the BIOS segment",
+      safecopy(DRV, 0, FS, 0, 0, 128, 64, BIOS_SEG), EINVAL);
+  expect("to the text segment",
+      safecopy(DRV, 0, FS, 0, 0, DBUF, 64, T), EINVAL);
+  expect("to physical memory with other bits set",
+      safecopy(DRV, 0, FS, 5, 0, 128, 64, PHYS_SEG | BIOS_SEG), EINVAL);
+  expect("to a remote segment the caller doesn't have",
+      safecopy(DRV, 0, FS, 5, 0, 0, 64, REMOTE_SEG), EFAULT);
+
+  printf("%d failure%s\n", failures, failures == 1 ? "" : "s");
+  return(failures);
+}
@@ -27,6 +27,8 @@
 #define SENDREC	 	   3  	/* 0 0 1 1 : SEND + RECEIVE */
 // 非阻塞通知
 #define NOTIFY		   4	/* 0 1 0 0 : nonblocking notify */
+// 异步发送, 参数是消息表及其大小, 由 sys_call() 单独检查
+#define SENDA		   5	/* 0 1 0 1 : asynchronous send, own checks */
 // 回射一个消息
 #define ECHO		   8	/* 1 0 0 0 : echo a message */
 
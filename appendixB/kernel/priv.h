@@ -32,10 +32,18 @@ struct priv {
   // 指示允许向哪些进程发送消息
   sys_map_t s_ipc_to;		/* allowed destination processes */
   // 允许的系统调用, 每一位代表一个系统调用.
-  long s_call_mask;		/* allowed kernel calls */
+  unsigned long s_call_mask;	/* allowed kernel calls */
 
   // 未决的通知位图, 每个系统进程的通知对应一位
   sys_map_t s_notify_pending;  	/* bit map with pending notifications */
+  // 有异步消息要发给本进程的系统进程的位图
+  sys_map_t s_asyn_pending;	/* bit map with pending async messages */
+  // senda() 登记的异步消息表, 位于本进程的地址空间中
+  vir_bytes s_asyntab;		/* table of asynchronous messages */
+  int s_asynsize;		/* entries in s_asyntab, 0 if none */
+  // sys_setgrant() 登记的内存授权表, 位于本进程的地址空间中
+  vir_bytes s_grant_table;	/* table of memory grants */
+  int s_grant_entries;		/* entries in s_grant_table, 0 if none */
   // 未决硬件中断位图
   irq_id_t s_int_pending;	/* pending hardware interrupts */
   // 未决信号位图
@@ -82,11 +82,25 @@ FORWARD _PROTOTYPE( int mini_send, (struct proc *caller_ptr, int dst,
 FORWARD _PROTOTYPE( int mini_receive, (struct proc *caller_ptr, int src,
 		message *m_ptr, unsigned flags) );
 FORWARD _PROTOTYPE( int mini_notify, (struct proc *caller_ptr, int dst) );
+FORWARD _PROTOTYPE( int mini_senda, (struct proc *caller_ptr,
+		asynmsg_t *table, int size) );
+FORWARD _PROTOTYPE( int asyn_take, (struct proc *src_ptr,
+		struct proc *dst_ptr, message *m_ptr) );
 
 FORWARD _PROTOTYPE( void enqueue, (struct proc *rp) );
 FORWARD _PROTOTYPE( void dequeue, (struct proc *rp) );
 FORWARD _PROTOTYPE( void sched, (struct proc *rp, int *queue, int *front) );
 FORWARD _PROTOTYPE( void pick_proc, (void) );
+FORWARD _PROTOTYPE( int first_queue, (unsigned map) );
+
+/* A process is on a ready queue iff its predecessor points back at it, or
+ * it is the head of the queue.  Forked children copy their parent's links,
+ * so the links alone don't tell.
+ */
+// 判断进程是否在其就绪队列中
+#define isreadyp(rp, q) \
+	((rp)->p_prevready != NIL_PROC ? (rp)->p_prevready->p_nextready == (rp) \
+				       : rdy_head[q] == (rp))
 
 // 构建一个消息
 #define BuildMess(m_ptr, src, dst_ptr) \
@@ -149,14 +163,24 @@ message *m_ptr;			/* pointer to message in the caller's space */
    */
   // 如果主调进程没有权限调用某个系统调用, 或者 
   // 发送进程是内核任务并且系统调用不是发送或接收, 并且 
-  // 系统调用不是阻塞发送, 则报错.
+  // 系统调用不是阻塞发送, 则报错. SENDA 的 src_dst 是表的大小, 不是
+  // 进程号, 由 mini_senda() 检查.
   if (! (priv(caller_ptr)->s_trap_mask & (1 << function)) || 
           (iskerneln(src_dst) && function != SENDREC
-           && function != RECEIVE)) { 
+           && function != RECEIVE && function != SENDA)) { 
       kprintf("sys_call: trap %d not allowed, caller %d, src_dst %d\n", 
           function, proc_nr(caller_ptr), src_dst);
       return(ECALLDENIED);		/* trap denied by mask or kernel */
   }
+
+  /* An asynchronous send passes a table and its size instead of a message
+   * and a process, so a negative size must not be taken for a kernel task
+   * above. Mini_senda() checks the size, and each entry when it is delivered.
+   */
+  // 异步发送的参数是消息表与表的大小, 而不是消息与进程号, 因此不做下面
+  // 的检查, 由 mini_senda() 逐项检查.
+  if (function == SENDA)
+      return(mini_senda(caller_ptr, (asynmsg_t *) m_ptr, src_dst));
   
   /* Require a valid source and/ or destination process, unless echoing. */
   /* 要求一个有效的发送与接收进程, 除非是回射 */
@@ -295,7 +319,6 @@ unsigned flags;				/* system call flags */
  * 在等待其他的消息, 那就对 'caller_ptr' 排队.
  */
   register struct proc *dst_ptr = proc_addr(dst);
-  register struct proc **xpp;
   register struct proc *xp;
 
   /* Check for deadlock by 'caller_ptr' and 'dst' sending to each other. */
@@ -329,11 +352,16 @@ unsigned flags;				/* system call flags */
 	caller_ptr->p_rts_flags |= SENDING;
 	caller_ptr->p_sendto = dst;
 
-	/* Process is now blocked.  Put in on the destination's queue. */
-	/* 发送进程现在已经阻塞, 将其放到目标进程的等待队列中 */
-	xpp = &dst_ptr->p_caller_q;		/* find end of list */
-	while (*xpp != NIL_PROC) xpp = &(*xpp)->p_q_link;	
-	*xpp = caller_ptr;			/* add caller to end */
+	/* Process is now blocked.  Put in on the destination's queue. The tail
+	 * pointer is only good while the queue is nonempty.
+	 */
+	/* 发送进程现在已经阻塞, 将其放到目标进程的等待队列中. 队尾指针
+	 * 只在队列非空时有效.
+	 */
+	if (dst_ptr->p_caller_q == NIL_PROC)	/* empty queue */
+		dst_ptr->p_caller_tail = &dst_ptr->p_caller_q;
+	*dst_ptr->p_caller_tail = caller_ptr;	/* add caller to end */
+	dst_ptr->p_caller_tail = &caller_ptr->p_q_link;
 	caller_ptr->p_q_link = NIL_PROC;	/* mark new end of list */
   } else {
 	return(ENOTREADY);
@@ -405,6 +433,30 @@ unsigned flags;				/* system call flags */
         }
     }
 
+    /* Check for asynchronous messages. These are ordinary messages, so
+     * SENDREC gets them too, if they are from the right source. Unlike above,
+     * look at every bit, since a sender may have nothing for us after all.
+     */
+    // 检查异步消息. 它们是普通的消息, 所以 SENDREC 也可以接收, 只要源
+    // 进程符合. 与上面不同, 这里检查每一个置位的位.
+    map = &priv(caller_ptr)->s_asyn_pending;
+    for (chunk=&map->chunk[0]; chunk<&map->chunk[NR_SYS_CHUNKS]; chunk++) {
+        if (! *chunk) continue; 			/* no bits in chunk */
+        for (i=0; i < BITCHUNK_BITS; i++) {
+            if (! (*chunk & (1<<i))) continue;
+            src_id = (chunk - &map->chunk[0]) * BITCHUNK_BITS + i;
+            if (src_id >= NR_SYS_PROCS) break;		/* out of range */
+            src_proc_nr = id_to_nr(src_id);		/* get source proc */
+            if (src_proc_nr == NONE) {			/* sender is gone */
+                *chunk &= ~(1 << i);
+                continue;
+            }
+            if (src!=ANY && src!=src_proc_nr) continue;	/* source not ok */
+            if (asyn_take(proc_addr(src_proc_nr), caller_ptr, m_ptr) == OK)
+                return(OK);				/* report success */
+        }
+    }
+
     /* Check caller queue. Use pointer pointers to keep code simple. */
     xpp = &caller_ptr->p_caller_q;
     while (*xpp != NIL_PROC) {
@@ -412,6 +464,8 @@ unsigned flags;				/* system call flags */
 	    /* Found acceptable message. Copy it and update status. */
 	    CopyMess((*xpp)->p_nr, *xpp, (*xpp)->p_messbuf, caller_ptr, m_ptr);
             if (((*xpp)->p_rts_flags &= ~SENDING) == 0) enqueue(*xpp);
+            if ((*xpp)->p_q_link == NIL_PROC)	/* tail removed */
+                caller_ptr->p_caller_tail = xpp;
             *xpp = (*xpp)->p_q_link;		/* remove from queue */
             return(OK);				/* report success */
 	}
@@ -496,6 +550,117 @@ int dst;				/* which process to notify */
   return(OK);
 }
 
+/*===========================================================================*
+ *				mini_senda				     * 
+ *===========================================================================*/
+// 异步发送. 登记主调进程的消息表, 并立即递送那些目标进程正在等待的消息,
+// 其余的在目标进程的 s_asyn_pending 中标记, 等它接收时再递送.
+PRIVATE int mini_senda(caller_ptr, table, size)
+register struct proc *caller_ptr;	/* process with messages to send */
+asynmsg_t *table;			/* table in caller's address space */
+int size;				/* number of entries in table */
+{
+/* Register a table of asynchronous messages, and deliver each valid entry
+ * whose destination is waiting for it now. For the others, set the caller's
+ * bit in the destination's s_asyn_pending map; mini_receive() delivers them
+ * from there. The caller doesn't block. It may reuse entries once they are
+ * AMF_DONE, and must call again to add new ones; a size of 0 withdraws the
+ * table. Only system processes have a privilege structure of their own for
+ * the pending map, so only they can send or receive this way.
+ */
+  register struct priv *privp = priv(caller_ptr);
+  register struct proc *dst_ptr;
+  asynmsg_t am;
+  phys_bytes tab_phys, am_phys;
+  int i, dst;
+
+  if (! (privp->s_flags & SYS_PROC)) return(ECALLDENIED);
+  privp->s_asynsize = 0;			/* withdraw old table */
+  if (size == 0) return(OK);
+  if (size < 0 || size > NR_ASYNMSGS) return(EINVAL);
+  if ((tab_phys = umap_local(caller_ptr, D, (vir_bytes) table,
+          (vir_bytes) (size * sizeof(asynmsg_t)))) == 0)
+      return(EFAULT);
+  privp->s_asyntab = (vir_bytes) table;
+  privp->s_asynsize = size;
+
+  for (i = 0; i < size; i++) {
+      am_phys = tab_phys + i * sizeof(asynmsg_t);
+      phys_copy(am_phys, vir2phys(&am), (phys_bytes) sizeof(am));
+      if ((am.flags & (AMF_VALID | AMF_DONE)) != AMF_VALID) continue;
+
+      /* Check the destination the way sys_call() checks that of a SEND. */
+      dst = am.dst;
+      if (! isokprocn(dst) || isemptyn(dst)) am.result = EDEADDST;
+      else if (iskerneln(dst) || dst == proc_nr(caller_ptr) ||
+               ! (priv(proc_addr(dst))->s_flags & SYS_PROC) ||
+               ! get_sys_bit(privp->s_ipc_to, nr_to_id(dst)))
+          am.result = ECALLDENIED;
+      else {
+          dst_ptr = proc_addr(dst);
+          if ( (dst_ptr->p_rts_flags & (RECEIVING | SENDING)) != RECEIVING ||
+               (dst_ptr->p_getfrom != ANY &&
+                dst_ptr->p_getfrom != caller_ptr->p_nr)) {
+              /* Not waiting for it. Leave it for mini_receive(). */
+              set_sys_bit(priv(dst_ptr)->s_asyn_pending, privp->s_id);
+              continue;
+          }
+          CopyMess(caller_ptr->p_nr, caller_ptr, &table[i].msg, dst_ptr,
+              dst_ptr->p_messbuf);
+          if ((dst_ptr->p_rts_flags &= ~RECEIVING) == 0) enqueue(dst_ptr);
+          am.result = OK;
+      }
+      am.flags |= AMF_DONE;
+      phys_copy(vir2phys(&am), am_phys, (phys_bytes) sizeof(am));
+      if (am.result == OK && (am.flags & AMF_NOTIFY))
+          mini_notify(dst_ptr, proc_nr(caller_ptr));
+  }
+  return(OK);
+}
+
+/*===========================================================================*
+ *				asyn_take				     * 
+ *===========================================================================*/
+// 从 src_ptr 的异步消息表中取出第一个发给 dst_ptr 的消息, 复制到 m_ptr.
+PRIVATE int asyn_take(src_ptr, dst_ptr, m_ptr)
+register struct proc *src_ptr;		/* process with a senda() table */
+register struct proc *dst_ptr;		/* process receiving */
+message *m_ptr;				/* where to put the message */
+{
+/* Deliver the first valid entry of the asynchronous table of 'src_ptr' that
+ * is for 'dst_ptr', and mark it done. Unless another one for 'dst_ptr' is
+ * left, clear the bit that brought us here. Return OK if a message was
+ * delivered, or ENOTREADY if there was none after all: the table may have
+ * been withdrawn or replaced since the bit was set.
+ */
+  register struct priv *privp = priv(src_ptr);
+  asynmsg_t am;
+  phys_bytes tab_phys, am_phys;
+  int i, found = FALSE;
+
+  tab_phys = 0;
+  if (privp->s_asynsize > 0)
+      tab_phys = umap_local(src_ptr, D, privp->s_asyntab,
+          (vir_bytes) (privp->s_asynsize * sizeof(asynmsg_t)));
+  for (i = 0; tab_phys != 0 && i < privp->s_asynsize; i++) {
+      am_phys = tab_phys + i * sizeof(asynmsg_t);
+      phys_copy(am_phys, vir2phys(&am), (phys_bytes) sizeof(am));
+      if ((am.flags & (AMF_VALID | AMF_DONE)) != AMF_VALID ||
+          am.dst != proc_nr(dst_ptr)) continue;
+      if (found) return(OK);			/* more left, keep the bit */
+
+      CopyMess(src_ptr->p_nr, src_ptr,
+          &((asynmsg_t *) privp->s_asyntab)[i].msg, dst_ptr, m_ptr);
+      am.flags |= AMF_DONE;
+      am.result = OK;
+      phys_copy(vir2phys(&am), am_phys, (phys_bytes) sizeof(am));
+      if (am.flags & AMF_NOTIFY) mini_notify(dst_ptr, proc_nr(src_ptr));
+      found = TRUE;
+  }
+  unset_sys_bit(priv(dst_ptr)->s_asyn_pending, privp->s_id);
+  return(found ? OK : ENOTREADY);
+}
+
 /*===========================================================================*
  *				lock_notify				     *
  *===========================================================================*/
@@ -565,19 +730,25 @@ register struct proc *rp;	/* this process is now runnable */
   sched(rp, &q, &front);
 
   /* Now add the process to the queue. */
-  // 如果调度队列为空, 则直接插入, 因为此时插在队尾与队头是一样的
+  // 如果调度队列为空, 则直接插入, 因为此时插在队尾与队头是一样的,
+  // 同时在就绪位图中标记该队列非空
   if (rdy_head[q] == NIL_PROC) {		/* add to empty queue */
       rdy_head[q] = rdy_tail[q] = rp; 		/* create a new queue */
       rp->p_nextready = NIL_PROC;		/* mark new end */
+      rp->p_prevready = NIL_PROC;		/* and new front */
+      rdy_map |= 1 << q;			/* queue is now nonempty */
   } 
   // 插在队头
   else if (front) {				/* add to head of queue */
       rp->p_nextready = rdy_head[q];		/* chain head of queue */
+      rp->p_prevready = NIL_PROC;		/* mark new front */
+      rdy_head[q]->p_prevready = rp;		/* link old head back */
       rdy_head[q] = rp;				/* set new queue head */
   } 
   // 插在队尾
   else {					/* add to tail of queue */
       rdy_tail[q]->p_nextready = rp;		/* chain tail of queue */	
+      rp->p_prevready = rdy_tail[q];		/* link back to old tail */
       rdy_tail[q] = rp;				/* set new queue tail */
       rp->p_nextready = NIL_PROC;		/* mark new end */
   }
@@ -603,8 +774,6 @@ register struct proc *rp;	/* this process is no longer runnable */
  * 通过 pick_proc() 挑选一个新进程运行.
  */
   register int q = rp->p_priority;		/* queue to use */
-  register struct proc **xpp;			/* iterate over queue */
-  register struct proc *prev_xp;
 
   /* Side-effect for kernel: check if the task's stack still is ok? */
   /* 内核的副作用: 检查任务的栈是否完好 */
@@ -622,24 +791,27 @@ register struct proc *rp;	/* this process is no longer runnable */
   /* 
    * 现在确定进程是否在就绪队列中, 如果在的话就移除. ????
    */
-  prev_xp = NIL_PROC;				
-  // 遍历进程所在的调度队列, 如果找到了进程, 则将其移除出队列
-  for (xpp = &rdy_head[q]; *xpp != NIL_PROC; xpp = &(*xpp)->p_nextready) {
-
-      if (*xpp == rp) {				/* found process to remove */
-          *xpp = (*xpp)->p_nextready;		/* replace with next chain */
-	  // 如果进程是队列的最后一个元素, 将队列尾指针前移
-          if (rp == rdy_tail[q])		/* queue tail removed */
-              rdy_tail[q] = prev_xp;		/* set new tail */
-	  // 如果进程是当前进程, 或者是下一次要运行的进程, 则重新选择一个
-	  // 进程来运行.
-	  // rp == proc_ptr ??? 
-          if (rp == proc_ptr || rp == next_ptr)	/* active process removed */
-              pick_proc();			/* pick new process to run */
-          break;
-      }
-      prev_xp = *xpp;				/* save previous in chain */
-  }
+  // 进程有前后两个指针, 不必遍历队列就可以把它摘下来.
+  if (! isreadyp(rp, q)) return;		/* not on its queue */
+
+  if (rp->p_prevready != NIL_PROC)		/* unlink from predecessor */
+      rp->p_prevready->p_nextready = rp->p_nextready;
+  else
+      rdy_head[q] = rp->p_nextready;		/* head removed */
+  // 如果进程是队列的最后一个元素, 将队列尾指针前移
+  if (rp->p_nextready != NIL_PROC)		/* unlink from successor */
+      rp->p_nextready->p_prevready = rp->p_prevready;
+  else
+      rdy_tail[q] = rp->p_prevready;		/* queue tail removed */
+  rp->p_nextready = rp->p_prevready = NIL_PROC;
+  // 队列空了, 清除就绪位图中对应的位
+  if (rdy_head[q] == NIL_PROC)
+      rdy_map &= ~(1 << q);			/* queue is now empty */
+
+  // 如果进程是当前进程, 或者是下一次要运行的进程, 则重新选择一个
+  // 进程来运行.
+  if (rp == proc_ptr || rp == next_ptr)		/* active process removed */
+      pick_proc();				/* pick new process to run */
 }
 
 /*===========================================================================*
@@ -733,26 +905,49 @@ PRIVATE void pick_proc()
  * 的进程被选择时, 将它记录到 bill_ptr 中, 于是时钟任务可以知道 ???.
  */
   register struct proc *rp;			/* process to run */
-  int q;					/* iterate over queues */
 
-  /* Check each of the scheduling queues for ready processes. The number of
-   * queues is defined in proc.h, and priorities are set in the image table.
-   * The lowest queue contains IDLE, which is always ready.
+  /* The ready map tells which scheduling queues have ready processes; the
+   * lowest bit set is the highest priority one. The number of queues is
+   * defined in proc.h, and priorities are set in the image table. The
+   * lowest queue contains IDLE, which is always ready.
    */
   /*
-   * 为就绪的进程检查每一个调度队列. 队列的数量在 proc.h 中定义, 它们的
-   * 优先级在一个镜像表格中记录. 优先级最低的队列含有 IDLE, 它总是就绪的.
+   * 就绪位图记录了哪些调度队列中有就绪的进程, 最低的置位位就是优先级最高
+   * 的非空队列. 队列的数量在 proc.h 中定义, 它们的优先级在一个镜像表格中
+   * 记录. 优先级最低的队列含有 IDLE, 它总是就绪的.
    */
-  // 从优先级最高的队列开始, 如果找到一个不为空的队列, 则取队头元素作为
-  // 下一个运行的进程. 如果进程是可记帐的, 则将其赋给 bill_ptr.
-  for (q=0; q < NR_SCHED_QUEUES; q++) {	
-      if ( (rp = rdy_head[q]) != NIL_PROC) {
-          next_ptr = rp;			/* run process 'rp' next */
-          if (priv(rp)->s_flags & BILLABLE)	 	
-              bill_ptr = rp;			/* bill for system time */
-          return;				 
-      }
-  }
+  // 取优先级最高的非空队列的队头元素作为下一个运行的进程. 如果进程是
+  // 可记帐的, 则将其赋给 bill_ptr.
+  if (rdy_map == 0) return;			/* nothing ready yet */
+  rp = rdy_head[first_queue(rdy_map)];
+  next_ptr = rp;				/* run process 'rp' next */
+  if (priv(rp)->s_flags & BILLABLE)	 	
+      bill_ptr = rp;				/* bill for system time */
+}
+
+/*===========================================================================*
+ *				first_queue				     *
+ *===========================================================================*/
+// 返回位图中最低的置位位的序号, 即优先级最高的非空队列. map 不能为 0.
+PRIVATE int first_queue(map)
+unsigned map;			/* nonzero map of nonempty queues */
+{
+/* Find the first set bit of the ready map. With gcc this is a single bit
+ * scan instruction; otherwise halve the map until a nibble remains, and look
+ * that up. NR_SCHED_QUEUES is 16, so the map fits in an int on every CPU.
+ */
+#if __GNUC__
+  return(__builtin_ctz(map));
+#else
+  static char nibble_first[16] = {
+	0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+  };
+  int q = 0;
+
+  if ((map & 0xFF) == 0) { map >>= 8; q += 8; }
+  if ((map & 0x0F) == 0) { map >>= 4; q += 4; }
+  return(q + nibble_first[map & 0x0F]);
+#endif
 }
 
 /*===========================================================================*
@@ -48,8 +48,12 @@ struct proc {
 
   // 指向下一个就绪的进程
   struct proc *p_nextready;	/* pointer to next ready process */
+  // 指向前一个就绪的进程, 使出队操作不必遍历队列
+  struct proc *p_prevready;	/* pointer to previous ready process */
   // 想要向该进程发送消息的进程链表
   struct proc *p_caller_q;	/* head of list of procs wishing to send */
+  // 指向链表最后一个 p_q_link 的指针, 使追加操作不必遍历链表
+  struct proc **p_caller_tail;	/* last link in p_caller_q, for appending */
   // 指向链表中的下一个元素.
   struct proc *p_q_link;	/* link to next proc wishing to send */
   // 被递送的消息缓冲区指针
@@ -145,5 +149,7 @@ EXTERN struct proc *pproc_addr[NR_TASKS + NR_PROCS];
 EXTERN struct proc *rdy_head[NR_SCHED_QUEUES]; /* ptrs to ready list headers */
 // 队列尾指针数组
 EXTERN struct proc *rdy_tail[NR_SCHED_QUEUES]; /* ptrs to ready list tails */
+// 就绪位图, 第 q 位置位表示队列 q 非空
+EXTERN unsigned rdy_map;		/* bit q set iff rdy_head[q] nonempty */
 
 #endif /* PROC_H */
@@ -0,0 +1,203 @@
+/* Host-side microbenchmark of the scheduling queues in proc.c.  This is an
+ * ordinary user program, not part of the kernel.
+ *
+ * It keeps "nprocs" processes spread over the user queues, plus IDLE, and
+ * runs cycles of the operations every message-driven block and unblock
+ * makes: dequeue a ready process, pick the next one to run, enqueue a
+ * blocked one at the front or back of its queue, and pick again.  Each cycle
+ * is done with both the old queues (singly linked lists, pick_proc scanning
+ * the heads) and the new (ready bitmap, doubly linked lists), and the two
+ * must pick the same process every time.
+ *
+ * usage: schedbench [nprocs [ncycles]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NR_SCHED_QUEUES   16
+#define MIN_USER_Q	  14
+#define IDLE_Q		  15
+#define NIL_PROC	((struct proc *) 0)
+
+struct proc {
+  struct proc *p_nextready;	/* old and new queues */
+  struct proc *p_prevready;	/* new queues only */
+  struct proc *p_oldnext;	/* old queues: separate links, same procs */
+  int p_priority;
+  int p_ready;
+  int p_ready0;			/* p_ready at the start */
+};
+
+static struct proc *old_head[NR_SCHED_QUEUES], *old_tail[NR_SCHED_QUEUES];
+static struct proc *rdy_head[NR_SCHED_QUEUES], *rdy_tail[NR_SCHED_QUEUES];
+static unsigned rdy_map;
+
+/*===========================================================================*
+ *				old queues				     *
+ *===========================================================================*/
+static void old_enqueue(struct proc *rp, int front)
+{
+  int q = rp->p_priority;
+
+  if (old_head[q] == NIL_PROC) {
+      old_head[q] = old_tail[q] = rp;
+      rp->p_oldnext = NIL_PROC;
+  } else if (front) {
+      rp->p_oldnext = old_head[q];
+      old_head[q] = rp;
+  } else {
+      old_tail[q]->p_oldnext = rp;
+      old_tail[q] = rp;
+      rp->p_oldnext = NIL_PROC;
+  }
+}
+
+static void old_dequeue(struct proc *rp)
+{
+  int q = rp->p_priority;
+  struct proc **xpp, *prev_xp;
+
+  prev_xp = NIL_PROC;
+  for (xpp = &old_head[q]; *xpp != NIL_PROC; xpp = &(*xpp)->p_oldnext) {
+      if (*xpp == rp) {
+          *xpp = (*xpp)->p_oldnext;
+          if (rp == old_tail[q])
+              old_tail[q] = prev_xp;
+          break;
+      }
+      prev_xp = *xpp;
+  }
+}
+
+static struct proc *old_pick(void)
+{
+  int q;
+
+  for (q = 0; q < NR_SCHED_QUEUES; q++)
+      if (old_head[q] != NIL_PROC) return(old_head[q]);
+  return(NIL_PROC);
+}
+
+/*===========================================================================*
+ *				new queues				     *
+ *===========================================================================*/
+static void new_enqueue(struct proc *rp, int front)
+{
+  int q = rp->p_priority;
+
+  if (rdy_head[q] == NIL_PROC) {
+      rdy_head[q] = rdy_tail[q] = rp;
+      rp->p_nextready = rp->p_prevready = NIL_PROC;
+      rdy_map |= 1 << q;
+  } else if (front) {
+      rp->p_nextready = rdy_head[q];
+      rp->p_prevready = NIL_PROC;
+      rdy_head[q]->p_prevready = rp;
+      rdy_head[q] = rp;
+  } else {
+      rdy_tail[q]->p_nextready = rp;
+      rp->p_prevready = rdy_tail[q];
+      rdy_tail[q] = rp;
+      rp->p_nextready = NIL_PROC;
+  }
+}
+
+static void new_dequeue(struct proc *rp)
+{
+  int q = rp->p_priority;
+
+  if (rp->p_prevready != NIL_PROC)
+      rp->p_prevready->p_nextready = rp->p_nextready;
+  else
+      rdy_head[q] = rp->p_nextready;
+  if (rp->p_nextready != NIL_PROC)
+      rp->p_nextready->p_prevready = rp->p_prevready;
+  else
+      rdy_tail[q] = rp->p_prevready;
+  rp->p_nextready = rp->p_prevready = NIL_PROC;
+  if (rdy_head[q] == NIL_PROC)
+      rdy_map &= ~(1 << q);
+}
+
+static struct proc *new_pick(void)
+{
+  if (rdy_map == 0) return(NIL_PROC);
+  return(rdy_head[__builtin_ctz(rdy_map)]);
+}
+
+/*===========================================================================*
+ *				main					     *
+ *===========================================================================*/
+int main(int argc, char *argv[])
+{
+  struct proc *procs, *rp, *ready_old, *ready_new;
+  int nprocs, i, pass, front;
+  long ncycles, c;
+  unsigned seed;
+  clock_t start;
+  double secs[2];
+
+  nprocs = argc > 1 ? atoi(argv[1]) : 500;
+  ncycles = argc > 2 ? atol(argv[2]) : 2000000L;
+  if (nprocs < 2 || ncycles < 1) {
+      fprintf(stderr, "usage: schedbench [nprocs [ncycles]]\n");
+      exit(1);
+  }
+  if ((procs = calloc(nprocs + 1, sizeof(struct proc))) == NULL) {
+      perror("calloc");
+      exit(1);
+  }
+
+  /* Half the processes are ready to start with; the last one is IDLE. */
+  seed = 1;
+  for (i = 0; i < nprocs; i++) {
+      seed = seed * 1103515245 + 12345;
+      procs[i].p_priority = (seed >> 16) % (MIN_USER_Q + 1);
+  }
+  procs[nprocs].p_priority = IDLE_Q;
+  for (i = 0; i <= nprocs; i++) {
+      if (i % 2 == 0 || i == nprocs) {
+          procs[i].p_ready = procs[i].p_ready0 = 1;
+          old_enqueue(&procs[i], 0);
+          new_enqueue(&procs[i], 0);
+      }
+  }
+
+  /* Run the same random cycles through each implementation in turn, and
+   * then once more through both at a time, from where they both ended up,
+   * to check they agree.
+   */
+  for (pass = 0; pass < 3; pass++) {
+      if (pass == 1)
+          for (i = 0; i < nprocs; i++) procs[i].p_ready = procs[i].p_ready0;
+      seed = 12345;
+      start = clock();
+      for (c = 0; c < ncycles; c++) {
+          seed = seed * 1103515245 + 12345;
+          rp = &procs[(seed >> 8) % nprocs];
+          front = (seed >> 4) & 1;
+          if (rp->p_ready) {
+              if (pass != 1) old_dequeue(rp);
+              if (pass != 0) new_dequeue(rp);
+          } else {
+              if (pass != 1) old_enqueue(rp, front);
+              if (pass != 0) new_enqueue(rp, front);
+          }
+          rp->p_ready = ! rp->p_ready;
+          ready_old = pass != 1 ? old_pick() : NIL_PROC;
+          ready_new = pass != 0 ? new_pick() : NIL_PROC;
+          if (pass == 2 && ready_old != ready_new) {
+              fprintf(stderr, "cycle %ld: picked %d and %d\n", c,
+                  (int) (ready_old - procs), (int) (ready_new - procs));
+              exit(1);
+          }
+      }
+      if (pass < 2) secs[pass] = (double) (clock() - start) / CLOCKS_PER_SEC;
+  }
+
+  printf("%d processes, %ld block/unblock cycles\n", nprocs, ncycles);
+  printf("scan and walk:        %8.1f ns/cycle\n", secs[0] * 1e9 / ncycles);
+  printf("bitmap, doubly linked:%8.1f ns/cycle\n", secs[1] * 1e9 / ncycles);
+  return(0);
+}
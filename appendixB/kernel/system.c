@@ -11,6 +11,7 @@
  *
  * In addition to the main sys_task() entry point, which starts the main loop,
  * there are several other minor entry points:
+ *   kernel_call:	check and make one kernel call, also used by SYS_BATCH
  *   get_priv:		assign privilege structure to user or system process
  *   send_sig:		send a signal directly to a system process
  *   cause_sig:		take action to cause a signal to occur via PM
@@ -39,6 +40,7 @@
  *
  * 除了主要的入口点 sys_task(), 该入口点在主循环开始, 还有其他几个次要
  * 的入口点:
+ *	kernel_call:	检查并执行一个系统调用, SYS_BATCH 也使用它;
  *	get_priv:	为用户进程与系统进程分配特权级结构;
  *	send_sig:	直接向一个系统进程发送信号;
  *	cause_sig:	为导致一个信号发生而采取行动, 通过 PM;
@@ -90,8 +92,6 @@ PUBLIC void sys_task()
 /* 系统调用的主要入口点. 获取消息, 再根据类型分派. */
   static message m;
   register int result;
-  register struct proc *caller_ptr;
-  unsigned int call_nr;
   int s;
 
   /* Initialize the system task. */
@@ -102,25 +102,10 @@ PUBLIC void sys_task()
       /* Get work. Block and wait until a request message arrives. */
 	/* 开始工作. 阻塞, 直到一个请求消息到来. */
       receive(ANY, &m);			
-      // 系统调用向量号
-      call_nr = (unsigned) m.m_type - KERNEL_CALL;	
-      // 请求系统调用的进程指针
-      caller_ptr = proc_addr(m.m_source);	
+      kcallstats.ks_received++;
 
       /* See if the caller made a valid request and try to handle it. */
-      // 检查主调进程是否有能力请求该系统调用.
-      if (! (priv(caller_ptr)->s_call_mask & (1<<call_nr))) {
-	  kprintf("SYSTEM: request %d from %d denied.\n", call_nr,m.m_source);
-	  result = ECALLDENIED;			/* illegal message type */
-      } else if (call_nr >= NR_SYS_CALLS) {		/* check call number */
-	      // 检查系统调用向量号的合法性.
-	  kprintf("SYSTEM: illegal request %d from %d.\n", call_nr,m.m_source);
-	  result = EBADREQUEST;			/* illegal message type */
-      } 
-      else {
-      // 执行系统调用.
-          result = (*call_vec[call_nr])(&m);	/* handle the kernel call */
-      }
+      result = kernel_call(&m);
 
       /* Send a reply, unless inhibited by a handler function. Use the kernel
        * function lock_send() to prevent a system call trap. The destination
@@ -141,6 +126,43 @@ PUBLIC void sys_task()
   }
 }
 
+/*===========================================================================*
+ *				kernel_call				     *
+ *===========================================================================*/
+PUBLIC int kernel_call(m_ptr)
+message *m_ptr;			/* request, with m_source filled in */
+{
+/* Check that the caller may make the kernel call in 'm_ptr', and make it.
+ * Besides the main loop, do_batch() uses this for each call in a vector, so
+ * a batch gives no rights that separate calls wouldn't.
+ */
+/*
+ * 检查主调进程是否可以执行 m_ptr 中的系统调用, 并执行它. 除了主循环,
+ * do_batch() 也用它执行向量中的每一个调用, 所以批量调用不会带来单独调用
+ * 所没有的权限.
+ */
+  // 系统调用向量号
+  unsigned int call_nr = (unsigned) m_ptr->m_type - KERNEL_CALL;
+  // 请求系统调用的进程指针
+  register struct proc *caller_ptr = proc_addr(m_ptr->m_source);
+
+  // 检查系统调用向量号的合法性.
+  if (call_nr >= NR_SYS_CALLS) {		/* check call number */
+      kprintf("SYSTEM: illegal request %d from %d.\n", call_nr,m_ptr->m_source);
+      kcallstats.ks_denied++;
+      return(EBADREQUEST);			/* illegal message type */
+  }
+  // 检查主调进程是否有能力请求该系统调用.
+  if (! (priv(caller_ptr)->s_call_mask & (1UL<<call_nr))) {
+      kprintf("SYSTEM: request %d from %d denied.\n", call_nr,m_ptr->m_source);
+      kcallstats.ks_denied++;
+      return(ECALLDENIED);			/* illegal message type */
+  }
+  // 执行系统调用.
+  kcallstats.ks_calls[call_nr]++;
+  return((*call_vec[call_nr])(m_ptr));		/* handle the kernel call */
+}
+
 /*===========================================================================*
  *				initialize				     *
  *===========================================================================*/
@@ -210,6 +232,10 @@ PRIVATE void initialize(void)
   map(SYS_PHYSCOPY, do_physcopy); 	/* use physical addressing */
   map(SYS_VIRVCOPY, do_virvcopy);	/* vector with copy requests */
   map(SYS_PHYSVCOPY, do_physvcopy);	/* vector with copy requests */
+  map(SYS_SETGRANT, do_setgrant);	/* register a grant table */
+  map(SYS_SAFECOPYFROM, do_safecopyfrom);	/* copy from a grant */
+  map(SYS_SAFECOPYTO, do_safecopyto);	/* copy to a grant */
+  map(SYS_BATCH, do_batch);		/* vector of kernel calls */
 
   /* Clock functionality. */
   map(SYS_TIMES, do_times);		/* get uptime and process times */
@@ -30,6 +30,11 @@ _PROTOTYPE( int do_vcopy, (message *m_ptr) );
 #define do_virvcopy 	do_vcopy
 #define do_physvcopy 	do_vcopy
 _PROTOTYPE( int do_umap, (message *m_ptr) );
+_PROTOTYPE( int do_batch, (message *m_ptr) );
+_PROTOTYPE( int do_setgrant, (message *m_ptr) );
+_PROTOTYPE( int do_safecopy, (message *m_ptr) );
+#define do_safecopyfrom	do_safecopy
+#define do_safecopyto	do_safecopy
 _PROTOTYPE( int do_memset, (message *m_ptr) );
 _PROTOTYPE( int do_abort, (message *m_ptr) );
 _PROTOTYPE( int do_getinfo, (message *m_ptr) );
@@ -0,0 +1,85 @@
+/* The kernel call implemented in this file:
+ *   m_type:	SYS_BATCH
+ *
+ * The parameters for this kernel call are:
+ *    m1_p1:	BAT_ADDR		address of vector of request messages
+ *    m1_i1:	BAT_COUNT		number of requests in the vector
+ *    m1_i2:	BAT_FLAGS		BAT_STOPERR to stop at the first error
+ *    m1_i3:	BAT_NR_DONE		number of requests carried out
+ */
+/*
+ * 该文件实现的系统调用:
+ *	m_type:	SYS_BATCH
+ *
+ * 该系统调用的参数包括:
+ *	m1_p1:	BAT_ADDR	请求消息向量的地址
+ *	m1_i1:	BAT_COUNT	向量中请求的数目
+ *	m1_i2:	BAT_FLAGS	BAT_STOPERR 表示遇到第一个错误时停止
+ *	m1_i3:	BAT_NR_DONE	已执行的请求数目
+ */
+
+#include "../system.h"
+
+#if USE_BATCH
+
+/*===========================================================================*
+ *				do_batch				     *
+ *===========================================================================*/
+PUBLIC int do_batch(m_ptr)
+register message *m_ptr;	/* pointer to request message */
+{
+/* Handle sys_batch(). Carry out a vector of kernel calls of any type, as if
+ * they were requested one by one, but with a single trap. Each request is
+ * replaced by its reply, with the result in m_type. The calls are checked
+ * against the caller's call mask one by one, and a batch in a batch is
+ * refused. The vector is mapped again for each call, since a call may change
+ * the caller's memory map.
+ */
+/*
+ * 处理 sys_batch(). 执行一个由任意类型系统调用组成的向量, 如同逐个请求
+ * 一样, 但只需要一次陷入. 每个请求消息被它的回复替换, 结果在 m_type 中.
+ * 每个调用都单独检查主调进程的调用掩码, 批量调用中不能再有批量调用.
+ * 因为某个调用可能改变主调进程的内存映射, 每次都重新映射向量.
+ */
+  static message req;		/* request being carried out */
+  int caller, nr_req, i, r;
+  vir_bytes vec;
+  phys_bytes req_phys;
+
+  caller = m_ptr->m_source;
+  vec = (vir_bytes) m_ptr->BAT_ADDR;
+  nr_req = m_ptr->BAT_COUNT;
+  if (nr_req < 0 || nr_req > BATCH_VEC_SIZE) return(EINVAL);
+
+  m_ptr->BAT_NR_DONE = 0;
+  for (i = 0; i < nr_req; i++) {
+      req_phys = numap_local(caller, vec + i * sizeof(message),
+          (vir_bytes) sizeof(message));
+      if (req_phys == 0) return(EFAULT);
+      phys_copy(req_phys, vir2phys(&req), (phys_bytes) sizeof(message));
+
+      req.m_source = caller;			/* can't claim to be another */
+      if (req.m_type == SYS_BATCH) r = EINVAL;
+      else r = kernel_call(&req);
+
+      /* A call that doesn't reply, e.g., the caller's own exit, ends the
+       * batch. There is no one left to copy the replies to.
+       */
+      // 不需要回复的调用(如主调进程自己退出)结束批量调用.
+      if (r == EDONTREPLY) return(EDONTREPLY);
+      kcallstats.ks_batched++;
+
+      /* Put the reply in place of the request. */
+      req.m_type = r;
+      req_phys = numap_local(caller, vec + i * sizeof(message),
+          (vir_bytes) sizeof(message));
+      if (req_phys == 0) return(EFAULT);
+      phys_copy(vir2phys(&req), req_phys, (phys_bytes) sizeof(message));
+      m_ptr->BAT_NR_DONE ++;
+
+      if (r < 0 && (m_ptr->BAT_FLAGS & BAT_STOPERR)) break;
+  }
+  return(OK);
+}
+
+#endif /* USE_BATCH */
@@ -52,6 +52,12 @@ register message *m_ptr;	/* pointer to request message */
   rp->p_rts_flags &= ~RECEIVING;	/* PM does not reply to EXEC call */
   if (rp->p_rts_flags == 0) lock_enqueue(rp);
 
+  /* Tables registered by the old image are gone with it. */
+  if (priv(rp)->s_flags & SYS_PROC) {
+      priv(rp)->s_asynsize = 0;
+      priv(rp)->s_grant_entries = 0;
+  }
+
   /* Save command name for debugging, ps(1) output, etc. */
   // 获取进程名
   phys_name = numap_local(m_ptr->m_source, (vir_bytes) m_ptr->PR_NAME_PTR,
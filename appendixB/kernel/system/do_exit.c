@@ -78,6 +78,7 @@ register struct proc *rc;		/* slot of process to clean up */
   /* If the process being terminated happens to be queued trying to send a
    * message (e.g., the process was killed by a signal, rather than it doing 
    * a normal exit), then it must be removed from the message queues.
+   * Its destination's tail pointer must move back if it was last.
    */
   /*
    * 如果正在被终止的进程碰巧正在发送消息(如, 进程被一个信号杀死, 而不是
@@ -91,6 +92,8 @@ register struct proc *rc;		/* slot of process to clean up */
           xpp = &rp->p_caller_q;
           while (*xpp != NIL_PROC) {		/* check entire queue */
               if (*xpp == rc) {			/* process is on the queue */
+                  if (rc->p_q_link == NIL_PROC)	/* tail removed */
+                      rp->p_caller_tail = xpp;
                   *xpp = (*xpp)->p_q_link;	/* replace by next process */
                   break;
               }
@@ -113,7 +116,11 @@ register struct proc *rc;		/* slot of process to clean up */
    * slots are assigned to another, new process. 
    */
   rc->p_rts_flags = SLOT_FREE;		
-  if (priv(rc)->s_flags & SYS_PROC) priv(rc)->s_proc_nr = NONE;
+  if (priv(rc)->s_flags & SYS_PROC) {
+      priv(rc)->s_proc_nr = NONE;
+      priv(rc)->s_asynsize = 0;		/* withdraw asynchronous messages */
+      priv(rc)->s_grant_entries = 0;	/* revoke all memory grants */
+  }
 }
 
 #endif /* USE_EXIT */
@@ -163,6 +163,13 @@ register message *m_ptr;	/* pointer to request message */
     	src_phys = vir2phys(&bios_buf_vir);
     	break;
 
+	// 系统调用计数器
+    case GET_KCALLSTATS: {
+        length = sizeof(struct kcallstats);
+        src_phys = vir2phys(&kcallstats);
+        break;
+    }
+
     default:
         return(EINVAL);
   }
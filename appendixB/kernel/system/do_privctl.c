@@ -72,8 +72,12 @@ message *m_ptr;			/* pointer to request message */
   priv(rp)->s_id = priv_id;			/* restore privilege id */
   priv(rp)->s_proc_nr = proc_nr;		/* reassociate process nr */
 
-  for (i=0; i< BITMAP_CHUNKS(NR_SYS_PROCS); i++)	/* remove pending: */
+  for (i=0; i< BITMAP_CHUNKS(NR_SYS_PROCS); i++) {	/* remove pending: */
       priv(rp)->s_notify_pending.chunk[i] = 0;		/* - notifications */
+      priv(rp)->s_asyn_pending.chunk[i] = 0;		/* - async messages */
+  }
+  priv(rp)->s_asynsize = 0;				/* - own async table */
+  priv(rp)->s_grant_entries = 0;			/* - own grant table */
   priv(rp)->s_int_pending = 0;				/* - interrupts */
   sigemptyset(&priv(rp)->s_sig_pending);		/* - signals */
 
@@ -0,0 +1,212 @@
+/* The kernel calls implemented in this file:
+ *   m_type:	SYS_SETGRANT, SYS_SAFECOPYFROM, SYS_SAFECOPYTO
+ *
+ * The parameters for SYS_SETGRANT are:
+ *    m2_p1:	SG_ADDR		address of grant table in caller's D space
+ *    m2_i2:	SG_SIZE		number of entries, 0 to revoke all grants
+ *
+ * The parameters for SYS_SAFECOPYFROM and SYS_SAFECOPYTO are:
+ *    m2_i1:	SCP_FROM_TO	process that made the grant
+ *    m2_i3:	SCP_GID		grant id, index in the granter's table
+ *    m2_l1:	SCP_OFFSET	offset within the granted bytes
+ *    m2_l2:	SCP_BYTES	number of bytes to copy
+ *    m2_p1:	SCP_ADDRESS	address at the caller
+ *    m2_i2:	SCP_INFO	segment of SCP_ADDRESS (D, remote or PHYS_SEG)
+ *
+ * FS's dev_io() makes the grants for the drivers that accept the _S requests,
+ * so far the memory driver.
+ */
+/*
+ * 该文件实现的系统调用:
+ *	m_type:	SYS_SETGRANT, SYS_SAFECOPYFROM, SYS_SAFECOPYTO
+ *
+ * SYS_SETGRANT 的参数:
+ *	m2_p1:	SG_ADDR		授权表在主调进程数据段中的地址
+ *	m2_i2:	SG_SIZE		表项数目, 为 0 则撤销所有授权
+ *
+ * SYS_SAFECOPYFROM 与 SYS_SAFECOPYTO 的参数:
+ *	m2_i1:	SCP_FROM_TO	授权进程
+ *	m2_i3:	SCP_GID		授权号, 即授权表中的下标
+ *	m2_l1:	SCP_OFFSET	在被授权字节中的偏移
+ *	m2_l2:	SCP_BYTES	需要复制的字节数
+ *	m2_p1:	SCP_ADDRESS	主调进程一方的地址
+ *	m2_i2:	SCP_INFO	SCP_ADDRESS 所在的段
+ */
+
+#include "../system.h"
+#include <minix/type.h>
+
+#if USE_SETGRANT
+
+/*===========================================================================*
+ *				do_setgrant				     *
+ *===========================================================================*/
+PUBLIC int do_setgrant(m_ptr)
+register message *m_ptr;	/* pointer to request message */
+{
+/* Register the caller's table of memory grants. The table stays in the
+ * caller's address space; only its address and size are kept here, so the
+ * caller can add and revoke grants without a kernel call.
+ */
+/*
+ * 登记主调进程的内存授权表. 表仍然在主调进程的地址空间中, 内核只记录它
+ * 的地址与大小, 所以主调进程增加与撤销授权时不需要系统调用.
+ */
+  register struct priv *privp = priv(proc_addr(m_ptr->m_source));
+  vir_bytes bytes;
+
+  privp->s_grant_entries = 0;		/* old table is gone in any case */
+  if (m_ptr->SG_SIZE == 0) return(OK);
+  if (m_ptr->SG_SIZE < 0) return(EINVAL);
+
+  /* The whole table must be mapped. */
+  bytes = (vir_bytes) m_ptr->SG_SIZE * sizeof(cp_grant_t);
+  if (bytes / sizeof(cp_grant_t) != (vir_bytes) m_ptr->SG_SIZE) return(EINVAL);
+  if (numap_local(m_ptr->m_source, (vir_bytes) m_ptr->SG_ADDR, bytes) == 0)
+      return(EFAULT);
+
+  privp->s_grant_table = (vir_bytes) m_ptr->SG_ADDR;
+  privp->s_grant_entries = m_ptr->SG_SIZE;
+  return(OK);
+}
+#endif /* USE_SETGRANT */
+
+#if USE_SAFECOPY
+
+FORWARD _PROTOTYPE( int verify_grant, (int granter, int grantee,
+	cp_grant_id_t grant, vir_bytes offset, vir_bytes bytes, int access,
+	int *proc_nr, vir_bytes *vir_addr) );
+
+/*===========================================================================*
+ *				verify_grant				     *
+ *===========================================================================*/
+// 检查授权进程 granter 的第 grant 号授权是否允许 grantee 以 access 方式
+// 访问 [offset, offset+bytes), 若允许, 返回被访问内存所属的进程与地址.
+PRIVATE int verify_grant(granter, grantee, grant, offset, bytes, access,
+	proc_nr, vir_addr)
+int granter;			/* process that made the grant */
+int grantee;			/* process that wants to use it */
+cp_grant_id_t grant;		/* index in the granter's table */
+vir_bytes offset;		/* offset within the granted bytes */
+vir_bytes bytes;		/* number of bytes to copy */
+int access;			/* CPF_READ or CPF_WRITE */
+int *proc_nr;			/* returns whose memory it is */
+vir_bytes *vir_addr;		/* returns address in its D space */
+{
+/* Look up a grant in the granter's table and check that the grantee may use
+ * it this way. Return OK, or EPERM if the grant doesn't exist, was revoked,
+ * is for another process or another kind of access, or doesn't cover the
+ * range. The entry is read afresh from the granter's memory each time.
+ */
+  register struct priv *privp;
+  cp_grant_t g;
+  phys_bytes g_phys;
+
+  if (! isokprocn(granter) || isemptyn(granter)) return(EDEADDST);
+  privp = priv(proc_addr(granter));
+  if (! (privp->s_flags & SYS_PROC)) return(EPERM);
+  if (grant < 0 || grant >= privp->s_grant_entries) return(EPERM);
+
+  /* Fetch the entry. The table was checked when it was registered, but the
+   * granter may have shrunk its data segment since.
+   */
+  g_phys = umap_local(proc_addr(granter), D,
+      privp->s_grant_table + grant * sizeof(cp_grant_t),
+      (vir_bytes) sizeof(cp_grant_t));
+  if (g_phys == 0) return(EPERM);
+  phys_copy(g_phys, vir2phys(&g), (phys_bytes) sizeof(g));
+
+  /* In use, for this process, and for this kind of access? */
+  if (! (g.cp_flags & CPF_USED)) return(EPERM);
+  if (g.cp_who != grantee && g.cp_who != ANY) return(EPERM);
+  if ((g.cp_flags & access) != access) return(EPERM);
+
+  /* Within bounds? Check the sum doesn't wrap around as well. */
+  if (offset > g.cp_len || bytes > g.cp_len - offset) return(EPERM);
+
+  /* A magic grant is of another process' memory. Only a process that could
+   * copy the memory itself with SYS_VIRCOPY may make one, e.g., FS on behalf
+   * of a user process.
+   */
+  // 魔术授权授予的是另一个进程的内存. 只有本来就能用 SYS_VIRCOPY 复制
+  // 该内存的进程才能创建, 如 FS 代表用户进程授权.
+  if (g.cp_flags & CPF_MAGIC) {
+      if (! (privp->s_call_mask & (1UL << (SYS_VIRCOPY - KERNEL_CALL))))
+          return(EPERM);
+      if (! isokprocn(g.cp_from) || isemptyn(g.cp_from)) return(EPERM);
+      *proc_nr = g.cp_from;
+  } else {
+      *proc_nr = granter;
+  }
+  *vir_addr = g.cp_start + offset;
+  return(OK);
+}
+
+/*===========================================================================*
+ *				do_safecopy				     *
+ *===========================================================================*/
+PUBLIC int do_safecopy(m_ptr)
+register message *m_ptr;	/* pointer to request message */
+{
+/* Handle sys_safecopyfrom() and sys_safecopyto(). Copy between memory that
+ * was granted to the caller and the caller's own memory. The caller needs no
+ * right to the granter's memory beyond the grant, which is the point: a
+ * driver can copy straight to a user buffer without SYS_VIRCOPY.
+ */
+/*
+ * 处理 sys_safecopyfrom() 与 sys_safecopyto(). 在授予主调进程的内存与
+ * 主调进程自己的内存之间复制. 主调进程除了授权之外不需要其他权限, 所以
+ * 驱动程序不必有 SYS_VIRCOPY 也能直接复制到用户缓冲区.
+ */
+  struct vir_addr vir_addr[2];	/* virtual source and destination address */
+  struct vir_addr *granted, *mine;
+  vir_bytes bytes;
+  int access, r;
+
+  bytes = (vir_bytes) m_ptr->SCP_BYTES;
+  if (m_ptr->SCP_BYTES <= 0) return(EINVAL);
+  if (m_ptr->m_type == SYS_SAFECOPYFROM) {
+      access = CPF_READ;
+      granted = &vir_addr[_SRC_];
+      mine = &vir_addr[_DST_];
+  } else {
+      access = CPF_WRITE;
+      granted = &vir_addr[_DST_];
+      mine = &vir_addr[_SRC_];
+  }
+
+  /* The caller's side: its data segment, one of its remote segments, such
+   * as a RAM disk, or physical memory if it has SYS_PHYSCOPY rights. Other
+   * segments, the BIOS one in particular, are not the caller's to copy.
+   */
+  // 主调进程一方只能是它的数据段, 它自己的远程段, 或者在有 SYS_PHYSCOPY
+  // 权限时的物理内存. BIOS_SEG 等其他段一律拒绝.
+  mine->proc_nr = m_ptr->m_source;
+  mine->segment = m_ptr->SCP_INFO;
+  mine->offset = (vir_bytes) m_ptr->SCP_ADDRESS;
+  switch (mine->segment & SEGMENT_TYPE) {
+  case LOCAL_SEG:
+      if (mine->segment != D) return(EINVAL);
+      break;
+  case REMOTE_SEG:
+      break;
+  case PHYS_SEG:
+      if (mine->segment != PHYS_SEG) return(EINVAL);
+      if (! (priv(proc_addr(m_ptr->m_source))->s_call_mask &
+              (1UL << (SYS_PHYSCOPY - KERNEL_CALL))))
+          return(EPERM);
+      break;
+  default:
+      return(EINVAL);
+  }
+
+  /* The granted side. */
+  if ((r = verify_grant(m_ptr->SCP_FROM_TO, m_ptr->m_source,
+          (cp_grant_id_t) m_ptr->SCP_GID, (vir_bytes) m_ptr->SCP_OFFSET,
+          bytes, access, &granted->proc_nr, &granted->offset)) != OK)
+      return(r);
+  granted->segment = D;
+
+  return(virtual_copy(&vir_addr[_SRC_], &vir_addr[_DST_], bytes));
+}
+#endif /* USE_SAFECOPY */
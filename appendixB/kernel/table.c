@@ -119,13 +119,17 @@ PUBLIC char *t_stack[TOT_STACK_SPACE / sizeof(char *)];
  * 服务分配权限.
  */
 // 获取系统调用编号, 从 0 开始.
-#define c(n)	(1 << ((n)-KERNEL_CALL))
+#define c(n)	(1UL << ((n)-KERNEL_CALL))
+// 每个系统调用在 s_call_mask 中占一位, 编号不能超出掩码的位数
+extern int dummy[NR_SYS_CALLS <= 8 * sizeof(unsigned long) ? 1 : -1];
 // 再生进程开启所有的二进制位
-#define RS_C	~0	
+#define RS_C	~0UL
 #define PM_C	~(c(SYS_DEVIO) | c(SYS_SDEVIO) | c(SYS_VDEVIO) \
     | c(SYS_IRQCTL) | c(SYS_INT86))
 #define FS_C	(c(SYS_KILL) | c(SYS_VIRCOPY) | c(SYS_VIRVCOPY) | c(SYS_UMAP) \
-    | c(SYS_GETINFO) | c(SYS_EXIT) | c(SYS_TIMES) | c(SYS_SETALARM))
+    | c(SYS_GETINFO) | c(SYS_EXIT) | c(SYS_TIMES) | c(SYS_SETALARM) \
+    | c(SYS_SETGRANT) | c(SYS_SAFECOPYFROM) | c(SYS_SAFECOPYTO) \
+    | c(SYS_BATCH))
 #define DRV_C	(FS_C | c(SYS_SEGCTL) | c(SYS_IRQCTL) | c(SYS_INT86) \
     | c(SYS_DEVIO) | c(SYS_VDEVIO) | c(SYS_SDEVIO)) 
 #define MEM_C	(DRV_C | c(SYS_PHYSCOPY) | c(SYS_PHYSVCOPY))
@@ -1,6 +1,8 @@
 #ifndef TYPE_H
 #define TYPE_H
 
+#include <minix/com.h>		/* NR_SYS_CALLS */
+
 typedef _PROTOTYPE( void task_t, (void) );
 
 /* Process table and system property related types. */ 
@@ -28,7 +30,7 @@ struct boot_image {
   short trap_mask;			/* allowed system call traps */
   // 发送掩码
   bitchunk_t ipc_to;			/* send mask protection */
-  long call_mask;			/* system call protection */
+  unsigned long call_mask;	/* system call protection */
   // 进程在进程表中的名字
   char proc_name[P_NAME_LEN];		/* name in process table */
 };
@@ -47,6 +49,19 @@ struct kmessages {
   char km_buf[KMESS_BUF_SIZE];		/* buffer for messages */
 };
 
+/* Kernel call counters, kept by the system task. Calls made from a SYS_BATCH
+ * vector count under their own type, and in ks_batched as well. Batching
+ * saved ks_batched less ks_calls[SYS_BATCH - KERNEL_CALL] traps.
+ */
+// 系统调用计数器. 批量调用中的每个调用按自己的类型计数, 同时计入
+// ks_batched. 批量调用省下的陷入次数是 ks_batched 减去 SYS_BATCH 的次数.
+struct kcallstats {
+  unsigned long ks_received;		/* request messages received */
+  unsigned long ks_batched;		/* requests taken from SYS_BATCH */
+  unsigned long ks_denied;		/* calls refused */
+  unsigned long ks_calls[NR_SYS_CALLS];	/* calls made, per type */
+};
+
 struct randomness {
   struct {
 	int r_next;				/* next index to write */
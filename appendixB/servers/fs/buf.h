@@ -1,14 +1,27 @@
 /* Buffer (block) cache.  To acquire a block, a routine calls get_block(),
  * telling which block it wants.  The block is then regarded as "in use"
  * and has its 'b_count' field incremented.  All the blocks that are not
- * in use are chained together in an LRU list, with 'front' pointing
- * to the least recently used block, and 'rear' to the most recently used
- * block.  A reverse chain, using the field b_prev is also maintained.
- * Usage for LRU is measured by the time the put_block() is done.  The second
- * parameter to put_block() can violate the LRU order and put a block on the
- * front of the list, if it will probably not be needed soon.  If a block
- * is modified, the modifying routine must set b_dirt to DIRTY, so the block
- * will eventually be rewritten to the disk.
+ * in use are chained together in one of two LRU lists, with 'front[q]'
+ * pointing to the least recently used block, and 'rear[q]' to the most
+ * recently used block.  A reverse chain, using the field b_prev is also
+ * maintained.  Usage for LRU is measured by the time the put_block() is done.
+ *
+ * The two lists are those of the 2Q algorithm.  A block read in for the
+ * first time is on probation (BQ_PROBATION).  Only a block that is read in
+ * again soon after it was evicted from probation, or that holds metadata,
+ * goes on the main list (BQ_MAIN).  Blocks are evicted from probation as
+ * long as it holds more than its share of the buffers, so reading a large
+ * file once only cycles through the buffers on probation, and doesn't push
+ * out the inode and directory blocks.  To remember which blocks were evicted
+ * from probation, their numbers are kept in a ring of ghosts.
+ *
+ * The second parameter to put_block() can violate the LRU order and put a
+ * block on the front of its list, if it will probably not be needed soon.
+ * If a block is modified, the modifying routine must set b_dirt to DIRTY, so
+ * the block will eventually be rewritten to the disk.  When put_block() sees
+ * a dirty block for the first time, it stamps it with the number of the
+ * current write-back run.  A timer starts a run every WB_INTERVAL ticks,
+ * which writes the blocks that have been dirty for WB_AGE runs.
  */
 
 #include <sys/dir.h>			/* need struct direct */
@@ -40,7 +53,9 @@ EXTERN struct buf {
   dev_t b_dev;			/* major | minor device where block resides */
   char b_dirt;			/* CLEAN or DIRTY */
   char b_count;			/* number of users of this buffer */
-} buf[NR_BUFS];
+  unsigned char b_queue;	/* BQ_PROBATION or BQ_MAIN */
+  unsigned b_dirtied;		/* write-back run it became dirty in, or 0 */
+} *buf;				/* nr_bufs of them, allocated at boot */
 
 /* A block is free if b_dev == NO_DEV. */
 
@@ -55,12 +70,37 @@ EXTERN struct buf {
 #define b_v2_ino b.b__v2_ino
 #define b_bitmap b.b__bitmap
 
-EXTERN struct buf *buf_hash[NR_BUF_HASH];	/* the buffer hash table */
+EXTERN int nr_bufs;		/* number of buffers */
+EXTERN struct buf **buf_hash;	/* the buffer hash table */
+EXTERN int nr_buf_hash;		/* its size, a power of 2 */
 
-EXTERN struct buf *front;	/* points to least recently used free block */
-EXTERN struct buf *rear;	/* points to most recently used free block */
+/* The two LRU lists. */
+#define BQ_PROBATION	0	/* blocks used once recently */
+#define BQ_MAIN		1	/* blocks used again, and metadata */
+#define NR_BQUEUES	2
+
+EXTERN struct buf *front[NR_BQUEUES];	/* least recently used free blocks */
+EXTERN struct buf *rear[NR_BQUEUES];	/* most recently used free blocks */
+EXTERN int bq_size[NR_BQUEUES];	/* # bufs in each queue, in use or not */
 EXTERN int bufs_in_use;		/* # bufs currently in use (not on free list)*/
 
+/* The ghosts of blocks evicted from probation.  A ring of nr_ghosts entries,
+ * oldest first from 'ghost_hand', with hash chains through g_hash.
+ */
+EXTERN struct ghost {
+  dev_t g_dev;			/* NO_DEV if the entry is unused */
+  block_t g_blocknr;
+  int g_hash;			/* next on hash chain, or -1 */
+} *ghost;
+EXTERN int nr_ghosts;		/* number of entries in the ring */
+EXTERN int ghost_hand;		/* entry to be reused next */
+EXTERN int *ghost_hash;		/* hash table, nr_buf_hash chains */
+
+EXTERN struct buf **dirty_q;	/* room for all buffers, for flushes */
+EXTERN int bufs_dirty;		/* # bufs with b_dirtied set */
+EXTERN unsigned wb_epoch;	/* number of the current write-back run */
+EXTERN struct cachestats cachestats;	/* hits, misses and evictions */
+
 /* When a block is released, the type of usage is passed to put_block(). */
 #define WRITE_IMMED   0100 /* block should be written to disk now */
 #define ONE_SHOT      0200 /* set if block not likely to be needed soon */
@@ -72,4 +112,10 @@ EXTERN int bufs_in_use;		/* # bufs currently in use (not on free list)*/
 #define FULL_DATA_BLOCK    5		 	 	 /* data, fully used */
 #define PARTIAL_DATA_BLOCK 6 				 /* data, partly used*/
 
-#define HASH_MASK (NR_BUF_HASH - 1)	/* mask for hashing block numbers */
+#define HASH_MASK (nr_buf_hash - 1)	/* mask for hashing block numbers */
+
+/* Probation gets a quarter of the buffers, and ghosts are kept for half as
+ * many blocks as there are buffers.
+ */
+#define PROBATION_SHARE(n)	((n) / 4)
+#define GHOST_SHARE(n)		((n) / 2)
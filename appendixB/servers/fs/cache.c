@@ -3,9 +3,14 @@
  * first made to see if the block is in the cache.  This file manages the
  * cache.
  *
+ * The cache replaces blocks with the 2Q algorithm, described in buf.h.
+ * Dirty blocks are written back in the background, by a timer, and when too
+ * many buffers are dirty.  Evicting a block writes only that block.
+ *
  * The entry points into this file are:
  *   get_block:	  request to fetch a block for reading or writing from cache
  *   put_block:	  return a block previously requested with get_block
+ *   in_cache:	  tell whether a block is in the cache, without fetching it
  *   alloc_zone:  allocate a new zone (to increase the length of a file)
  *   free_zone:	  release a zone (when a file is removed)
  *   rw_block:	  read or write a block from the disk itself
@@ -13,6 +18,7 @@
  */
 
 #include "fs.h"
+#include <timers.h>
 #include <minix/com.h>
 #include "buf.h"
 #include "file.h"
@@ -20,6 +26,16 @@
 #include "super.h"
 
 FORWARD _PROTOTYPE( void rm_lru, (struct buf *bp) );
+FORWARD _PROTOTYPE( void add_ghost, (struct buf *bp) );
+FORWARD _PROTOTYPE( int find_ghost, (Dev_t dev, block_t block) );
+FORWARD _PROTOTYPE( void mark_clean, (struct buf *bp) );
+FORWARD _PROTOTYPE( void write_back, (int urgent) );
+FORWARD _PROTOTYPE( void flush_dirty, (unsigned before) );
+FORWARD _PROTOTYPE( void wb_start, (void) );
+FORWARD _PROTOTYPE( void wb_timeout, (timer_t *tp) );
+
+PRIVATE timer_t wb_timer;	/* timer for write-back runs */
+PRIVATE int wb_armed;		/* TRUE if wb_timer is set */
 
 /*===========================================================================*
  *				get_block				     *
@@ -32,19 +48,20 @@ int only_search;		/* if NO_READ, don't read, else act normal */
 /* Check to see if the requested block is in the block cache.  If so, return
  * a pointer to it.  If not, evict some other block and fetch it (unless
  * 'only_search' is 1).  All the blocks in the cache that are not in use
- * are linked together in a chain, with 'front' pointing to the least recently
- * used block and 'rear' to the most recently used block.  If 'only_search' is
- * 1, the block being requested will be overwritten in its entirety, so it is
- * only necessary to see if it is in the cache; if it is not, any free buffer
- * will do.  It is not necessary to actually read the block in from disk.
+ * are linked together in two chains, the probation and the main chain, with
+ * 'front[q]' pointing to the least recently used block and 'rear[q]' to the
+ * most recently used block.  If 'only_search' is 1, the block being requested
+ * will be overwritten in its entirety, so it is only necessary to see if it
+ * is in the cache; if it is not, any free buffer will do.  It is not
+ * necessary to actually read the block in from disk.
  * If 'only_search' is PREFETCH, the block need not be read from the disk,
  * and the device is not to be marked on the block, so callers can tell if
  * the block returned is valid.
- * In addition to the LRU chain, there is also a hash chain to link together
+ * In addition to the LRU chains, there is also a hash chain to link together
  * blocks whose block numbers end with the same bit strings, for fast lookup.
  */
 
-  int b;
+  int b, q;
   register struct buf *bp, *prev_ptr;
 
   /* Search the hash chain for (dev, block). Do_read() can use 
@@ -60,6 +77,7 @@ int only_search;		/* if NO_READ, don't read, else act normal */
 			/* Block needed has been found. */
 			if (bp->b_count == 0) rm_lru(bp);
 			bp->b_count++;	/* record that block is in use */
+			cachestats.cs_hits++;
 
 			return(bp);
 		} else {
@@ -67,10 +85,18 @@ int only_search;		/* if NO_READ, don't read, else act normal */
 			bp = bp->b_hash; /* move to next block on hash chain */
 		}
 	}
+	cachestats.cs_misses++;
   }
 
-  /* Desired block is not on available chain.  Take oldest block ('front'). */
-  if ((bp = front) == NIL_BUF) panic(__FILE__,"all buffers in use", NR_BUFS);
+  /* Desired block is not on available chain.  Take the oldest block on
+   * probation if probation holds more than its share, or else the least
+   * recently used block on the main chain.
+   */
+  // 2Q: 试用队列超过份额时淘汰试用队列中最旧的块, 否则淘汰主队列中最近
+  // 最少使用的块.
+  q = bq_size[BQ_PROBATION] > PROBATION_SHARE(nr_bufs) ? BQ_PROBATION : BQ_MAIN;
+  if (front[q] == NIL_BUF) q = !q;
+  if ((bp = front[q]) == NIL_BUF) panic(__FILE__,"all buffers in use", nr_bufs);
   rm_lru(bp);
 
   /* Remove the block that was just taken from its hash chain. */
@@ -90,11 +116,28 @@ int only_search;		/* if NO_READ, don't read, else act normal */
   }
 
   /* If the block taken is dirty, make it clean by writing it to the disk.
-   * Avoid hysteresis by flushing all other dirty blocks for the same device.
+   * Only this block is written; the other dirty blocks are left to the
+   * write-back runs, so the caller doesn't pay for them.  Remember blocks
+   * evicted from probation, in case they come back soon.
    */
+  // 只写回被淘汰的这一块, 其他脏块由后台写回.
   if (bp->b_dev != NO_DEV) {
-	if (bp->b_dirt == DIRTY) flushall(bp->b_dev);
+	if (bp->b_dirt == DIRTY) rw_block(bp, WRITING);
+	if (bp->b_queue == BQ_PROBATION) add_ghost(bp);
+	cachestats.cs_evictions++;
+  }
+  mark_clean(bp);		/* whatever it held is gone */
+
+  /* A block that comes back soon after it was evicted from probation is used
+   * more than once, so it goes on the main chain this time.
+   */
+  bq_size[bp->b_queue]--;
+  bp->b_queue = BQ_PROBATION;
+  if (dev != NO_DEV && find_ghost(dev, block)) {
+	bp->b_queue = BQ_MAIN;
+	cachestats.cs_ghost_hits++;
   }
+  bq_size[bp->b_queue]++;
 
   /* Fill in block's parameters and add it to the hash chain where it goes. */
   bp->b_dev = dev;		/* fill in device number */
@@ -115,6 +158,24 @@ int only_search;		/* if NO_READ, don't read, else act normal */
   return(bp);			/* return the newly acquired block */
 }
 
+/*===========================================================================*
+ *				in_cache				     *
+ *===========================================================================*/
+PUBLIC int in_cache(dev, block)
+dev_t dev;			/* on which device is the block? */
+block_t block;			/* which block is wanted? */
+{
+/* Tell whether a block is in the cache.  Unlike get_block(), this takes no
+ * buffer, evicts nothing, and counts neither a hit nor a miss, so read ahead
+ * can look before it decides to read.
+ */
+  register struct buf *bp;
+
+  for (bp = buf_hash[(int) block & HASH_MASK]; bp != NIL_BUF; bp = bp->b_hash)
+	if (bp->b_blocknr == block && bp->b_dev == dev) return(TRUE);
+  return(FALSE);
+}
+
 /*===========================================================================*
  *				put_block				     *
  *===========================================================================*/
@@ -123,13 +184,17 @@ register struct buf *bp;	/* pointer to the buffer to be released */
 int block_type;			/* INODE_BLOCK, DIRECTORY_BLOCK, or whatever */
 {
 /* Return a block to the list of available blocks.   Depending on 'block_type'
- * it may be put on the front or rear of the LRU chain.  Blocks that are
+ * it may be put on the front or rear of its LRU chain.  Blocks that are
  * expected to be needed again shortly (e.g., partially full data blocks)
  * go on the rear; blocks that are unlikely to be needed again shortly
- * (e.g., full data blocks) go on the front.  Blocks whose loss can hurt
- * the integrity of the file system (e.g., inode blocks) are written to
- * disk immediately if they are dirty.
+ * (e.g., full data blocks) go on the front.  Metadata blocks (inode,
+ * directory, indirect and bit map blocks) go on the main chain, even when
+ * used only once so far.  Blocks whose loss can hurt the integrity of the
+ * file system (e.g., inode blocks) are written to disk immediately if they
+ * are dirty.
  */
+  int q;
+
   if (bp == NIL_BUF) return;	/* it is easier to check here than in caller */
 
   bp->b_count--;		/* there is one use fewer now */
@@ -137,33 +202,45 @@ int block_type;			/* INODE_BLOCK, DIRECTORY_BLOCK, or whatever */
 
   bufs_in_use--;		/* one fewer block buffers in use */
 
-  /* Put this block back on the LRU chain.  If the ONE_SHOT bit is set in
+  /* Metadata is used over and over, and a scan of a large file must not
+   * push it out, so it skips probation.
+   */
+  if (bp->b_queue == BQ_PROBATION && bp->b_dev != NO_DEV &&
+			(block_type & ~(WRITE_IMMED | ONE_SHOT)) < FULL_DATA_BLOCK) {
+	bq_size[BQ_PROBATION]--;
+	bq_size[BQ_MAIN]++;
+	bp->b_queue = BQ_MAIN;
+  }
+  q = bp->b_queue;
+
+  /* Put this block back on its LRU chain.  If the ONE_SHOT bit is set in
    * 'block_type', the block is not likely to be needed again shortly, so put
    * it on the front of the LRU chain where it will be the first one to be
-   * taken when a free buffer is needed later.
+   * taken when a free buffer is needed later.  So does a block that holds
+   * nothing.
    */
-  if (bp->b_dev == DEV_RAM || block_type & ONE_SHOT) {
+  if (bp->b_dev == DEV_RAM || bp->b_dev == NO_DEV || block_type & ONE_SHOT) {
 	/* Block probably won't be needed quickly. Put it on front of chain.
   	 * It will be the next block to be evicted from the cache.
   	 */
 	bp->b_prev = NIL_BUF;
-	bp->b_next = front;
-	if (front == NIL_BUF)
-		rear = bp;	/* LRU chain was empty */
+	bp->b_next = front[q];
+	if (front[q] == NIL_BUF)
+		rear[q] = bp;	/* LRU chain was empty */
 	else
-		front->b_prev = bp;
-	front = bp;
+		front[q]->b_prev = bp;
+	front[q] = bp;
   } else {
 	/* Block probably will be needed quickly.  Put it on rear of chain.
   	 * It will not be evicted from the cache for a long time.
   	 */
-	bp->b_prev = rear;
+	bp->b_prev = rear[q];
 	bp->b_next = NIL_BUF;
-	if (rear == NIL_BUF)
-		front = bp;
+	if (rear[q] == NIL_BUF)
+		front[q] = bp;
 	else
-		rear->b_next = bp;
-	rear = bp;
+		rear[q]->b_next = bp;
+	rear[q] = bp;
   }
 
   /* Some blocks are so important (e.g., inodes, indirect blocks) that they
@@ -173,6 +250,17 @@ int block_type;			/* INODE_BLOCK, DIRECTORY_BLOCK, or whatever */
   if ((block_type & WRITE_IMMED) && bp->b_dirt==DIRTY && bp->b_dev != NO_DEV) {
 		rw_block(bp, WRITING);
   } 
+
+  /* Stamp a block that has just become dirty with the current write-back
+   * run, and see that there is a run to come.  If too many buffers are dirty,
+   * write some now.
+   */
+  if (bp->b_dirt == DIRTY && bp->b_dirtied == 0 && bp->b_dev != NO_DEV) {
+	bp->b_dirtied = wb_epoch;
+	bufs_dirty++;
+	if (!wb_armed) wb_start();
+	if (bufs_dirty > WB_HIGH(nr_bufs)) write_back(TRUE);
+  }
 }
 
 /*===========================================================================*
@@ -272,7 +360,7 @@ int rw_flag;			/* READING or WRITING */
 	}
   }
 
-  bp->b_dirt = CLEAN;
+  mark_clean(bp);
 }
 
 /*===========================================================================*
@@ -281,12 +369,20 @@ int rw_flag;			/* READING or WRITING */
 PUBLIC void invalidate(device)
 dev_t device;			/* device whose blocks are to be purged */
 {
-/* Remove all the blocks belonging to some device from the cache. */
+/* Remove all the blocks belonging to some device from the cache, and forget
+ * its ghosts, as the device may hold another file system next time.
+ */
 
   register struct buf *bp;
+  register struct ghost *gp;
 
-  for (bp = &buf[0]; bp < &buf[NR_BUFS]; bp++)
-	if (bp->b_dev == device) bp->b_dev = NO_DEV;
+  for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++)
+	if (bp->b_dev == device) {
+		bp->b_dev = NO_DEV;
+		mark_clean(bp);
+	}
+  for (gp = &ghost[0]; gp < &ghost[nr_ghosts]; gp++)
+	if (gp->g_dev == device) (void) find_ghost(device, gp->g_blocknr);
 }
 
 /*===========================================================================*
@@ -298,12 +394,11 @@ dev_t dev;			/* device to flush */
 /* Flush all dirty blocks for one device. */
 
   register struct buf *bp;
-  static struct buf *dirty[NR_BUFS];	/* static so it isn't on stack */
   int ndirty;
 
-  for (bp = &buf[0], ndirty = 0; bp < &buf[NR_BUFS]; bp++)
-	if (bp->b_dirt == DIRTY && bp->b_dev == dev) dirty[ndirty++] = bp;
-  rw_scattered(dev, dirty, ndirty, WRITING);
+  for (bp = &buf[0], ndirty = 0; bp < &buf[nr_bufs]; bp++)
+	if (bp->b_dirt == DIRTY && bp->b_dev == dev) dirty_q[ndirty++] = bp;
+  rw_scattered(dev, dirty_q, ndirty, WRITING);
 }
 
 /*===========================================================================*
@@ -372,6 +467,7 @@ int rw_flag;			/* READING or WRITING */
 					(dev>>MAJOR)&BYTE, (dev>>MINOR)&BYTE,
 					bp->b_blocknr);
 				bp->b_dev = NO_DEV;	/* invalidate block */
+				mark_clean(bp);
 			}
 			break;
 		}
@@ -379,14 +475,16 @@ int rw_flag;			/* READING or WRITING */
 			bp->b_dev = dev;	/* validate block */
 			put_block(bp, PARTIAL_DATA_BLOCK);
 		} else {
-			bp->b_dirt = CLEAN;
+			mark_clean(bp);
 		}
 	}
 	bufq += i;
 	bufqsize -= i;
-	if (rw_flag == READING) {
+	if (rw_flag == READING && (i < j || r != OK)) {
 		/* Don't bother reading more than the device is willing to
 		 * give at this time.  Don't forget to release those extras.
+		 * If a run was read in full, go on with the next one; the
+		 * blocks of a fragmented file come in several runs.
 		 */
 		while (bufqsize > 0) {
 			put_block(*bufq++, PARTIAL_DATA_BLOCK);
@@ -412,17 +510,174 @@ struct buf *bp;
 {
 /* Remove a block from its LRU chain. */
   struct buf *next_ptr, *prev_ptr;
+  int q;
 
   bufs_in_use++;
+  q = bp->b_queue;
   next_ptr = bp->b_next;	/* successor on LRU chain */
   prev_ptr = bp->b_prev;	/* predecessor on LRU chain */
   if (prev_ptr != NIL_BUF)
 	prev_ptr->b_next = next_ptr;
   else
-	front = next_ptr;	/* this block was at front of chain */
+	front[q] = next_ptr;	/* this block was at front of chain */
 
   if (next_ptr != NIL_BUF)
 	next_ptr->b_prev = prev_ptr;
   else
-	rear = prev_ptr;	/* this block was at rear of chain */
+	rear[q] = prev_ptr;	/* this block was at rear of chain */
+}
+
+/*===========================================================================*
+ *				add_ghost				     *
+ *===========================================================================*/
+PRIVATE void add_ghost(bp)
+struct buf *bp;			/* block evicted from probation */
+{
+/* Remember the number of a block that is evicted from probation, in place of
+ * the oldest ghost.
+ */
+  register struct ghost *gp;
+  int g, b;
+
+  if (nr_ghosts == 0) return;
+  g = ghost_hand;
+  ghost_hand = (ghost_hand + 1) % nr_ghosts;
+  gp = &ghost[g];
+  if (gp->g_dev != NO_DEV) (void) find_ghost(gp->g_dev, gp->g_blocknr);
+
+  gp->g_dev = bp->b_dev;
+  gp->g_blocknr = bp->b_blocknr;
+  b = (int) bp->b_blocknr & HASH_MASK;
+  gp->g_hash = ghost_hash[b];
+  ghost_hash[b] = g;
+}
+
+/*===========================================================================*
+ *				find_ghost				     *
+ *===========================================================================*/
+PRIVATE int find_ghost(dev, block)
+Dev_t dev;			/* on which device is the block? */
+block_t block;			/* which block is wanted? */
+{
+/* See if a block was evicted from probation recently.  If so, forget it, and
+ * return TRUE.  Its entry in the ring is left unused until its turn comes.
+ */
+  register struct ghost *gp;
+  int *gpp;
+
+  gpp = &ghost_hash[(int) block & HASH_MASK];
+  while (*gpp != -1) {
+	gp = &ghost[*gpp];
+	if (gp->g_blocknr == block && gp->g_dev == dev) {
+		*gpp = gp->g_hash;		/* off the hash chain */
+		gp->g_dev = NO_DEV;
+		return(TRUE);
+	}
+	gpp = &gp->g_hash;
+  }
+  return(FALSE);
+}
+
+/*===========================================================================*
+ *				mark_clean				     *
+ *===========================================================================*/
+PRIVATE void mark_clean(bp)
+struct buf *bp;			/* block that was written or discarded */
+{
+/* Mark a block clean, and no longer count it as dirty. */
+  bp->b_dirt = CLEAN;
+  if (bp->b_dirtied != 0) {
+	bp->b_dirtied = 0;
+	bufs_dirty--;
+  }
+}
+
+/*===========================================================================*
+ *				write_back				     *
+ *===========================================================================*/
+PRIVATE void write_back(urgent)
+int urgent;			/* TRUE if too many buffers are dirty */
+{
+/* Write dirty blocks that are not in use.  A run started by the timer writes
+ * the blocks that have been dirty for WB_AGE runs.  An urgent one, when more
+ * than WB_HIGH of the buffers are dirty, writes the oldest blocks, a run's
+ * worth at a time, until no more than WB_LOW are.
+ */
+  static int busy;		/* no write-back within a write-back */
+  register struct buf *bp;
+  unsigned oldest;
+
+  if (busy) return;
+  busy = TRUE;
+  if (!urgent) {
+	if (wb_epoch > WB_AGE) flush_dirty(wb_epoch - WB_AGE);
+  } else {
+	oldest = wb_epoch;
+	for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++)
+		if (bp->b_dirtied != 0 && bp->b_dirtied < oldest)
+			oldest = bp->b_dirtied;
+	while (bufs_dirty > WB_LOW(nr_bufs) && oldest <= wb_epoch)
+		flush_dirty(oldest++);
+  }
+  busy = FALSE;
+}
+
+/*===========================================================================*
+ *				flush_dirty				     *
+ *===========================================================================*/
+PRIVATE void flush_dirty(before)
+unsigned before;		/* write blocks stamped in this run or before */
+{
+/* Write the dirty blocks that are not in use and were stamped in run 'before'
+ * or earlier.  The blocks are written a device at a time.  Rw_scattered()
+ * sorts them by block number, and writes each stretch of adjacent blocks with
+ * one request.
+ */
+  register struct buf *bp;
+  struct buf **bufq;
+  int ndirty, i, n;
+  dev_t dev;
+
+  for (bp = &buf[0], ndirty = 0; bp < &buf[nr_bufs]; bp++)
+	if (bp->b_dirtied != 0 && bp->b_dirtied <= before &&
+			bp->b_count == 0 && bp->b_dirt == DIRTY)
+		dirty_q[ndirty++] = bp;
+
+  for (bufq = dirty_q; ndirty > 0; bufq += n, ndirty -= n) {
+	/* Move the blocks on the device of the first one to the front. */
+	dev = bufq[0]->b_dev;
+	for (i = n = 0; i < ndirty; i++) {
+		if (bufq[i]->b_dev != dev) continue;
+		bp = bufq[n];
+		bufq[n++] = bufq[i];
+		bufq[i] = bp;
+	}
+	rw_scattered(dev, bufq, n, WRITING);
+  }
+}
+
+/*===========================================================================*
+ *				wb_start				     *
+ *===========================================================================*/
+PRIVATE void wb_start()
+{
+/* Set the timer for the next write-back run.  It is only set while there
+ * are dirty blocks, so an idle file system isn't woken up for nothing.
+ */
+  fs_init_timer(&wb_timer);
+  fs_set_timer(&wb_timer, WB_INTERVAL, wb_timeout, 0);
+  wb_armed = TRUE;
+}
+
+/*===========================================================================*
+ *				wb_timeout				     *
+ *===========================================================================*/
+PRIVATE void wb_timeout(tp)
+timer_t *tp;			/* the write-back timer */
+{
+/* Start a new write-back run, and write what has been dirty long enough. */
+  wb_armed = FALSE;
+  wb_epoch++;
+  write_back(FALSE);
+  if (bufs_dirty > 0) wb_start();
 }
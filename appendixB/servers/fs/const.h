@@ -8,6 +8,8 @@
 #define NR_INODES         64	/* # slots in "in core" inode table */
 #define NR_SUPERS          8	/* # slots in super block table */
 #define NR_LOCKS           8	/* # slots in the file locking table */
+#define NR_DCACHE        512	/* # slots in the directory entry cache */
+#define NR_DC_HASH       256	/* # dcache hash chains (must be 2^n) */
 
 /* The type of sizeof may be (unsigned) long.  Use the following macro for
  * taking the sizes of small objects so that there are no surprises like
@@ -34,6 +36,22 @@
 #define NO_READ            1	/* prevents get_block from doing disk read */
 #define PREFETCH           2	/* tells get_block not to read or mark dev */
 
+/* Write-back of dirty blocks in the cache.  Dirty data blocks are mostly on
+ * probation, which is a quarter of the buffers, so the high water mark must
+ * be well below that, or they are evicted, and written, one by one first.
+ */
+#define WB_INTERVAL   (5*HZ)	/* ticks between write-back runs */
+#define WB_AGE             3	/* write blocks dirty for this many runs */
+#define WB_HIGH(n)  ((n) / 8)	/* this many dirty buffers start a flush */
+#define WB_LOW(n)  ((n) / 16)	/* ... which goes on down to this many */
+
+/* Read-ahead window of a sequential stream, in blocks.  It starts small and
+ * doubles on every read that continues the stream, but stays within half of
+ * the probation queue, or the blocks read ahead are evicted before use.
+ */
+#define RA_MIN             4	/* window when a stream is detected */
+#define RA_MAX(n)  MIN(NR_IOREQS, PROBATION_SHARE(n) / 2)  /* largest window */
+
 #define XPIPE   (-NR_TASKS-1)	/* used in fp_task when susp'd on pipe */
 #define XLOCK   (-NR_TASKS-2)	/* used in fp_task when susp'd on lock */
 #define XPOPEN  (-NR_TASKS-3)	/* used in fp_task when susp'd on pipe open */
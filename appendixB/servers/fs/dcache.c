@@ -0,0 +1,256 @@
+/* This file manages the directory entry cache.  Search_dir() asks it before
+ * searching a directory for a name, and tells it what it found afterwards,
+ * also when the name was not there.  Whenever a directory entry is made or
+ * removed, the name is dropped from the cache.  All names in a directory are
+ * dropped when its inode is freed, because the inode number may be used for
+ * another directory, and all names on a device when it is mounted or
+ * unmounted.
+ *
+ * The entry points into this file are
+ *   init_dcache:  initialize the directory entry cache
+ *   dc_lookup:	   look up a name in the cache
+ *   dc_enter:	   remember the inode number of a name, or that it is absent
+ *   dc_purge:	   drop a name from the cache
+ *   dc_purge_dir: drop all names in a directory
+ *   dc_purge_dev: drop all names on a device
+ */
+
+#include "fs.h"
+#include <string.h>
+#include "inode.h"
+#include "dcache.h"
+
+FORWARD _PROTOTYPE( struct dentry **dc_chain, (Dev_t dev, ino_t dir,
+							char *string)	);
+FORWARD _PROTOTYPE( struct dentry *dc_find, (struct inode *dirp,
+							char *string)	);
+FORWARD _PROTOTYPE( void dc_front_lru, (struct dentry *dp)		);
+FORWARD _PROTOTYPE( void dc_free, (struct dentry *dp)			);
+
+/*===========================================================================*
+ *				init_dcache				     *
+ *===========================================================================*/
+PUBLIC void init_dcache()
+{
+/* Put all slots on the LRU chain, free. */
+
+  register struct dentry *dp;
+
+  for (dp = &dentry[0]; dp < &dentry[NR_DCACHE]; dp++) {
+	dp->dc_dev = NO_DEV;
+	dp->dc_next = dp + 1;
+	dp->dc_prev = dp - 1;
+	dp->dc_hash = NIL_DENTRY;
+  }
+  dentry[0].dc_prev = NIL_DENTRY;
+  dentry[NR_DCACHE - 1].dc_next = NIL_DENTRY;
+  dc_front = &dentry[0];
+  dc_rear = &dentry[NR_DCACHE - 1];
+  memset(dc_hash, 0, sizeof(dc_hash));
+  namestats.ns_slots = NR_DCACHE;
+}
+
+/*===========================================================================*
+ *				dc_lookup				     *
+ *===========================================================================*/
+PUBLIC int dc_lookup(dirp, string, numb)
+struct inode *dirp;		/* directory to look in */
+char string[NAME_MAX];		/* name to look for */
+ino_t *numb;			/* the inode number goes here */
+{
+/* Look up a name in the cache.  Return FALSE if it isn't there.  Otherwise
+ * return TRUE, with the inode number in '*numb', or NO_ENTRY if the name is
+ * known not to be in the directory.
+ */
+  register struct dentry *dp;
+
+  if ( (dp = dc_find(dirp, string)) == NIL_DENTRY) {
+	namestats.ns_misses++;
+	return(FALSE);
+  }
+  dc_front_lru(dp);
+  *numb = dp->dc_ino;
+  if (dp->dc_ino == NO_ENTRY) namestats.ns_neg_hits++;
+  else namestats.ns_hits++;
+  return(TRUE);
+}
+
+/*===========================================================================*
+ *				dc_enter				     *
+ *===========================================================================*/
+PUBLIC void dc_enter(dirp, string, numb)
+struct inode *dirp;		/* directory the name was looked up in */
+char string[NAME_MAX];		/* the name */
+ino_t numb;			/* its inode number, or NO_ENTRY if absent */
+{
+/* Remember what a search of a directory found.  The least recently used
+ * slot is taken for it.
+ */
+  register struct dentry *dp;
+  struct dentry **chain;
+
+  // 不在缓存中时取最久未用的槽位; numb 为 NO_ENTRY 时是负项.
+  if ( (dp = dc_find(dirp, string)) == NIL_DENTRY) {
+	dp = dc_rear;
+	if (dp->dc_dev != NO_DEV) dc_free(dp);
+	else namestats.ns_used++;
+	dp->dc_dev = dirp->i_dev;
+	dp->dc_dir = dirp->i_num;
+	strncpy(dp->dc_name, string, (size_t) NAME_MAX);
+	chain = dc_chain(dp->dc_dev, dp->dc_dir, dp->dc_name);
+	dp->dc_hash = *chain;
+	*chain = dp;
+  }
+  dp->dc_ino = numb;
+  dc_front_lru(dp);
+}
+
+/*===========================================================================*
+ *				dc_purge				     *
+ *===========================================================================*/
+PUBLIC void dc_purge(dirp, string)
+struct inode *dirp;		/* directory that changed */
+char string[NAME_MAX];		/* the name entered or removed */
+{
+/* A directory entry is made or removed.  Drop the name from the cache. */
+
+  register struct dentry *dp;
+
+  if ( (dp = dc_find(dirp, string)) != NIL_DENTRY) {
+	dc_free(dp);
+	namestats.ns_used--;
+	namestats.ns_purged++;
+  }
+}
+
+/*===========================================================================*
+ *				dc_purge_dir				     *
+ *===========================================================================*/
+PUBLIC void dc_purge_dir(dev, dir)
+Dev_t dev;			/* device the directory is on */
+ino_t dir;			/* inode number of the directory */
+{
+/* Drop all names in a directory, whose inode is freed. */
+
+  register struct dentry *dp;
+
+  for (dp = &dentry[0]; dp < &dentry[NR_DCACHE]; dp++) {
+	if (dp->dc_dev == dev && dp->dc_dir == dir) {
+		dc_free(dp);
+		namestats.ns_used--;
+		namestats.ns_purged++;
+	}
+  }
+}
+
+/*===========================================================================*
+ *				dc_purge_dev				     *
+ *===========================================================================*/
+PUBLIC void dc_purge_dev(dev)
+Dev_t dev;			/* device mounted or unmounted */
+{
+/* Drop all names on a device. */
+
+  register struct dentry *dp;
+
+  for (dp = &dentry[0]; dp < &dentry[NR_DCACHE]; dp++) {
+	if (dp->dc_dev == dev) {
+		dc_free(dp);
+		namestats.ns_used--;
+		namestats.ns_purged++;
+	}
+  }
+}
+
+/*===========================================================================*
+ *				dc_chain				     *
+ *===========================================================================*/
+PRIVATE struct dentry **dc_chain(dev, dir, string)
+Dev_t dev;			/* device the directory is on */
+ino_t dir;			/* inode number of the directory */
+char *string;			/* the name */
+{
+/* Return the hash chain for a name in a directory. */
+
+  register unsigned h;
+  register int i;
+
+  h = (unsigned) dev * 31 + (unsigned) dir;
+  for (i = 0; i < NAME_MAX && string[i] != '\0'; i++)
+	h = h * 31 + (unsigned char) string[i];
+  return(&dc_hash[h & (NR_DC_HASH - 1)]);
+}
+
+/*===========================================================================*
+ *				dc_find					     *
+ *===========================================================================*/
+PRIVATE struct dentry *dc_find(dirp, string)
+struct inode *dirp;		/* directory to look in */
+char *string;			/* name to look for */
+{
+/* Find the slot for a name in a directory, if there is one.  Names are
+ * compared like search_dir() does, on the first NAME_MAX characters.
+ */
+  register struct dentry *dp;
+
+  dp = *dc_chain(dirp->i_dev, dirp->i_num, string);
+  for ( ; dp != NIL_DENTRY; dp = dp->dc_hash) {
+	if (dp->dc_dir == dirp->i_num && dp->dc_dev == dirp->i_dev &&
+			strncmp(dp->dc_name, string, NAME_MAX) == 0)
+		return(dp);
+  }
+  return(NIL_DENTRY);
+}
+
+/*===========================================================================*
+ *				dc_front_lru				     *
+ *===========================================================================*/
+PRIVATE void dc_front_lru(dp)
+register struct dentry *dp;	/* slot just used */
+{
+/* Move a slot to the front of the LRU chain. */
+
+  if (dp == dc_front) return;
+
+  /* Take it off the chain. */
+  dp->dc_prev->dc_next = dp->dc_next;
+  if (dp->dc_next != NIL_DENTRY) dp->dc_next->dc_prev = dp->dc_prev;
+  else dc_rear = dp->dc_prev;
+
+  /* Put it in front. */
+  dp->dc_prev = NIL_DENTRY;
+  dp->dc_next = dc_front;
+  dc_front->dc_prev = dp;
+  dc_front = dp;
+}
+
+/*===========================================================================*
+ *				dc_free					     *
+ *===========================================================================*/
+PRIVATE void dc_free(dp)
+register struct dentry *dp;	/* slot to be freed */
+{
+/* Take a slot off its hash chain, mark it free, and move it to the rear of
+ * the LRU chain, so it is the next one to be used.
+ */
+  struct dentry **pp;
+
+  pp = dc_chain(dp->dc_dev, dp->dc_dir, dp->dc_name);
+  while (*pp != dp) pp = &(*pp)->dc_hash;
+  *pp = dp->dc_hash;
+  dp->dc_hash = NIL_DENTRY;
+  dp->dc_dev = NO_DEV;
+
+  if (dp == dc_rear) return;
+
+  /* Take it off the LRU chain. */
+  if (dp->dc_prev != NIL_DENTRY) dp->dc_prev->dc_next = dp->dc_next;
+  else dc_front = dp->dc_next;
+  dp->dc_next->dc_prev = dp->dc_prev;
+
+  /* Put it at the rear. */
+  dp->dc_next = NIL_DENTRY;
+  dp->dc_prev = dc_rear;
+  dc_rear->dc_next = dp;
+  dc_rear = dp;
+}
@@ -0,0 +1,25 @@
+/* This is the directory entry cache.  It remembers the inode number that a
+ * name has in a directory, given by device and inode number, so that path
+ * lookups don't have to search the directory blocks each time.  A slot with
+ * dc_ino == NO_ENTRY says that the name is not in the directory.  A slot is
+ * free if dc_dev == NO_DEV.
+ *
+ * The slots are on an LRU chain, most recently used at the front, and on a
+ * hash chain by device, directory and name.
+ */
+EXTERN struct dentry {
+  struct dentry *dc_next;	/* next slot on the LRU chain */
+  struct dentry *dc_prev;	/* previous slot on the LRU chain */
+  struct dentry *dc_hash;	/* next slot on the hash chain */
+  dev_t dc_dev;			/* device the directory is on */
+  ino_t dc_dir;			/* inode number of the directory */
+  ino_t dc_ino;			/* inode number of the name, or NO_ENTRY */
+  char dc_name[NAME_MAX];	/* the name, as in a directory entry */
+} dentry[NR_DCACHE];
+
+#define NIL_DENTRY (struct dentry *) 0	/* indicates absence of a slot */
+
+EXTERN struct dentry *dc_hash[NR_DC_HASH];	/* the hash chains */
+EXTERN struct dentry *dc_front;	/* most recently used slot */
+EXTERN struct dentry *dc_rear;	/* least recently used slot */
+EXTERN struct namestats namestats;	/* hits and misses */
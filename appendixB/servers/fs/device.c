@@ -4,6 +4,7 @@
  * The entry points in this file are:
  *   dev_open:   FS opens a device
  *   dev_close:  FS closes a device
+ *   init_grants: register the grant table for driver transfers
  *   dev_io:	 FS does a read or write on a device
  *   dev_status: FS processes callback request alert
  *   gen_opcl:   generic call to a task to perform an open/close
@@ -29,6 +30,33 @@
 
 extern int dmap_size;
 
+/* Drivers flagged DMAP_SAFE get the _S requests, which name FS's buffers or
+ * a user's buffer with grants.  FS waits for each reply, and such drivers
+ * never suspend, so one request at a time uses the table, from the start.
+ */
+PRIVATE cp_grant_t grant_table[NR_IOREQS];
+PRIVATE iovec_s_t iovec_s[NR_IOREQS];
+PRIVATE int grants_ok;		/* did the kernel take the table? */
+
+FORWARD _PROTOTYPE( int set_grants, (int op, int driver, int proc,
+			void *buf, int bytes)				);
+FORWARD _PROTOTYPE( void end_grants, (int op, void *buf, int bytes)	);
+
+/*===========================================================================*
+ *				init_grants				     *
+ *===========================================================================*/
+PUBLIC void init_grants()
+{
+/* Register the grant table with the kernel.  Without it, the drivers are
+ * sent the plain requests, as before.
+ */
+  int s;
+
+  if ((s = sys_setgrant(grant_table, NR_IOREQS)) != OK)
+	printf("FS: can't register grant table: %d\n", s);
+  grants_ok = (s == OK);
+}
+
 /*===========================================================================*
  *				dev_open				     *
  *===========================================================================*/
@@ -116,6 +144,7 @@ int flags;			/* special flags, like O_NONBLOCK */
 /* Read or write from a device.  The parameter 'dev' tells which one. */
   struct dmap *dp;
   message dev_mess;
+  int safe_op;
 
   /* Determine task dmap. */
   dp = &dmap[(dev >> MAJOR) & BYTE];
@@ -129,8 +158,20 @@ int flags;			/* special flags, like O_NONBLOCK */
   dev_mess.COUNT    = bytes;
   dev_mess.TTY_FLAGS = flags;
 
+  /* Let the driver copy the data itself, through grants, if it can. */
+  safe_op = op;
+  if (grants_ok && (dp->dmap_flags & DMAP_SAFE))
+	safe_op = set_grants(op, dp->dmap_driver, proc, buf, bytes);
+  if (safe_op != op) {
+	dev_mess.m_type = safe_op;
+	dev_mess.PROC_NR = FS_PROC_NR;
+	dev_mess.ADDRESS = (op == DEV_READ || op == DEV_WRITE) ?
+		(char *) 0 : (char *) iovec_s;
+  }
+
   /* Call the task. */
   (*dp->dmap_io)(dp->dmap_driver, &dev_mess);
+  if (safe_op != op) end_grants(op, buf, bytes);
 
   /* Task has completed.  See if call completed. */
   if (dev_mess.REP_STATUS == SUSPEND) {
@@ -150,6 +191,81 @@ int flags;			/* special flags, like O_NONBLOCK */
   return(dev_mess.REP_STATUS);
 }
 
+/*===========================================================================*
+ *				set_grants				     *
+ *===========================================================================*/
+PRIVATE int set_grants(op, driver, proc, buf, bytes)
+int op;				/* DEV_READ, DEV_WRITE, DEV_IOCTL, etc. */
+int driver;			/* process that gets the grants */
+int proc;			/* in whose address space is buf? */
+void *buf;			/* virtual address of the buffer */
+int bytes;			/* how many bytes, or iovec_t entries */
+{
+/* Grant the driver the buffer of a read or write, or each buffer of the I/O
+ * vector of a gather or scatter.  A user's buffer gets a magic grant, so the
+ * driver copies it straight to or from the user.  Return the _S request to
+ * send, or op itself if it must be sent as it is.
+ */
+  register cp_grant_t *gp;
+  register iovec_t *iop;
+  int i, access;
+
+  access = (op == DEV_READ || op == DEV_GATHER) ? CPF_WRITE : CPF_READ;
+  switch (op) {
+  case DEV_READ:
+  case DEV_WRITE:
+	if (bytes < 0) return(op);
+	gp = &grant_table[0];
+	gp->cp_who = driver;
+	gp->cp_from = proc;
+	gp->cp_start = (vir_bytes) buf;
+	gp->cp_len = (vir_bytes) bytes;
+	gp->cp_flags = CPF_USED | access | (proc == FS_PROC_NR ? 0 : CPF_MAGIC);
+	return(op == DEV_READ ? DEV_READ_S : DEV_WRITE_S);
+  case DEV_GATHER:
+  case DEV_SCATTER:
+	/* The vector is FS's own, from rw_scattered(). */
+	if (proc != FS_PROC_NR || bytes > NR_IOREQS) return(op);
+	for (i = 0, iop = buf; i < bytes; i++, iop++) {
+		gp = &grant_table[i];
+		gp->cp_who = driver;
+		gp->cp_from = FS_PROC_NR;
+		gp->cp_start = iop->iov_addr;
+		gp->cp_len = iop->iov_size;
+		gp->cp_flags = CPF_USED | access;
+		iovec_s[i].iov_grant = (cp_grant_id_t) i;
+		iovec_s[i].iov_size = iop->iov_size;
+	}
+	return(op == DEV_GATHER ? DEV_GATHER_S : DEV_SCATTER_S);
+  default:
+	return(op);
+  }
+}
+
+/*===========================================================================*
+ *				end_grants				     *
+ *===========================================================================*/
+PRIVATE void end_grants(op, buf, bytes)
+int op;				/* the request as dev_io() got it */
+void *buf;			/* virtual address of the buffer */
+int bytes;			/* how many bytes, or iovec_t entries */
+{
+/* Revoke the grants of a request, and hand the sizes the driver left in the
+ * grant vector back to the caller's I/O vector.
+ */
+  register iovec_t *iop;
+  int i;
+
+  if (op == DEV_READ || op == DEV_WRITE) {
+	grant_table[0].cp_flags = 0;
+	return;
+  }
+  for (i = 0, iop = buf; i < bytes; i++, iop++) {
+	grant_table[i].cp_flags = 0;
+	iop->iov_size = iovec_s[i].iov_size;
+  }
+}
+
 /*===========================================================================*
  *				gen_opcl				     *
  *===========================================================================*/
@@ -162,6 +278,7 @@ int flags;			/* mode bits and flags */
 /* Called from the dmap struct in table.c on opens & closes of special files.*/
   struct dmap *dp;
   message dev_mess;
+  int safe_op;
 
   /* Determine task dmap. */
   dp = &dmap[(dev >> MAJOR) & BYTE];
@@ -33,7 +33,7 @@
 struct dmap dmap[NR_DEVICES];				/* actual map */ 
 PRIVATE struct dmap init_dmap[] = {
   DT(1, no_dev,   0,       0,       	0) 	  	/* 0 = not used   */
-  DT(1, gen_opcl, gen_io,  MEM_PROC_NR, 0)	        /* 1 = /dev/mem   */
+  DT(1, gen_opcl, gen_io,  MEM_PROC_NR, DMAP_SAFE)	/* 1 = /dev/mem   */
   DT(0, no_dev,   0,       0,           DMAP_MUTABLE)	/* 2 = /dev/fd0   */
   DT(0, no_dev,   0,       0,           DMAP_MUTABLE)	/* 3 = /dev/c0    */
   DT(1, tty_opcl, gen_io,  TTY_PROC_NR, 0)    	  	/* 4 = /dev/tty00 */
@@ -109,6 +109,7 @@ int style;			/* style of the device */
   }
   dp->dmap_io = gen_io;
   dp->dmap_driver = proc_nr;
+  dp->dmap_flags &= ~DMAP_SAFE;	/* the new driver may not take grants */
   return(OK); 
 }
 
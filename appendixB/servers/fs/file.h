@@ -8,6 +8,8 @@ EXTERN struct filp {
   int filp_count;		/* how many file descriptors share this slot?*/
   struct inode *filp_ino;	/* pointer to the inode */
   off_t filp_pos;		/* file position */
+  off_t filp_ra_next;		/* position a sequential read starts at */
+  unsigned filp_ra_win;		/* read-ahead window in blocks, 0 if none */
 
   /* the following fields are for select() and are owned by the generic
    * select() code (i.e., fd-type-specific select() code can't touch these).
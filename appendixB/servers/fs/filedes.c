@@ -43,6 +43,8 @@ PUBLIC int get_fd(int start, mode_t bits, int *k, struct filp **fpt)
 	if (f->filp_count == 0) {
 		f->filp_mode = bits;
 		f->filp_pos = 0L;
+		f->filp_ra_next = 0L;
+		f->filp_ra_win = 0;
 		f->filp_selectors = 0;
 		f->filp_select_ops = 0;
 		f->filp_pipe_select_ops = 0;
@@ -192,6 +192,7 @@ ino_t inumb;			/* number of inode to be freed */
   b = inumb;
   free_bit(sp, IMAP, b);
   if (b < sp->s_isearch) sp->s_isearch = b;
+  dc_purge_dir(dev, inumb);	/* the number may come back as another dir */
 }
 
 /*===========================================================================*
@@ -29,7 +29,6 @@ EXTERN struct inode {
   char i_dirt;			/* CLEAN or DIRTY */
   char i_pipe;			/* set to I_PIPE if pipe */
   char i_mount;			/* this bit is set if file mounted on */
-  char i_seek;			/* set on LSEEK, cleared on READ/WRITE */
   char i_update;		/* the ATIME, CTIME, and MTIME bits are here */
 } inode[NR_INODES];
 
@@ -40,5 +39,3 @@ EXTERN struct inode {
 #define I_PIPE             1	/* i_pipe is I_PIPE if inode is a pipe */
 #define NO_MOUNT           0	/* i_mount is NO_MOUNT if file not mounted on*/
 #define I_MOUNT            1	/* i_mount is I_MOUNT if file mounted on */
-#define NO_SEEK            0	/* i_seek = NO_SEEK if last op was not SEEK */
-#define ISEEK              1	/* i_seek = ISEEK if last op was SEEK */
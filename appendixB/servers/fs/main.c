@@ -16,6 +16,7 @@ struct super_block;		/* proto.h needs to know this */
 #include <stdio.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <sys/ioc_memory.h>
 #include <sys/svrctl.h>
 #include <minix/callnr.h>
@@ -65,7 +66,8 @@ PUBLIC int main()
 		}
         } else if (call_nr == SYN_ALARM) {
         	/* Not a user request; system has expired one of our timers,
-        	 * currently only in use for select(). Check it.
+        	 * in use for select() and for writing back dirty blocks.
+        	 * Check it.
         	 */
         	fs_expire_timers(m_in.NOTIFY_TIMESTAMP);
         } else if ((call_nr & NOTIFY_MESSAGE)) {
@@ -132,26 +134,72 @@ PRIVATE void get_work()
  *===========================================================================*/
 PRIVATE void buf_pool(void)
 {
-/* Initialize the buffer pool. */
-
+/* Size and initialize the buffer pool.  The boot parameter 'bufs' gives the
+ * number of buffers.  Without it, use about 1/BUF_MEM_SHARE of the memory
+ * that PM has free, between NR_BUFS and NR_BUFS_MAX buffers.  The buffers
+ * come from the heap, which the Makefile only makes big enough for NR_BUFS
+ * of them; more fit only if FS was given a bigger gap with chmem.  If there
+ * isn't room for that many, try fewer.
+ */
   register struct buf *bp;
+  struct memstats memstats;
+  int i;
 
+  if ((nr_bufs = igetenv("bufs", 1)) == 0) {
+	nr_bufs = NR_BUFS;
+	if (getsysinfo(PM_PROC_NR, SI_MEM_STATS, &memstats) == OK)
+		nr_bufs = ((phys_bytes) memstats.ms_free << CLICK_SHIFT) /
+				BUF_MEM_SHARE / sizeof(struct buf);
+  }
+  if (nr_bufs < NR_BUFS) nr_bufs = NR_BUFS;
+  if (nr_bufs > NR_BUFS_MAX) nr_bufs = NR_BUFS_MAX;
+
+  for (;;) {
+	for (nr_buf_hash = 1; nr_buf_hash < nr_bufs; nr_buf_hash <<= 1) {}
+	nr_ghosts = GHOST_SHARE(nr_bufs);
+	buf = (struct buf *) malloc(nr_bufs * sizeof(struct buf));
+	buf_hash = (struct buf **) malloc(nr_buf_hash * sizeof(struct buf *));
+	dirty_q = (struct buf **) malloc(nr_bufs * sizeof(struct buf *));
+	ghost = (struct ghost *) malloc(nr_ghosts * sizeof(struct ghost));
+	ghost_hash = (int *) malloc(nr_buf_hash * sizeof(int));
+	if (buf != NULL && buf_hash != NULL && dirty_q != NULL &&
+			ghost != NULL && ghost_hash != NULL) break;
+	if (nr_bufs == NR_BUFS) panic(__FILE__,"no memory for buffers", NO_NUM);
+	free(buf); free(buf_hash); free(dirty_q); free(ghost); free(ghost_hash);
+	if ((nr_bufs /= 2) < NR_BUFS) nr_bufs = NR_BUFS;
+  }
+
+  /* All buffers start out empty, on probation. */
   bufs_in_use = 0;
-  front = &buf[0];
-  rear = &buf[NR_BUFS - 1];
+  front[BQ_PROBATION] = &buf[0];
+  rear[BQ_PROBATION] = &buf[nr_bufs - 1];
+  front[BQ_MAIN] = rear[BQ_MAIN] = NIL_BUF;
+  bq_size[BQ_PROBATION] = nr_bufs;
+  bq_size[BQ_MAIN] = 0;
 
-  for (bp = &buf[0]; bp < &buf[NR_BUFS]; bp++) {
+  for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++) {
 	bp->b_blocknr = NO_BLOCK;
 	bp->b_dev = NO_DEV;
+	bp->b_dirt = CLEAN;
+	bp->b_count = 0;
+	bp->b_queue = BQ_PROBATION;
+	bp->b_dirtied = 0;
 	bp->b_next = bp + 1;
 	bp->b_prev = bp - 1;
   }
   buf[0].b_prev = NIL_BUF;
-  buf[NR_BUFS - 1].b_next = NIL_BUF;
+  buf[nr_bufs - 1].b_next = NIL_BUF;
+
+  for (i = 0; i < nr_buf_hash; i++) buf_hash[i] = NIL_BUF;
+  for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++) bp->b_hash = bp->b_next;
+  buf_hash[0] = front[BQ_PROBATION];
 
-  for (bp = &buf[0]; bp < &buf[NR_BUFS]; bp++) bp->b_hash = bp->b_next;
-  buf_hash[0] = front;
+  for (i = 0; i < nr_ghosts; i++) ghost[i].g_dev = NO_DEV;
+  for (i = 0; i < nr_buf_hash; i++) ghost_hash[i] = -1;
+  ghost_hand = 0;
 
+  bufs_dirty = 0;
+  wb_epoch = 1;			/* 0 means not dirty */
 }
 
 /*===========================================================================*
@@ -220,6 +268,8 @@ PRIVATE void fs_init()
   who = FS_PROC_NR;
 
   buf_pool();			/* initialize buffer pool */
+  init_dcache();		/* initialize directory entry cache */
+  init_grants();		/* register grant table for drivers */
   build_dmap();			/* build device table and map boot driver */
   load_ram();			/* init RAM disk, load if it is root */
   load_super(root_dev);		/* load super block for root device */
@@ -374,6 +424,7 @@ PRIVATE void load_ram(void)
   }
 
   /* Loading blocks from image device. */
+  rdahedwin = NR_IOREQS;		/* the image is read sequentially */
   for (b = 0; b < (block_t) lcount; b++) {
   	int rb, factor;
 	bp = rahead(&inode[0], b, (off_t)block_size_image * b, block_size_image);
@@ -389,6 +440,7 @@ PRIVATE void load_ram(void)
 	if (b % 11 == 0)
 	printf("\b\b\b\b\b\b\b\b\b%6ld KB", ((long) b * block_size_image)/1024L);
   }
+  rdahedwin = 0;
 
   /* Commit changes to RAM so dev_io will see it. */
   do_sync();
@@ -451,5 +503,6 @@ dev_t super_dev;			/* place to get superblock from */
   dup_inode(rip);
   sp->s_isup = rip;
   sp->s_rd_only = 0;
+  build_summary(sp);
   return;
 }
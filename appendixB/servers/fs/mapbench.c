@@ -0,0 +1,332 @@
+/* Host-side benchmark of the bit map search in super.c.  This is an ordinary
+ * user program, not part of FS.
+ *
+ * It builds the zone bit map of a file system image in memory, fills it to a
+ * given percentage, and then allocates and frees zones through the old
+ * alloc_bit() (read every block in turn, skip full chunks, then look for the
+ * bit one by one) and the new one (skip blocks whose free count is zero,
+ * skip full chunks a long at a time, and find the bit with a single
+ * instruction).  It reports the time per allocation and how many bit map
+ * blocks each one had to fetch from the cache.  Both search from the same
+ * origin in the same order, so they must hand out the same bits; they are
+ * checked against each other, and the free counts are checked against the
+ * map at the end.
+ *
+ * The free space of an aged file system is not spread evenly: most map blocks
+ * are full, and the free zones are in the few blocks that are left.  The
+ * image is made that way.  Allocations start at a random origin, like the
+ * goal hints of files all over the disk.
+ *
+ * Then a file is written zone by zone, with the search starting at the first
+ * zone of the file (old) or at the zone before the new one (new), and the
+ * mean distance between consecutive zones of the file is reported.
+ *
+ * usage: mapbench [-b blocksize] [-z zones] [-f percentfull] [-n nops]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef unsigned short bitchunk_t;
+typedef unsigned long bit_t;
+
+#define CHUNK_BITS	(sizeof(bitchunk_t) * 8)
+#define NO_BIT		((bit_t) 0)
+
+static int block_size = 4096;
+static bit_t map_bits = 1000000;
+static int percent = 95;
+static long nops = 200000;
+
+static bitchunk_t *map;		/* the bit map, all blocks */
+static unsigned bit_blocks, bits_per_block, chunks_per_block;
+static unsigned *nr_free;	/* new: free bits per block */
+static long fetches;		/* bit map blocks fetched */
+
+static bitchunk_t *get_block(unsigned block)
+{
+  fetches++;
+  return(&map[(size_t) block * chunks_per_block]);
+}
+
+/* The old alloc_bit(), less the buffer cache. */
+static bit_t old_alloc(bit_t origin)
+{
+  unsigned block, word, bcount;
+  bitchunk_t *bp, *wptr, *wlim, k;
+  bit_t i, b;
+
+  if (origin >= map_bits) origin = 0;
+  block = origin / bits_per_block;
+  word = (origin % bits_per_block) / CHUNK_BITS;
+  bcount = bit_blocks + 1;
+  do {
+	bp = get_block(block);
+	wlim = &bp[chunks_per_block];
+	for (wptr = &bp[word]; wptr < wlim; wptr++) {
+		if (*wptr == (bitchunk_t) ~0) continue;
+		k = *wptr;
+		for (i = 0; (k & (1 << i)) != 0; ++i) {}
+		b = ((bit_t) block * bits_per_block)
+		    + (wptr - &bp[0]) * CHUNK_BITS + i;
+		if (b >= map_bits) break;
+		k |= 1 << i;
+		*wptr = k;
+		return(b);
+	}
+	if (++block >= bit_blocks) block = 0;
+	word = 0;
+  } while (--bcount > 0);
+  return(NO_BIT);
+}
+
+/* The new first_free(). */
+static int first_free(bitchunk_t *bp, unsigned word)
+{
+  bitchunk_t *wptr, *wlim;
+  unsigned long *lptr;
+  unsigned k;
+  int i;
+
+  wptr = &bp[word];
+  wlim = &bp[chunks_per_block];
+  while (wptr < wlim && (unsigned long) wptr % sizeof(long) != 0
+					&& *wptr == (bitchunk_t) ~0) wptr++;
+  if (wptr < wlim && (unsigned long) wptr % sizeof(long) == 0) {
+	lptr = (unsigned long *) wptr;
+	while (lptr < (unsigned long *) wlim && *lptr == ~0UL) lptr++;
+	wptr = (bitchunk_t *) lptr;
+	while (wptr < wlim && *wptr == (bitchunk_t) ~0) wptr++;
+  }
+  if (wptr >= wlim) return(-1);
+  k = *wptr;
+#if __GNUC__
+  i = __builtin_ctz(~k);
+#else
+  for (i = 0; (k & (1 << i)) != 0; ++i) {}
+#endif
+  return((wptr - &bp[0]) * CHUNK_BITS + i);
+}
+
+/* The new alloc_bit(). */
+static bit_t new_alloc(bit_t origin)
+{
+  unsigned block, word, bcount;
+  bitchunk_t *bp;
+  bit_t b;
+  int i;
+
+  if (origin >= map_bits) origin = 0;
+  block = origin / bits_per_block;
+  word = (origin % bits_per_block) / CHUNK_BITS;
+  bcount = bit_blocks + 1;
+  do {
+	if (nr_free[block] == 0) {
+		if (++block >= bit_blocks) block = 0;
+		word = 0;
+		continue;
+	}
+	bp = get_block(block);
+	if ((i = first_free(bp, word)) >= 0) {
+		b = ((bit_t) block * bits_per_block) + i;
+		if (b < map_bits) {
+			bp[i / CHUNK_BITS] |= 1 << (i % CHUNK_BITS);
+			nr_free[block]--;
+			return(b);
+		}
+	}
+	if (word == 0) nr_free[block] = 0;
+	if (++block >= bit_blocks) block = 0;
+	word = 0;
+  } while (--bcount > 0);
+  return(NO_BIT);
+}
+
+static int is_set(bit_t b)
+{
+  return((map[b / CHUNK_BITS] >> (b % CHUNK_BITS)) & 1);
+}
+
+static void set_bit(bit_t b, int on)
+{
+  if (on) map[b / CHUNK_BITS] |= 1 << (b % CHUNK_BITS);
+  else map[b / CHUNK_BITS] &= ~(1 << (b % CHUNK_BITS));
+}
+
+static void free_one(bit_t b, int counts)
+{
+  if (!is_set(b)) { fprintf(stderr, "freeing free bit %lu\n", b); exit(1); }
+  set_bit(b, 0);
+  if (counts) nr_free[b / bits_per_block]++;
+}
+
+static void count_all(void)
+{
+  unsigned block;
+  bit_t b, end;
+
+  for (block = 0; block < bit_blocks; block++) {
+	nr_free[block] = 0;
+	end = (bit_t) (block + 1) * bits_per_block;
+	if (end > map_bits) end = map_bits;
+	for (b = (bit_t) block * bits_per_block; b < end; b++)
+		if (!is_set(b)) nr_free[block]++;
+  }
+}
+
+/* Make an aged image: most blocks full, the free bits in every 'every'th
+ * block, which is about half free.
+ */
+static void make_image(unsigned seed)
+{
+  bit_t b, nfree, want;
+  unsigned block, every;
+
+  srand(seed);
+  memset(map, 0xFF, (size_t) bit_blocks * chunks_per_block * sizeof(bitchunk_t));
+  want = map_bits * (100 - percent) / 100;
+  every = percent < 100 ? 50 / (100 - percent) : 1;
+  if (every < 1 || every > bit_blocks) every = 1;
+  nfree = 0;
+  while (nfree < want) {
+	block = rand() % bit_blocks;
+	if (block % every != 0) continue;
+	b = (bit_t) block * bits_per_block + rand() % bits_per_block;
+	if (b == 0 || b >= map_bits || !is_set(b)) continue;
+	set_bit(b, 0);
+	nfree++;
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* Allocate at random origins, and free what was allocated LIVE operations
+ * ago, like short lived files, so the map stays as full as it is.
+ */
+#define LIVE	1000
+
+static void churn(int new, bit_t *got, double *secs, long *nfetch)
+{
+  long i;
+  bit_t b;
+  double t;
+
+  srand(12345);
+  fetches = 0;
+  t = now();
+  for (i = 0; i < nops; i++) {
+	b = new ? new_alloc(rand() % map_bits) : old_alloc(rand() % map_bits);
+	got[i] = b;
+	if (i >= LIVE && got[i - LIVE] != NO_BIT) free_one(got[i - LIVE], new);
+  }
+  *secs = now() - t;
+  *nfetch = fetches;
+}
+
+/* Write a file of 'len' zones, one zone at a time. */
+static double write_file(int new, bit_t len)
+{
+  bit_t first, prev, b, i;
+  double dist;
+
+  first = prev = new ? new_alloc(map_bits / 3) : old_alloc(map_bits / 3);
+  dist = 0;
+  for (i = 1; i < len; i++) {
+	if (new) b = new_alloc(prev);
+	else b = old_alloc(first);
+	if (b == NO_BIT) break;
+	dist += (b > prev ? b - prev : prev - b);
+	prev = b;
+	/* Something else frees a zone now and then, near the file's start. */
+	if (i % 4 == 0) {
+		b = first + rand() % (len * 2);
+		if (b < map_bits && is_set(b) && b != first) free_one(b, new);
+	}
+  }
+  return(dist / (len - 1));
+}
+
+int main(int argc, char **argv)
+{
+  int c;
+  bitchunk_t *copy;
+  bit_t *got_old, *got_new;
+  unsigned *check;
+  double t_old, t_new;
+  long f_old, f_new, i;
+  size_t size;
+
+  while ((c = getopt(argc, argv, "b:z:f:n:")) != -1) {
+	switch (c) {
+	case 'b': block_size = atoi(optarg); break;
+	case 'z': map_bits = atol(optarg); break;
+	case 'f': percent = atoi(optarg); break;
+	case 'n': nops = atol(optarg); break;
+	default:
+		fprintf(stderr, "usage: mapbench [-b blocksize] [-z zones] "
+			"[-f percentfull] [-n nops]\n");
+		exit(1);
+	}
+  }
+  bits_per_block = block_size * 8;
+  chunks_per_block = block_size / sizeof(bitchunk_t);
+  bit_blocks = (map_bits + bits_per_block - 1) / bits_per_block;
+  size = (size_t) bit_blocks * chunks_per_block * sizeof(bitchunk_t);
+  map = malloc(size);
+  copy = malloc(size);
+  nr_free = malloc(bit_blocks * sizeof(unsigned));
+  check = malloc(bit_blocks * sizeof(unsigned));
+  got_old = malloc(nops * sizeof(bit_t));
+  got_new = malloc(nops * sizeof(bit_t));
+  if (!map || !copy || !nr_free || !check || !got_old || !got_new) {
+	fprintf(stderr, "out of memory\n");
+	exit(1);
+  }
+
+  make_image(1);
+  memcpy(copy, map, size);
+  printf("%lu zones, %u map blocks of %d bytes, %d%% full\n",
+	map_bits, bit_blocks, block_size, percent);
+
+  churn(0, got_old, &t_old, &f_old);
+  memcpy(map, copy, size);
+  count_all();
+  churn(1, got_new, &t_new, &f_new);
+
+  for (i = 0; i < nops; i++) {
+	if (got_old[i] != got_new[i]) {
+		fprintf(stderr, "allocation %ld: old %lu, new %lu\n",
+			i, got_old[i], got_new[i]);
+		exit(1);
+	}
+  }
+  memcpy(check, nr_free, bit_blocks * sizeof(unsigned));
+  count_all();
+  if (memcmp(check, nr_free, bit_blocks * sizeof(unsigned)) != 0) {
+	fprintf(stderr, "free counts don't match the map\n");
+	exit(1);
+  }
+
+  printf("old: %7.0f ns/alloc, %6.2f blocks fetched/alloc\n",
+	t_old / nops * 1e9, (double) f_old / nops);
+  printf("new: %7.0f ns/alloc, %6.2f blocks fetched/alloc\n",
+	t_new / nops * 1e9, (double) f_new / nops);
+
+  memcpy(map, copy, size);
+  srand(7);
+  printf("file, goal first zone: %8.1f zones between zones\n",
+	write_file(0, 2000));
+  memcpy(map, copy, size);
+  count_all();
+  srand(7);
+  printf("file, goal last zone:  %8.1f zones between zones\n",
+	write_file(1, 2000));
+  return(0);
+}
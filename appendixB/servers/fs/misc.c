@@ -24,6 +24,7 @@
 #include <minix/com.h>
 #include <sys/svrctl.h>
 #include "buf.h"
+#include "dcache.h"
 #include "file.h"
 #include "fproc.h"
 #include "inode.h"
@@ -54,6 +55,17 @@ PUBLIC int do_getsysinfo()
   	src_addr = (vir_bytes) dmap;
   	len = sizeof(struct dmap) * NR_DEVICES;
   	break; 
+  case SI_CACHE_STATS:
+  	cachestats.cs_bufs = nr_bufs;
+  	cachestats.cs_probation = bq_size[BQ_PROBATION];
+  	cachestats.cs_in_use = bufs_in_use;
+  	src_addr = (vir_bytes) &cachestats;
+  	len = sizeof(struct cachestats);
+  	break; 
+  case SI_NAME_STATS:
+  	src_addr = (vir_bytes) &namestats;
+  	len = sizeof(struct namestats);
+  	break; 
   default:
   	return(EINVAL);
   }
@@ -179,7 +191,7 @@ PUBLIC int do_sync()
 	if (rip->i_count > 0 && rip->i_dirt == DIRTY) rw_inode(rip, WRITING);
 
   /* Write all the dirty blocks to the disk, one drive at a time. */
-  for (bp = &buf[0]; bp < &buf[NR_BUFS]; bp++)
+  for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++)
 	if (bp->b_dev != NO_DEV && bp->b_dirt == DIRTY) flushall(bp->b_dev);
 
   return(OK);		/* sync() can't fail */
@@ -56,6 +56,7 @@ PUBLIC int do_mount()
   /* Make the cache forget about blocks it has open on the filesystem */
   (void) do_sync();
   invalidate(dev);
+  dc_purge_dev(dev);
 
   /* Fill in the super block. */
   sp->s_dev = dev;		/* read_super() needs to know which dev */
@@ -120,6 +121,7 @@ PUBLIC int do_mount()
   sp->s_imount = rip;
   sp->s_isup = root_ip;
   sp->s_rd_only = m_in.rd_only;
+  if (!sp->s_rd_only) build_summary(sp);
   return(OK);
 }
 
@@ -172,6 +174,7 @@ Dev_t dev;
   /* Sync the disk, and invalidate cache. */
   (void) do_sync();		/* force any cached blocks out of memory */
   invalidate(dev);		/* invalidate cache entries for this dev */
+  dc_purge_dev(dev);		/* and names in its directories */
   if (sp == NIL_SUPER) {
   	return(EINVAL);
   }
@@ -184,6 +187,7 @@ Dev_t dev;
   put_inode(sp->s_imount);	/* release the inode mounted on */
   put_inode(sp->s_isup);	/* release the root inode of the mounted fs */
   sp->s_imount = NIL_INODE;
+  drop_summary(sp);
   sp->s_dev = NO_DEV;
   return(OK);
 }
@@ -466,7 +466,7 @@ PUBLIC int do_lseek()
   pos = pos + m_in.offset;
 
   if (pos != rfilp->filp_pos)
-	rfilp->filp_ino->i_seek = ISEEK;	/* inhibit read ahead */
+	rfilp->filp_ra_win = 0;		/* a seek ends a sequential stream */
   rfilp->filp_pos = pos;
   m_out.reply_l1 = pos;		/* insert the long into the output message */
   return(OK);
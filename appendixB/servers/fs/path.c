@@ -273,6 +273,13 @@ int flag;			 /* LOOK_UP, ENTER, DELETE or IS_EMPTY */
 	else r = forbidden(ldir_ptr, bits); /* check access permissions */
   }
   if (r != OK) return(r);
+
+  /* A name looked up before need not be searched for again.  A name that
+   * is entered or deleted is dropped from the cache.
+   */
+  if (flag == LOOK_UP && dc_lookup(ldir_ptr, string, numb))
+	return(*numb == NO_ENTRY ? ENOENT : OK);
+  if (flag == ENTER || flag == DELETE) dc_purge(ldir_ptr, string);
   
   /* Step through the directory one block at a time. */
   old_slots = (unsigned) (ldir_ptr->i_size/DIR_ENTRY_SIZE);
@@ -326,6 +333,7 @@ int flag;			 /* LOOK_UP, ENTER, DELETE or IS_EMPTY */
 			} else {
 				sp = ldir_ptr->i_sp;	/* 'flag' is LOOK_UP */
 				*numb = conv4(sp->s_native, (int) dp->d_ino);
+				dc_enter(ldir_ptr, string, *numb);
 			}
 			put_block(bp, DIRECTORY_BLOCK);
 			return(r);
@@ -345,6 +353,8 @@ int flag;			 /* LOOK_UP, ENTER, DELETE or IS_EMPTY */
 
   /* The whole directory has now been searched. */
   if (flag != ENTER) {
+	// 记住名字不存在 (负项).
+	if (flag == LOOK_UP) dc_enter(ldir_ptr, string, NO_ENTRY);
   	return(flag == IS_EMPTY ? OK : ENOENT);
   }
 
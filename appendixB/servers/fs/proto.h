@@ -13,15 +13,27 @@ _PROTOTYPE( zone_t alloc_zone, (Dev_t dev, zone_t z)			);
 _PROTOTYPE( void flushall, (Dev_t dev)					);
 _PROTOTYPE( void free_zone, (Dev_t dev, zone_t numb)			);
 _PROTOTYPE( struct buf *get_block, (Dev_t dev, block_t block,int only_search));
+_PROTOTYPE( int in_cache, (Dev_t dev, block_t block)			);
 _PROTOTYPE( void invalidate, (Dev_t device)				);
 _PROTOTYPE( void put_block, (struct buf *bp, int block_type)		);
 _PROTOTYPE( void rw_block, (struct buf *bp, int rw_flag)		);
 _PROTOTYPE( void rw_scattered, (Dev_t dev,
 			struct buf **bufq, int bufqsize, int rw_flag)	);
 
+/* dcache.c */
+_PROTOTYPE( void init_dcache, (void)					);
+_PROTOTYPE( int dc_lookup, (struct inode *dirp, char string[NAME_MAX],
+							ino_t *numb)	);
+_PROTOTYPE( void dc_enter, (struct inode *dirp, char string[NAME_MAX],
+							ino_t numb)	);
+_PROTOTYPE( void dc_purge, (struct inode *dirp, char string[NAME_MAX])	);
+_PROTOTYPE( void dc_purge_dir, (Dev_t dev, ino_t dir)			);
+_PROTOTYPE( void dc_purge_dev, (Dev_t dev)				);
+
 /* device.c */
 _PROTOTYPE( int dev_open, (Dev_t dev, int proc, int flags)		);
 _PROTOTYPE( void dev_close, (Dev_t dev)					);
+_PROTOTYPE( void init_grants, (void)					);
 _PROTOTYPE( int dev_io, (int op, Dev_t dev, int proc, void *buf,
 			off_t pos, int bytes, int flags)		);
 _PROTOTYPE( int gen_opcl, (int op, Dev_t dev, int proc, int flags)	);
@@ -145,6 +157,8 @@ _PROTOTYPE( int do_fstatfs, (void)					);
 
 /* super.c */
 _PROTOTYPE( bit_t alloc_bit, (struct super_block *sp, int map, bit_t origin));
+_PROTOTYPE( void build_summary, (struct super_block *sp)		);
+_PROTOTYPE( void drop_summary, (struct super_block *sp)			);
 _PROTOTYPE( void free_bit, (struct super_block *sp, int map,
 						bit_t bit_returned)	);
 _PROTOTYPE( struct super_block *get_super, (Dev_t dev)			);
@@ -24,6 +24,8 @@
 FORWARD _PROTOTYPE( int rw_chunk, (struct inode *rip, off_t position,
 	unsigned off, int chunk, unsigned left, int rw_flag,
 	char *buff, int seg, int usr, int block_size, int *completed));
+FORWARD _PROTOTYPE( int ra_collect, (struct inode *rip, Dev_t dev,
+	off_t position, unsigned nr_blocks, struct buf **read_q));
 
 /*===========================================================================*
  *				do_read					     *
@@ -154,6 +156,22 @@ int rw_flag;			/* READING or WRITING */
 
 	if (partial_cnt > 0) partial_pipe = 1;
 
+	/* A read that starts where the last read of this file ended goes on
+	 * with a sequential stream, and doubles its read-ahead window.  A read
+	 * anywhere else ends the stream.
+	 */
+	// 顺序读时预读窗口加倍, 否则关闭预读.
+	rdahedwin = 0;
+	if (rw_flag == READING && rip->i_pipe != I_PIPE) {
+		if (position != f->filp_ra_next)
+			f->filp_ra_win = 0;
+		else if (f->filp_ra_win == 0)
+			f->filp_ra_win = RA_MIN;
+		else
+			f->filp_ra_win = MIN(2 * f->filp_ra_win, RA_MAX(nr_bufs));
+		rdahedwin = f->filp_ra_win;
+	}
+
 	/* Split the transfer into chunks that don't span two blocks. */
 	while (m_in.nbytes != 0) {
 
@@ -209,12 +227,13 @@ int rw_flag;			/* READING or WRITING */
   f->filp_pos = position;
 
   /* Check to see if read-ahead is called for, and if so, set it up. */
-  if (rw_flag == READING && rip->i_seek == NO_SEEK && position % block_size== 0
-		&& (regular || mode_word == I_DIRECTORY)) {
-	rdahed_inode = rip;
-	rdahedpos = position;
+  if (rw_flag == READING) {
+	f->filp_ra_next = position;
+	if (rdahedwin != 0 && (regular || mode_word == I_DIRECTORY)) {
+		rdahed_inode = rip;
+		rdahedpos = position;
+	}
   }
-  rip->i_seek = NO_SEEK;
 
   if (rdwt_err != OK) r = rdwt_err;	/* check for disk error */
   if (rdwt_err == END_OF_FILE) r = OK;
@@ -292,6 +311,19 @@ int *completed;			/* number of bytes copied */
 		if ((bp= new_block(rip, position)) == NIL_BUF)return(err_code);
 	}
   } else if (rw_flag == READING) {
+	/* A whole block that isn't cached, when there is nothing to read
+	 * ahead, goes from the driver straight into the user's buffer rather
+	 * than through a cache buffer and a copy.  If that fails for any
+	 * reason, the block is read the usual way, which reports the error.
+	 */
+	if (off == 0 && chunk == block_size && left <= block_size &&
+	    rdahedwin == 0 && seg == D && !in_cache(dev, b) &&
+	    dev_io(DEV_READ, dev, usr, buff, (off_t) b * block_size,
+		   block_size, 0) == block_size) {
+		*completed = chunk;
+		return(OK);
+	}
+
 	/* Read and read ahead if convenient. */
 	bp = rahead(rip, b, position, left);
   } else {
@@ -432,18 +464,32 @@ int index;			/* index into *bp */
  *===========================================================================*/
 PUBLIC void read_ahead()
 {
-/* Read a block into the cache before it is needed. */
-  int block_size;
+/* Read the blocks in the window of a sequential stream into the cache before
+ * they are needed.  This is done after the reply to the read, so the reader
+ * doesn't wait for it.  The window is only read once the block in its middle
+ * is missing, so the blocks go to the disk in large requests, and are there
+ * before the reader catches up with them.
+ */
+  int block_size, n;
   register struct inode *rip;
-  struct buf *bp;
+  off_t pos, mid;
   block_t b;
+  static struct buf *read_q[NR_IOREQS];
 
   rip = rdahed_inode;		/* pointer to inode to read ahead from */
   block_size = get_block_size(rip->i_dev);
   rdahed_inode = NIL_INODE;	/* turn off read ahead */
-  if ( (b = read_map(rip, rdahedpos)) == NO_BLOCK) return;	/* at EOF */
-  bp = rahead(rip, b, rdahedpos, block_size);
-  put_block(bp, PARTIAL_DATA_BLOCK);
+  pos = rdahedpos - rdahedpos % block_size;
+  if (pos >= rip->i_size) return;	/* at EOF */
+
+  // 窗口中间的块还在缓存中时, 先不读.
+  mid = pos + (off_t) (rdahedwin / 2) * block_size;
+  if (mid >= rip->i_size) mid = rip->i_size - 1;
+  if ( (b = read_map(rip, mid)) != NO_BLOCK && in_cache(rip->i_dev, b))
+	return;
+
+  n = ra_collect(rip, rip->i_dev, pos, rdahedwin, read_q);
+  if (n > 0) rw_scattered(rip->i_dev, read_q, n, READING);
 }
 
 /*===========================================================================*
@@ -456,22 +502,18 @@ off_t position;			/* position within file */
 unsigned bytes_ahead;		/* bytes beyond position for immediate use */
 {
 /* Fetch a block from the cache or the device.  If a physical read is
- * required, prefetch as many more blocks as convenient into the cache.
- * This usually covers bytes_ahead and is at least BLOCKS_MINIMUM.
- * The device driver may decide it knows better and stop reading at a
- * cylinder boundary (or after an error).  Rw_scattered() puts an optional
- * flag on all reads to allow this.
+ * required, prefetch more blocks of the file into the cache as well: those
+ * that cover bytes_ahead, and at least the read-ahead window of a sequential
+ * stream, but nothing more after a seek.  The device driver may decide it
+ * knows better and stop reading at a cylinder boundary (or after an error).
+ * Rw_scattered() puts an optional flag on all reads to allow this.
  */
   int block_size;
-/* Minimum number of blocks to prefetch. */
-# define BLOCKS_MINIMUM		(NR_BUFS < 50 ? 18 : 32)
-  int block_spec, scale, read_q_size;
+  int block_spec, read_q_size;
   unsigned int blocks_ahead, fragment;
-  block_t block, blocks_left;
-  off_t ind1_pos;
   dev_t dev;
   struct buf *bp;
-  static struct buf *read_q[NR_BUFS];
+  static struct buf *read_q[NR_IOREQS];
 
   block_spec = (rip->i_mode & I_TYPE) == I_BLOCK_SPECIAL;
   if (block_spec) {
@@ -481,82 +523,74 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
   }
   block_size = get_block_size(dev);
 
-  block = baseblock;
-  bp = get_block(dev, block, PREFETCH);
+  bp = get_block(dev, baseblock, PREFETCH);
   if (bp->b_dev != NO_DEV) return(bp);
 
-  /* The best guess for the number of blocks to prefetch:  A lot.
-   * It is impossible to tell what the device looks like, so we don't even
-   * try to guess the geometry, but leave it to the driver.
-   *
-   * The floppy driver can read a full track with no rotational delay, and it
-   * avoids reading partial tracks if it can, so handing it enough buffers to
-   * read two tracks is perfect.  (Two, because some diskette types have
-   * an odd number of sectors per track, so a block may span tracks.)
-   *
-   * The disk drivers don't try to be smart.  With todays disks it is
-   * impossible to tell what the real geometry looks like, so it is best to
-   * read as much as you can.  With luck the caching on the drive allows
-   * for a little time to start the next read.
-   *
-   * The current solution below is a bit of a hack, it just reads blocks from
-   * the current file position hoping that more of the file can be found.  A
-   * better solution must look at the already available zone pointers and
-   * indirect blocks (but don't call read_map!).
+  /* It is impossible to tell what the device looks like, so we don't even
+   * try to guess the geometry, but leave it to the driver.  The blocks to
+   * prefetch are found through the zone pointers and indirect blocks, not
+   * by guessing that the file goes on at the next block of the device, so
+   * a fragmented file gets its own blocks and no garbage.  Rw_scattered()
+   * reads each run of adjacent blocks with one request.
    */
-
   fragment = position % block_size;
   position -= fragment;
   bytes_ahead += fragment;
 
   blocks_ahead = (bytes_ahead + block_size - 1) / block_size;
-
-  if (block_spec && rip->i_size == 0) {
-	blocks_left = NR_IOREQS;
-  } else {
-	blocks_left = (rip->i_size - position + block_size - 1) / block_size;
-
-	/* Go for the first indirect block if we are in its neighborhood. */
-	if (!block_spec) {
-		scale = rip->i_sp->s_log_zone_size;
-		ind1_pos = (off_t) rip->i_ndzones * (block_size << scale);
-		if (position <= ind1_pos && rip->i_size > ind1_pos) {
-			blocks_ahead++;
-			blocks_left++;
-		}
-	}
-  }
+  if (blocks_ahead < rdahedwin) blocks_ahead = rdahedwin;
 
   /* No more than the maximum request. */
   if (blocks_ahead > NR_IOREQS) blocks_ahead = NR_IOREQS;
 
-  /* Read at least the minimum number of blocks, but not after a seek. */
-  if (blocks_ahead < BLOCKS_MINIMUM && rip->i_seek == NO_SEEK)
-	blocks_ahead = BLOCKS_MINIMUM;
-
-  /* Can't go past end of file. */
-  if (blocks_ahead > blocks_left) blocks_ahead = blocks_left;
+  read_q[0] = bp;
+  read_q_size = 1;
+  if (blocks_ahead > 1) {
+	read_q_size += ra_collect(rip, dev, position + block_size,
+		blocks_ahead - 1, &read_q[1]);
+  }
+  rw_scattered(dev, read_q, read_q_size, READING);
+  return(get_block(dev, baseblock, NORMAL));
+}
 
-  read_q_size = 0;
+/*===========================================================================*
+ *				ra_collect				     *
+ *===========================================================================*/
+PRIVATE int ra_collect(rip, dev, position, nr_blocks, read_q)
+register struct inode *rip;	/* pointer to inode for file to be read */
+dev_t dev;			/* device the blocks are on */
+off_t position;			/* block aligned position to start at */
+unsigned nr_blocks;		/* number of blocks of the file to look at */
+struct buf **read_q;		/* buffers to be read are put here */
+{
+/* Acquire buffers for the blocks of a file from position on, so they can be
+ * read by rw_scattered().  Blocks of block special files follow each other,
+ * those of other files are looked up in the zone map.  Blocks in the cache
+ * already and holes in the file are skipped.  Return the number of buffers.
+ */
+  int block_spec, block_size, n;
+  block_t b;
 
-  /* Acquire block buffers. */
-  for (;;) {
-	read_q[read_q_size++] = bp;
+  block_spec = (rip->i_mode & I_TYPE) == I_BLOCK_SPECIAL;
+  block_size = get_block_size(dev);
 
-	if (--blocks_ahead == 0) break;
+  for (n = 0; nr_blocks > 0; nr_blocks--, position += block_size) {
+	/* Can't go past end of file, but a device may not know its size. */
+	if (position >= rip->i_size && !(block_spec && rip->i_size == 0))
+		break;
 
 	/* Don't trash the cache, leave 4 free. */
-	if (bufs_in_use >= NR_BUFS - 4) break;
+	if (bufs_in_use >= nr_bufs - 4) break;
 
-	block++;
-
-	bp = get_block(dev, block, PREFETCH);
-	if (bp->b_dev != NO_DEV) {
-		/* Oops, block already in the cache, get out. */
-		put_block(bp, FULL_DATA_BLOCK);
-		break;
+	// 通过 i_zone[] 和间接块找到文件的下一块, 空洞不读.
+	if (block_spec) {
+		b = position / block_size;
+	} else {
+		if ( (b = read_map(rip, position)) == NO_BLOCK) continue;
 	}
+
+	if (in_cache(dev, b)) continue;	/* block already in the cache */
+	read_q[n++] = get_block(dev, b, PREFETCH);
   }
-  rw_scattered(dev, read_q, read_q_size, READING);
-  return(get_block(dev, baseblock, NORMAL));
+  return(n);
 }
@@ -1,11 +1,15 @@
 /* This file manages the super block table and the related data structures,
  * namely, the bit maps that keep track of which zones and which inodes are
  * allocated and which are free.  When a new inode or zone is needed, the
- * appropriate bit map is searched for a free entry.
+ * appropriate bit map is searched for a free entry.  For every block of the
+ * bit maps, the number of free bits in it is kept in core, so that full
+ * blocks are skipped without reading them.
  *
  * The entry points into this file are
  *   alloc_bit:       somebody wants to allocate a zone or inode; find one
  *   free_bit:        indicate that a zone or inode is available for allocation
+ *   build_summary:   count the free bits in every bit map block at mount time
+ *   drop_summary:    release those counts at unmount time
  *   get_super:       search the 'superblock' table for a device
  *   mounted:         tells if file inode is on mounted (or ROOT) file system
  *   read_super:      read a superblock
@@ -13,12 +17,18 @@
 
 #include "fs.h"
 #include <string.h>
+#include <stdlib.h>
 #include <minix/com.h>
 #include "buf.h"
 #include "inode.h"
 #include "super.h"
 #include "const.h"
 
+FORWARD _PROTOTYPE( int first_free, (struct super_block *sp, struct buf *bp,
+	unsigned word)						);
+FORWARD _PROTOTYPE( unsigned count_free, (struct super_block *sp,
+	struct buf *bp, bit_t nr_bits)				);
+
 /*===========================================================================*
  *				alloc_bit				     *
  *===========================================================================*/
@@ -27,15 +37,18 @@ struct super_block *sp;		/* the filesystem to allocate from */
 int map;			/* IMAP (inode map) or ZMAP (zone map) */
 bit_t origin;			/* number of bit to start searching at */
 {
-/* Allocate a bit from a bit map and return its bit number. */
+/* Allocate a bit from a bit map and return its bit number.  The search
+ * starts at 'origin', so that a new zone lands near the zone before it.
+ */
 
   block_t start_block;		/* first bit block */
   bit_t map_bits;		/* how many bits are there in the bit map? */
   unsigned bit_blocks;		/* how many blocks are there in the bit map? */
-  unsigned block, word, bcount;
+  unsigned block, word, bcount, *nr_free;
   struct buf *bp;
-  bitchunk_t *wptr, *wlim, k;
-  bit_t i, b;
+  bitchunk_t *wptr, k;
+  bit_t b;
+  int i;
 
   if (sp->s_rd_only)
 	panic(__FILE__,"can't allocate bit on read-only filesys.", NO_NUM);
@@ -44,10 +57,12 @@ bit_t origin;			/* number of bit to start searching at */
 	start_block = START_BLOCK;
 	map_bits = sp->s_ninodes + 1;
 	bit_blocks = sp->s_imap_blocks;
+	nr_free = sp->s_ifree;
   } else {
 	start_block = START_BLOCK + sp->s_imap_blocks;
 	map_bits = sp->s_zones - (sp->s_firstdatazone - 1);
 	bit_blocks = sp->s_zmap_blocks;
+	nr_free = sp->s_zfree;
   }
 
   /* Figure out where to start the bit search (depends on 'origin'). */
@@ -60,34 +75,34 @@ bit_t origin;			/* number of bit to start searching at */
   /* Iterate over all blocks plus one, because we start in the middle. */
   bcount = bit_blocks + 1;
   do {
+	// 空闲计数为 0 的位图块不必读入.
+	if (nr_free != NIL_COUNT && nr_free[block] == 0) {
+		if (++block >= bit_blocks) block = 0;
+		word = 0;
+		continue;
+	}
 	bp = get_block(sp->s_dev, start_block + block, NORMAL);
-	wlim = &bp->b_bitmap[FS_BITMAP_CHUNKS(sp->s_block_size)];
-
-	/* Iterate over the words in block. */
-	for (wptr = &bp->b_bitmap[word]; wptr < wlim; wptr++) {
-
-		/* Does this word contain a free bit? */
-		if (*wptr == (bitchunk_t) ~0) continue;
-
-		/* Find and allocate the free bit. */
-		k = conv2(sp->s_native, (int) *wptr);
-		for (i = 0; (k & (1 << i)) != 0; ++i) {}
 
+	if ( (i = first_free(sp, bp, word)) >= 0) {
 		/* Bit number from the start of the bit map. */
-		b = ((bit_t) block * FS_BITS_PER_BLOCK(sp->s_block_size))
-		    + (wptr - &bp->b_bitmap[0]) * FS_BITCHUNK_BITS
-		    + i;
+		b = ((bit_t) block * FS_BITS_PER_BLOCK(sp->s_block_size)) + i;
 
 		/* Don't allocate bits beyond the end of the map. */
-		if (b >= map_bits) break;
-
-		/* Allocate and return bit number. */
-		k |= 1 << i;
-		*wptr = conv2(sp->s_native, (int) k);
-		bp->b_dirt = DIRTY;
-		put_block(bp, MAP_BLOCK);
-		return(b);
+		if (b < map_bits) {
+			/* Allocate and return bit number. */
+			wptr = &bp->b_bitmap[i / FS_BITCHUNK_BITS];
+			k = conv2(sp->s_native, (int) *wptr);
+			k |= 1 << (i % FS_BITCHUNK_BITS);
+			*wptr = conv2(sp->s_native, (int) k);
+			bp->b_dirt = DIRTY;
+			put_block(bp, MAP_BLOCK);
+			if (nr_free != NIL_COUNT) nr_free[block]--;
+			return(b);
+		}
 	}
+
+	/* The whole block was searched and is full, whatever the count said. */
+	if (word == 0 && nr_free != NIL_COUNT) nr_free[block] = 0;
 	put_block(bp, MAP_BLOCK);
 	if (++block >= bit_blocks) block = 0;	/* last block, wrap around */
 	word = 0;
@@ -95,6 +110,47 @@ bit_t origin;			/* number of bit to start searching at */
   return(NO_BIT);		/* no bit could be allocated */
 }
 
+/*===========================================================================*
+ *				first_free				     *
+ *===========================================================================*/
+PRIVATE int first_free(sp, bp, word)
+struct super_block *sp;		/* the filesystem the map is on */
+struct buf *bp;			/* bit map block to search */
+unsigned word;			/* number of the chunk to start at */
+{
+/* Return the number of the first zero bit in a bit map block at or after
+ * chunk 'word', or -1 if there is none.  Full chunks are skipped a long at a
+ * time; all ones need no byte swapping, so they can be compared as they are.
+ */
+  bitchunk_t *wptr, *wlim;
+  unsigned long *lptr;
+  unsigned k;
+  int i;
+
+  wptr = &bp->b_bitmap[word];
+  wlim = &bp->b_bitmap[FS_BITMAP_CHUNKS(sp->s_block_size)];
+
+  /* Go chunk by chunk up to a long boundary, then a long at a time. */
+  while (wptr < wlim && (vir_bytes) wptr % sizeof(long) != 0
+					&& *wptr == (bitchunk_t) ~0) wptr++;
+  if (wptr < wlim && (vir_bytes) wptr % sizeof(long) == 0) {
+	lptr = (unsigned long *) wptr;
+	while (lptr < (unsigned long *) wlim && *lptr == ~0UL) lptr++;
+	wptr = (bitchunk_t *) lptr;
+	while (wptr < wlim && *wptr == (bitchunk_t) ~0) wptr++;
+  }
+  if (wptr >= wlim) return(-1);
+
+  /* Find the free bit in the chunk. */
+  k = (bitchunk_t) conv2(sp->s_native, (int) *wptr);
+#if __GNUC__
+  i = __builtin_ctz(~k);
+#else
+  for (i = 0; (k & (1 << i)) != 0; ++i) {}
+#endif
+  return((wptr - &bp->b_bitmap[0]) * FS_BITCHUNK_BITS + i);
+}
+
 /*===========================================================================*
  *				free_bit				     *
  *===========================================================================*/
@@ -138,6 +194,94 @@ bit_t bit_returned;		/* number of bit to insert into the map */
   bp->b_dirt = DIRTY;
 
   put_block(bp, MAP_BLOCK);
+  if (map == IMAP && sp->s_ifree != NIL_COUNT) sp->s_ifree[block]++;
+  if (map == ZMAP && sp->s_zfree != NIL_COUNT) sp->s_zfree[block]++;
+}
+
+/*===========================================================================*
+ *				build_summary				     *
+ *===========================================================================*/
+PUBLIC void build_summary(sp)
+struct super_block *sp;		/* the file system just mounted */
+{
+/* Count the free bits in every block of both bit maps, so that alloc_bit()
+ * can pass over full blocks without reading them.  If there is no memory
+ * for the counts, alloc_bit() simply reads every block, as it used to.
+ */
+  unsigned *nr_free;
+  bit_t map_bits, per_block;
+  unsigned bit_blocks, block;
+  block_t start_block;
+  struct buf *bp;
+  int map;
+
+  per_block = FS_BITS_PER_BLOCK(sp->s_block_size);
+  for (map = IMAP; map <= ZMAP; map++) {
+	if (map == IMAP) {
+		start_block = START_BLOCK;
+		map_bits = sp->s_ninodes + 1;
+		bit_blocks = sp->s_imap_blocks;
+	} else {
+		start_block = START_BLOCK + sp->s_imap_blocks;
+		map_bits = sp->s_zones - (sp->s_firstdatazone - 1);
+		bit_blocks = sp->s_zmap_blocks;
+	}
+	nr_free = (unsigned *) malloc(bit_blocks * sizeof(unsigned));
+	if (nr_free == NIL_COUNT) break;
+
+	// 最后一块中超出位图末尾的位不计入.
+	for (block = 0; block < bit_blocks; block++) {
+		bp = get_block(sp->s_dev, start_block + block, NORMAL);
+		nr_free[block] = count_free(sp, bp,
+			map_bits > per_block ? per_block : map_bits);
+		put_block(bp, MAP_BLOCK);
+		map_bits -= (map_bits > per_block ? per_block : map_bits);
+	}
+	if (map == IMAP) sp->s_ifree = nr_free; else sp->s_zfree = nr_free;
+  }
+}
+
+/*===========================================================================*
+ *				drop_summary				     *
+ *===========================================================================*/
+PUBLIC void drop_summary(sp)
+struct super_block *sp;		/* the file system being unmounted */
+{
+/* Release the counts of free bits made by build_summary(). */
+
+  if (sp->s_ifree != NIL_COUNT) free(sp->s_ifree);
+  if (sp->s_zfree != NIL_COUNT) free(sp->s_zfree);
+  sp->s_ifree = sp->s_zfree = NIL_COUNT;
+}
+
+/*===========================================================================*
+ *				count_free				     *
+ *===========================================================================*/
+PRIVATE unsigned count_free(sp, bp, nr_bits)
+struct super_block *sp;		/* the filesystem the map is on */
+struct buf *bp;			/* bit map block to count */
+bit_t nr_bits;			/* the bits of the map in this block */
+{
+/* Return the number of zero bits among the first 'nr_bits' of a block. */
+
+  bitchunk_t *wptr;
+  unsigned k, zeros;
+  bit_t bits;
+
+  zeros = 0;
+  for (wptr = &bp->b_bitmap[0], bits = 0; bits < nr_bits;
+					wptr++, bits += FS_BITCHUNK_BITS) {
+	k = (bitchunk_t) conv2(sp->s_native, (int) *wptr);
+	if (nr_bits - bits < FS_BITCHUNK_BITS)
+		k |= ~((1 << (nr_bits - bits)) - 1);	/* past end of map */
+	k = (bitchunk_t) ~k;
+#if __GNUC__
+	zeros += __builtin_popcount(k);
+#else
+	for ( ; k != 0; k &= k - 1) zeros++;
+#endif
+  }
+  return(zeros);
 }
 
 /*===========================================================================*
@@ -302,6 +446,7 @@ register struct super_block *sp; /* pointer to a superblock */
 
   sp->s_isearch = 0;		/* inode searches initially start at 0 */
   sp->s_zsearch = 0;		/* zone searches initially start at 0 */
+  sp->s_ifree = sp->s_zfree = NIL_COUNT;	/* no counts until mounted */
   sp->s_version = version;
   sp->s_native  = native;
 
@@ -52,8 +52,11 @@ EXTERN struct super_block {
   int s_nindirs;		/* # indirect zones per indirect block */
   bit_t s_isearch;		/* inodes below this bit number are in use */
   bit_t s_zsearch;		/* all zones below this bit number are in use*/
+  unsigned *s_ifree;		/* free bits in each inode map block */
+  unsigned *s_zfree;		/* free bits in each zone map block */
 } super_block[NR_SUPERS];
 
 #define NIL_SUPER (struct super_block *) 0
+#define NIL_COUNT (unsigned *) 0	/* no free bit counts for a map */
 #define IMAP		0	/* operating on the inode bit map */
 #define ZMAP		1	/* operating on the zone bit map */
@@ -8,6 +8,7 @@
 #include <minix/callnr.h>
 #include <minix/com.h>
 #include "buf.h"
+#include "dcache.h"
 #include "file.h"
 #include "fproc.h"
 #include "inode.h"
@@ -203,16 +203,21 @@ off_t position;			/* file pointer */
 
   /* Is another block available in the current zone? */
   if ( (b = read_map(rip, position)) == NO_BLOCK) {
-	/* Choose first zone if possible. */
-	/* Lose if the file is nonempty but the first zone number is NO_ZONE
-	 * corresponding to a zone full of zeros.  It would be better to
-	 * search near the last real zone.
+	/* Hunt right after the zone before this one, so that the file stays
+	 * contiguous.  If that is a hole, hunt near the first zone, or if the
+	 * first zone is a hole too, where the free zones start.
 	 */
-	if (rip->i_zone[0] == NO_ZONE) {
+	scale = rip->i_sp->s_log_zone_size;
+	zone_size = (zone_t) rip->i_sp->s_block_size << scale;
+	z = NO_ZONE;
+	if (position >= zone_size &&
+	    (b = read_map(rip, position - zone_size)) != NO_BLOCK) {
+		z = (zone_t) (b >> scale);	/* zone before this one */
+	}
+	if (z == NO_ZONE) z = rip->i_zone[0];	/* hunt near first zone */
+	if (z == NO_ZONE) {
 		sp = rip->i_sp;
 		z = sp->s_firstdatazone;
-	} else {
-		z = rip->i_zone[0];	/* hunt near first zone */
 	}
 	if ( (z = alloc_zone(rip->i_dev, z)) == NO_ZONE) return(NIL_BUF);
 	if ( (r = write_map(rip, position, z)) != OK) {
@@ -223,9 +228,7 @@ off_t position;			/* file pointer */
 
 	/* If we are not writing at EOF, clear the zone, just to be safe. */
 	if ( position != rip->i_size) clear_zone(rip, position, 1);
-	scale = rip->i_sp->s_log_zone_size;
 	base_block = (block_t) z << scale;
-	zone_size = (zone_t) rip->i_sp->s_block_size << scale;
 	b = base_block + (block_t)((position % zone_size)/rip->i_sp->s_block_size);
   }
 
@@ -1,32 +1,46 @@
 /* This file is concerned with allocating and freeing arbitrary-size blocks of
  * physical memory on behalf of the FORK and EXEC system calls.  The key data
- * structure used is the hole table, which maintains a list of holes in memory.
- * It is kept sorted in order of increasing memory address. The addresses
- * it contains refers to physical memory, starting at absolute address 0
- * (i.e., they are not relative to the start of PM).  During system
+ * structure used is the hole table, which maintains the holes in memory.
+ * The addresses it contains refers to physical memory, starting at absolute
+ * address 0 (i.e., they are not relative to the start of PM).  During system
  * initialization, that part of memory containing the interrupt vectors,
  * kernel, and PM are "allocated" to mark them as not available and to
- * remove them from the hole list.
+ * remove them from the hole tree.
+ *
+ * The holes are kept in a binary search tree ordered by address.  Each node
+ * also records the largest hole in its subtree, so alloc_mem() can go
+ * straight down to the first hole that is big enough, and free_mem() finds
+ * the neighbours to merge with the same way.  The tree is a treap: every
+ * table slot has a fixed random priority, and a parent's priority is always
+ * above its children's, which keeps the tree balanced in the expected case.
+ * Allocating and freeing take O(log n) steps for n holes, instead of a walk
+ * along a list, and the largest hole is known at the root.
  *
  * The entry points into this file are:
  *   alloc_mem:	allocate a given sized chunk of memory
  *   free_mem:	release a previously allocated chunk of memory
  *   mem_init:	initialize the tables when PM start up
- *   max_hole:	returns the largest hole currently available
+ *   mem_stats:	report free memory, largest hole and fragmentation
  */
 /*
  * 这个文件涉及任意大小内存块的分配与释放, 代表 FORK 与 EXEC 系统调用.
- * 使用的关键数据结构是空洞表, 这个表维护着内存中空洞的一份列表. 按照
- * 内存地址的升序排列. 这张表包含的地址引用了从绝对地址 0 开始的物理地
- * 址(也就是说, 表里的地址并不相对于 PM). 在系统初始化过程中, 这部分内
- * 存包含了中断向量表, 内核和 PM 被分配存储空间, 使得中断向量表不再有
- * 效, 并将它从空间列表中移除.
+ * 使用的关键数据结构是空洞表, 这个表维护着内存中的空洞. 这张表包含的地址
+ * 引用了从绝对地址 0 开始的物理地址(也就是说, 表里的地址并不相对于 PM).
+ * 在系统初始化过程中, 这部分内存包含了中断向量表, 内核和 PM 被分配存储
+ * 空间, 使得中断向量表不再有效, 并将它从空间列表中移除.
+ *
+ * 空洞保存在一棵按地址排序的二叉查找树中. 每个节点还记录了它的子树中
+ * 最大的空洞, 所以 alloc_mem() 可以直接向下找到第一个足够大的空洞,
+ * free_mem() 也用同样的方式找到可以合并的相邻空洞. 这棵树是一个 treap:
+ * 表中每一项有一个固定的随机优先级, 父节点的优先级总是高于子节点, 这样
+ * 树的期望高度是对数级的. 分配与释放只需 O(log n) 步, 不再需要遍历链表,
+ * 而最大的空洞就记录在根节点中.
  *
  * 这个文件的入口点包括:
  *	alloc_mem:	分配一个给定大小的内存块
  *	free_mem:	释放一个内存块
  *	mem_init:	当 PM 启动时, 初始化表格
- *	max_hole:	返回当前可用的最大空洞大小
+ *	mem_stats:	报告空闲内存, 最大空洞与碎片程度
  */
 
 #include "pm.h"
@@ -39,22 +53,35 @@
 #include "../../kernel/config.h"
 #include "../../kernel/type.h"
 
-#define NR_HOLES  (2*NR_PROCS)	/* max # entries in hole table */
+/* Each process has at most two blocks, text and data, and each block splits
+ * at most one hole in two.  The chunks of memory at startup and the blocks
+ * handed out by do_allocmem() account for the rest.
+ */
+#define NR_HOLES  (2*NR_PROCS + 2*NR_MEMS + 16)	/* max # entries in table */
 #define NIL_HOLE (struct hole *) 0
 
 PRIVATE struct hole {
-  struct hole *h_next;		/* pointer to next entry on the list */
+  struct hole *h_left;		/* holes at lower addresses */
+  struct hole *h_right;		/* holes at higher addresses */
+  unsigned h_prio;		/* treap priority, fixed per slot */
   phys_clicks h_base;		/* where does the hole begin? */
   phys_clicks h_len;		/* how big is the hole? */
+  phys_clicks h_max;		/* largest h_len in this subtree */
 } hole[NR_HOLES];
 
-PRIVATE struct hole *hole_head;	/* pointer to first hole */
+PRIVATE struct hole *hole_root;	/* root of the tree of holes */
 PRIVATE struct hole *free_slots;/* ptr to list of unused table slots */
-// #define swap_base 0xff...ff
-#define swap_base ((phys_clicks) -1)
+PRIVATE struct memstats stats;	/* counters for mem_stats() */
 
-FORWARD _PROTOTYPE( void del_slot, (struct hole *prev_ptr, struct hole *hp) );
-FORWARD _PROTOTYPE( void merge, (struct hole *hp)			    );
+FORWARD _PROTOTYPE( phys_clicks take, (struct hole **rootp,
+						phys_clicks clicks)	    );
+FORWARD _PROTOTYPE( void fix, (struct hole *hp)				    );
+FORWARD _PROTOTYPE( struct hole *join, (struct hole *lp, struct hole *rp)   );
+FORWARD _PROTOTYPE( void ins_hole, (struct hole **rootp, struct hole *hp)  );
+FORWARD _PROTOTYPE( void del_hole, (struct hole **rootp, struct hole *hp)  );
+FORWARD _PROTOTYPE( void upd_hole, (struct hole **rootp, struct hole *hp)  );
+FORWARD _PROTOTYPE( struct hole *new_slot, (void)			    );
+FORWARD _PROTOTYPE( void del_slot, (struct hole *hp)			    );
 #define swap_out()	(0)
 
 /*===========================================================================*
@@ -63,47 +90,71 @@ FORWARD _PROTOTYPE( void merge, (struct hole *hp)			    );
 PUBLIC phys_clicks alloc_mem(clicks)
 phys_clicks clicks;		/* amount of memory requested */
 {
-/* Allocate a block of memory from the free list using first fit. The block
+/* Allocate a block of memory from the hole tree using first fit. The block
  * consists of a sequence of contiguous bytes, whose length in clicks is
  * given by 'clicks'.  A pointer to the block is returned.  The block is
  * always on a click boundary.  This procedure is called when memory is
  * needed for FORK or EXEC.  Swap other processes out if needed.
  */
 /*
- * 从空闲列表使用首次匹配算法分配一个内存块. 分配的内存是一块地址连续的内
- * 存, 长度以 click 为单位, 由输入参数决定. 返回指向该内存块的指针. 内存 
+ * 从空洞树使用首次匹配算法分配一个内存块. 分配的内存是一块地址连续的内
+ * 存, 长度以 click 为单位, 由输入参数决定. 返回指向该内存块的指针. 内存
  * 块总是 click 对齐. 当 FORK 或 EXEC 需要内存时就会调用该函数. 必要时交
  * 换将进程从内存中交换出去.
  */
-  register struct hole *hp, *prev_ptr;
   phys_clicks old_base;
 
   do {
-        prev_ptr = NIL_HOLE;
-	hp = hole_head;
-	while (hp != NIL_HOLE && hp->h_base < swap_base) {
-		// 首次匹配算法
-		if (hp->h_len >= clicks) {
-			/* We found a hole that is big enough.  Use it. */
-			old_base = hp->h_base;	/* remember where it started */
-			hp->h_base += clicks;	/* bite a piece off */
-			hp->h_len -= clicks;	/* ditto */
-
-			/* Delete the hole if used up completely. */
-			if (hp->h_len == 0) del_slot(prev_ptr, hp);
-
-			/* Return the start address of the acquired block. */
-			return(old_base);
-		}
+	if (hole_root != NIL_HOLE && hole_root->h_max >= clicks) {
+		/* There is a hole that is big enough.  Use the first one. */
+		old_base = take(&hole_root, clicks);
+		stats.ms_free -= clicks;
+		stats.ms_allocs++;
 
-		prev_ptr = hp;
-		hp = hp->h_next;
+		/* Return the start address of the acquired block. */
+		return(old_base);
 	}
   } while (swap_out());		/* try to swap some other process out */
   // #define swap_out() (0)
+  stats.ms_failed++;
   return(NO_MEM);
 }
 
+/*===========================================================================*
+ *				take					     *
+ *===========================================================================*/
+PRIVATE phys_clicks take(rootp, clicks)
+struct hole **rootp;		/* subtree with a hole that is big enough */
+phys_clicks clicks;		/* amount of memory requested */
+{
+/* Bite 'clicks' off the lowest hole in a subtree that is big enough, and
+ * return where it started.  The caller has checked the subtree has one.
+ */
+  register struct hole *hp;
+  phys_clicks old_base;
+
+  hp = *rootp;
+  // 左子树中地址更低, 若有足够大的空洞, 优先使用
+  if (hp->h_left != NIL_HOLE && hp->h_left->h_max >= clicks) {
+	old_base = take(&hp->h_left, clicks);
+  } else if (hp->h_len >= clicks) {
+	old_base = hp->h_base;	/* remember where it started */
+	hp->h_base += clicks;	/* bite a piece off */
+	hp->h_len -= clicks;	/* ditto */
+
+	/* Delete the hole if used up completely. */
+	if (hp->h_len == 0) {
+		*rootp = join(hp->h_left, hp->h_right);
+		del_slot(hp);
+		return(old_base);
+	}
+  } else {
+	old_base = take(&hp->h_right, clicks);
+  }
+  fix(hp);
+  return(old_base);
+}
+
 /*===========================================================================*
  *				free_mem				     *
  *===========================================================================*/
@@ -111,106 +162,206 @@ PUBLIC void free_mem(base, clicks)
 phys_clicks base;		/* base address of block to free */
 phys_clicks clicks;		/* number of clicks to free */
 {
-/* Return a block of free memory to the hole list.  The parameters tell where
- * the block starts in physical memory and how big it is.  The block is added
- * to the hole list.  If it is contiguous with an existing hole on either end,
- * it is merged with the hole or holes.
+/* Return a block of free memory to the hole tree.  The parameters tell where
+ * the block starts in physical memory and how big it is.  If it is contiguous
+ * with an existing hole on either end, it is merged with the hole or holes.
  */
 /*
- * 将一块空闲内存插入到空洞列表中. 参数给出了这块内存的地址与大小. 如果这块
- * 内存与空洞列表中的某块内存地址连续, 合并之.
+ * 将一块空闲内存插入到空洞树中. 参数给出了这块内存的地址与大小. 如果这块
+ * 内存与某个空洞地址连续, 合并之.
  */
-  register struct hole *hp, *new_ptr, *prev_ptr;
+  register struct hole *hp, *prev_ptr, *next_ptr;
 
   if (clicks == 0) return;
-  if ( (new_ptr = free_slots) == NIL_HOLE) 
-	// __FILE__ ???
-  	panic(__FILE__,"hole table full", NO_NUM);
-  new_ptr->h_base = base;
-  new_ptr->h_len = clicks;
-  free_slots = new_ptr->h_next;
-  hp = hole_head;
-
-  /* If this block's address is numerically less than the lowest hole currently
-   * available, or if no holes are currently available, put this hole on the
-   * front of the hole list.
-   */
-  if (hp == NIL_HOLE || base <= hp->h_base) {
-	/* Block to be freed goes on front of the hole list. */
-	new_ptr->h_next = hp;
-	hole_head = new_ptr;
-	merge(new_ptr);
-	return;
-  }
+  stats.ms_free += clicks;
+  stats.ms_frees++;
 
-  /* Block to be returned does not go on front of hole list. */
-  prev_ptr = NIL_HOLE;
-  while (hp != NIL_HOLE && base > hp->h_base) {
-	prev_ptr = hp;
-	hp = hp->h_next;
+  /* Find the holes just below and just above the block. */
+  prev_ptr = next_ptr = NIL_HOLE;
+  hp = hole_root;
+  while (hp != NIL_HOLE) {
+	if (hp->h_base < base) {
+		prev_ptr = hp;
+		hp = hp->h_right;
+	} else {
+		next_ptr = hp;
+		hp = hp->h_left;
+	}
   }
+  if (prev_ptr != NIL_HOLE && prev_ptr->h_base + prev_ptr->h_len != base)
+	prev_ptr = NIL_HOLE;			/* not adjacent */
+  if (next_ptr != NIL_HOLE && base + clicks != next_ptr->h_base)
+	next_ptr = NIL_HOLE;			/* not adjacent */
 
-  /* We found where it goes.  Insert block after 'prev_ptr'. */
-  new_ptr->h_next = prev_ptr->h_next;
-  prev_ptr->h_next = new_ptr;
-  merge(prev_ptr);		/* sequence is 'prev_ptr', 'new_ptr', 'hp' */
+  /* A hole that grows at either end keeps its place in the tree, since no
+   * other hole lies in between, but the sizes above it must be updated.
+   */
+  if (prev_ptr != NIL_HOLE) {
+	/* Extend the hole below, and absorb the one above, if any. */
+	prev_ptr->h_len += clicks;
+	if (next_ptr != NIL_HOLE) {
+		del_hole(&hole_root, next_ptr);
+		prev_ptr->h_len += next_ptr->h_len;
+		del_slot(next_ptr);
+	}
+	upd_hole(&hole_root, prev_ptr);
+  } else if (next_ptr != NIL_HOLE) {
+	/* Extend the hole above downwards. */
+	next_ptr->h_base = base;
+	next_ptr->h_len += clicks;
+	upd_hole(&hole_root, next_ptr);
+  } else {
+	/* A hole of its own. */
+	hp = new_slot();
+	hp->h_base = base;
+	hp->h_len = clicks;
+	ins_hole(&hole_root, hp);
+  }
 }
 
 /*===========================================================================*
- *				del_slot				     *
+ *				fix					     *
  *===========================================================================*/
-PRIVATE void del_slot(prev_ptr, hp)
-/* pointer to hole entry just ahead of 'hp' */
-register struct hole *prev_ptr;
-/* pointer to hole entry to be removed */
-register struct hole *hp;	
+PRIVATE void fix(hp)
+register struct hole *hp;	/* hole whose children may have changed */
 {
-/* Remove an entry from the hole list.  This procedure is called when a
- * request to allocate memory removes a hole in its entirety, thus reducing
- * the numbers of holes in memory, and requiring the elimination of one
- * entry in the hole list.
+/* Recompute the largest hole in the subtree of 'hp' from its own size and
+ * those of its children.
  */
-  if (hp == hole_head)
-	hole_head = hp->h_next;
-  else
-	prev_ptr->h_next = hp->h_next;
+  hp->h_max = hp->h_len;
+  if (hp->h_left != NIL_HOLE && hp->h_left->h_max > hp->h_max)
+	hp->h_max = hp->h_left->h_max;
+  if (hp->h_right != NIL_HOLE && hp->h_right->h_max > hp->h_max)
+	hp->h_max = hp->h_right->h_max;
+}
 
-  hp->h_next = free_slots;
-  free_slots = hp;
+/*===========================================================================*
+ *				join					     *
+ *===========================================================================*/
+PRIVATE struct hole *join(lp, rp)
+struct hole *lp;		/* subtree of holes at lower addresses */
+struct hole *rp;		/* subtree of holes at higher addresses */
+{
+/* Join two subtrees into one and return its root, which is the root of
+ * either with the higher priority.
+ */
+  if (lp == NIL_HOLE) return(rp);
+  if (rp == NIL_HOLE) return(lp);
+  if (lp->h_prio > rp->h_prio) {
+	lp->h_right = join(lp->h_right, rp);
+	fix(lp);
+	return(lp);
+  } else {
+	rp->h_left = join(lp, rp->h_left);
+	fix(rp);
+	return(rp);
+  }
 }
 
 /*===========================================================================*
- *				merge					     *
+ *				ins_hole				     *
  *===========================================================================*/
-PRIVATE void merge(hp)
-register struct hole *hp;	/* ptr to hole to merge with its successors */
+PRIVATE void ins_hole(rootp, hp)
+struct hole **rootp;		/* link to the subtree to insert into */
+struct hole *hp;		/* hole to insert */
 {
-/* Check for contiguous holes and merge any found.  Contiguous holes can occur
- * when a block of memory is freed, and it happens to abut another hole on
- * either or both ends.  The pointer 'hp' points to the first of a series of
- * three holes that can potentially all be merged together.
+/* Insert a hole into a subtree as a leaf, then rotate it up for as long as
+ * it has a higher priority than its parent.
  */
-  register struct hole *next_ptr;
+  register struct hole *parent, *child;
 
-  /* If 'hp' points to the last hole, no merging is possible.  If it does not,
-   * try to absorb its successor into it and free the successor's table entry.
-   */
-  if ( (next_ptr = hp->h_next) == NIL_HOLE) return;
-  if (hp->h_base + hp->h_len == next_ptr->h_base) {
-	hp->h_len += next_ptr->h_len;	/* first one gets second one's mem */
-	del_slot(hp, next_ptr);
+  if ((parent = *rootp) == NIL_HOLE) {
+	hp->h_left = hp->h_right = NIL_HOLE;
+	hp->h_max = hp->h_len;
+	*rootp = hp;
+	return;
+  }
+  if (hp->h_base < parent->h_base) {
+	ins_hole(&parent->h_left, hp);
+	if ((child = parent->h_left)->h_prio > parent->h_prio) {
+		parent->h_left = child->h_right;	/* rotate right */
+		child->h_right = parent;
+		*rootp = child;
+	}
   } else {
-	hp = next_ptr;
+	ins_hole(&parent->h_right, hp);
+	if ((child = parent->h_right)->h_prio > parent->h_prio) {
+		parent->h_right = child->h_left;	/* rotate left */
+		child->h_left = parent;
+		*rootp = child;
+	}
   }
+  fix(parent);
+  if (*rootp != parent) fix(*rootp);
+}
 
-  /* If 'hp' now points to the last hole, return; otherwise, try to absorb its
-   * successor into it.
-   */
-  if ( (next_ptr = hp->h_next) == NIL_HOLE) return;
-  if (hp->h_base + hp->h_len == next_ptr->h_base) {
-	hp->h_len += next_ptr->h_len;
-	del_slot(hp, next_ptr);
+/*===========================================================================*
+ *				del_hole				     *
+ *===========================================================================*/
+PRIVATE void del_hole(rootp, hp)
+struct hole **rootp;		/* link to the subtree that holds 'hp' */
+struct hole *hp;		/* hole to remove */
+{
+/* Remove a hole from a subtree, putting the join of its children in its
+ * place, and update the sizes on the way back up.
+ */
+  register struct hole *parent;
+
+  if ((parent = *rootp) == hp) {
+	*rootp = join(hp->h_left, hp->h_right);
+	return;
   }
+  del_hole(hp->h_base < parent->h_base ? &parent->h_left : &parent->h_right,
+									hp);
+  fix(parent);
+}
+
+/*===========================================================================*
+ *				upd_hole				     *
+ *===========================================================================*/
+PRIVATE void upd_hole(rootp, hp)
+struct hole **rootp;		/* link to the subtree that holds 'hp' */
+struct hole *hp;		/* hole whose size has changed */
+{
+/* A hole changed size.  Update the sizes on the path down to it. */
+  register struct hole *parent;
+
+  parent = *rootp;
+  if (parent != hp)
+	upd_hole(hp->h_base < parent->h_base ?
+				&parent->h_left : &parent->h_right, hp);
+  fix(parent);
+}
+
+/*===========================================================================*
+ *				new_slot				     *
+ *===========================================================================*/
+PRIVATE struct hole *new_slot()
+{
+/* Take an unused entry from the hole table. */
+  register struct hole *hp;
+
+  if ( (hp = free_slots) == NIL_HOLE)
+	// __FILE__ ???
+  	panic(__FILE__,"hole table full", NO_NUM);
+  free_slots = hp->h_left;
+  stats.ms_holes++;
+  return(hp);
+}
+
+/*===========================================================================*
+ *				del_slot				     *
+ *===========================================================================*/
+PRIVATE void del_slot(hp)
+register struct hole *hp;	/* pointer to hole entry to be removed */
+{
+/* Return an entry that is no longer in the tree to the unused entries.
+ * This happens when a request to allocate memory removes a hole in its
+ * entirety, or when freeing a block merges two holes into one.
+ */
+  hp->h_left = free_slots;
+  free_slots = hp;
+  stats.ms_holes--;
 }
 
 /*===========================================================================*
@@ -220,22 +371,26 @@ PUBLIC void mem_init(chunks, free)
 struct memory *chunks;		/* list of free memory chunks */
 phys_clicks *free;		/* memory size summaries */
 {
-/* Initialize hole lists.  There are two lists: 'hole_head' points to a linked
- * list of all the holes (unused memory) in the system; 'free_slots' points to
- * a linked list of table entries that are not in use.  Initially, the former
- * list has one entry for each chunk of physical memory, and the second
- * list links together the remaining table slots.  As memory becomes more
- * fragmented in the course of time (i.e., the initial big holes break up into
- * smaller holes), new table slots are needed to represent them.  These slots
- * are taken from the list headed by 'free_slots'.
+/* Initialize the hole table.  Initially, the tree has one entry for each
+ * chunk of physical memory, and 'free_slots' links together the remaining
+ * table slots.  As memory becomes more fragmented in the course of time
+ * (i.e., the initial big holes break up into smaller holes), new table slots
+ * are needed to represent them.  These slots are taken from the list headed
+ * by 'free_slots'.
  */
   int i;
   register struct hole *hp;
+  unsigned long seed;
 
-  /* Put all holes on the free list. */
-  for (hp = &hole[0]; hp < &hole[NR_HOLES]; hp++) hp->h_next = hp + 1;
-  hole[NR_HOLES-1].h_next = NIL_HOLE;
-  hole_head = NIL_HOLE;
+  /* Put all holes on the free list, and give each a random priority. */
+  seed = 1;
+  for (hp = &hole[0]; hp < &hole[NR_HOLES]; hp++) {
+	hp->h_left = hp + 1;
+	seed = seed * 1103515245 + 12345;
+	hp->h_prio = (unsigned) (seed >> 16);
+  }
+  hole[NR_HOLES-1].h_left = NIL_HOLE;
+  hole_root = NIL_HOLE;
   free_slots = &hole[0];
 
   /* Use the chunks of physical memory to allocate holes. */
@@ -246,4 +401,24 @@ phys_clicks *free;		/* memory size summaries */
 		*free += chunks[i].size;
 	}
   }
+  stats.ms_frees = 0;			/* these weren't frees */
+}
+
+/*===========================================================================*
+ *				mem_stats				     *
+ *===========================================================================*/
+PUBLIC void mem_stats(msp)
+struct memstats *msp;		/* where to put the statistics */
+{
+/* Report the total free memory, the largest hole, and how fragmented the
+ * free memory is: the part of it, in percent, that is not in the largest
+ * hole.  A request bigger than the largest hole fails, however much memory
+ * is free in total.
+ */
+  stats.ms_largest = hole_root != NIL_HOLE ? hole_root->h_max : 0;
+  stats.ms_frag = 0;
+  if (stats.ms_free > 0)
+	stats.ms_frag = 100 - (unsigned) ((unsigned long) stats.ms_largest *
+						100 / stats.ms_free);
+  *msp = stats;
 }
@@ -0,0 +1,528 @@
+/* Host-side benchmark of the hole table in alloc.c.  This is an ordinary user
+ * program, not part of PM.
+ *
+ * It replays a trace of allocations and frees through the old allocator (a
+ * list of holes sorted by address, first fit) and the new one (a treap
+ * ordered by address, first fit), and reports the time per operation, the
+ * requests that failed, and how fragmented free memory was at the end.  Both
+ * use first fit, so they must put every block in the same place.  Every block
+ * handed out is also checked against a map of memory, so two blocks must
+ * never overlap and a freed block must have been allocated.
+ *
+ * A trace has one operation per line:
+ *	a id clicks	allocate 'clicks' clicks, and call the block 'id'
+ *	f id		free block 'id'
+ * Without a trace file, a synthetic one is made up that looks like FORK and
+ * EXEC: processes of random sizes come and go, each with a text and a data
+ * block, and some blocks stay for good.
+ *
+ * usage: allocbench [-m memclicks] [-n nops] [tracefile]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned int phys_clicks;
+
+#define NO_MEM		((phys_clicks) 0)
+#define NIL_HOLE	((struct hole *) 0)
+#define NR_HOLES	16384
+#define MAX_IDS		65536
+#define BASE		1	/* NO_MEM is 0, so memory starts at click 1 */
+
+struct hole {
+  struct hole *h_next;		/* old: next hole by address */
+  struct hole *h_left;		/* new: holes at lower addresses */
+  struct hole *h_right;		/* new: holes at higher addresses */
+  unsigned h_prio;
+  phys_clicks h_base;
+  phys_clicks h_len;
+  phys_clicks h_max;		/* new: largest h_len in subtree */
+};
+
+struct op {
+  char o_type;			/* 'a' or 'f' */
+  int o_id;
+  phys_clicks o_clicks;
+};
+
+static struct hole hole[NR_HOLES];
+static struct hole *free_slots;
+static struct hole *hole_head;		/* old */
+static struct hole *hole_root;		/* new */
+static int nr_holes;
+
+static struct op *ops;
+static int nr_ops;
+static phys_clicks blk_base[MAX_IDS], blk_len[MAX_IDS];
+static unsigned char *used;		/* one byte per click, when checking */
+static phys_clicks *placed;		/* where the old allocator put each */
+
+static struct hole *new_slot(void)
+{
+  struct hole *hp;
+
+  if ((hp = free_slots) == NIL_HOLE) {
+      fprintf(stderr, "hole table full\n");
+      exit(1);
+  }
+  free_slots = hp->h_next;
+  nr_holes++;
+  return(hp);
+}
+
+static void del_slot(struct hole *hp)
+{
+  hp->h_next = free_slots;
+  free_slots = hp;
+  nr_holes--;
+}
+
+/*===========================================================================*
+ *				old: list, first fit			     *
+ *===========================================================================*/
+static phys_clicks old_alloc(phys_clicks clicks)
+{
+  struct hole *hp, *prev_ptr;
+  phys_clicks old_base;
+
+  prev_ptr = NIL_HOLE;
+  for (hp = hole_head; hp != NIL_HOLE; prev_ptr = hp, hp = hp->h_next) {
+      if (hp->h_len >= clicks) {
+          old_base = hp->h_base;
+          hp->h_base += clicks;
+          hp->h_len -= clicks;
+          if (hp->h_len == 0) {
+              if (prev_ptr == NIL_HOLE) hole_head = hp->h_next;
+              else prev_ptr->h_next = hp->h_next;
+              del_slot(hp);
+          }
+          return(old_base);
+      }
+  }
+  return(NO_MEM);
+}
+
+static void old_free(phys_clicks base, phys_clicks clicks)
+{
+  struct hole *hp, *prev_ptr, *new_ptr, *next_ptr;
+  int i;
+
+  new_ptr = new_slot();
+  new_ptr->h_base = base;
+  new_ptr->h_len = clicks;
+
+  prev_ptr = NIL_HOLE;
+  for (hp = hole_head; hp != NIL_HOLE && base > hp->h_base; hp = hp->h_next)
+      prev_ptr = hp;
+  new_ptr->h_next = hp;
+  if (prev_ptr == NIL_HOLE) hole_head = new_ptr;
+  else prev_ptr->h_next = new_ptr;
+
+  /* merge(): 'hp' is the first of up to three holes to merge. */
+  hp = prev_ptr != NIL_HOLE ? prev_ptr : new_ptr;
+  for (i = 0; i < 2; i++) {
+      if ((next_ptr = hp->h_next) == NIL_HOLE) return;
+      if (hp->h_base + hp->h_len == next_ptr->h_base) {
+          hp->h_len += next_ptr->h_len;
+          hp->h_next = next_ptr->h_next;
+          del_slot(next_ptr);
+      } else {
+          hp = next_ptr;
+      }
+  }
+}
+
+static phys_clicks old_largest(void)
+{
+  struct hole *hp;
+  phys_clicks largest = 0;
+
+  for (hp = hole_head; hp != NIL_HOLE; hp = hp->h_next)
+      if (hp->h_len > largest) largest = hp->h_len;
+  return(largest);
+}
+
+/*===========================================================================*
+ *				new: treap, first fit			     *
+ *===========================================================================*/
+static void fix(struct hole *hp)
+{
+  hp->h_max = hp->h_len;
+  if (hp->h_left != NIL_HOLE && hp->h_left->h_max > hp->h_max)
+      hp->h_max = hp->h_left->h_max;
+  if (hp->h_right != NIL_HOLE && hp->h_right->h_max > hp->h_max)
+      hp->h_max = hp->h_right->h_max;
+}
+
+static struct hole *join(struct hole *lp, struct hole *rp)
+{
+  if (lp == NIL_HOLE) return(rp);
+  if (rp == NIL_HOLE) return(lp);
+  if (lp->h_prio > rp->h_prio) {
+      lp->h_right = join(lp->h_right, rp);
+      fix(lp);
+      return(lp);
+  }
+  rp->h_left = join(lp, rp->h_left);
+  fix(rp);
+  return(rp);
+}
+
+static void ins_hole(struct hole **rootp, struct hole *hp)
+{
+  struct hole *parent, *child;
+
+  if ((parent = *rootp) == NIL_HOLE) {
+      hp->h_left = hp->h_right = NIL_HOLE;
+      hp->h_max = hp->h_len;
+      *rootp = hp;
+      return;
+  }
+  if (hp->h_base < parent->h_base) {
+      ins_hole(&parent->h_left, hp);
+      if ((child = parent->h_left)->h_prio > parent->h_prio) {
+          parent->h_left = child->h_right;
+          child->h_right = parent;
+          *rootp = child;
+      }
+  } else {
+      ins_hole(&parent->h_right, hp);
+      if ((child = parent->h_right)->h_prio > parent->h_prio) {
+          parent->h_right = child->h_left;
+          child->h_left = parent;
+          *rootp = child;
+      }
+  }
+  fix(parent);
+  if (*rootp != parent) fix(*rootp);
+}
+
+static void del_hole(struct hole **rootp, struct hole *hp)
+{
+  struct hole *parent;
+
+  if ((parent = *rootp) == hp) {
+      *rootp = join(hp->h_left, hp->h_right);
+      return;
+  }
+  del_hole(hp->h_base < parent->h_base ? &parent->h_left : &parent->h_right,
+      hp);
+  fix(parent);
+}
+
+static void upd_hole(struct hole **rootp, struct hole *hp)
+{
+  struct hole *parent = *rootp;
+
+  if (parent != hp)
+      upd_hole(hp->h_base < parent->h_base ?
+          &parent->h_left : &parent->h_right, hp);
+  fix(parent);
+}
+
+static phys_clicks take(struct hole **rootp, phys_clicks clicks)
+{
+  struct hole *hp = *rootp;
+  phys_clicks old_base;
+
+  if (hp->h_left != NIL_HOLE && hp->h_left->h_max >= clicks) {
+      old_base = take(&hp->h_left, clicks);
+  } else if (hp->h_len >= clicks) {
+      old_base = hp->h_base;
+      hp->h_base += clicks;
+      hp->h_len -= clicks;
+      if (hp->h_len == 0) {
+          *rootp = join(hp->h_left, hp->h_right);
+          del_slot(hp);
+          return(old_base);
+      }
+  } else {
+      old_base = take(&hp->h_right, clicks);
+  }
+  fix(hp);
+  return(old_base);
+}
+
+static phys_clicks new_alloc(phys_clicks clicks)
+{
+  if (hole_root == NIL_HOLE || hole_root->h_max < clicks) return(NO_MEM);
+  return(take(&hole_root, clicks));
+}
+
+static void new_free(phys_clicks base, phys_clicks clicks)
+{
+  struct hole *hp, *prev_ptr, *next_ptr;
+
+  prev_ptr = next_ptr = NIL_HOLE;
+  for (hp = hole_root; hp != NIL_HOLE; ) {
+      if (hp->h_base < base) {
+          prev_ptr = hp;
+          hp = hp->h_right;
+      } else {
+          next_ptr = hp;
+          hp = hp->h_left;
+      }
+  }
+  if (prev_ptr != NIL_HOLE && prev_ptr->h_base + prev_ptr->h_len != base)
+      prev_ptr = NIL_HOLE;
+  if (next_ptr != NIL_HOLE && base + clicks != next_ptr->h_base)
+      next_ptr = NIL_HOLE;
+
+  if (prev_ptr != NIL_HOLE) {
+      prev_ptr->h_len += clicks;
+      if (next_ptr != NIL_HOLE) {
+          del_hole(&hole_root, next_ptr);
+          prev_ptr->h_len += next_ptr->h_len;
+          del_slot(next_ptr);
+      }
+      upd_hole(&hole_root, prev_ptr);
+  } else if (next_ptr != NIL_HOLE) {
+      next_ptr->h_base = base;
+      next_ptr->h_len += clicks;
+      upd_hole(&hole_root, next_ptr);
+  } else {
+      hp = new_slot();
+      hp->h_base = base;
+      hp->h_len = clicks;
+      ins_hole(&hole_root, hp);
+  }
+}
+
+static phys_clicks new_largest(void)
+{
+  return(hole_root != NIL_HOLE ? hole_root->h_max : 0);
+}
+
+/*===========================================================================*
+ *				traces					     *
+ *===========================================================================*/
+static void add_op(int type, int id, phys_clicks clicks)
+{
+  static int max_ops;
+
+  if (nr_ops == max_ops) {
+      max_ops = max_ops ? 2 * max_ops : 1024;
+      if ((ops = realloc(ops, max_ops * sizeof(*ops))) == NULL) {
+          perror("realloc");
+          exit(1);
+      }
+  }
+  ops[nr_ops].o_type = type;
+  ops[nr_ops].o_id = id;
+  ops[nr_ops].o_clicks = clicks;
+  nr_ops++;
+}
+
+static void read_trace(char *name)
+{
+  FILE *fp;
+  char type;
+  int id;
+  unsigned clicks;
+  char line[128];
+
+  if ((fp = fopen(name, "r")) == NULL) {
+      perror(name);
+      exit(1);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+      clicks = 0;
+      if (sscanf(line, " %c %d %u", &type, &id, &clicks) < 2) continue;
+      if ((type != 'a' && type != 'f') || id < 0 || id >= MAX_IDS ||
+              (type == 'a' && clicks == 0)) {
+          fprintf(stderr, "%s: bad line: %s", name, line);
+          exit(1);
+      }
+      add_op(type, id, clicks);
+  }
+  fclose(fp);
+}
+
+/* Processes are a text and a data block; the data block is mostly bigger.
+ * Sizes are spread over a few clicks to a few hundred, with a long tail, as
+ * for a mix of small commands and a few big programs.  One process in
+ * sixteen stays for good, like a server or a shell.
+ */
+static void make_trace(long nops, phys_clicks mem)
+{
+  static int live[MAX_IDS / 2], idle[MAX_IDS / 2];
+  int nlive, nidle, i, id;
+  unsigned long seed;
+  phys_clicks text, data, in_use, limit;
+
+  /* A process uses ids 2n and 2n+1; ids of processes that exited are used
+   * again.
+   */
+  nlive = 0;
+  for (nidle = 0; nidle < MAX_IDS / 2; nidle++)
+      idle[nidle] = MAX_IDS - 2 - 2 * nidle;
+  in_use = 0;
+  limit = mem / 4 * 3;			/* keep about three quarters full */
+  seed = 1;
+  while (nr_ops < nops) {
+      seed = seed * 1103515245 + 12345;
+      if (nlive > 0 && (in_use > limit || (seed >> 16) % 2 == 0 ||
+              nidle == 0)) {
+          /* Exit a random process, but mostly not one that stays. */
+          i = (seed >> 8) % nlive;
+          id = live[i];
+          if (id % 32 == 0 && (seed >> 4) % 64 != 0) continue;
+          add_op('f', id, 0);
+          add_op('f', id + 1, 0);
+          in_use -= blk_len[id] + blk_len[id + 1];
+          live[i] = live[--nlive];
+          idle[nidle++] = id;
+          continue;
+      }
+      seed = seed * 1103515245 + 12345;
+      text = 4 + (seed >> 16) % 32;
+      if ((seed >> 8) % 8 == 0) text *= 8;
+      seed = seed * 1103515245 + 12345;
+      data = 8 + (seed >> 16) % 64;
+      if ((seed >> 8) % 8 == 0) data *= 16;
+      id = idle[--nidle];
+      blk_len[id] = text;
+      blk_len[id + 1] = data;
+      add_op('a', id, text);
+      add_op('a', id + 1, data);
+      in_use += text + data;
+      live[nlive++] = id;
+  }
+}
+
+/*===========================================================================*
+ *				run					     *
+ *===========================================================================*/
+static void init(void)
+{
+  struct hole *hp;
+  unsigned long seed = 1;
+
+  for (hp = &hole[0]; hp < &hole[NR_HOLES]; hp++) {
+      hp->h_next = hp + 1;
+      seed = seed * 1103515245 + 12345;
+      hp->h_prio = (unsigned) (seed >> 16);
+  }
+  hole[NR_HOLES - 1].h_next = NIL_HOLE;
+  free_slots = &hole[0];
+  hole_head = hole_root = NIL_HOLE;
+  nr_holes = 0;
+  memset(blk_base, 0, sizeof(blk_base));
+}
+
+static void check(phys_clicks base, phys_clicks len, int set)
+{
+  phys_clicks c;
+
+  for (c = base; c < base + len; c++) {
+      if (used[c] == set) {
+          fprintf(stderr, set ? "block at %u overlaps\n" :
+              "block at %u was not allocated\n", base);
+          exit(1);
+      }
+      used[c] = set;
+  }
+}
+
+static double run(int new, phys_clicks mem, int checking, long *failed)
+{
+  phys_clicks (*alloc)(phys_clicks);
+  void (*release)(phys_clicks, phys_clicks);
+  struct op *op;
+  phys_clicks base;
+  clock_t start;
+
+  alloc = new ? new_alloc : old_alloc;
+  release = new ? new_free : old_free;
+  init();
+  release(BASE, mem);
+  if (checking) memset(used, 0, BASE + mem);
+  *failed = 0;
+
+  start = clock();
+  for (op = ops; op < &ops[nr_ops]; op++) {
+      if (op->o_type == 'a') {
+          if (blk_base[op->o_id] != NO_MEM) continue;	/* still in use */
+          base = alloc(op->o_clicks);
+          if (checking && ! new) placed[op - ops] = base;
+          if (checking && new && base != placed[op - ops]) {
+              fprintf(stderr, "operation %d: old put it at %u, new at %u\n",
+                  (int) (op - ops), placed[op - ops], base);
+              exit(1);
+          }
+          if (base == NO_MEM) {
+              (*failed)++;
+              continue;
+          }
+          blk_base[op->o_id] = base;
+          blk_len[op->o_id] = op->o_clicks;
+          if (checking) check(base, op->o_clicks, 1);
+      } else {
+          if ((base = blk_base[op->o_id]) == NO_MEM) continue;  /* failed */
+          if (checking) check(base, blk_len[op->o_id], 0);
+          release(base, blk_len[op->o_id]);
+          blk_base[op->o_id] = NO_MEM;
+      }
+  }
+  return((double) (clock() - start) / CLOCKS_PER_SEC);
+}
+
+static void report(char *name, int new, phys_clicks mem, double secs,
+	long failed)
+{
+  phys_clicks free_clicks, largest;
+  int i;
+
+  /* Sum the free memory from what is still allocated. */
+  free_clicks = mem;
+  for (i = 0; i < MAX_IDS; i++)
+      if (blk_base[i] != NO_MEM) free_clicks -= blk_len[i];
+  largest = new ? new_largest() : old_largest();
+
+  printf("%-22s%8.1f ns/op %7ld failed %6d holes %3u%% fragmented\n",
+      name, secs * 1e9 / nr_ops, failed, nr_holes,
+      free_clicks ? 100 - (unsigned) ((unsigned long long) largest * 100 /
+      free_clicks) : 0);
+}
+
+/*===========================================================================*
+ *				main					     *
+ *===========================================================================*/
+int main(int argc, char *argv[])
+{
+  phys_clicks mem;
+  long nops, failed;
+  double secs;
+  int i, new;
+
+  mem = 65536;				/* 256 MB of 4 KB clicks */
+  nops = 1000000L;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+      if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) mem = atol(argv[++i]);
+      else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) nops = atol(argv[++i]);
+      else break;
+  }
+  if (i < argc - 1 || (i < argc && argv[i][0] == '-') || mem < 1024 ||
+          nops < 1) {
+      fprintf(stderr, "usage: allocbench [-m memclicks] [-n nops] [tracefile]\n");
+      exit(1);
+  }
+  if (i < argc) read_trace(argv[i]);
+  else make_trace(nops, mem);
+  if ((used = malloc(BASE + mem)) == NULL ||
+          (placed = malloc(nr_ops * sizeof(*placed))) == NULL) {
+      perror("malloc");
+      exit(1);
+  }
+
+  printf("%u clicks of memory, %d operations\n", mem, nr_ops);
+  for (new = 0; new <= 1; new++) {
+      run(new, mem, 1, &failed);		/* check, and warm up */
+      secs = run(new, mem, 0, &failed);
+      report(new ? "treap, first fit:" : "list, first fit:", new, mem,
+          secs, failed);
+  }
+  return(0);
+}
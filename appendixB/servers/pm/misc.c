@@ -57,6 +57,7 @@ PUBLIC int do_getsysinfo()
   struct mproc *proc_addr;
   vir_bytes src_addr, dst_addr;
   struct kinfo kinfo;
+  struct memstats memstats;
   size_t len;
   int s;
 
@@ -75,6 +76,11 @@ PUBLIC int do_getsysinfo()
         src_addr = (vir_bytes) mproc;
         len = sizeof(struct mproc) * NR_PROCS;
         break;
+  case SI_MEM_STATS:			/* free memory and fragmentation */
+  	mem_stats(&memstats);
+  	src_addr = (vir_bytes) &memstats;
+  	len = sizeof(struct memstats);
+  	break;
   default:
   	return(EINVAL);
   }
@@ -4,6 +4,7 @@ struct mproc;
 struct stat;
 struct mem_map;
 struct memory;
+struct memstats;
 
 #include <timers.h>
 
@@ -11,6 +12,7 @@ struct memory;
 _PROTOTYPE( phys_clicks alloc_mem, (phys_clicks clicks)			);
 _PROTOTYPE( void free_mem, (phys_clicks base, phys_clicks clicks)	);
 _PROTOTYPE( void mem_init, (struct memory *chunks, phys_clicks *free)	);
+_PROTOTYPE( void mem_stats, (struct memstats *msp)			);
 // ((void)0)  是一个表达式, 值为空
 #define swap_in()			((void)0)
 #define swap_inqueue(rmp)		((void)0)
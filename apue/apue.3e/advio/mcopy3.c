@@ -0,0 +1,259 @@
+#include "apue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#ifdef LINUX
+#include <linux/fs.h>		/* for FICLONE */
+#endif
+
+/*
+ * High-throughput version of mcopy2.  We try, in order:
+ *
+ *	1. FICLONE: share the source extents with the destination (reflink).
+ *	2. copy_file_range(): the kernel copies without a trip through
+ *	   user space, and some filesystems offload it to the device.
+ *	3. mmap() + memcpy(), as in mcopy2, with MADV_SEQUENTIAL hints.
+ *
+ * For 2 and 3 we only copy the data regions of the source, found with
+ * SEEK_DATA/SEEK_HOLE.  The destination is ftruncate()d to the size of
+ * the source first, so the holes stay holes.  Data regions are cut into
+ * CHUNKSZ pieces which are handed out to a pool of threads.
+ */
+#define CHUNKSZ		(64*1024*1024)	/* 64 MB per unit of work */
+#define MAXTHREADS	64
+
+enum method { M_CLONE, M_COPYRANGE, M_MMAP };
+
+static const char *methname[] = { "clone", "copy_file_range", "mmap" };
+
+static int		fdin, fdout;
+static off_t	fsize;
+static long		pagesz;
+
+static pthread_mutex_t	cursorlock = PTHREAD_MUTEX_INITIALIZER;
+static off_t	cursor;			/* next offset to examine; under cursorlock */
+static off_t	dataend;		/* end of current data region; under cursorlock */
+
+static int		method = M_COPYRANGE;	/* may drop to M_MMAP at run time */
+static off_t	ncopied;		/* bytes of data copied */
+
+static int		next_chunk(off_t *, size_t *);
+static void		*copy_thread(void *);
+static int		copy_range(off_t, size_t);
+static void		copy_mmap(off_t, size_t);
+
+int
+main(int argc, char *argv[])
+{
+	int				c, i, err, nthreads;
+	struct stat		sbuf;
+	struct timespec	start, end;
+	pthread_t		tid[MAXTHREADS];
+	double			secs;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	opterr = 0;
+	while ((c = getopt(argc, argv, "t:")) != EOF) {
+		switch (c) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case '?':
+			err_quit("unrecognized option: -%c", optopt);
+		}
+	}
+	if (argc - optind != 2)
+		err_quit("usage: %s [-t nthreads] <fromfile> <tofile>", argv[0]);
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+
+	if ((fdin = open(argv[optind], O_RDONLY)) < 0)
+		err_sys("can't open %s for reading", argv[optind]);
+
+	if ((fdout = open(argv[optind+1], O_RDWR | O_CREAT | O_TRUNC,
+	  FILE_MODE)) < 0)
+		err_sys("can't creat %s for writing", argv[optind+1]);
+
+	if (fstat(fdin, &sbuf) < 0)			/* need size of input file */
+		err_sys("fstat error");
+	fsize = sbuf.st_size;
+	pagesz = sysconf(_SC_PAGESIZE);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+#ifdef FICLONE
+	if (ioctl(fdout, FICLONE, fdin) == 0) {
+		method = M_CLONE;
+		ncopied = fsize;
+		goto done;
+	}
+#endif
+
+	if (ftruncate(fdout, fsize) < 0)	/* set output file size */
+		err_sys("ftruncate error");
+
+	/*
+	 * We read the source once, front to back within each chunk.
+	 */
+	posix_fadvise(fdin, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	/* don't start more threads than there are chunks */
+	if (nthreads > fsize / CHUNKSZ + 1)
+		nthreads = fsize / CHUNKSZ + 1;
+	for (i = 0; i < nthreads; i++) {
+		if ((err = pthread_create(&tid[i], NULL, copy_thread, NULL)) != 0)
+			err_exit(err, "can't create thread");
+	}
+	for (i = 0; i < nthreads; i++) {
+		if ((err = pthread_join(tid[i], NULL)) != 0)
+			err_exit(err, "can't join thread");
+	}
+
+#ifdef FICLONE
+done:
+#endif
+	if (fsync(fdout) < 0)
+		err_sys("fsync error");
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (secs <= 0)
+		secs = 1e-9;
+	printf("%lld bytes (%lld data, %lld holes) in %.3f s via %s, "
+	  "%.1f MB/s\n", (long long)fsize, (long long)ncopied,
+	  (long long)(fsize - ncopied), secs, methname[method],
+	  ncopied / secs / (1024 * 1024));
+	exit(0);
+}
+
+/*
+ * Hand out the next piece of data to copy, at most CHUNKSZ bytes long.
+ * Returns 0 when the whole file has been handed out.
+ */
+static int
+next_chunk(off_t *offp, size_t *lenp)
+{
+	off_t	off;
+
+	pthread_mutex_lock(&cursorlock);
+	if (cursor >= dataend) {
+		/*
+		 * Find the next data region.  If the filesystem doesn't
+		 * know about holes, treat the rest of the file as data.
+		 */
+		if (cursor >= fsize) {
+			pthread_mutex_unlock(&cursorlock);
+			return(0);
+		}
+#ifdef SEEK_DATA
+		if ((off = lseek(fdin, cursor, SEEK_DATA)) < 0) {
+			if (errno == ENXIO) {		/* only a hole remains */
+				cursor = fsize;
+				pthread_mutex_unlock(&cursorlock);
+				return(0);
+			}
+			off = cursor;
+			dataend = fsize;
+		} else if ((dataend = lseek(fdin, off, SEEK_HOLE)) < 0) {
+			dataend = fsize;
+		}
+#else
+		off = cursor;
+		dataend = fsize;
+#endif
+		if (dataend > fsize)
+			dataend = fsize;
+		cursor = off;
+	}
+	*offp = cursor;
+	*lenp = min(dataend - cursor, CHUNKSZ);
+	cursor += *lenp;
+	pthread_mutex_unlock(&cursorlock);
+	return(1);
+}
+
+static void *
+copy_thread(void *arg)
+{
+	off_t	off;
+	size_t	len;
+
+	while (next_chunk(&off, &len)) {
+		if (__atomic_load_n(&method, __ATOMIC_RELAXED) != M_COPYRANGE ||
+		  copy_range(off, len) < 0)
+			copy_mmap(off, len);
+		__atomic_add_fetch(&ncopied, len, __ATOMIC_RELAXED);
+
+		/* we won't read this piece again */
+		posix_fadvise(fdin, off, len, POSIX_FADV_DONTNEED);
+	}
+	return((void *)0);
+}
+
+/*
+ * Copy with copy_file_range().  We pass the offsets explicitly, so
+ * the threads don't fight over the file offsets of the descriptors.
+ * Returns -1, having switched everybody to mmap, if the kernel or
+ * filesystem can't do it.
+ */
+static int
+copy_range(off_t off, size_t len)
+{
+#ifdef LINUX
+	loff_t	inoff, outoff;
+	ssize_t	n;
+
+	inoff = outoff = off;
+	while (len > 0) {
+		if ((n = copy_file_range(fdin, &inoff, fdout, &outoff,
+		  len, 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (inoff == off && (errno == ENOSYS || errno == EXDEV ||
+			  errno == EINVAL || errno == EOPNOTSUPP)) {
+				__atomic_store_n(&method, M_MMAP, __ATOMIC_RELAXED);
+				return(-1);
+			}
+			err_sys("copy_file_range error");
+		} else if (n == 0) {
+			err_quit("%s: source file shrank", methname[M_COPYRANGE]);
+		}
+		len -= n;
+	}
+	return(0);
+#else
+	__atomic_store_n(&method, M_MMAP, __ATOMIC_RELAXED);
+	return(-1);
+#endif
+}
+
+/*
+ * Copy with mmap() and memcpy(), the way mcopy2 does.  The mapping
+ * has to start on a page boundary, but a data region may not.
+ */
+static void
+copy_mmap(off_t off, size_t len)
+{
+	void	*src, *dst;
+	off_t	mapoff;
+	size_t	delta;
+
+	mapoff = off & ~((off_t)pagesz - 1);
+	delta = off - mapoff;
+	if ((src = mmap(0, len + delta, PROT_READ, MAP_SHARED,
+	  fdin, mapoff)) == MAP_FAILED)
+		err_sys("mmap error for input");
+	if ((dst = mmap(0, len + delta, PROT_READ | PROT_WRITE,
+	  MAP_SHARED, fdout, mapoff)) == MAP_FAILED)
+		err_sys("mmap error for output");
+	madvise(src, len + delta, MADV_SEQUENTIAL);
+	madvise(dst, len + delta, MADV_SEQUENTIAL);
+
+	memcpy((char *)dst + delta, (char *)src + delta, len);
+	munmap(src, len + delta);
+	munmap(dst, len + delta);
+}
@@ -2,14 +2,22 @@
 #define _APUE_DB_H
 
 typedef	void *	DBHANDLE;
+typedef	void *	DBLOG;
 
 DBHANDLE  db_open(const char *, int, ...);
+DBHANDLE  db_xopen(const char *, int, int, int);
 void      db_close(DBHANDLE);
 char     *db_fetch(DBHANDLE, const char *);
 int       db_store(DBHANDLE, const char *, const char *, int);
 int       db_delete(DBHANDLE, const char *);
 void      db_rewind(DBHANDLE);
 char     *db_nextrec(DBHANDLE, char *);
+long      db_bulkload(const char *, int, int (*)(void *, char **, char **),
+                      void *);
+DBLOG     db_logopen(const char *, off_t);
+int       db_logread(DBLOG, off_t *, char **, char **);
+off_t     db_logtell(DBLOG);
+void      db_logclose(DBLOG);
 
 /*
  * Flags for db_store().
@@ -18,6 +26,20 @@ char     *db_nextrec(DBHANDLE, char *);
 #define DB_REPLACE	   2	/* replace existing record */
 #define DB_STORE	   3	/* replace or insert */
 
+/*
+ * Flags for db_xopen().
+ */
+#define DB_MT		0x01	/* handle may be shared by threads */
+#define DB_SHMLOCK	0x02	/* lock in shared memory, not with fcntl */
+#define DB_LOG		0x04	/* log changes in name.log */
+
+/*
+ * Changes returned by db_logread().
+ */
+#define DB_LOGSTORE	 'S'	/* key stored, with data */
+#define DB_LOGDELETE 'D'	/* key deleted */
+#define DB_LOGTRUNC	 'T'	/* database emptied */
+
 /*
  * Implementation limits.
  */
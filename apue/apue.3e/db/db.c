@@ -3,7 +3,8 @@
 #include <fcntl.h>		/* open & db_open flags */
 #include <stdarg.h>
 #include <errno.h>
-#include <sys/uio.h>	/* struct iovec */
+#include <pthread.h>
+#include <sys/mman.h>
 
 /*
  * Internal index file constants.
@@ -29,14 +30,16 @@ typedef unsigned long	DBHASH;	/* hash values */
 typedef unsigned long	COUNT;	/* unsigned counter */
 
 /*
- * Library's private representation of the database.
+ * The record an operation is working on, and the buffers it is read
+ * into.  A handle opened without DB_MT has a single cursor, in the DB
+ * structure.  With DB_MT, each thread gets its own the first time it
+ * uses the handle, so threads don't overwrite each other's records,
+ * and the data pointer db_fetch returns stays good until the same
+ * thread calls us again.
  */
-typedef struct {
-  int    idxfd;  /* fd for index file */
-  int    datfd;  /* fd for data file */
+typedef struct dbcur {
   char  *idxbuf; /* malloc'ed buffer for index record */
   char  *datbuf; /* malloc'ed buffer for data record*/
-  char  *name;   /* name db was opened under */
   off_t  idxoff; /* offset in index file of index record */
 			      /* key is at (idxoff + PTR_SZ + IDXLEN_SZ) */
   size_t idxlen; /* length of index record */
@@ -48,8 +51,74 @@ typedef struct {
   off_t  ptrval; /* contents of chain ptr in index record */
   off_t  ptroff; /* chain ptr offset pointing to this idx record */
   off_t  chainoff; /* offset of hash chain for this index record */
+  off_t  nextoff;  /* offset of next index record for db_nextrec */
+  struct dbcur *next;	/* DB_MT: list of all cursors */
+} DBCUR;
+
+/*
+ * DB_MT: an entry of the in-process lock table.  Threads exclude each
+ * other with the rwlock.  Record locks belong to the process (or open
+ * file description), not the thread, so they only keep other processes
+ * out: the first thread to read-lock takes the file lock, and the last
+ * to unlock releases it.
+ */
+typedef struct {
+  pthread_rwlock_t rwlock;
+  pthread_mutex_t  mutex;	/* protects nread */
+  int              nread;	/* threads holding the read lock */
+} DBLOCK;
+
+/*
+ * DB_SHMLOCK: the sidecar lock file, "name.lck".  It is mapped shared
+ * by every process that has the database open, and holds one futex
+ * rwlock (lib/plock.c) for each lock in the LK_xxx numbering, each in
+ * its own cache line.  Zero-filled means unlocked.
+ *
+ * Every process keeps a read lock on byte LCK_INUSE of the file while
+ * it has the database open.  An opener that can write-lock that byte
+ * is alone, so it zeroes the file, throwing away any lock words left
+ * set by a process that crashed, and writes the header.  Later openers
+ * check the header instead, and refuse a file made for a different
+ * number of locks.  Opening is serialized by a write lock on byte
+ * LCK_INIT.  These are open file description locks, so they also work
+ * for two opens of the database in one process.
+ */
+#define LCK_MAGIC	0x44424c31	/* "DBL1" */
+#define LCK_ALIGN	64
+#define LCK_INUSE	0			/* byte read-locked by every user */
+#define LCK_INIT	1			/* byte write-locked while opening */
+
+typedef struct {
+  struct prwlock lk;
+  char   pad[LCK_ALIGN - sizeof(struct prwlock)];
+} DBSHMLOCK;
+
+typedef struct {
+  unsigned int magic;
+  unsigned int nlocks;
+  char   pad[LCK_ALIGN - 2 * sizeof(unsigned int)];
+  DBSHMLOCK locks[1];	/* actually nlocks */
+} DBLCKFILE;
+
+/*
+ * Library's private representation of the database.
+ */
+typedef struct {
+  int    idxfd;  /* fd for index file */
+  int    datfd;  /* fd for data file */
+  int    logfd;  /* DB_LOG: fd for change log */
+  int    flags;  /* DB_xxx flags given to db_xopen */
+  char  *name;   /* name db was opened under */
+  DBCUR  cur;    /* the cursor, without DB_MT */
   off_t  hashoff;  /* offset in index file of hash table */
   DBHASH nhash;    /* current hash table size */
+  DBLOCK *locks;   /* DB_MT: lock table, NLOCKS entries */
+  int    lckfd;			/* DB_SHMLOCK: fd for lock file */
+  DBLCKFILE *lckfile;	/* DB_SHMLOCK: mapped lock file */
+  size_t lcklen;		/* DB_SHMLOCK: its size */
+  pthread_key_t   curkey;	/* DB_MT: each thread's cursor */
+  pthread_mutex_t curlock;	/* DB_MT: protects curlist */
+  DBCUR  *curlist;			/* DB_MT: all the cursors */
   COUNT  cnt_delok;    /* delete OK */
   COUNT  cnt_delerr;   /* delete error */
   COUNT  cnt_fetchok;  /* fetch OK */
@@ -62,20 +131,88 @@ typedef struct {
   COUNT  cnt_storerr;  /* store error */
 } DB;
 
+/*
+ * Counters can be bumped by several threads at once.
+ */
+#define COUNTUP(cnt)	__atomic_add_fetch(&(cnt), 1, __ATOMIC_RELAXED)
+
+/*
+ * The locks we take, by number.  Each stands for a byte range
+ * of the index or data file.
+ */
+#define LK_FREE		0					/* the free list */
+#define LK_CHAIN(db, off)	(((off) - (db)->hashoff) / PTR_SZ + 1)
+#define LK_IDXEND(db)	((db)->nhash + 1)	/* appending index records */
+#define LK_DATEND(db)	((db)->nhash + 2)	/* appending data records */
+#define LK_LOGEND(db)	((db)->nhash + 3)	/* appending log records */
+#define NLOCKS(db)		((db)->nhash + 4)
+
+/*
+ * DB_LOG: the change log, "name.log".  Each db_store or db_delete
+ * that changes the database appends a record, in ASCII like the
+ * other two files: the operation (DB_LOGSTORE and so on), the lengths
+ * of the key and data, then the key, the data, and a newline.  A
+ * record's sequence number is its offset in the log, so they only
+ * grow, and a reader can pick up again at any one.
+ */
+#define LOGLEN_SZ	   4	/* key or data length in log record */
+#define LOG_HDRSZ	(1 + 2 * LOGLEN_SZ)	/* op, key length, data length */
+#define LOGREC_MAX	(LOG_HDRSZ + IDXLEN_MAX + DATLEN_MAX + 1)
+
+/*
+ * A reader of the log.
+ */
+typedef struct {
+  int    fd;     /* fd for log file */
+  off_t  pos;    /* sequence number of next record */
+  char  *buf;    /* malloc'ed buffer for record */
+} DBLOGRD;
+
+/*
+ * db_bulkload: a record read from the caller, and where it goes.
+ * The keys are copied into a pool of large chunks rather than
+ * malloc'ed one at a time.
+ */
+typedef struct {
+  char  *key;    /* in the key pool */
+  DBHASH hash;   /* its hash chain */
+  off_t  datoff; /* offset in data file */
+  size_t datlen; /* length of data record, includes newline */
+  off_t  idxoff; /* offset in index file */
+  int    idxlen; /* length of index record, as in DBCUR */
+} BULKREC;
+
+#define KEYPOOL_SZ	(1024 * 1024)
+
+typedef struct keypool {
+  struct keypool *next;
+  size_t used;
+  char   buf[KEYPOOL_SZ];
+} KEYPOOL;
+
 /*
  * Internal functions.
  */
 static DB     *_db_alloc(int);
-static void    _db_dodelete(DB *);
-static int	    _db_find_and_lock(DB *, const char *, int);
-static int     _db_findfree(DB *, int, int);
+static int     _db_lckbyte(int, int, short, off_t);
+static int     _db_shmopen(DB *, int);
+static DBCUR  *_db_cursor(DB *);
+static int     _db_bulkcmp(const void *, const void *);
+static int     _db_curinit(DBCUR *);
+static void    _db_dodelete(DB *, DBCUR *);
+static int	    _db_find_and_lock(DB *, DBCUR *, const char *, int);
+static int     _db_findfree(DB *, DBCUR *, int, int);
 static void    _db_free(DB *);
 static DBHASH  _db_hash(DB *, const char *);
-static char   *_db_readdat(DB *);
-static off_t   _db_readidx(DB *, off_t);
+static int     _db_inithash(DB *);
+static void    _db_lock(DB *, int, int);
+static void    _db_log(DB *, int, const char *, const char *);
+static char   *_db_readdat(DB *, DBCUR *);
+static off_t   _db_readidx(DB *, DBCUR *, off_t);
 static off_t   _db_readptr(DB *, off_t);
-static void    _db_writedat(DB *, const char *, off_t, int);
-static void    _db_writeidx(DB *, const char *, off_t, int, off_t);
+static void    _db_unlock(DB *, int);
+static void    _db_writedat(DB *, DBCUR *, const char *, off_t, int);
+static void    _db_writeidx(DB *, DBCUR *, const char *, off_t, int, off_t);
 static void    _db_writeptr(DB *, off_t, off_t);
 
 /*
@@ -83,13 +220,29 @@ static void    _db_writeptr(DB *, off_t, off_t);
  */
 DBHANDLE
 db_open(const char *pathname, int oflag, ...)
+{
+	int		mode = 0;
+
+	if (oflag & O_CREAT) {
+		va_list ap;
+
+		va_start(ap, oflag);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	return(db_xopen(pathname, oflag, 0, mode));
+}
+
+/*
+ * Open or create a database, with DB_xxx flags.  The mode is
+ * used only if oflag includes O_CREAT.
+ */
+DBHANDLE
+db_xopen(const char *pathname, int oflag, int dbflags, int mode)
 {
 	DB			*db;
-	int			len, mode;
+	int			len;
 	size_t		i;
-	char		asciiptr[PTR_SZ + 1],
-				hash[(NHASH_DEF + 1) * PTR_SZ + 2];
-					/* +2 for newline and null */
 	struct stat	statbuff;
 
 	/*
@@ -99,18 +252,13 @@ db_open(const char *pathname, int oflag, ...)
 	if ((db = _db_alloc(len)) == NULL)
 		err_dump("db_open: _db_alloc error for DB");
 
+	db->flags   = dbflags;
 	db->nhash   = NHASH_DEF;/* hash table size */
 	db->hashoff = HASH_OFF;	/* offset in index file of hash table */
 	strcpy(db->name, pathname);
 	strcat(db->name, ".idx");
 
 	if (oflag & O_CREAT) {
-		va_list ap;
-
-		va_start(ap, oflag);
-		mode = va_arg(ap, int);
-		va_end(ap);
-
 		/*
 		 * Open index file and data file.
 		 */
@@ -131,6 +279,45 @@ db_open(const char *pathname, int oflag, ...)
 		return(NULL);
 	}
 
+	if ((dbflags & DB_LOG) && (oflag & O_ACCMODE) != O_RDONLY) {
+		/*
+		 * Create the log if this is the first time we log, even
+		 * if the database itself exists.
+		 */
+		strcpy(db->name + len, ".log");
+		db->logfd = open(db->name, O_WRONLY | O_CREAT,
+		  (oflag & O_CREAT) ? mode : FILE_MODE);
+		if (db->logfd < 0) {
+			_db_free(db);
+			return(NULL);
+		}
+	}
+
+	if ((dbflags & DB_SHMLOCK) && _db_shmopen(db, len) < 0) {
+		_db_free(db);
+		return(NULL);
+	}
+
+	if (dbflags & DB_MT) {
+		pthread_mutex_init(&db->curlock, NULL);
+		if (pthread_key_create(&db->curkey, NULL) != 0)
+			err_dump("db_open: pthread_key_create error");
+	}
+	if ((dbflags & DB_MT) && db->lckfile == NULL) {
+		/*
+		 * Build the lock table: the free list, one per hash
+		 * chain, and the ends of the two files.  The shared
+		 * locks of DB_SHMLOCK work between threads too, so they
+		 * don't need one.
+		 */
+		if ((db->locks = calloc(NLOCKS(db), sizeof(DBLOCK))) == NULL)
+			err_dump("db_open: calloc error for lock table");
+		for (i = 0; i < NLOCKS(db); i++) {
+			pthread_rwlock_init(&db->locks[i].rwlock, NULL);
+			pthread_mutex_init(&db->locks[i].mutex, NULL);
+		}
+	}
+
 	if ((oflag & (O_CREAT | O_TRUNC)) == (O_CREAT | O_TRUNC)) {
 		/*
 		 * If the database was created, we have to initialize
@@ -144,19 +331,14 @@ db_open(const char *pathname, int oflag, ...)
 			err_sys("db_open: fstat error");
 
 		if (statbuff.st_size == 0) {
+			if (_db_inithash(db) < 0)
+				err_dump("db_open: index file init write error");
+
 			/*
-			 * We have to build a list of (NHASH_DEF + 1) chain
-			 * ptrs with a value of 0.  The +1 is for the free
-			 * list pointer that precedes the hash table.
+			 * Tell readers of the log to start over too.
 			 */
-			sprintf(asciiptr, "%*d", PTR_SZ, 0);
-			hash[0] = 0;
-			for (i = 0; i < NHASH_DEF + 1; i++)
-				strcat(hash, asciiptr);
-			strcat(hash, "\n");
-			i = strlen(hash);
-			if (write(db->idxfd, hash, i) != i)
-				err_dump("db_open: index file init write error");
+			if (db->logfd >= 0)
+				_db_log(db, DB_LOGTRUNC, "", "");
 		}
 		if (un_lock(db->idxfd, 0, SEEK_SET, 0) < 0)
 			err_dump("db_open: un_lock error");
@@ -165,6 +347,119 @@ db_open(const char *pathname, int oflag, ...)
 	return(db);
 }
 
+#ifdef LINUX
+/*
+ * Lock or unlock one byte of the lock file, with an open file
+ * description lock.  "cmd" is F_OFD_SETLK or F_OFD_SETLKW.
+ */
+static int
+_db_lckbyte(int fd, int cmd, short type, off_t offset)
+{
+	struct flock	lock;
+
+	lock.l_type = type;
+	lock.l_whence = SEEK_SET;
+	lock.l_start = offset;
+	lock.l_len = 1;
+	lock.l_pid = 0;
+	return(fcntl(fd, cmd, &lock));
+}
+#endif
+
+/*
+ * Open and map the sidecar lock file for DB_SHMLOCK.  db->name
+ * holds the name of the data file, which is "namelen" bytes plus
+ * ".dat".  The file stays open, to hold our LCK_INUSE lock, until
+ * _db_free().  Returns -1 with errno set on error.
+ */
+static int
+_db_shmopen(DB *db, int namelen)
+{
+#ifdef LINUX
+	int			fd, err, first;
+	size_t		len;
+	void		*p;
+	struct stat	statbuf;
+
+	strcpy(db->name + namelen, ".lck");
+	if ((fd = open(db->name, O_RDWR | O_CREAT, FILE_MODE)) < 0)
+		return(-1);
+	db->lckfd = fd;
+	len = offsetof(DBLCKFILE, locks) + NLOCKS(db) * sizeof(DBSHMLOCK);
+	if (_db_lckbyte(fd, F_OFD_SETLKW, F_WRLCK, LCK_INIT) < 0)
+		return(-1);
+
+	/*
+	 * If nobody else has the database open, start from a zero-filled
+	 * file of the right size.
+	 */
+	first = _db_lckbyte(fd, F_OFD_SETLK, F_WRLCK, LCK_INUSE) == 0;
+	if (first && (ftruncate(fd, 0) < 0 || ftruncate(fd, len) < 0))
+		goto err;
+	if (fstat(fd, &statbuf) < 0)
+		goto err;
+	if (statbuf.st_size < len) {
+		errno = EINVAL;		/* made for fewer locks */
+		goto err;
+	}
+	p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto err;
+	db->lckfile = p;
+	db->lcklen = len;
+	if (first) {
+		db->lckfile->magic = LCK_MAGIC;
+		db->lckfile->nlocks = NLOCKS(db);
+	} else if (db->lckfile->magic != LCK_MAGIC ||
+	  db->lckfile->nlocks != NLOCKS(db)) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	/*
+	 * Downgrading our write lock to a read lock is atomic, so no
+	 * other opener can think it is the first in between.
+	 */
+	if (_db_lckbyte(fd, F_OFD_SETLK, F_RDLCK, LCK_INUSE) < 0)
+		goto err;
+	_db_lckbyte(fd, F_OFD_SETLK, F_UNLCK, LCK_INIT);
+	return(0);
+
+err:
+	err = errno;
+	_db_lckbyte(fd, F_OFD_SETLK, F_UNLCK, LCK_INIT);
+	errno = err;
+	return(-1);			/* _db_free() unmaps and closes */
+#else
+	errno = ENOTSUP;	/* the futex locks are Linux only */
+	return(-1);
+#endif
+}
+
+/*
+ * Write the hash table of an empty database to the start of its
+ * index file: (NHASH_DEF + 1) chain ptrs with a value of 0.  The +1
+ * is for the free list pointer that precedes the hash table.
+ */
+static int
+_db_inithash(DB *db)
+{
+	size_t	i;
+	char	asciiptr[PTR_SZ + 1],
+			hash[(NHASH_DEF + 1) * PTR_SZ + 2];
+				/* +2 for newline and null */
+
+	sprintf(asciiptr, "%*d", PTR_SZ, 0);
+	hash[0] = 0;
+	for (i = 0; i < NHASH_DEF + 1; i++)
+		strcat(hash, asciiptr);
+	strcat(hash, "\n");
+	i = strlen(hash);
+	if (pwrite(db->idxfd, hash, i, 0) != i)
+		return(-1);
+	return(0);
+}
+
 /*
  * Allocate & initialize a DB structure and its buffers.
  */
@@ -178,7 +473,7 @@ _db_alloc(int namelen)
 	 */
 	if ((db = calloc(1, sizeof(DB))) == NULL)
 		err_dump("_db_alloc: calloc error for DB");
-	db->idxfd = db->datfd = -1;				/* descriptors */
+	db->idxfd = db->datfd = db->logfd = db->lckfd = -1;	/* descriptors */
 
 	/*
 	 * Allocate room for the name.
@@ -187,17 +482,52 @@ _db_alloc(int namelen)
 	if ((db->name = malloc(namelen + 5)) == NULL)
 		err_dump("_db_alloc: malloc error for name");
 
-	/*
-	 * Allocate an index buffer and a data buffer.
-	 * +2 for newline and null at end.
-	 */
-	if ((db->idxbuf = malloc(IDXLEN_MAX + 2)) == NULL)
-		err_dump("_db_alloc: malloc error for index buffer");
-	if ((db->datbuf = malloc(DATLEN_MAX + 2)) == NULL)
-		err_dump("_db_alloc: malloc error for data buffer");
+	if (_db_curinit(&db->cur) < 0)
+		err_dump("_db_alloc: malloc error for buffers");
 	return(db);
 }
 
+/*
+ * Allocate an index buffer and a data buffer for a cursor.
+ * +2 for newline and null at end.
+ */
+static int
+_db_curinit(DBCUR *cp)
+{
+	if ((cp->idxbuf = malloc(IDXLEN_MAX + 2)) == NULL)
+		return(-1);
+	if ((cp->datbuf = malloc(DATLEN_MAX + 2)) == NULL) {
+		free(cp->idxbuf);
+		cp->idxbuf = NULL;
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+ * Return the calling thread's cursor, making it the first time.
+ */
+static DBCUR *
+_db_cursor(DB *db)
+{
+	DBCUR	*cp;
+
+	if (!(db->flags & DB_MT))
+		return(&db->cur);
+	if ((cp = pthread_getspecific(db->curkey)) != NULL)
+		return(cp);
+	if ((cp = calloc(1, sizeof(DBCUR))) == NULL || _db_curinit(cp) < 0)
+		err_dump("_db_cursor: malloc error for cursor");
+	cp->nextoff = db->cur.nextoff;
+	pthread_mutex_lock(&db->curlock);
+	cp->next = db->curlist;
+	db->curlist = cp;
+	pthread_mutex_unlock(&db->curlock);
+	if (pthread_setspecific(db->curkey, cp) != 0)
+		err_dump("_db_cursor: pthread_setspecific error");
+	return(cp);
+}
+
 /*
  * Relinquish access to the database.
  */
@@ -210,23 +540,167 @@ db_close(DBHANDLE h)
 /*
  * Free up a DB structure, and all the malloc'ed buffers it
  * may point to.  Also close the file descriptors if still open.
+ * With DB_MT, no other thread may be using the handle.
  */
 static void
 _db_free(DB *db)
 {
+	DBCUR	*cp, *next;
+	DBHASH	i;
+
 	if (db->idxfd >= 0)
 		close(db->idxfd);
 	if (db->datfd >= 0)
 		close(db->datfd);
-	if (db->idxbuf != NULL)
-		free(db->idxbuf);
-	if (db->datbuf != NULL)
-		free(db->datbuf);
+	if (db->logfd >= 0)
+		close(db->logfd);
+	if (db->cur.idxbuf != NULL)
+		free(db->cur.idxbuf);
+	if (db->cur.datbuf != NULL)
+		free(db->cur.datbuf);
+	if (db->lckfile != NULL)
+		munmap(db->lckfile, db->lcklen);
+	if (db->lckfd >= 0)
+		close(db->lckfd);		/* drops our LCK_INUSE lock */
+	if (db->flags & DB_MT) {
+		for (cp = db->curlist; cp != NULL; cp = next) {
+			next = cp->next;
+			free(cp->idxbuf);
+			free(cp->datbuf);
+			free(cp);
+		}
+		pthread_key_delete(db->curkey);
+		pthread_mutex_destroy(&db->curlock);
+	}
+	if (db->locks != NULL) {
+		for (i = 0; i < NLOCKS(db); i++) {
+			pthread_rwlock_destroy(&db->locks[i].rwlock);
+			pthread_mutex_destroy(&db->locks[i].mutex);
+		}
+		free(db->locks);
+	}
 	if (db->name != NULL)
 		free(db->name);
 	free(db);
 }
 
+/*
+ * Take or release a record lock for one of the LK_xxx ranges.
+ * With DB_MT we use open file description locks where we have
+ * them, which aren't lost if the process closes some other
+ * descriptor for the file.
+ */
+static int
+_db_filelock(DB *db, int lk, int type)
+{
+	int		fd;
+	off_t	offset, len;
+#ifdef F_OFD_SETLKW
+	struct flock	lock;
+#endif
+
+	fd = db->idxfd;
+	len = 1;
+	if (lk == LK_FREE) {
+		offset = FREE_OFF;
+	} else if (lk == LK_IDXEND(db)) {
+		offset = ((db->nhash+1)*PTR_SZ)+1;
+		len = 0;
+	} else if (lk == LK_DATEND(db)) {
+		fd = db->datfd;
+		offset = 0;
+		len = 0;
+	} else if (lk == LK_LOGEND(db)) {
+		fd = db->logfd;
+		offset = 0;
+		len = 0;
+	} else {
+		offset = db->hashoff + (lk - 1) * PTR_SZ;
+	}
+#ifdef F_OFD_SETLKW
+	if (db->flags & DB_MT) {
+		lock.l_type = type;
+		lock.l_start = offset;
+		lock.l_whence = SEEK_SET;
+		lock.l_len = len;
+		lock.l_pid = 0;
+		return(fcntl(fd, type == F_UNLCK ? F_OFD_SETLK : F_OFD_SETLKW,
+		  &lock));
+	}
+#endif
+	return(lock_reg(fd, type == F_UNLCK ? F_SETLK : F_SETLKW, type,
+	  offset, SEEK_SET, len));
+}
+
+/*
+ * Lock one of the LK_xxx ranges, for reading or writing.
+ */
+static void
+_db_lock(DB *db, int lk, int writelock)
+{
+	DBLOCK	*lp;
+
+#ifdef LINUX
+	if (db->lckfile != NULL) {
+		/*
+		 * If the last holder died, it may have left the chain or
+		 * free list half updated.  There's no log to repair it
+		 * from, so all we can do is carry on.
+		 */
+		if ((writelock ? prw_wrlock : prw_rdlock)
+		  (&db->lckfile->locks[lk].lk) == EOWNERDEAD)
+			err_msg("%s: lock %d: owner died", db->name, lk);
+		return;
+	}
+#endif
+	if (db->locks == NULL) {
+		if (_db_filelock(db, lk, writelock ? F_WRLCK : F_RDLCK) < 0)
+			err_dump("_db_lock: lock error");
+		return;
+	}
+	lp = &db->locks[lk];
+	if (writelock) {
+		pthread_rwlock_wrlock(&lp->rwlock);
+		if (_db_filelock(db, lk, F_WRLCK) < 0)
+			err_dump("_db_lock: write lock error");
+	} else {
+		pthread_rwlock_rdlock(&lp->rwlock);
+		pthread_mutex_lock(&lp->mutex);
+		if (lp->nread++ == 0 && _db_filelock(db, lk, F_RDLCK) < 0)
+			err_dump("_db_lock: read lock error");
+		pthread_mutex_unlock(&lp->mutex);
+	}
+}
+
+static void
+_db_unlock(DB *db, int lk)
+{
+	DBLOCK	*lp;
+
+#ifdef LINUX
+	if (db->lckfile != NULL) {
+		prw_unlock(&db->lckfile->locks[lk].lk);
+		return;
+	}
+#endif
+	if (db->locks == NULL) {
+		if (_db_filelock(db, lk, F_UNLCK) < 0)
+			err_dump("_db_unlock: un_lock error");
+		return;
+	}
+
+	/*
+	 * While a writer has the rwlock, nread is 0.
+	 */
+	lp = &db->locks[lk];
+	pthread_mutex_lock(&lp->mutex);
+	if (lp->nread == 0 || --lp->nread == 0)
+		if (_db_filelock(db, lk, F_UNLCK) < 0)
+			err_dump("_db_unlock: un_lock error");
+	pthread_mutex_unlock(&lp->mutex);
+	pthread_rwlock_unlock(&lp->rwlock);
+}
+
 /*
  * Fetch a record.  Return a pointer to the null-terminated data.
  */
@@ -234,21 +708,21 @@ char *
 db_fetch(DBHANDLE h, const char *key)
 {
 	DB      *db = h;
+	DBCUR	*cp = _db_cursor(db);
 	char	*ptr;
 
-	if (_db_find_and_lock(db, key, 0) < 0) {
+	if (_db_find_and_lock(db, cp, key, 0) < 0) {
 		ptr = NULL;				/* error, record not found */
-		db->cnt_fetcherr++;
+		COUNTUP(db->cnt_fetcherr);
 	} else {
-		ptr = _db_readdat(db);	/* return pointer to data */
-		db->cnt_fetchok++;
+		ptr = _db_readdat(db, cp);	/* return pointer to data */
+		COUNTUP(db->cnt_fetchok);
 	}
 
 	/*
 	 * Unlock the hash chain that _db_find_and_lock locked.
 	 */
-	if (un_lock(db->idxfd, db->chainoff, SEEK_SET, 1) < 0)
-		err_dump("db_fetch: un_lock error");
+	_db_unlock(db, LK_CHAIN(db, cp->chainoff));
 	return(ptr);
 }
 
@@ -257,7 +731,7 @@ db_fetch(DBHANDLE h, const char *key)
  * and db_store.  Returns with the hash chain locked.
  */
 static int
-_db_find_and_lock(DB *db, const char *key, int writelock)
+_db_find_and_lock(DB *db, DBCUR *cp, const char *key, int writelock)
 {
 	off_t	offset, nextoffset;
 
@@ -267,31 +741,25 @@ _db_find_and_lock(DB *db, const char *key, int writelock)
 	 * This is where our search starts.  First we calculate the
 	 * offset in the hash table for this key.
 	 */
-	db->chainoff = (_db_hash(db, key) * PTR_SZ) + db->hashoff;
-	db->ptroff = db->chainoff;
+	cp->chainoff = (_db_hash(db, key) * PTR_SZ) + db->hashoff;
+	cp->ptroff = cp->chainoff;
 
 	/*
 	 * We lock the hash chain here.  The caller must unlock it
 	 * when done.  Note we lock and unlock only the first byte.
 	 */
-	if (writelock) {
-		if (writew_lock(db->idxfd, db->chainoff, SEEK_SET, 1) < 0)
-			err_dump("_db_find_and_lock: writew_lock error");
-	} else {
-		if (readw_lock(db->idxfd, db->chainoff, SEEK_SET, 1) < 0)
-			err_dump("_db_find_and_lock: readw_lock error");
-	}
+	_db_lock(db, LK_CHAIN(db, cp->chainoff), writelock);
 
 	/*
 	 * Get the offset in the index file of first record
 	 * on the hash chain (can be 0).
 	 */
-	offset = _db_readptr(db, db->ptroff);
+	offset = _db_readptr(db, cp->ptroff);
 	while (offset != 0) {
-		nextoffset = _db_readidx(db, offset);
-		if (strcmp(db->idxbuf, key) == 0)
+		nextoffset = _db_readidx(db, cp, offset);
+		if (strcmp(cp->idxbuf, key) == 0)
 			break;       /* found a match */
-		db->ptroff = offset; /* offset of this (unequal) record */
+		cp->ptroff = offset; /* offset of this (unequal) record */
 		offset = nextoffset; /* next one to compare */
 	}
 	/*
@@ -325,9 +793,7 @@ _db_readptr(DB *db, off_t offset)
 {
 	char	asciiptr[PTR_SZ + 1];
 
-	if (lseek(db->idxfd, offset, SEEK_SET) == -1)
-		err_dump("_db_readptr: lseek error to ptr field");
-	if (read(db->idxfd, asciiptr, PTR_SZ) != PTR_SZ)
+	if (pread(db->idxfd, asciiptr, PTR_SZ, offset) != PTR_SZ)
 		err_dump("_db_readptr: read error of ptr field");
 	asciiptr[PTR_SZ] = 0;		/* null terminate */
 	return(atol(asciiptr));
@@ -335,68 +801,68 @@ _db_readptr(DB *db, off_t offset)
 
 /*
  * Read the next index record.  We start at the specified offset
- * in the index file.  We read the index record into db->idxbuf
+ * in the index file.  We read the index record into cp->idxbuf
  * and replace the separators with null bytes.  If all is OK we
- * set db->datoff and db->datlen to the offset and length of the
+ * set cp->datoff and cp->datlen to the offset and length of the
  * corresponding data record in the data file.
  */
 static off_t
-_db_readidx(DB *db, off_t offset)
+_db_readidx(DB *db, DBCUR *cp, off_t offset)
 {
-	ssize_t				i;
+	ssize_t			i;
 	char			*ptr1, *ptr2;
-	char			asciiptr[PTR_SZ + 1], asciilen[IDXLEN_SZ + 1];
-	struct iovec	iov[2];
+	char			asciiptrlen[PTR_SZ + IDXLEN_SZ + 1];
+	char			asciilen[IDXLEN_SZ + 1];
+	int				eofok;
 
 	/*
-	 * Position index file and record the offset.  db_nextrec
-	 * calls us with offset==0, meaning read from current offset.
-	 * We still need to call lseek to record the current offset.
+	 * Record the offset.  db_nextrec calls us with offset==0,
+	 * meaning read the record after the last one it read.
 	 */
-	if ((db->idxoff = lseek(db->idxfd, offset,
-	  offset == 0 ? SEEK_CUR : SEEK_SET)) == -1)
-		err_dump("_db_readidx: lseek error");
+	if ((eofok = (offset == 0)))
+		offset = cp->nextoff;
+	cp->idxoff = offset;
 
 	/*
 	 * Read the ascii chain ptr and the ascii length at
 	 * the front of the index record.  This tells us the
 	 * remaining size of the index record.
 	 */
-	iov[0].iov_base = asciiptr;
-	iov[0].iov_len  = PTR_SZ;
-	iov[1].iov_base = asciilen;
-	iov[1].iov_len  = IDXLEN_SZ;
-	if ((i = readv(db->idxfd, &iov[0], 2)) != PTR_SZ + IDXLEN_SZ) {
-		if (i == 0 && offset == 0)
+	if ((i = pread(db->idxfd, asciiptrlen, PTR_SZ + IDXLEN_SZ, offset)) !=
+	  PTR_SZ + IDXLEN_SZ) {
+		if (i == 0 && eofok)
 			return(-1);		/* EOF for db_nextrec */
-		err_dump("_db_readidx: readv error of index record");
+		err_dump("_db_readidx: read error of index record");
 	}
 
 	/*
 	 * This is our return value; always >= 0.
 	 */
-	asciiptr[PTR_SZ] = 0;        /* null terminate */
-	db->ptrval = atol(asciiptr); /* offset of next key in chain */
+	memcpy(asciilen, asciiptrlen + PTR_SZ, IDXLEN_SZ);
+	asciiptrlen[PTR_SZ] = 0;        /* null terminate */
+	cp->ptrval = atol(asciiptrlen); /* offset of next key in chain */
 
 	asciilen[IDXLEN_SZ] = 0;     /* null terminate */
-	if ((db->idxlen = atoi(asciilen)) < IDXLEN_MIN ||
-	  db->idxlen > IDXLEN_MAX)
+	if ((cp->idxlen = atoi(asciilen)) < IDXLEN_MIN ||
+	  cp->idxlen > IDXLEN_MAX)
 		err_dump("_db_readidx: invalid length");
 
 	/*
 	 * Now read the actual index record.  We read it into the key
-	 * buffer that we malloced when we opened the database.
+	 * buffer that we malloced for the cursor.
 	 */
-	if ((i = read(db->idxfd, db->idxbuf, db->idxlen)) != db->idxlen)
+	if ((i = pread(db->idxfd, cp->idxbuf, cp->idxlen,
+	  offset + PTR_SZ + IDXLEN_SZ)) != cp->idxlen)
 		err_dump("_db_readidx: read error of index record");
-	if (db->idxbuf[db->idxlen-1] != NEWLINE)	/* sanity check */
+	if (cp->idxbuf[cp->idxlen-1] != NEWLINE)	/* sanity check */
 		err_dump("_db_readidx: missing newline");
-	db->idxbuf[db->idxlen-1] = 0;	 /* replace newline with null */
+	cp->idxbuf[cp->idxlen-1] = 0;	 /* replace newline with null */
+	cp->nextoff = offset + PTR_SZ + IDXLEN_SZ + cp->idxlen;
 
 	/*
 	 * Find the separators in the index record.
 	 */
-	if ((ptr1 = strchr(db->idxbuf, SEP)) == NULL)
+	if ((ptr1 = strchr(cp->idxbuf, SEP)) == NULL)
 		err_dump("_db_readidx: missing first separator");
 	*ptr1++ = 0;				/* replace SEP with null */
 
@@ -410,11 +876,11 @@ _db_readidx(DB *db, off_t offset)
 	/*
 	 * Get the starting offset and length of the data record.
 	 */
-	if ((db->datoff = atol(ptr1)) < 0)
+	if ((cp->datoff = atol(ptr1)) < 0)
 		err_dump("_db_readidx: starting offset < 0");
-	if ((db->datlen = atol(ptr2)) <= 0 || db->datlen > DATLEN_MAX)
+	if ((cp->datlen = atol(ptr2)) <= 0 || cp->datlen > DATLEN_MAX)
 		err_dump("_db_readidx: invalid length");
-	return(db->ptrval);		/* return offset of next key in chain */
+	return(cp->ptrval);		/* return offset of next key in chain */
 }
 
 /*
@@ -422,16 +888,15 @@ _db_readidx(DB *db, off_t offset)
  * Return a pointer to the null-terminated data buffer.
  */
 static char *
-_db_readdat(DB *db)
+_db_readdat(DB *db, DBCUR *cp)
 {
-	if (lseek(db->datfd, db->datoff, SEEK_SET) == -1)
-		err_dump("_db_readdat: lseek error");
-	if (read(db->datfd, db->datbuf, db->datlen) != db->datlen)
+	if (pread(db->datfd, cp->datbuf, cp->datlen, cp->datoff) !=
+	  cp->datlen)
 		err_dump("_db_readdat: read error");
-	if (db->datbuf[db->datlen-1] != NEWLINE)	/* sanity check */
+	if (cp->datbuf[cp->datlen-1] != NEWLINE)	/* sanity check */
 		err_dump("_db_readdat: missing newline");
-	db->datbuf[db->datlen-1] = 0; /* replace newline with null */
-	return(db->datbuf);		/* return pointer to data record */
+	cp->datbuf[cp->datlen-1] = 0; /* replace newline with null */
+	return(cp->datbuf);		/* return pointer to data record */
 }
 
 /*
@@ -441,27 +906,29 @@ int
 db_delete(DBHANDLE h, const char *key)
 {
 	DB		*db = h;
+	DBCUR	*cp = _db_cursor(db);
 	int		rc = 0;			/* assume record will be found */
 
-	if (_db_find_and_lock(db, key, 1) == 0) {
-		_db_dodelete(db);
-		db->cnt_delok++;
+	if (_db_find_and_lock(db, cp, key, 1) == 0) {
+		_db_dodelete(db, cp);
+		if (db->logfd >= 0)
+			_db_log(db, DB_LOGDELETE, key, "");
+		COUNTUP(db->cnt_delok);
 	} else {
 		rc = -1;			/* not found */
-		db->cnt_delerr++;
+		COUNTUP(db->cnt_delerr);
 	}
-	if (un_lock(db->idxfd, db->chainoff, SEEK_SET, 1) < 0)
-		err_dump("db_delete: un_lock error");
+	_db_unlock(db, LK_CHAIN(db, cp->chainoff));
 	return(rc);
 }
 
 /*
- * Delete the current record specified by the DB structure.
+ * Delete the current record specified by the cursor.
  * This function is called by db_delete and db_store, after
  * the record has been located by _db_find_and_lock.
  */
 static void
-_db_dodelete(DB *db)
+_db_dodelete(DB *db, DBCUR *cp)
 {
 	int		i;
 	char	*ptr;
@@ -470,23 +937,22 @@ _db_dodelete(DB *db)
 	/*
 	 * Set data buffer and key to all blanks.
 	 */
-	for (ptr = db->datbuf, i = 0; i < db->datlen - 1; i++)
+	for (ptr = cp->datbuf, i = 0; i < cp->datlen - 1; i++)
 		*ptr++ = SPACE;
 	*ptr = 0;	/* null terminate for _db_writedat */
-	ptr = db->idxbuf;
+	ptr = cp->idxbuf;
 	while (*ptr)
 		*ptr++ = SPACE;
 
 	/*
 	 * We have to lock the free list.
 	 */
-	if (writew_lock(db->idxfd, FREE_OFF, SEEK_SET, 1) < 0)
-		err_dump("_db_dodelete: writew_lock error");
+	_db_lock(db, LK_FREE, 1);
 
 	/*
 	 * Write the data record with all blanks.
 	 */
-	_db_writedat(db, db->datbuf, db->datoff, SEEK_SET);
+	_db_writedat(db, cp, cp->datbuf, cp->datoff, SEEK_SET);
 
 	/*
 	 * Read the free list pointer.  Its value becomes the
@@ -499,29 +965,28 @@ _db_dodelete(DB *db)
 	 * Save the contents of index record chain ptr,
 	 * before it's rewritten by _db_writeidx.
 	 */
-	saveptr = db->ptrval;
+	saveptr = cp->ptrval;
 
 	/*
 	 * Rewrite the index record.  This also rewrites the length
 	 * of the index record, the data offset, and the data length,
 	 * none of which has changed, but that's OK.
 	 */
-	_db_writeidx(db, db->idxbuf, db->idxoff, SEEK_SET, freeptr);
+	_db_writeidx(db, cp, cp->idxbuf, cp->idxoff, SEEK_SET, freeptr);
 
 	/*
 	 * Write the new free list pointer.
 	 */
-	_db_writeptr(db, FREE_OFF, db->idxoff);
+	_db_writeptr(db, FREE_OFF, cp->idxoff);
 
 	/*
 	 * Rewrite the chain ptr that pointed to this record being
-	 * deleted.  Recall that _db_find_and_lock sets db->ptroff to
+	 * deleted.  Recall that _db_find_and_lock sets cp->ptroff to
 	 * point to this chain ptr.  We set this chain ptr to the
 	 * contents of the deleted record's chain ptr, saveptr.
 	 */
-	_db_writeptr(db, db->ptroff, saveptr);
-	if (un_lock(db->idxfd, FREE_OFF, SEEK_SET, 1) < 0)
-		err_dump("_db_dodelete: un_lock error");
+	_db_writeptr(db, cp->ptroff, saveptr);
+	_db_unlock(db, LK_FREE);
 }
 
 /*
@@ -529,86 +994,77 @@ _db_dodelete(DB *db)
  * the record with blanks) and db_store.
  */
 static void
-_db_writedat(DB *db, const char *data, off_t offset, int whence)
+_db_writedat(DB *db, DBCUR *cp, const char *data, off_t offset, int whence)
 {
-	struct iovec	iov[2];
-	static char	newline = NEWLINE;
+	char	buf[DATLEN_MAX];
 
 	/*
-	 * If we're appending, we have to lock before doing the lseek
-	 * and write to make the two an atomic operation.  If we're
-	 * overwriting an existing record, we don't have to lock.
+	 * If we're appending, we have to lock before finding the end
+	 * of the file and writing there, to make the two an atomic
+	 * operation.  If we're overwriting an existing record, we
+	 * don't have to lock.
 	 */
-	if (whence == SEEK_END) /* we're appending, lock entire file */
-		if (writew_lock(db->datfd, 0, SEEK_SET, 0) < 0)
-			err_dump("_db_writedat: writew_lock error");
-
-	if ((db->datoff = lseek(db->datfd, offset, whence)) == -1)
-		err_dump("_db_writedat: lseek error");
-	db->datlen = strlen(data) + 1;	/* datlen includes newline */
+	if (whence == SEEK_END) { /* we're appending, lock entire file */
+		_db_lock(db, LK_DATEND(db), 1);
+		if ((offset = lseek(db->datfd, 0, SEEK_END)) == -1)
+			err_dump("_db_writedat: lseek error");
+	}
+	cp->datoff = offset;
+	cp->datlen = strlen(data) + 1;	/* datlen includes newline */
 
-	iov[0].iov_base = (char *) data;
-	iov[0].iov_len  = db->datlen - 1;
-	iov[1].iov_base = &newline;
-	iov[1].iov_len  = 1;
-	if (writev(db->datfd, &iov[0], 2) != db->datlen)
-		err_dump("_db_writedat: writev error of data record");
+	memcpy(buf, data, cp->datlen - 1);
+	buf[cp->datlen - 1] = NEWLINE;
+	if (pwrite(db->datfd, buf, cp->datlen, offset) != cp->datlen)
+		err_dump("_db_writedat: write error of data record");
 
 	if (whence == SEEK_END)
-		if (un_lock(db->datfd, 0, SEEK_SET, 0) < 0)
-			err_dump("_db_writedat: un_lock error");
+		_db_unlock(db, LK_DATEND(db));
 }
 
 /*
  * Write an index record.  _db_writedat is called before
  * this function to set the datoff and datlen fields in the
- * DB structure, which we need to write the index record.
+ * cursor, which we need to write the index record.
  */
 static void
-_db_writeidx(DB *db, const char *key,
+_db_writeidx(DB *db, DBCUR *cp, const char *key,
              off_t offset, int whence, off_t ptrval)
 {
-	struct iovec	iov[2];
-	char			asciiptrlen[PTR_SZ + IDXLEN_SZ + 1];
+	char			buf[PTR_SZ + IDXLEN_SZ + IDXLEN_MAX + 2];
 	int				len;
 
-	if ((db->ptrval = ptrval) < 0 || ptrval > PTR_MAX)
+	if ((cp->ptrval = ptrval) < 0 || ptrval > PTR_MAX)
 		err_quit("_db_writeidx: invalid ptr: %d", ptrval);
-	sprintf(db->idxbuf, "%s%c%lld%c%ld\n", key, SEP,
-	  (long long)db->datoff, SEP, (long)db->datlen);
-	len = strlen(db->idxbuf);
+	sprintf(cp->idxbuf, "%s%c%lld%c%ld\n", key, SEP,
+	  (long long)cp->datoff, SEP, (long)cp->datlen);
+	len = strlen(cp->idxbuf);
 	if (len < IDXLEN_MIN || len > IDXLEN_MAX)
 		err_dump("_db_writeidx: invalid length");
-	sprintf(asciiptrlen, "%*lld%*d", PTR_SZ, (long long)ptrval,
-	  IDXLEN_SZ, len);
+	sprintf(buf, "%*lld%*d", PTR_SZ, (long long)ptrval, IDXLEN_SZ, len);
+	memcpy(buf + PTR_SZ + IDXLEN_SZ, cp->idxbuf, len);
 
 	/*
-	 * If we're appending, we have to lock before doing the lseek
-	 * and write to make the two an atomic operation.  If we're
-	 * overwriting an existing record, we don't have to lock.
+	 * If we're appending, we have to lock before finding the end
+	 * of the file and writing there, to make the two an atomic
+	 * operation.  If we're overwriting an existing record, we
+	 * don't have to lock.
 	 */
-	if (whence == SEEK_END)		/* we're appending */
-		if (writew_lock(db->idxfd, ((db->nhash+1)*PTR_SZ)+1,
-		  SEEK_SET, 0) < 0)
-			err_dump("_db_writeidx: writew_lock error");
+	if (whence == SEEK_END) {		/* we're appending */
+		_db_lock(db, LK_IDXEND(db), 1);
+		if ((offset = lseek(db->idxfd, 0, SEEK_END)) == -1)
+			err_dump("_db_writeidx: lseek error");
+	}
 
 	/*
-	 * Position the index file and record the offset.
+	 * Record the offset and write the record.
 	 */
-	if ((db->idxoff = lseek(db->idxfd, offset, whence)) == -1)
-		err_dump("_db_writeidx: lseek error");
-
-	iov[0].iov_base = asciiptrlen;
-	iov[0].iov_len  = PTR_SZ + IDXLEN_SZ;
-	iov[1].iov_base = db->idxbuf;
-	iov[1].iov_len  = len;
-	if (writev(db->idxfd, &iov[0], 2) != PTR_SZ + IDXLEN_SZ + len)
-		err_dump("_db_writeidx: writev error of index record");
+	cp->idxoff = offset;
+	if (pwrite(db->idxfd, buf, PTR_SZ + IDXLEN_SZ + len, offset) !=
+	  PTR_SZ + IDXLEN_SZ + len)
+		err_dump("_db_writeidx: write error of index record");
 
 	if (whence == SEEK_END)
-		if (un_lock(db->idxfd, ((db->nhash+1)*PTR_SZ)+1,
-		  SEEK_SET, 0) < 0)
-			err_dump("_db_writeidx: un_lock error");
+		_db_unlock(db, LK_IDXEND(db));
 }
 
 /*
@@ -624,12 +1080,42 @@ _db_writeptr(DB *db, off_t offset, off_t ptrval)
 		err_quit("_db_writeptr: invalid ptr: %d", ptrval);
 	sprintf(asciiptr, "%*lld", PTR_SZ, (long long)ptrval);
 
-	if (lseek(db->idxfd, offset, SEEK_SET) == -1)
-		err_dump("_db_writeptr: lseek error to ptr field");
-	if (write(db->idxfd, asciiptr, PTR_SZ) != PTR_SZ)
+	if (pwrite(db->idxfd, asciiptr, PTR_SZ, offset) != PTR_SZ)
 		err_dump("_db_writeptr: write error of ptr field");
 }
 
+/*
+ * DB_LOG: append a record of a change to the log.  The caller holds
+ * the lock on the hash chain it changed, so the changes to any one
+ * key are logged in the order they were made.
+ */
+static void
+_db_log(DB *db, int op, const char *key, const char *data)
+{
+	char	buf[LOGREC_MAX + 1];
+	int		keylen, datlen, len;
+	off_t	offset;
+
+	keylen = strlen(key);
+	datlen = strlen(data);
+	sprintf(buf, "%c%*d%*d", op, LOGLEN_SZ, keylen, LOGLEN_SZ, datlen);
+	memcpy(buf + LOG_HDRSZ, key, keylen);
+	memcpy(buf + LOG_HDRSZ + keylen, data, datlen);
+	len = LOG_HDRSZ + keylen + datlen;
+	buf[len++] = NEWLINE;
+
+	/*
+	 * Find the end and write there atomically, as _db_writedat
+	 * does when it appends.
+	 */
+	_db_lock(db, LK_LOGEND(db), 1);
+	if ((offset = lseek(db->logfd, 0, SEEK_END)) == -1)
+		err_dump("_db_log: lseek error");
+	if (pwrite(db->logfd, buf, len, offset) != len)
+		err_dump("_db_log: write error of log record");
+	_db_unlock(db, LK_LOGEND(db));
+}
+
 /*
  * Store a record in the database.  Return 0 if OK, 1 if record
  * exists and DB_INSERT specified, -1 on error.
@@ -638,6 +1124,7 @@ int
 db_store(DBHANDLE h, const char *key, const char *data, int flag)
 {
 	DB		*db = h;
+	DBCUR	*cp;
 	int		rc, keylen, datlen;
 	off_t	ptrval;
 
@@ -650,18 +1137,19 @@ db_store(DBHANDLE h, const char *key, const char *data, int flag)
 	datlen = strlen(data) + 1;		/* +1 for newline at end */
 	if (datlen < DATLEN_MIN || datlen > DATLEN_MAX)
 		err_dump("db_store: invalid data length");
+	cp = _db_cursor(db);
 
 	/*
 	 * _db_find_and_lock calculates which hash table this new record
-	 * goes into (db->chainoff), regardless of whether it already
+	 * goes into (cp->chainoff), regardless of whether it already
 	 * exists or not. The following calls to _db_writeptr change the
 	 * hash table entry for this chain to point to the new record.
 	 * The new record is added to the front of the hash chain.
 	 */
-	if (_db_find_and_lock(db, key, 1) < 0) { /* record not found */
+	if (_db_find_and_lock(db, cp, key, 1) < 0) { /* record not found */
 		if (flag == DB_REPLACE) {
 			rc = -1;
-			db->cnt_storerr++;
+			COUNTUP(db->cnt_storerr);
 			errno = ENOENT;		/* error, record does not exist */
 			goto doreturn;
 		}
@@ -670,37 +1158,37 @@ db_store(DBHANDLE h, const char *key, const char *data, int flag)
 		 * _db_find_and_lock locked the hash chain for us; read
 		 * the chain ptr to the first index record on hash chain.
 		 */
-		ptrval = _db_readptr(db, db->chainoff);
+		ptrval = _db_readptr(db, cp->chainoff);
 
-		if (_db_findfree(db, keylen, datlen) < 0) {
+		if (_db_findfree(db, cp, keylen, datlen) < 0) {
 			/*
 			 * Can't find an empty record big enough. Append the
 			 * new record to the ends of the index and data files.
 			 */
-			_db_writedat(db, data, 0, SEEK_END);
-			_db_writeidx(db, key, 0, SEEK_END, ptrval);
+			_db_writedat(db, cp, data, 0, SEEK_END);
+			_db_writeidx(db, cp, key, 0, SEEK_END, ptrval);
 
 			/*
-			 * db->idxoff was set by _db_writeidx.  The new
+			 * cp->idxoff was set by _db_writeidx.  The new
 			 * record goes to the front of the hash chain.
 			 */
-			_db_writeptr(db, db->chainoff, db->idxoff);
-			db->cnt_stor1++;
+			_db_writeptr(db, cp->chainoff, cp->idxoff);
+			COUNTUP(db->cnt_stor1);
 		} else {
 			/*
 			 * Reuse an empty record. _db_findfree removed it from
-			 * the free list and set both db->datoff and db->idxoff.
+			 * the free list and set both cp->datoff and cp->idxoff.
 			 * Reused record goes to the front of the hash chain.
 			 */
-			_db_writedat(db, data, db->datoff, SEEK_SET);
-			_db_writeidx(db, key, db->idxoff, SEEK_SET, ptrval);
-			_db_writeptr(db, db->chainoff, db->idxoff);
-			db->cnt_stor2++;
+			_db_writedat(db, cp, data, cp->datoff, SEEK_SET);
+			_db_writeidx(db, cp, key, cp->idxoff, SEEK_SET, ptrval);
+			_db_writeptr(db, cp->chainoff, cp->idxoff);
+			COUNTUP(db->cnt_stor2);
 		}
 	} else {						/* record found */
 		if (flag == DB_INSERT) {
 			rc = 1;		/* error, record already in db */
-			db->cnt_storerr++;
+			COUNTUP(db->cnt_storerr);
 			goto doreturn;
 		}
 
@@ -709,39 +1197,40 @@ db_store(DBHANDLE h, const char *key, const char *data, int flag)
 		 * key equals the existing key, but we need to check if
 		 * the data records are the same size.
 		 */
-		if (datlen != db->datlen) {
-			_db_dodelete(db);	/* delete the existing record */
+		if (datlen != cp->datlen) {
+			_db_dodelete(db, cp);	/* delete the existing record */
 
 			/*
 			 * Reread the chain ptr in the hash table
 			 * (it may change with the deletion).
 			 */
-			ptrval = _db_readptr(db, db->chainoff);
+			ptrval = _db_readptr(db, cp->chainoff);
 
 			/*
 			 * Append new index and data records to end of files.
 			 */
-			_db_writedat(db, data, 0, SEEK_END);
-			_db_writeidx(db, key, 0, SEEK_END, ptrval);
+			_db_writedat(db, cp, data, 0, SEEK_END);
+			_db_writeidx(db, cp, key, 0, SEEK_END, ptrval);
 
 			/*
 			 * New record goes to the front of the hash chain.
 			 */
-			_db_writeptr(db, db->chainoff, db->idxoff);
-			db->cnt_stor3++;
+			_db_writeptr(db, cp->chainoff, cp->idxoff);
+			COUNTUP(db->cnt_stor3);
 		} else {
 			/*
 			 * Same size data, just replace data record.
 			 */
-			_db_writedat(db, data, db->datoff, SEEK_SET);
-			db->cnt_stor4++;
+			_db_writedat(db, cp, data, cp->datoff, SEEK_SET);
+			COUNTUP(db->cnt_stor4);
 		}
 	}
+	if (db->logfd >= 0)
+		_db_log(db, DB_LOGSTORE, key, data);
 	rc = 0;		/* OK */
 
 doreturn:	/* unlock hash chain locked by _db_find_and_lock */
-	if (un_lock(db->idxfd, db->chainoff, SEEK_SET, 1) < 0)
-		err_dump("db_store: un_lock error");
+	_db_unlock(db, LK_CHAIN(db, cp->chainoff));
 	return(rc);
 }
 
@@ -750,7 +1239,7 @@ doreturn:	/* unlock hash chain locked by _db_find_and_lock */
  * of the correct sizes.  We're only called by db_store.
  */
 static int
-_db_findfree(DB *db, int keylen, int datlen)
+_db_findfree(DB *db, DBCUR *cp, int keylen, int datlen)
 {
 	int		rc;
 	off_t	offset, nextoffset, saveoffset;
@@ -758,8 +1247,7 @@ _db_findfree(DB *db, int keylen, int datlen)
 	/*
 	 * Lock the free list.
 	 */
-	if (writew_lock(db->idxfd, FREE_OFF, SEEK_SET, 1) < 0)
-		err_dump("_db_findfree: writew_lock error");
+	_db_lock(db, LK_FREE, 1);
 
 	/*
 	 * Read the free list pointer.
@@ -768,8 +1256,8 @@ _db_findfree(DB *db, int keylen, int datlen)
 	offset = _db_readptr(db, saveoffset);
 
 	while (offset != 0) {
-		nextoffset = _db_readidx(db, offset);
-		if (strlen(db->idxbuf) == keylen && db->datlen == datlen)
+		nextoffset = _db_readidx(db, cp, offset);
+		if (strlen(cp->idxbuf) == keylen && cp->datlen == datlen)
 			break;		/* found a match */
 		saveoffset = offset;
 		offset = nextoffset;
@@ -781,17 +1269,17 @@ _db_findfree(DB *db, int keylen, int datlen)
 		/*
 		 * Found a free record with matching sizes.
 		 * The index record was read in by _db_readidx above,
-		 * which sets db->ptrval.  Also, saveoffset points to
+		 * which sets cp->ptrval.  Also, saveoffset points to
 		 * the chain ptr that pointed to this empty record on
-		 * the free list.  We set this chain ptr to db->ptrval,
+		 * the free list.  We set this chain ptr to cp->ptrval,
 		 * which removes the empty record from the free list.
 		 */
-		_db_writeptr(db, saveoffset, db->ptrval);
+		_db_writeptr(db, saveoffset, cp->ptrval);
 		rc = 0;
 
 		/*
-		 * Notice also that _db_readidx set both db->idxoff
-		 * and db->datoff.  This is used by the caller, db_store,
+		 * Notice also that _db_readidx set both cp->idxoff
+		 * and cp->datoff.  This is used by the caller, db_store,
 		 * to write the new index record and data record.
 		 */
 	}
@@ -799,8 +1287,7 @@ _db_findfree(DB *db, int keylen, int datlen)
 	/*
 	 * Unlock the free list.
 	 */
-	if (un_lock(db->idxfd, FREE_OFF, SEEK_SET, 1) < 0)
-		err_dump("_db_findfree: un_lock error");
+	_db_unlock(db, LK_FREE);
 	return(rc);
 }
 
@@ -808,6 +1295,7 @@ _db_findfree(DB *db, int keylen, int datlen)
  * Rewind the index file for db_nextrec.
  * Automatically called by db_open.
  * Must be called before first db_nextrec.
+ * With DB_MT, each thread has its own position.
  */
 void
 db_rewind(DBHANDLE h)
@@ -818,12 +1306,12 @@ db_rewind(DBHANDLE h)
 	offset = (db->nhash + 1) * PTR_SZ;	/* +1 for free list ptr */
 
 	/*
-	 * We're just setting the file offset for this process
+	 * We're just setting the position for this cursor
 	 * to the start of the index records; no need to lock.
 	 * +1 below for newline at end of hash table.
 	 */
-	if ((db->idxoff = lseek(db->idxfd, offset+1, SEEK_SET)) == -1)
-		err_dump("db_rewind: lseek error");
+	_db_cursor(db)->nextoff = offset + 1;
+	db->cur.nextoff = offset + 1;
 }
 
 /*
@@ -836,6 +1324,7 @@ char *
 db_nextrec(DBHANDLE h, char *key)
 {
 	DB		*db = h;
+	DBCUR	*cp = _db_cursor(db);
 	char	c;
 	char	*ptr;
 
@@ -843,14 +1332,13 @@ db_nextrec(DBHANDLE h, char *key)
 	 * We read lock the free list so that we don't read
 	 * a record in the middle of its being deleted.
 	 */
-	if (readw_lock(db->idxfd, FREE_OFF, SEEK_SET, 1) < 0)
-		err_dump("db_nextrec: readw_lock error");
+	_db_lock(db, LK_FREE, 0);
 
 	do {
 		/*
 		 * Read next sequential index record.
 		 */
-		if (_db_readidx(db, 0) < 0) {
+		if (_db_readidx(db, cp, 0) < 0) {
 			ptr = NULL;		/* end of index file, EOF */
 			goto doreturn;
 		}
@@ -858,18 +1346,383 @@ db_nextrec(DBHANDLE h, char *key)
 		/*
 		 * Check if key is all blank (empty record).
 		 */
-		ptr = db->idxbuf;
+		ptr = cp->idxbuf;
 		while ((c = *ptr++) != 0  &&  c == SPACE)
 			;	/* skip until null byte or nonblank */
 	} while (c == 0);	/* loop until a nonblank key is found */
 
 	if (key != NULL)
-		strcpy(key, db->idxbuf);	/* return key */
-	ptr = _db_readdat(db);	/* return pointer to data buffer */
-	db->cnt_nextrec++;
+		strcpy(key, cp->idxbuf);	/* return key */
+	ptr = _db_readdat(db, cp);	/* return pointer to data buffer */
+	COUNTUP(db->cnt_nextrec);
 
 doreturn:
-	if (un_lock(db->idxfd, FREE_OFF, SEEK_SET, 1) < 0)
-		err_dump("db_nextrec: un_lock error");
+	_db_unlock(db, LK_FREE);
 	return(ptr);
 }
+
+/*
+ * Build a database from scratch out of the records getrec returns.
+ * Instead of a db_store for each, which walks its chain, searches the
+ * free list, and writes pointers one at a time, we append the data
+ * records to the data file as they come, partition the index records
+ * by hash chain in memory, and write the whole index file in one
+ * pass, with the records of each chain next to each other.
+ *
+ * getrec sets its arguments to the next key and data, which need stay
+ * good only until it's called again, and returns 1, or 0 at the end,
+ * or -1 on error.  If a key comes more than once the last one wins, as
+ * with DB_STORE; the data records of the others are left unreferenced.
+ * Any existing database by that name is truncated, and left empty, as
+ * db_open creates one, if we fail.
+ *
+ * If the database has a change log (DB_LOG), the truncation and every
+ * record that survives are logged as db_open and db_store would log
+ * them, so a replica following the log ends up with the same records.
+ * The records are logged only once the index is complete; if we fail,
+ * the log gets another truncation instead.
+ *
+ * Returns the number of records stored, or -1 on error (EINVAL for a
+ * key or data too long, EFBIG if the index would outgrow PTR_MAX).
+ */
+long
+db_bulkload(const char *pathname, int mode,
+            int (*getrec)(void *, char **, char **), void *arg)
+{
+	DB			*db;
+	BULKREC		*recs, *rp, **chain;
+	KEYPOOL		*pool, *kp;
+	FILE		*datfp, *idxfp;
+	long		nrecs, maxrecs, n, first, i, *start;
+	int			len, rc, err;
+	size_t		keylen;
+	char		*key, *data, buf[IDXLEN_MAX + 64];
+	off_t		datoff, idxoff;
+	DBHASH		h;
+
+	len = strlen(pathname);
+	if ((db = _db_alloc(len)) == NULL)
+		err_dump("db_bulkload: _db_alloc error for DB");
+	db->nhash   = NHASH_DEF;
+	db->hashoff = HASH_OFF;
+	strcpy(db->name, pathname);
+	strcat(db->name, ".idx");
+	db->idxfd = open(db->name, O_RDWR | O_CREAT | O_TRUNC, mode);
+	strcpy(db->name + len, ".dat");
+	db->datfd = open(db->name, O_RDWR | O_CREAT | O_TRUNC, mode);
+	if (db->idxfd < 0 || db->datfd < 0) {
+		_db_free(db);
+		return(-1);
+	}
+	strcpy(db->name + len, ".log");
+	if ((db->logfd = open(db->name, O_WRONLY)) < 0 && errno != ENOENT) {
+		_db_free(db);
+		return(-1);
+	}
+
+	/*
+	 * Keep out anyone who opens the database before the index is
+	 * complete, as db_open does while it initializes one.  The
+	 * streams write through duplicates, so closing them leaves
+	 * our descriptors, and the lock, alone.
+	 */
+	if (writew_lock(db->idxfd, 0, SEEK_SET, 0) < 0)
+		err_dump("db_bulkload: writew_lock error");
+	if (db->logfd >= 0)
+		_db_log(db, DB_LOGTRUNC, "", "");
+	if ((datfp = fdopen(dup(db->datfd), "w")) == NULL)
+		err_dump("db_bulkload: fdopen error");
+	setvbuf(datfp, NULL, _IOFBF, 65536);
+	recs = NULL;
+	chain = NULL;
+	start = NULL;
+	pool = NULL;
+	nrecs = maxrecs = 0;
+	datoff = 0;
+
+	/*
+	 * Append each data record to the data file, and remember
+	 * its key and where the data went.
+	 */
+	while ((rc = getrec(arg, &key, &data)) > 0) {
+		if (nrecs == maxrecs) {
+			maxrecs = maxrecs == 0 ? 1024 : maxrecs * 2;
+			if ((recs = realloc(recs, maxrecs * sizeof(BULKREC))) == NULL)
+				err_dump("db_bulkload: realloc error for records");
+		}
+		rp = &recs[nrecs];
+		rp->datoff = datoff;
+		rp->datlen = strlen(data) + 1;	/* +1 for newline at end */
+		keylen = strlen(key);
+		if (rp->datlen < DATLEN_MIN || rp->datlen > DATLEN_MAX ||
+		  keylen > IDXLEN_MAX) {
+			rc = -1;
+			errno = EINVAL;
+			break;
+		}
+		rp->idxlen = sprintf(buf, "%s%c%lld%c%ld\n", key, SEP,
+		  (long long)rp->datoff, SEP, (long)rp->datlen);
+		if (rp->idxlen < IDXLEN_MIN || rp->idxlen > IDXLEN_MAX) {
+			rc = -1;
+			errno = EINVAL;
+			break;
+		}
+		if (pool == NULL || pool->used + keylen + 1 > KEYPOOL_SZ) {
+			if ((kp = malloc(sizeof(KEYPOOL))) == NULL)
+				err_dump("db_bulkload: malloc error for keys");
+			kp->next = pool;
+			kp->used = 0;
+			pool = kp;
+		}
+		rp->key = pool->buf + pool->used;
+		memcpy(rp->key, key, keylen + 1);
+		pool->used += keylen + 1;
+		rp->hash = _db_hash(db, key);
+		if (fputs(data, datfp) == EOF || putc(NEWLINE, datfp) == EOF)
+			err_dump("db_bulkload: write error of data record");
+		datoff += rp->datlen;
+		nrecs++;
+	}
+	if (rc < 0)
+		goto errout;
+	if (fclose(datfp) == EOF)
+		err_dump("db_bulkload: write error of data file");
+	datfp = NULL;
+
+	/*
+	 * Partition the records by hash chain: count each chain,
+	 * then place the records.  start[h] ends up as the first
+	 * record of chain h, and start[nhash] as the end.
+	 */
+	if ((start = calloc(db->nhash + 1, sizeof(long))) == NULL ||
+	  (chain = malloc((nrecs + 1) * sizeof(BULKREC *))) == NULL)
+		err_dump("db_bulkload: malloc error for chains");
+	for (i = 0; i < nrecs; i++)
+		start[recs[i].hash + 1]++;
+	for (h = 0; h < db->nhash; h++)
+		start[h + 1] += start[h];
+	for (i = 0; i < nrecs; i++)
+		chain[start[recs[i].hash]++] = &recs[i];
+	for (h = db->nhash; h > 0; h--)
+		start[h] = start[h - 1];
+	start[0] = 0;
+
+	/*
+	 * Sort each chain by key to drop the duplicates, and lay out
+	 * the index file.  Records that survive are packed down, so
+	 * the chains stay in order.
+	 */
+	idxoff = (db->nhash + 1) * PTR_SZ + 1;	/* +1 for free list ptr */
+	n = 0;
+	for (h = 0; h < db->nhash; h++) {
+		first = n;
+		qsort(chain + start[h], start[h + 1] - start[h],
+		  sizeof(BULKREC *), _db_bulkcmp);
+		for (i = start[h]; i < start[h + 1]; i++) {
+			if (i + 1 < start[h + 1] &&
+			  strcmp(chain[i]->key, chain[i + 1]->key) == 0)
+				continue;	/* a later record has the same key */
+			if (idxoff > PTR_MAX) {
+				rc = -1;
+				errno = EFBIG;
+				goto errout;
+			}
+			chain[i]->idxoff = idxoff;
+			idxoff += PTR_SZ + IDXLEN_SZ + chain[i]->idxlen;
+			chain[n++] = chain[i];
+		}
+		start[h] = first;
+	}
+	start[db->nhash] = n;
+
+	/*
+	 * Write the free list ptr, the hash table, and then the
+	 * index records, chain by chain.
+	 */
+	if ((idxfp = fdopen(dup(db->idxfd), "w")) == NULL)
+		err_dump("db_bulkload: fdopen error");
+	setvbuf(idxfp, NULL, _IOFBF, 65536);
+	fprintf(idxfp, "%*d", PTR_SZ, 0);
+	for (h = 0; h < db->nhash; h++)
+		fprintf(idxfp, "%*lld", PTR_SZ, start[h] < start[h + 1] ?
+		  (long long)chain[start[h]]->idxoff : 0LL);
+	putc(NEWLINE, idxfp);
+	for (h = 0; h < db->nhash; h++) {
+		for (i = start[h]; i < start[h + 1]; i++) {
+			rp = chain[i];
+			fprintf(idxfp, "%*lld%*d%s%c%lld%c%ld\n", PTR_SZ,
+			  i + 1 < start[h + 1] ? (long long)chain[i + 1]->idxoff : 0LL,
+			  IDXLEN_SZ, rp->idxlen, rp->key, SEP, (long long)rp->datoff,
+			  SEP, (long)rp->datlen);
+		}
+	}
+	if (fclose(idxfp) == EOF)
+		err_dump("db_bulkload: write error of index file");
+
+	/*
+	 * Only now that nothing can fail do we log the records,
+	 * reading each one's data back from the data file.  They go
+	 * chain by chain rather than in the order they came, which
+	 * leaves a replica with the same records all the same.
+	 */
+	if (db->logfd >= 0) {
+		data = db->cur.datbuf;
+		for (i = 0; i < n; i++) {
+			rp = chain[i];
+			if (pread(db->datfd, data, rp->datlen, rp->datoff) !=
+			  rp->datlen)
+				err_dump("db_bulkload: read error of data record");
+			data[rp->datlen - 1] = 0;	/* replace newline */
+			_db_log(db, DB_LOGSTORE, rp->key, data);
+		}
+	}
+	rc = 0;
+
+errout:
+	err = errno;
+	if (datfp != NULL)
+		fclose(datfp);
+	while ((kp = pool) != NULL) {
+		pool = kp->next;
+		free(kp);
+	}
+	free(recs);
+	free(chain);
+	free(start);
+	if (rc < 0) {
+		/*
+		 * Leave an empty database behind, as db_open would
+		 * make it: an index file of nothing but the hash table,
+		 * which db_fetch and the rest can read.
+		 */
+		ftruncate(db->idxfd, 0);
+		ftruncate(db->datfd, 0);
+		if (_db_inithash(db) < 0)
+			err_dump("db_bulkload: index file init write error");
+		if (db->logfd >= 0)
+			_db_log(db, DB_LOGTRUNC, "", "");
+	}
+	_db_free(db);		/* closing the index file drops the lock */
+	if (rc < 0) {
+		errno = err;
+		return(-1);
+	}
+	return(n);
+}
+
+/*
+ * Order records by key for db_bulkload, and those with the same
+ * key by the order they were read in.
+ */
+static int
+_db_bulkcmp(const void *a, const void *b)
+{
+	const BULKREC	*ra = *(BULKREC * const *)a;
+	const BULKREC	*rb = *(BULKREC * const *)b;
+	int				c;
+
+	if ((c = strcmp(ra->key, rb->key)) != 0)
+		return(c);
+	return(ra < rb ? -1 : ra > rb);
+}
+
+/*
+ * Open the change log of a database for reading, starting with the
+ * record whose sequence number is seq (0 for the beginning, or what
+ * db_logtell returned).
+ */
+DBLOG
+db_logopen(const char *pathname, off_t seq)
+{
+	DBLOGRD	*lp;
+	char	*name;
+
+	if ((lp = calloc(1, sizeof(DBLOGRD))) == NULL ||
+	  (lp->buf = malloc(LOGREC_MAX + 2)) == NULL ||
+	  (name = malloc(strlen(pathname) + 5)) == NULL)
+		err_dump("db_logopen: malloc error");
+	strcpy(name, pathname);
+	strcat(name, ".log");
+	lp->fd = open(name, O_RDONLY);
+	free(name);
+	if (lp->fd < 0) {
+		free(lp->buf);
+		free(lp);
+		return(NULL);
+	}
+	lp->pos = seq;
+	return(lp);
+}
+
+/*
+ * Read the next change from the log.  Returns its operation, and
+ * sets *seqp to its sequence number, and *keyp and *datap to the key
+ * and data (empty for a delete), which stay good until the next call.
+ * Returns 0 if there are no more changes yet: a record still being
+ * written counts as not there, so the caller can just try again
+ * later.  Returns -1 with errno set on error, EINVAL if what we read
+ * isn't a log record.
+ */
+int
+db_logread(DBLOG h, off_t *seqp, char **keyp, char **datap)
+{
+	DBLOGRD	*lp = h;
+	char	hdr[LOG_HDRSZ + 1], *ptr;
+	int		op, keylen, datlen;
+	ssize_t	n;
+
+	if ((n = pread(lp->fd, hdr, LOG_HDRSZ, lp->pos)) < 0)
+		return(-1);
+	if (n < LOG_HDRSZ)
+		return(0);
+	hdr[LOG_HDRSZ] = 0;
+	op = hdr[0];
+	datlen = strtol(hdr + 1 + LOGLEN_SZ, NULL, 10);
+	hdr[1 + LOGLEN_SZ] = 0;
+	keylen = strtol(hdr + 1, NULL, 10);
+	if ((op != DB_LOGSTORE && op != DB_LOGDELETE && op != DB_LOGTRUNC) ||
+	  keylen < 0 || keylen > IDXLEN_MAX || datlen < 0 ||
+	  datlen > DATLEN_MAX) {
+		errno = EINVAL;
+		return(-1);
+	}
+
+	/*
+	 * Read the key, data, and newline, and leave room to
+	 * null terminate the key before the data.
+	 */
+	ptr = lp->buf + 1;
+	if ((n = pread(lp->fd, ptr, keylen + datlen + 1,
+	  lp->pos + LOG_HDRSZ)) < 0)
+		return(-1);
+	if (n < keylen + datlen + 1 || ptr[keylen + datlen] != NEWLINE)
+		return(0);
+	memmove(lp->buf, ptr, keylen);
+	lp->buf[keylen] = 0;
+	ptr[keylen + datlen] = 0;
+	*keyp = lp->buf;
+	*datap = ptr + keylen;
+	*seqp = lp->pos;
+	lp->pos += LOG_HDRSZ + keylen + datlen + 1;
+	return(op);
+}
+
+/*
+ * The sequence number of the next record db_logread will return,
+ * for db_logopen to start from.
+ */
+off_t
+db_logtell(DBLOG h)
+{
+	return(((DBLOGRD *)h)->pos);
+}
+
+void
+db_logclose(DBLOG h)
+{
+	DBLOGRD	*lp = h;
+
+	close(lp->fd);
+	free(lp->buf);
+	free(lp);
+}
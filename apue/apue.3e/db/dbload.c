@@ -0,0 +1,92 @@
+#include "apue.h"
+#include "apue_db.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+/*
+ * Load a database from a file of "key<tab>data" lines, or standard
+ * input, with db_bulkload.  With -s, do it the slow way instead, one
+ * db_store(DB_STORE) per line, for comparison.
+ *
+ * usage: dbload [-s] dbname [file]
+ */
+static FILE	*fp;
+static long	lineno;
+static char	line[IDXLEN_MAX + DATLEN_MAX + 2];
+
+/*
+ * A bad line is an error, rather than the end of us, so that
+ * db_bulkload gets to clean up after itself.
+ */
+static int
+getrec(void *arg, char **keyp, char **datap)
+{
+	char	*tab, *nl;
+
+	if (fgets(line, sizeof(line), fp) == NULL)
+		return(ferror(fp) ? -1 : 0);
+	lineno++;
+	if ((nl = strchr(line, '\n')) == NULL) {
+		err_msg("line %ld: too long", lineno);
+		errno = EINVAL;
+		return(-1);
+	}
+	*nl = 0;
+	if ((tab = strchr(line, '\t')) == NULL) {
+		err_msg("line %ld: no tab", lineno);
+		errno = EINVAL;
+		return(-1);
+	}
+	*tab = 0;
+	*keyp = line;
+	*datap = tab + 1;
+	return(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int				c, slow;
+	char			*key, *data;
+	DBHANDLE		db;
+	struct timespec	start, end;
+	double			secs;
+
+	slow = 0;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "s")) != EOF) {
+		switch (c) {
+		case 's':
+			slow = 1;
+			break;
+		case '?':
+			err_quit("usage: dbload [-s] dbname [file]");
+		}
+	}
+	if (optind != argc - 1 && optind != argc - 2)
+		err_quit("usage: dbload [-s] dbname [file]");
+	fp = stdin;
+	if (optind == argc - 2 && (fp = fopen(argv[optind + 1], "r")) == NULL)
+		err_sys("can't open %s", argv[optind + 1]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (slow) {
+		if ((db = db_open(argv[optind], O_RDWR | O_CREAT | O_TRUNC,
+		  FILE_MODE)) == NULL)
+			err_sys("db_open error");
+		while ((c = getrec(NULL, &key, &data)) > 0)
+			if (db_store(db, key, data, DB_STORE) != 0)
+				err_sys("line %ld: db_store error", lineno);
+		db_close(db);
+		if (c < 0)
+			err_sys("dbload error");
+	} else if (db_bulkload(argv[optind], FILE_MODE, getrec, NULL) < 0) {
+		err_sys("db_bulkload error");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%ld lines in %.3f s, %.0f records/s\n", lineno, secs,
+	  lineno / secs);
+	exit(0);
+}
@@ -0,0 +1,138 @@
+#include "apue.h"
+#include "apue_db.h"
+#include <fcntl.h>
+
+/*
+ * Keep a replica of a database up to date from the change log the
+ * master writes when it's opened with DB_LOG.  The sequence number to
+ * pick up from is kept in "replica.seq", and saved every NSAVE changes
+ * and each time we catch up with the log, so we can be stopped and
+ * restarted.  Applying a change twice does no harm, so it doesn't
+ * matter if we die between applying some and saving the number.  With
+ * -f we keep following the log, like tail -f, checking it "interval"
+ * milliseconds apart.
+ *
+ * The replica starts out empty, so the master should have been
+ * logging from the time it was created.
+ *
+ * usage: dbreplica [-f] [-i interval] master replica
+ */
+#define NSAVE	10000
+
+static char	*seqname, *tmpname;
+
+static DBHANDLE
+openrep(const char *name, int oflag)
+{
+	DBHANDLE	db;
+
+	if ((db = db_open(name, O_RDWR | O_CREAT | oflag, FILE_MODE)) == NULL)
+		err_sys("can't open %s", name);
+	return(db);
+}
+
+static off_t
+getseq(void)
+{
+	FILE		*fp;
+	long long	seq;
+
+	if ((fp = fopen(seqname, "r")) == NULL)
+		return(0);
+	if (fscanf(fp, "%lld", &seq) != 1)
+		err_quit("%s: bad sequence number", seqname);
+	fclose(fp);
+	return(seq);
+}
+
+/*
+ * Replace the file, so a crash leaves the old number or the new.
+ */
+static void
+putseq(off_t seq)
+{
+	FILE	*fp;
+
+	if ((fp = fopen(tmpname, "w")) == NULL)
+		err_sys("can't create %s", tmpname);
+	fprintf(fp, "%lld\n", (long long)seq);
+	if (fclose(fp) == EOF)
+		err_sys("write error for %s", tmpname);
+	if (rename(tmpname, seqname) < 0)
+		err_sys("can't rename %s", tmpname);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int			c, follow, interval, op;
+	long		n;
+	off_t		seq, start;
+	char		*key, *data, *replica;
+	DBLOG		log;
+	DBHANDLE	db;
+
+	follow = 0;
+	interval = 100;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "fi:")) != EOF) {
+		switch (c) {
+		case 'f':
+			follow = 1;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case '?':
+			err_quit("usage: dbreplica [-f] [-i interval] master replica");
+		}
+	}
+	if (optind != argc - 2)
+		err_quit("usage: dbreplica [-f] [-i interval] master replica");
+	replica = argv[optind + 1];
+	if ((seqname = malloc(strlen(replica) + 5)) == NULL ||
+	  (tmpname = malloc(strlen(replica) + 9)) == NULL)
+		err_sys("malloc error");
+	sprintf(seqname, "%s.seq", replica);
+	sprintf(tmpname, "%s.seq.tmp", replica);
+
+	start = getseq();
+	if ((log = db_logopen(argv[optind], start)) == NULL)
+		err_sys("can't open log of %s", argv[optind]);
+	db = openrep(replica, start == 0 ? O_TRUNC : 0);
+	n = 0;
+	for ( ; ; ) {
+		while ((op = db_logread(log, &seq, &key, &data)) > 0) {
+			switch (op) {
+			case DB_LOGSTORE:
+				if (db_store(db, key, data, DB_STORE) != 0)
+					err_sys("seq %lld: db_store error for %s",
+					  (long long)seq, key);
+				break;
+			case DB_LOGDELETE:
+				db_delete(db, key);		/* may be gone already */
+				break;
+			case DB_LOGTRUNC:
+				db_close(db);
+				db = openrep(replica, O_TRUNC);
+				break;
+			}
+			if (++n % NSAVE == 0)
+				putseq(db_logtell(log));
+		}
+		if (op < 0)
+			err_sys("db_logread error at %lld", (long long)db_logtell(log));
+		if (db_logtell(log) != start) {
+			putseq(start = db_logtell(log));
+			if (!follow)
+				printf("%ld changes applied, next %lld\n", n,
+				  (long long)start);
+		}
+		if (!follow)
+			break;
+		usleep(interval * 1000);
+	}
+	db_close(db);
+	db_logclose(log);
+	exit(0);
+}
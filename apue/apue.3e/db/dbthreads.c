@@ -0,0 +1,149 @@
+#include "apue.h"
+#include "apue_db.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/*
+ * Lookups against one database by "n" threads sharing a DB_MT handle,
+ * or with -p by "n" processes with a handle each.  We store "nkeys"
+ * records, then every thread or process fetches "nloops" random keys
+ * and checks the data.  With -w, one fetch in "wratio" is a store of
+ * the same data instead, so writers contend with the readers.  With
+ * -s, locking uses the shared-memory lock file (DB_SHMLOCK) instead of
+ * record locks.
+ *
+ * usage: dbthreads [-ps] [-n nthreads] [-k nkeys] [-l nloops] [-w wratio]
+ */
+#define	DBNAME	"dbthr"
+
+static DBHANDLE	db;
+static long		nkeys = 2000;
+static long		nloops = 20000;
+static int		wratio;
+static int		procs;
+static int		dbflags;
+
+static void
+mkkey(char *key, char *data, long i)
+{
+	sprintf(key, "key%ld", i);
+	sprintf(data, "data for key %ld", i);
+}
+
+static void *
+lookup(void *arg)
+{
+	DBHANDLE		h;
+	long			i, k;
+	unsigned int	seed;
+	char			key[64], data[64], *ptr;
+
+	seed = (unsigned int)(long)arg;
+	h = db;
+	if (procs && (h = db_xopen(DBNAME, O_RDWR, dbflags, 0)) == NULL)
+		err_sys("db_xopen error");
+	for (i = 0; i < nloops; i++) {
+		seed = seed * 1103515245 + 12345;
+		k = (seed >> 8) % nkeys;
+		mkkey(key, data, k);
+		if (wratio > 0 && i % wratio == 0) {
+			if (db_store(h, key, data, DB_REPLACE) != 0)
+				err_quit("db_store error for %s", key);
+			continue;
+		}
+		if ((ptr = db_fetch(h, key)) == NULL)
+			err_quit("can't fetch %s", key);
+		if (strcmp(ptr, data) != 0)
+			err_quit("%s: got \"%s\"", key, ptr);
+	}
+	if (procs)
+		db_close(h);
+	return((void *)0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int				c, n, i, err, status;
+	long			k;
+	char			key[64], data[64];
+	pthread_t		*tids;
+	pid_t			pid;
+	struct timespec	start, end;
+	double			secs;
+
+	n = 32;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "k:l:n:psw:")) != EOF) {
+		switch (c) {
+		case 'k':
+			nkeys = atol(optarg);
+			break;
+		case 'l':
+			nloops = atol(optarg);
+			break;
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'p':
+			procs = 1;
+			break;
+		case 's':
+			dbflags |= DB_SHMLOCK;
+			break;
+		case 'w':
+			wratio = atoi(optarg);
+			break;
+		case '?':
+			err_quit("usage: dbthreads [-ps] [-n nthreads] [-k nkeys] "
+			  "[-l nloops] [-w wratio]");
+		}
+	}
+	if (n < 1 || nkeys < 1)
+		err_quit("need at least one thread and one key");
+
+	if ((db = db_open(DBNAME, O_RDWR | O_CREAT | O_TRUNC, FILE_MODE)) == NULL)
+		err_sys("db_open error");
+	for (k = 0; k < nkeys; k++) {
+		mkkey(key, data, k);
+		if (db_store(db, key, data, DB_INSERT) != 0)
+			err_quit("db_store error for %s", key);
+	}
+	db_close(db);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (procs) {
+		for (i = 0; i < n; i++) {
+			if ((pid = fork()) < 0) {
+				err_sys("fork error");
+			} else if (pid == 0) {
+				lookup((void *)(long)(i + 1));
+				exit(0);
+			}
+		}
+		while (wait(&status) > 0)
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				err_quit("child failed");
+	} else {
+		if ((db = db_xopen(DBNAME, O_RDWR, DB_MT | dbflags, 0)) == NULL)
+			err_sys("db_xopen error");
+		if ((tids = malloc(n * sizeof(pthread_t))) == NULL)
+			err_sys("malloc error");
+		for (i = 0; i < n; i++)
+			if ((err = pthread_create(&tids[i], NULL, lookup,
+			  (void *)(long)(i + 1))) != 0)
+				err_exit(err, "can't create thread");
+		for (i = 0; i < n; i++)
+			pthread_join(tids[i], NULL);
+		db_close(db);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%d %s, %s, %ld keys: %.0f operations/s\n", n,
+	  procs ? "processes" : "threads",
+	  (dbflags & DB_SHMLOCK) ? "shm locks" : "record locks", nkeys,
+	  n * nloops / secs);
+	exit(0);
+}
@@ -0,0 +1,388 @@
+#include "apue.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+/*
+ * Parallel version of ftw8.  Instead of recursing on one ever-growing
+ * pathname and calling lstat() for every file, each directory is opened
+ * relative to its parent's descriptor with openat(), and its entries
+ * are read in large batches with getdents64.  The file type usually
+ * comes back in d_type; we only fall back to fstatat() when it doesn't
+ * (or always, with -s).
+ *
+ * Directories still to be read are kept in one deque per thread.
+ * A thread pushes and pops at the bottom of its own deque, so it walks
+ * depth first and its directories stay open for a short time; a thread
+ * that runs dry steals from the top of somebody else's.
+ */
+#define	MAXTHREADS	64
+#define	DENTBUFSZ	(64*1024)	/* getdents64 buffer per thread */
+#define	DQINIT		256			/* initial deque size */
+
+struct linux_dirent64 {		/* not exported by the C library */
+	ino64_t			d_ino;
+	off64_t			d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char			d_name[];
+};
+
+/*
+ * An open directory.  The descriptor stays open until the directory
+ * has been read and every subdirectory found in it has been opened.
+ */
+struct dnode {
+	int		fd;
+	int		refcnt;			/* updated atomically */
+};
+
+/*
+ * A directory waiting to be read: a name relative to an open parent.
+ */
+struct dwork {
+	struct dnode	*parent;	/* NULL for the starting pathname */
+	char			name[];
+};
+
+struct deque {
+	pthread_mutex_t	lock;
+	struct dwork	**buf;
+	size_t			size;		/* always a power of 2 */
+	size_t			top;		/* steal from here */
+	size_t			bot;		/* push and pop here */
+	char			pad[64];	/* keep deques on separate cache lines */
+};
+
+struct tally {
+	long	nreg, ndir, nblk, nchr, nfifo, nslink, nsock;
+};
+
+static struct deque	deques[MAXTHREADS];
+static struct tally	tallies[MAXTHREADS];
+static int			nthreads;
+static int			statall;	/* -s: fstatat() every entry */
+static long			pending;	/* directories queued or being read */
+
+static void		*walk_thread(void *);
+static void		readdirectory(int, struct dwork *, char *);
+static void		count(int, int, mode_t);
+static void		dq_push(struct deque *, struct dwork *);
+static struct dwork	*dq_pop(struct deque *);
+static struct dwork	*dq_steal(struct deque *);
+static void		dn_release(struct dnode *);
+static void		work_err(const char *, struct dwork *);
+
+int
+main(int argc, char *argv[])
+{
+	int			c, i, err;
+	long		ntot;
+	pthread_t	tid[MAXTHREADS];
+	struct stat	statbuf;
+	struct tally *tp, t;
+	struct dwork *wp;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	opterr = 0;
+	while ((c = getopt(argc, argv, "st:")) != EOF) {
+		switch (c) {
+		case 's':
+			statall = 1;
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case '?':
+			err_quit("unrecognized option: -%c", optopt);
+		}
+	}
+	if (argc - optind != 1)
+		err_quit("usage:  pftw  [-s] [-t nthreads]  <starting-pathname>");
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+
+	if (lstat(argv[optind], &statbuf) < 0)
+		err_sys("stat error for %s", argv[optind]);
+	if (S_ISDIR(statbuf.st_mode) == 0) {
+		count(0, DT_UNKNOWN, statbuf.st_mode);
+	} else {
+		if ((wp = malloc(sizeof(struct dwork) +
+		  strlen(argv[optind]) + 1)) == NULL)
+			err_sys("malloc error");
+		wp->parent = NULL;
+		strcpy(wp->name, argv[optind]);
+		for (i = 0; i < nthreads; i++) {
+			pthread_mutex_init(&deques[i].lock, NULL);
+			deques[i].size = DQINIT;
+			if ((deques[i].buf = malloc(DQINIT *
+			  sizeof(struct dwork *))) == NULL)
+				err_sys("malloc error");
+		}
+		pending = 1;
+		dq_push(&deques[0], wp);
+		for (i = 0; i < nthreads; i++) {
+			err = pthread_create(&tid[i], NULL, walk_thread,
+			  (void *)((long)i));
+			if (err != 0)
+				err_exit(err, "can't create thread");
+		}
+		for (i = 0; i < nthreads; i++) {
+			if ((err = pthread_join(tid[i], NULL)) != 0)
+				err_exit(err, "can't join thread");
+		}
+	}
+
+	memset(&t, 0, sizeof(t));
+	for (tp = &tallies[0]; tp < &tallies[MAXTHREADS]; tp++) {
+		t.nreg += tp->nreg;		t.ndir += tp->ndir;
+		t.nblk += tp->nblk;		t.nchr += tp->nchr;
+		t.nfifo += tp->nfifo;	t.nslink += tp->nslink;
+		t.nsock += tp->nsock;
+	}
+	ntot = t.nreg + t.ndir + t.nblk + t.nchr + t.nfifo + t.nslink + t.nsock;
+	if (ntot == 0)
+		ntot = 1;		/* avoid divide by 0; print 0 for all counts */
+	printf("regular files  = %7ld, %5.2f %%\n", t.nreg,
+	  t.nreg*100.0/ntot);
+	printf("directories    = %7ld, %5.2f %%\n", t.ndir,
+	  t.ndir*100.0/ntot);
+	printf("block special  = %7ld, %5.2f %%\n", t.nblk,
+	  t.nblk*100.0/ntot);
+	printf("char special   = %7ld, %5.2f %%\n", t.nchr,
+	  t.nchr*100.0/ntot);
+	printf("FIFOs          = %7ld, %5.2f %%\n", t.nfifo,
+	  t.nfifo*100.0/ntot);
+	printf("symbolic links = %7ld, %5.2f %%\n", t.nslink,
+	  t.nslink*100.0/ntot);
+	printf("sockets        = %7ld, %5.2f %%\n", t.nsock,
+	  t.nsock*100.0/ntot);
+	exit(0);
+}
+
+static void *
+walk_thread(void *arg)
+{
+	int				self, i, idle;
+	char			*dentbuf;
+	struct dwork	*wp;
+	struct timespec	ts;
+
+	self = (int)((long)arg);
+	if ((dentbuf = malloc(DENTBUFSZ)) == NULL)
+		err_sys("malloc error");
+	idle = 0;
+	for (;;) {
+		if ((wp = dq_pop(&deques[self])) == NULL) {
+			for (i = 1; i < nthreads; i++) {
+				wp = dq_steal(&deques[(self + i) % nthreads]);
+				if (wp != NULL)
+					break;
+			}
+		}
+		if (wp == NULL) {
+			if (__atomic_load_n(&pending, __ATOMIC_ACQUIRE) == 0)
+				break;		/* nothing queued, nobody reading */
+			if (++idle < 100) {
+				sched_yield();
+			} else {
+				ts.tv_sec = 0;
+				ts.tv_nsec = 100000;	/* 100 usec */
+				nanosleep(&ts, NULL);
+			}
+			continue;
+		}
+		idle = 0;
+		readdirectory(self, wp, dentbuf);
+		__atomic_sub_fetch(&pending, 1, __ATOMIC_RELEASE);
+	}
+	free(dentbuf);
+	return((void *)0);
+}
+
+/*
+ * Open the directory described by "wp", count everything in it, and
+ * queue its subdirectories.
+ */
+static void
+readdirectory(int self, struct dwork *wp, char *dentbuf)
+{
+	int						fd, pfd, type;
+	long					n, off;
+	struct dnode			*np;
+	struct dwork			*cp;
+	struct linux_dirent64	*dp;
+	struct stat				statbuf;
+
+	pfd = (wp->parent == NULL) ? AT_FDCWD : wp->parent->fd;
+	fd = openat(pfd, wp->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW |
+	  O_CLOEXEC);
+	if (fd < 0) {
+		work_err("can't read directory", wp);
+		goto out;
+	}
+	if ((np = malloc(sizeof(struct dnode))) == NULL)
+		err_sys("malloc error");
+	np->fd = fd;
+	np->refcnt = 1;		/* for us, while we read it */
+
+	while ((n = syscall(SYS_getdents64, fd, dentbuf, DENTBUFSZ)) > 0) {
+		for (off = 0; off < n; off += dp->d_reclen) {
+			dp = (struct linux_dirent64 *)(dentbuf + off);
+			if (strcmp(dp->d_name, ".") == 0  ||
+			    strcmp(dp->d_name, "..") == 0)
+					continue;		/* ignore dot and dot-dot */
+			type = dp->d_type;
+			statbuf.st_mode = 0;
+			if (type == DT_UNKNOWN || statall) {
+				if (fstatat(fd, dp->d_name, &statbuf,
+				  AT_SYMLINK_NOFOLLOW) < 0) {
+					err_ret("stat error for %s in directory %s",
+					  dp->d_name, wp->name);
+					continue;
+				}
+				type = DT_UNKNOWN;
+			}
+			count(self, type, statbuf.st_mode);
+			if (type == DT_DIR || (type == DT_UNKNOWN &&
+			  S_ISDIR(statbuf.st_mode))) {
+				if ((cp = malloc(sizeof(struct dwork) +
+				  strlen(dp->d_name) + 1)) == NULL)
+					err_sys("malloc error");
+				cp->parent = np;
+				strcpy(cp->name, dp->d_name);
+				__atomic_add_fetch(&np->refcnt, 1, __ATOMIC_RELAXED);
+				__atomic_add_fetch(&pending, 1, __ATOMIC_RELAXED);
+				dq_push(&deques[self], cp);
+			}
+		}
+	}
+	if (n < 0)
+		work_err("getdents64 error", wp);
+	dn_release(np);
+out:
+	if (wp->parent != NULL)
+		dn_release(wp->parent);
+	else
+		count(self, DT_DIR, 0);		/* the starting directory */
+	free(wp);
+}
+
+/*
+ * Same bookkeeping as ftw8's myfunc().  The type comes from d_type,
+ * or, if that's DT_UNKNOWN, from the mode returned by fstatat().
+ */
+static void
+count(int self, int type, mode_t mode)
+{
+	struct tally	*tp = &tallies[self];
+
+	if (type == DT_UNKNOWN) {
+		switch (mode & S_IFMT) {
+		case S_IFREG:	type = DT_REG;	break;
+		case S_IFDIR:	type = DT_DIR;	break;
+		case S_IFBLK:	type = DT_BLK;	break;
+		case S_IFCHR:	type = DT_CHR;	break;
+		case S_IFIFO:	type = DT_FIFO;	break;
+		case S_IFLNK:	type = DT_LNK;	break;
+		case S_IFSOCK:	type = DT_SOCK;	break;
+		}
+	}
+	switch (type) {
+	case DT_REG:	tp->nreg++;		break;
+	case DT_DIR:	tp->ndir++;		break;
+	case DT_BLK:	tp->nblk++;		break;
+	case DT_CHR:	tp->nchr++;		break;
+	case DT_FIFO:	tp->nfifo++;	break;
+	case DT_LNK:	tp->nslink++;	break;
+	case DT_SOCK:	tp->nsock++;	break;
+	default:
+		err_msg("unknown type %d", type);
+	}
+}
+
+/*
+ * Drop a reference to an open directory, closing it with the last one.
+ */
+static void
+dn_release(struct dnode *np)
+{
+	if (__atomic_sub_fetch(&np->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+		close(np->fd);
+		free(np);
+	}
+}
+
+/*
+ * We don't keep full pathnames around, so recover the parent's
+ * name from /proc for the error message.
+ */
+static void
+work_err(const char *msg, struct dwork *wp)
+{
+	char	proc[64], dir[PATH_MAX];
+	ssize_t	n;
+
+	if (wp->parent == NULL) {
+		err_ret("%s %s", msg, wp->name);
+		return;
+	}
+	snprintf(proc, sizeof(proc), "/proc/self/fd/%d", wp->parent->fd);
+	if ((n = readlink(proc, dir, sizeof(dir) - 1)) < 0)
+		strcpy(dir, "?");
+	else
+		dir[n] = 0;
+	err_ret("%s %s/%s", msg, dir, wp->name);
+}
+
+static void
+dq_push(struct deque *dq, struct dwork *wp)
+{
+	size_t			i;
+	struct dwork	**nbuf;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bot - dq->top == dq->size) {	/* full: double it */
+		if ((nbuf = malloc(2 * dq->size * sizeof(struct dwork *))) == NULL)
+			err_sys("malloc error");
+		for (i = dq->top; i != dq->bot; i++)
+			nbuf[i & (2 * dq->size - 1)] = dq->buf[i & (dq->size - 1)];
+		free(dq->buf);
+		dq->buf = nbuf;
+		dq->size *= 2;
+	}
+	dq->buf[dq->bot++ & (dq->size - 1)] = wp;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+static struct dwork *
+dq_pop(struct deque *dq)
+{
+	struct dwork	*wp = NULL;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bot != dq->top)
+		wp = dq->buf[--dq->bot & (dq->size - 1)];
+	pthread_mutex_unlock(&dq->lock);
+	return(wp);
+}
+
+static struct dwork *
+dq_steal(struct deque *dq)
+{
+	struct dwork	*wp = NULL;
+
+	if (pthread_mutex_trylock(&dq->lock) != 0)
+		return(NULL);		/* busy; try another one */
+	if (dq->bot != dq->top)
+		wp = dq->buf[dq->top++ & (dq->size - 1)];
+	pthread_mutex_unlock(&dq->lock);
+	return(wp);
+}
@@ -64,6 +64,16 @@ void	 sleep_us(unsigned int);			/* {Ex sleepus} */
 ssize_t	 readn(int, void *, size_t);		/* {Prog readn_writen} */
 ssize_t	 writen(int, const void *, size_t);	/* {Prog readn_writen} */
 
+struct bufio;								/* buffered input, lib/bufio.c */
+#define	BIO_NOREAD	(-2)	/* timeout: use only what's buffered */
+struct bufio	*bio_alloc(int, size_t);
+void	 bio_free(struct bufio *);
+size_t	 bio_buffered(struct bufio *);
+ssize_t	 bio_fill(struct bufio *, int);
+ssize_t	 bio_getrec(struct bufio *, int, char **, int);
+ssize_t	 bio_getspan(struct bufio *, size_t, char **, int);
+ssize_t	 bio_read(struct bufio *, void *, size_t, int);
+
 int		 fd_pipe(int *);					/* {Prog sock_fdpipe} */
 int		 recv_fd(int, ssize_t (*func)(int,
 		         const void *, size_t));	/* {Prog recvfd_sockets} */
@@ -123,6 +133,82 @@ void	log_quit(const char *, ...) __attribute__((noreturn));
 void	log_ret(const char *, ...);
 void	log_sys(const char *, ...) __attribute__((noreturn));
 void	log_exit(int, const char *, ...) __attribute__((noreturn));
+int		log_async(const char *, int);		/* lib/asynclog.c */
+void	log_flush(void);
+void	log_stats(unsigned long *, unsigned long *, unsigned long *,
+		  unsigned long *);
+
+/*
+ * A timer for lib/timerwheel.c.  The caller provides the storage,
+ * which must be zero-filled before the first tw_add().
+ */
+struct tw_timer {
+	struct tw_timer	*tw_next;
+	struct tw_timer	*tw_prev;
+	unsigned long	 tw_expires;		/* tick it's due */
+	void			(*tw_fn)(void *);
+	void			*tw_arg;
+};
+int		tw_add(struct tw_timer *, unsigned long,
+		  void (*)(void *), void *);			/* lib/timerwheel.c */
+int		tw_cancel(struct tw_timer *);
+
+#define	SHR_MPSC	0x01	/* more than one producer */
+#define	SHR_EVENTFD	0x02	/* wait on eventfds instead of futexes */
+struct shmring;								/* lib/shmring.c */
+struct shmring	*shr_create(const char *, size_t, unsigned long, int);
+struct shmring	*shr_open(const char *);
+struct shmring	*shr_fdopen(int);
+int		 shr_fd(struct shmring *);
+int		 shr_pollfd(struct shmring *);
+void	 shr_close(struct shmring *);
+int		 shr_send(struct shmring *, const void *, size_t, int);
+ssize_t	 shr_recv(struct shmring *, void *, int);
+void	 shr_shutdown(struct shmring *);
+
+/*
+ * Process-shared locks, lib/plock.c.  Put them in shared memory;
+ * zero-filled means unlocked.
+ */
+struct plock {
+	int		pl_word;		/* owner's thread ID and futex bits */
+	int		pl_spins;		/* adaptive spin count */
+};
+struct prwlock {
+	int		prw_word;		/* # readers, or writer flag and thread ID */
+	int		prw_nwait;		/* # asleep */
+	int		prw_wwait;		/* thread ID of a waiting writer, or 0 */
+	int		prw_spins;
+};
+int		pl_lock(struct plock *);
+int		pl_trylock(struct plock *);
+int		pl_unlock(struct plock *);
+int		prw_rdlock(struct prwlock *);
+int		prw_wrlock(struct prwlock *);
+int		prw_tryrdlock(struct prwlock *);
+int		prw_trywrlock(struct prwlock *);
+int		prw_unlock(struct prwlock *);
+
+/*
+ * Work-stealing thread pool, lib/workq.c.  The caller provides the
+ * storage for tasks and groups; a zero-filled group is empty.
+ */
+struct wq_group {
+	int		wg_pending;			/* tasks not finished yet */
+};
+struct wq_task {
+	struct wq_task	*wt_next;	/* used by the pool */
+	void			(*wt_fn)(void *);
+	void			*wt_arg;
+	struct wq_group	*wt_group;	/* or NULL */
+};
+#define	WQ_PIN		0x01		/* pin worker i to CPU i */
+struct workq;
+struct workq	*wq_create(int, int);
+int		wq_submit(struct workq *, struct wq_task *, int);
+void	wq_wait(struct workq *, struct wq_group *);
+int		wq_self(void);
+void	wq_destroy(struct workq *);
 
 void	TELL_WAIT(void);		/* parent/child from {Sec race_conditions} */
 void	TELL_PARENT(pid_t);
@@ -0,0 +1,529 @@
+#include "apue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+
+/*
+ * Compare the IPC mechanisms of Chapters 15 and 17 between a parent
+ * and a child: pipes, FIFOs, a UNIX domain socket pair, XSI and POSIX
+ * message queues, and shared memory, both with POSIX semaphores and
+ * with the channels of lib/shmring.c.
+ *
+ * For every mechanism and message size we measure
+ *
+ *	latency:	the parent sends a message, the child sends it back,
+ *				"niters" times; we report half the round trip.
+ *	throughput:	the parent streams "mbytes" megabytes to the child,
+ *				which acknowledges the end.
+ *
+ * Results go to standard output as CSV.  A size that a mechanism can't
+ * carry (a message queue's limit, say) gets empty fields.
+ *
+ * usage: ipcbench [-t transport,...] [-s size,...] [-n niters]
+ *		[-m mbytes] [-c parentcpu,childcpu]
+ */
+#define	MAXSIZES	16
+#define	NWARMUP		100
+#define	SHRSLOTS	64
+
+struct transport {
+	const char	*name;
+	int			(*setup)(size_t);	/* before fork; -1: can't do size */
+	int			(*send)(int, const void *, size_t);
+	int			(*recv)(int, void *, size_t);
+	void		(*cleanup)(void);
+};
+
+/*
+ * Direction of a message, for the send and receive functions.
+ */
+#define	TOCHILD		0
+#define	TOPARENT	1
+
+static int		pfd[2][2];			/* pipe and FIFO descriptors */
+static int		sockfd[2];
+static int		msqid;
+static mqd_t	mqd[2];
+static char		*shmbuf[2];
+static size_t	shmsize;
+static sem_t	*full, *empty;	/* in the mapping, after the buffers */
+static struct shmring	*ring[2];
+static int		ischild;
+
+static int		pipe_setup(size_t);
+static int		fifo_setup(size_t);
+static int		fd_send(int, const void *, size_t);
+static int		fd_recv(int, void *, size_t);
+static void		fd_cleanup(void);
+static int		sock_setup(size_t);
+static int		sock_send(int, const void *, size_t);
+static int		sock_recv(int, void *, size_t);
+static void		sock_cleanup(void);
+static int		xsimsg_setup(size_t);
+static int		xsimsg_send(int, const void *, size_t);
+static int		xsimsg_recv(int, void *, size_t);
+static void		xsimsg_cleanup(void);
+static int		pmq_setup(size_t);
+static int		pmq_send(int, const void *, size_t);
+static int		pmq_recv(int, void *, size_t);
+static void		pmq_cleanup(void);
+static int		shm_setup(size_t);
+static int		shm_send(int, const void *, size_t);
+static int		shm_recv(int, void *, size_t);
+static void		shm_cleanup(void);
+static int		shr_setup(size_t);
+static int		shr_xsend(int, const void *, size_t);
+static int		shr_xrecv(int, void *, size_t);
+static void		shr_cleanup(void);
+
+static struct transport	transports[] = {
+	{ "pipe", pipe_setup, fd_send, fd_recv, fd_cleanup },
+	{ "fifo", fifo_setup, fd_send, fd_recv, fd_cleanup },
+	{ "socketpair", sock_setup, sock_send, sock_recv, sock_cleanup },
+	{ "xsimsg", xsimsg_setup, xsimsg_send, xsimsg_recv, xsimsg_cleanup },
+	{ "posixmq", pmq_setup, pmq_send, pmq_recv, pmq_cleanup },
+	{ "shm+sem", shm_setup, shm_send, shm_recv, shm_cleanup },
+	{ "shmring", shr_setup, shr_xsend, shr_xrecv, shr_cleanup },
+	{ NULL }
+};
+
+static void		run(struct transport *, size_t, long, long, int, int);
+static void		pin(int);
+static double	now(void);
+
+int
+main(int argc, char *argv[])
+{
+	int					c, i, nsizes, pcpu, ccpu;
+	long				niters, mbytes;
+	size_t				sizes[MAXSIZES];
+	char				*only, *p;
+	struct transport	*tp;
+
+	niters = 10000;
+	mbytes = 64;
+	pcpu = ccpu = -1;
+	only = NULL;
+	nsizes = 0;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "c:m:n:s:t:")) != EOF) {
+		switch (c) {
+		case 'c':
+			if (sscanf(optarg, "%d,%d", &pcpu, &ccpu) != 2)
+				err_quit("-c wants parentcpu,childcpu");
+			break;
+		case 'm':
+			mbytes = atol(optarg);
+			break;
+		case 'n':
+			niters = atol(optarg);
+			break;
+		case 's':
+			for (p = strtok(optarg, ","); p != NULL && nsizes < MAXSIZES;
+			  p = strtok(NULL, ","))
+				sizes[nsizes++] = strtoul(p, NULL, 0);
+			break;
+		case 't':
+			only = optarg;
+			break;
+		case '?':
+			err_quit("usage: ipcbench [-t transport,...] [-s size,...] "
+			  "[-n niters] [-m mbytes] [-c parentcpu,childcpu]");
+		}
+	}
+	if (nsizes == 0) {
+		sizes[nsizes++] = 64;
+		sizes[nsizes++] = 512;
+		sizes[nsizes++] = 4096;
+		sizes[nsizes++] = 65536;
+	}
+	for (i = 0; i < nsizes; i++)
+		if (sizes[i] == 0)
+			err_quit("message size must be positive");
+	if (niters < 1 || mbytes < 1)
+		err_quit("niters and mbytes must be positive");
+	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+		err_sys("signal error");
+
+	printf("transport,size,latency_us,throughput_MBps\n");
+	for (tp = transports; tp->name != NULL; tp++) {
+		if (only != NULL && !strstr(only, tp->name))
+			continue;
+		for (i = 0; i < nsizes; i++)
+			run(tp, sizes[i], niters, mbytes, pcpu, ccpu);
+	}
+	exit(0);
+}
+
+static double
+now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+pin(int cpu)
+{
+	cpu_set_t	set;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) < 0)
+		err_sys("can't pin to CPU %d", cpu);
+}
+
+/*
+ * Run one test in a child.  "nmsgs" is how many messages the parent
+ * sends: if "pingpong" is set the child echoes each one, otherwise it
+ * only answers the last.
+ */
+static double
+onetest(struct transport *tp, char *buf, size_t size, long nmsgs,
+  int pingpong, int ccpu)
+{
+	long	i;
+	pid_t	pid;
+	double	start, elapsed;
+
+	if ((pid = fork()) < 0)
+		err_sys("fork error");
+	if (pid == 0) {
+		ischild = 1;
+		pin(ccpu);
+		for (i = 0; i < nmsgs; i++) {
+			if ((*tp->recv)(TOCHILD, buf, size) < 0)
+				err_sys("%s: child receive error", tp->name);
+			if ((pingpong || i == nmsgs - 1) &&
+			  (*tp->send)(TOPARENT, buf, size) < 0)
+				err_sys("%s: child send error", tp->name);
+		}
+		_exit(0);
+	}
+	start = now();
+	for (i = 0; i < nmsgs; i++) {
+		if ((*tp->send)(TOCHILD, buf, size) < 0)
+			err_sys("%s: send error", tp->name);
+		if ((pingpong || i == nmsgs - 1) &&
+		  (*tp->recv)(TOPARENT, buf, size) < 0)
+			err_sys("%s: receive error", tp->name);
+	}
+	elapsed = now() - start;
+	if (waitpid(pid, NULL, 0) < 0)
+		err_sys("waitpid error");
+	return(elapsed);
+}
+
+static void
+run(struct transport *tp, size_t size, long niters, long mbytes,
+  int pcpu, int ccpu)
+{
+	char	*buf;
+	long	nmsgs;
+	double	lat, thr;
+
+	if ((buf = malloc(size)) == NULL)
+		err_sys("malloc error");
+	memset(buf, 'a', size);
+	pin(pcpu);
+
+	if ((*tp->setup)(size) < 0) {
+		printf("%s,%lu,,\n", tp->name, (unsigned long)size);
+		free(buf);
+		return;
+	}
+	onetest(tp, buf, size, NWARMUP, 1, ccpu);
+	lat = onetest(tp, buf, size, niters, 1, ccpu) / niters / 2;
+	nmsgs = (mbytes * 1024 * 1024 + size - 1) / size;
+	thr = onetest(tp, buf, size, nmsgs, 0, ccpu);
+	thr = (double)nmsgs * size / thr / (1024 * 1024);
+	(*tp->cleanup)();
+
+	printf("%s,%lu,%.2f,%.1f\n", tp->name, (unsigned long)size,
+	  lat * 1e6, thr);
+	fflush(stdout);
+	free(buf);
+}
+
+/*
+ * Pipes and FIFOs: a byte stream in each direction.
+ */
+static int
+pipe_setup(size_t size)
+{
+	if (pipe(pfd[TOCHILD]) < 0 || pipe(pfd[TOPARENT]) < 0)
+		err_sys("pipe error");
+	return(0);
+}
+
+/*
+ * Open the FIFOs the way fifo1.c does, so neither open blocks.
+ */
+static int
+fifo_setup(size_t size)
+{
+	int		i;
+	char	name[32];
+
+	for (i = 0; i < 2; i++) {
+		snprintf(name, sizeof(name), "temp.fifo%d", i);
+		unlink(name);
+		if (mkfifo(name, FILE_MODE) < 0)
+			err_sys("mkfifo error");
+		if ((pfd[i][0] = open(name, O_RDONLY | O_NONBLOCK)) < 0)
+			err_sys("open error for reading");
+		if ((pfd[i][1] = open(name, O_WRONLY)) < 0)
+			err_sys("open error for writing");
+		clr_fl(pfd[i][0], O_NONBLOCK);
+		unlink(name);
+	}
+	return(0);
+}
+
+static int
+fd_send(int dir, const void *buf, size_t size)
+{
+	return(writen(pfd[dir][1], buf, size) == size ? 0 : -1);
+}
+
+static int
+fd_recv(int dir, void *buf, size_t size)
+{
+	return(readn(pfd[dir][0], buf, size) == size ? 0 : -1);
+}
+
+static void
+fd_cleanup(void)
+{
+	int		i;
+
+	for (i = 0; i < 2; i++) {
+		close(pfd[i][0]);
+		close(pfd[i][1]);
+	}
+}
+
+/*
+ * A UNIX domain stream socket pair; the parent uses one end and the
+ * child the other, for both directions.
+ */
+static int
+sock_setup(size_t size)
+{
+	if (fd_pipe(sockfd) < 0)
+		err_sys("fd_pipe error");
+	return(0);
+}
+
+static int
+sock_send(int dir, const void *buf, size_t size)
+{
+	return(writen(sockfd[ischild], buf, size) == size ? 0 : -1);
+}
+
+static int
+sock_recv(int dir, void *buf, size_t size)
+{
+	return(readn(sockfd[ischild], buf, size) == size ? 0 : -1);
+}
+
+static void
+sock_cleanup(void)
+{
+	close(sockfd[0]);
+	close(sockfd[1]);
+}
+
+/*
+ * One XSI message queue, with the message type giving the direction.
+ */
+struct xsimsg {
+	long	mtype;
+	char	mtext[1];
+};
+
+static struct xsimsg	*xmsg;
+
+static int
+xsimsg_setup(size_t size)
+{
+	struct msginfo	info;
+
+	if (msgctl(0, IPC_INFO, (struct msqid_ds *)&info) < 0)
+		err_sys("msgctl error");
+	if (size > info.msgmax)
+		return(-1);
+	if ((msqid = msgget(IPC_PRIVATE, 0600)) < 0)
+		err_sys("msgget error");
+	if ((xmsg = malloc(sizeof(struct xsimsg) + size)) == NULL)
+		err_sys("malloc error");
+	return(0);
+}
+
+static int
+xsimsg_send(int dir, const void *buf, size_t size)
+{
+	xmsg->mtype = dir + 1;
+	memcpy(xmsg->mtext, buf, size);
+	return(msgsnd(msqid, xmsg, size, 0));
+}
+
+static int
+xsimsg_recv(int dir, void *buf, size_t size)
+{
+	if (msgrcv(msqid, xmsg, size, dir + 1, 0) < 0)
+		return(-1);
+	memcpy(buf, xmsg->mtext, size);
+	return(0);
+}
+
+static void
+xsimsg_cleanup(void)
+{
+	if (msgctl(msqid, IPC_RMID, NULL) < 0)
+		err_sys("msgctl error");
+	free(xmsg);
+	xmsg = NULL;
+}
+
+/*
+ * A POSIX message queue in each direction.  The names are removed
+ * as soon as the queues are open; the child inherits the descriptors.
+ */
+static int
+pmq_setup(size_t size)
+{
+	int				i;
+	char			name[64];
+	struct mq_attr	attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.mq_maxmsg = 10;
+	attr.mq_msgsize = size;
+	for (i = 0; i < 2; i++) {
+		snprintf(name, sizeof(name), "/ipcbench.%ld.%d", (long)getpid(), i);
+		if ((mqd[i] = mq_open(name, O_RDWR | O_CREAT | O_EXCL, 0600,
+		  &attr)) == (mqd_t)-1) {
+			if (errno != EINVAL && errno != EMFILE && errno != ENOMEM)
+				err_sys("mq_open error");
+			if (i == 1)
+				mq_close(mqd[0]);
+			return(-1);			/* size is over the limit */
+		}
+		mq_unlink(name);
+	}
+	return(0);
+}
+
+static int
+pmq_send(int dir, const void *buf, size_t size)
+{
+	return(mq_send(mqd[dir], buf, size, 0));
+}
+
+static int
+pmq_recv(int dir, void *buf, size_t size)
+{
+	return(mq_receive(mqd[dir], buf, size, NULL) == size ? 0 : -1);
+}
+
+static void
+pmq_cleanup(void)
+{
+	mq_close(mqd[0]);
+	mq_close(mqd[1]);
+}
+
+/*
+ * Shared memory: one buffer in each direction, with a pair of
+ * process-shared semaphores saying whether it is empty or full.
+ */
+static int
+shm_setup(size_t size)
+{
+	int		i;
+
+	shmsize = 2 * size + 4 * sizeof(sem_t);
+	if ((shmbuf[0] = mmap(0, shmsize, PROT_READ | PROT_WRITE,
+	  MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+		err_sys("mmap error");
+	shmbuf[1] = shmbuf[0] + size;
+	full = (sem_t *)(shmbuf[0] + ((2 * size + 7) & ~7));
+	empty = full + 2;
+	for (i = 0; i < 2; i++) {
+		if (sem_init(&full[i], 1, 0) < 0 || sem_init(&empty[i], 1, 1) < 0)
+			err_sys("sem_init error");
+	}
+	return(0);
+}
+
+static int
+shm_send(int dir, const void *buf, size_t size)
+{
+	if (sem_wait(&empty[dir]) < 0)
+		return(-1);
+	memcpy(shmbuf[dir], buf, size);
+	return(sem_post(&full[dir]));
+}
+
+static int
+shm_recv(int dir, void *buf, size_t size)
+{
+	if (sem_wait(&full[dir]) < 0)
+		return(-1);
+	memcpy(buf, shmbuf[dir], size);
+	return(sem_post(&empty[dir]));
+}
+
+static void
+shm_cleanup(void)
+{
+	int		i;
+
+	for (i = 0; i < 2; i++) {
+		sem_destroy(&full[i]);
+		sem_destroy(&empty[i]);
+	}
+	munmap(shmbuf[0], shmsize);
+}
+
+/*
+ * The record channels of lib/shmring.c, one in each direction.
+ */
+static int
+shr_setup(size_t size)
+{
+	if ((ring[0] = shr_create(NULL, size, SHRSLOTS, 0)) == NULL ||
+	  (ring[1] = shr_create(NULL, size, SHRSLOTS, 0)) == NULL)
+		err_sys("shr_create error");
+	return(0);
+}
+
+static int
+shr_xsend(int dir, const void *buf, size_t size)
+{
+	return(shr_send(ring[dir], buf, size, -1));
+}
+
+static int
+shr_xrecv(int dir, void *buf, size_t size)
+{
+	return(shr_recv(ring[dir], buf, -1) == size ? 0 : -1);
+}
+
+static void
+shr_cleanup(void)
+{
+	shr_close(ring[0]);
+	shr_close(ring[1]);
+}
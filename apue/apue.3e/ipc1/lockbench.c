@@ -0,0 +1,203 @@
+#include "apue.h"
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/*
+ * Contention benchmark for locks shared between processes.  "nprocs"
+ * children each take and release a lock "nloops" times, updating a
+ * shared counter while they hold it.  We compare the futex locks of
+ * lib/plock.c with a process-shared pthread mutex and a process-shared
+ * POSIX semaphore (what slock.c used to be).  For the reader-writer
+ * lock, "rpct" percent of the operations are reads.
+ *
+ * With -d, we first check recovery: a child takes each lock and exits
+ * without releasing it, and the parent must still get the lock.
+ *
+ * usage: lockbench [-d] [-p nprocs] [-n nloops] [-r rpct] [-w work]
+ */
+struct shared {
+	struct plock		pl;
+	struct prwlock		rw;
+	pthread_mutex_t		mutex;
+	sem_t				sem;
+	volatile long		counter;
+	volatile long		reads;
+};
+
+enum lockkind { L_PLOCK, L_PRWLOCK, L_PTHREAD, L_SEM, NKINDS };
+static const char *kindname[] = { "plock", "prwlock", "pthread", "sem" };
+
+static struct shared	*shp;
+static int				work;		/* loop iterations inside the lock */
+
+static void
+critical(void)
+{
+	volatile int	i;
+
+	shp->counter++;
+	for (i = 0; i < work; i++)
+		;
+}
+
+static void
+worker(enum lockkind kind, long nloops, int rpct, unsigned int seed)
+{
+	long	i;
+	long	v;
+
+	for (i = 0; i < nloops; i++) {
+		switch (kind) {
+		case L_PLOCK:
+			pl_lock(&shp->pl);
+			critical();
+			pl_unlock(&shp->pl);
+			break;
+
+		case L_PRWLOCK:
+			seed = seed * 1103515245 + 12345;
+			if ((seed >> 16) % 100 < rpct) {
+				prw_rdlock(&shp->rw);
+				v = shp->counter;			/* just look */
+				if (v < 0)
+					abort();
+				__atomic_add_fetch(&shp->reads, 1, __ATOMIC_RELAXED);
+				prw_unlock(&shp->rw);
+			} else {
+				prw_wrlock(&shp->rw);
+				critical();
+				prw_unlock(&shp->rw);
+			}
+			break;
+
+		case L_PTHREAD:
+			pthread_mutex_lock(&shp->mutex);
+			critical();
+			pthread_mutex_unlock(&shp->mutex);
+			break;
+
+		case L_SEM:
+			while (sem_wait(&shp->sem) < 0 && errno == EINTR)
+				;
+			critical();
+			sem_post(&shp->sem);
+			break;
+
+		default:
+			abort();
+		}
+	}
+}
+
+/*
+ * A child takes the lock and dies; can we still get it?
+ */
+static void
+check_recovery(void)
+{
+	pid_t	pid;
+	int		err;
+
+	if ((pid = fork()) < 0)
+		err_sys("fork error");
+	if (pid == 0) {
+		pl_lock(&shp->pl);
+		prw_wrlock(&shp->rw);
+		_exit(0);
+	}
+	if (waitpid(pid, NULL, 0) < 0)
+		err_sys("waitpid error");
+	if ((err = pl_trylock(&shp->pl)) != EOWNERDEAD)
+		err_quit("plock: pl_trylock returned %d, not EOWNERDEAD", err);
+	pl_unlock(&shp->pl);
+	if ((err = prw_rdlock(&shp->rw)) != EOWNERDEAD)
+		err_quit("prwlock: prw_rdlock returned %d, not EOWNERDEAD", err);
+	prw_unlock(&shp->rw);
+	printf("recovered both locks from a dead owner\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int					c, i, nprocs, rpct, dflag, status;
+	long				nloops;
+	enum lockkind		kind;
+	pid_t				pid;
+	pthread_mutexattr_t	attr;
+	struct timespec		start, end;
+	double				secs;
+
+	nprocs = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	nloops = 200000;
+	rpct = 90;
+	dflag = 0;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "dn:p:r:w:")) != EOF) {
+		switch (c) {
+		case 'd':
+			dflag = 1;
+			break;
+		case 'n':
+			nloops = atol(optarg);
+			break;
+		case 'p':
+			nprocs = atoi(optarg);
+			break;
+		case 'r':
+			rpct = atoi(optarg);
+			break;
+		case 'w':
+			work = atoi(optarg);
+			break;
+		case '?':
+			err_quit("usage: lockbench [-d] [-p nprocs] [-n nloops] "
+			  "[-r rpct] [-w work]");
+		}
+	}
+	if (nprocs < 1)
+		nprocs = 1;
+
+	if ((shp = mmap(0, sizeof(struct shared), PROT_READ | PROT_WRITE,
+	  MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+		err_sys("mmap error");
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutex_init(&shp->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	if (sem_init(&shp->sem, 1, 1) < 0)
+		err_sys("sem_init error");
+
+	if (dflag)
+		check_recovery();
+
+	printf("%d processes, %ld loops each, work %d\n", nprocs, nloops, work);
+	for (kind = 0; kind < NKINDS; kind++) {
+		shp->counter = shp->reads = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < nprocs; i++) {
+			if ((pid = fork()) < 0) {
+				err_sys("fork error");
+			} else if (pid == 0) {
+				worker(kind, nloops, rpct, getpid());
+				_exit(0);
+			}
+		}
+		while (wait(&status) > 0) {
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				err_quit("%s: child failed", kindname[kind]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		secs = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+		if (shp->counter + shp->reads != (long)nprocs * nloops)
+			err_quit("%s: counter is %ld, should be %ld", kindname[kind],
+			  shp->counter + shp->reads, (long)nprocs * nloops);
+		printf("%-8s %10.0f ops/s  %6.1f ns/op\n", kindname[kind],
+		  nprocs * nloops / secs, secs * 1e9 / (nprocs * nloops));
+	}
+	exit(0);
+}
@@ -0,0 +1,97 @@
+#include "apue.h"
+#include <time.h>
+#include <sys/resource.h>
+
+/*
+ * How many popen()/pclose() pairs a second: the library's version
+ * (lib/popen.c, posix_spawn) against the fork() version in popen.c,
+ * which is compiled here as fork_popen() and fork_pclose().
+ *
+ * The cost of the fork version grows with the descriptor limit, which
+ * -l sets (it's raised as far as the hard limit allows), and with the
+ * size of the caller, which -m makes bigger by touching that many
+ * megabytes of heap.
+ *
+ * usage: popenbench [-n nspawns] [-l nofile] [-m megabytes] [cmd]
+ */
+FILE	*fork_popen(const char *, const char *);	/* popen.c */
+int		 fork_pclose(FILE *);
+
+static double
+run(const char *name, FILE *(*openf)(const char *, const char *),
+  int (*closef)(FILE *), const char *cmd, long n)
+{
+	long			i;
+	int				c;
+	FILE			*fp;
+	struct timespec	start, end;
+	double			secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++) {
+		if ((fp = openf(cmd, "r")) == NULL)
+			err_sys("%s error", name);
+		while ((c = getc(fp)) != EOF)
+			;
+		if (closef(fp) < 0)
+			err_sys("%s: pclose error", name);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%-12s %8.0f spawns/s  %8.1f us/spawn\n", name, n / secs,
+	  secs * 1e6 / n);
+	return(secs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int				c;
+	long			n, nofile, mb, i;
+	char			*cmd, *heap;
+	struct rlimit	rl;
+
+	n = 2000;
+	nofile = 0;
+	mb = 0;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "l:m:n:")) != EOF) {
+		switch (c) {
+		case 'l':
+			nofile = atol(optarg);
+			break;
+		case 'm':
+			mb = atol(optarg);
+			break;
+		case 'n':
+			n = atol(optarg);
+			break;
+		case '?':
+			err_quit("usage: popenbench [-n nspawns] [-l nofile] "
+			  "[-m megabytes] [cmd]");
+		}
+	}
+	cmd = optind < argc ? argv[optind] : "true";
+
+	if (nofile > 0) {
+		if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+			err_sys("getrlimit error");
+		rl.rlim_cur = nofile;
+		if (rl.rlim_max != RLIM_INFINITY && rl.rlim_cur > rl.rlim_max)
+			rl.rlim_cur = rl.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+			err_sys("setrlimit error");
+	}
+	if (mb > 0) {
+		if ((heap = malloc(mb << 20)) == NULL)
+			err_sys("malloc error");
+		for (i = 0; i < (mb << 20); i += 4096)
+			heap[i] = 1;
+	}
+	printf("%ld spawns of \"%s\", open_max %ld, %ld MB heap\n", n, cmd,
+	  open_max(), mb);
+
+	run("posix_spawn", popen, pclose, cmd, n);
+	run("fork", fork_popen, fork_pclose, cmd, n);
+	exit(0);
+}
@@ -0,0 +1,148 @@
+#include "apue.h"
+#include <pthread.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/*
+ * The add2 coprocess of pipe4.c, with the records going through
+ * shared-memory channels (lib/shmring.c) instead of a pair of pipes.
+ * A thread sends "nrecs" pairs of numbers to the coprocess, and the
+ * main thread reads back and checks the sums.  With -p we use pipes,
+ * to compare.  With -e the channels wait on eventfds instead of futexes.
+ *
+ * usage: shmcopro [-pe] [-n nrecs]
+ */
+struct rec {
+	long	int1;
+	long	int2;
+};
+
+static long				nrecs = 1000000;
+static int				usepipe;
+static struct shmring	*tochild, *fromchild;
+static int				fd1[2], fd2[2];
+
+static void
+add2(void)
+{
+	struct rec	r;
+
+	if (usepipe) {
+		while (readn(fd1[0], &r, sizeof(r)) == sizeof(r)) {
+			r.int1 += r.int2;
+			if (writen(fd2[1], &r, sizeof(r)) != sizeof(r))
+				err_sys("write error to pipe");
+		}
+	} else {
+		while (shr_recv(tochild, &r, -1) == sizeof(r)) {
+			r.int1 += r.int2;
+			if (shr_send(fromchild, &r, sizeof(r), -1) < 0)
+				err_sys("shr_send error");
+		}
+		shr_shutdown(fromchild);
+	}
+	exit(0);
+}
+
+static void *
+sender(void *arg)
+{
+	long		i;
+	struct rec	r;
+
+	for (i = 0; i < nrecs; i++) {
+		r.int1 = i;
+		r.int2 = 2 * i;
+		if (usepipe) {
+			if (writen(fd1[1], &r, sizeof(r)) != sizeof(r))
+				err_sys("write error to pipe");
+		} else if (shr_send(tochild, &r, sizeof(r), -1) < 0) {
+			err_sys("shr_send error");
+		}
+	}
+	if (usepipe)
+		close(fd1[1]);
+	else
+		shr_shutdown(tochild);
+	return((void *)0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int				c, err, flags;
+	long			i;
+	pid_t			pid;
+	pthread_t		tid;
+	struct rec		r;
+	struct timespec	start, end;
+	double			secs;
+
+	flags = 0;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "en:p")) != EOF) {
+		switch (c) {
+		case 'e':
+			flags |= SHR_EVENTFD;
+			break;
+		case 'n':
+			nrecs = atol(optarg);
+			break;
+		case 'p':
+			usepipe = 1;
+			break;
+		case '?':
+			err_quit("unrecognized option: -%c", optopt);
+		}
+	}
+
+	if (usepipe) {
+		if (pipe(fd1) < 0 || pipe(fd2) < 0)
+			err_sys("pipe error");
+	} else {
+		if ((tochild = shr_create(NULL, sizeof(struct rec), 4096,
+		  flags)) == NULL ||
+		  (fromchild = shr_create(NULL, sizeof(struct rec), 4096,
+		  flags)) == NULL)
+			err_sys("shr_create error");
+	}
+
+	if ((pid = fork()) < 0) {
+		err_sys("fork error");
+	} else if (pid == 0) {						/* child */
+		if (usepipe) {
+			close(fd1[1]);
+			close(fd2[0]);
+		}
+		add2();
+	}
+
+	/* parent */
+	if (usepipe) {
+		close(fd1[0]);
+		close(fd2[1]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if ((err = pthread_create(&tid, NULL, sender, NULL)) != 0)
+		err_exit(err, "can't create thread");
+	for (i = 0; i < nrecs; i++) {
+		if (usepipe) {
+			if (readn(fd2[0], &r, sizeof(r)) != sizeof(r))
+				err_quit("child closed pipe");
+		} else if (shr_recv(fromchild, &r, -1) != sizeof(r)) {
+			err_quit("child closed channel");
+		}
+		if (r.int1 != 3 * i)
+			err_quit("record %ld: got %ld", i, r.int1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pthread_join(tid, NULL);
+	if (waitpid(pid, NULL, 0) < 0)
+		err_sys("waitpid error");
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%ld records through %s in %.3f s, %.0f records/s\n", nrecs,
+	  usepipe ? "pipes" : (flags & SHR_EVENTFD) ? "shm+eventfd" : "shm+futex",
+	  secs, nrecs / secs);
+	exit(0);
+}
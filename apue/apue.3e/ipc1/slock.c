@@ -1,51 +1,59 @@
 #include "slock.h"
-#include <stdlib.h>
-#include <stdio.h>
-#include <unistd.h>
 #include <errno.h>
+#include <sys/mman.h>
 
+/*
+ * These used to use a named POSIX semaphore, created with sem_open()
+ * and unlinked right away.  An uncontended s_lock() now never enters
+ * the kernel, and if a process dies holding the lock, the next one to
+ * wait for it takes it over.
+ */
 struct slock *
 s_alloc()
 {
 	struct slock *sp;
-	static int cnt;
 
 	if ((sp = malloc(sizeof(struct slock))) == NULL)
 		return(NULL);
-	do {
-		snprintf(sp->name, sizeof(sp->name), "/%ld.%d", (long)getpid(),
-		  cnt++);
-		sp->semp = sem_open(sp->name, O_CREAT|O_EXCL, S_IRWXU, 1);
-	} while ((sp->semp == SEM_FAILED) && (errno == EEXIST));
-	if (sp->semp == SEM_FAILED) {
+	sp->lockp = mmap(0, sizeof(struct plock), PROT_READ|PROT_WRITE,
+	  MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (sp->lockp == MAP_FAILED) {
 		free(sp);
 		return(NULL);
 	}
-	sem_unlink(sp->name);
-	return(sp);
+	return(sp);		/* the mapping is zero-filled: unlocked */
 }
 
 void
 s_free(struct slock *sp)
 {
-	sem_close(sp->semp);
+	munmap(sp->lockp, sizeof(struct plock));
 	free(sp);
 }
 
+/*
+ * If the last owner died, we have the lock anyway; sem_wait() had
+ * no way to report that, so we don't either.
+ */
 int
 s_lock(struct slock *sp)
 {
-	return(sem_wait(sp->semp));
+	pl_lock(sp->lockp);
+	return(0);
 }
 
 int
 s_trylock(struct slock *sp)
 {
-	return(sem_trywait(sp->semp));
+	if (pl_trylock(sp->lockp) == EBUSY) {
+		errno = EAGAIN;		/* what sem_trywait() says */
+		return(-1);
+	}
+	return(0);
 }
 
 int
 s_unlock(struct slock *sp)
 {
-	return(sem_post(sp->semp));
+	return(pl_unlock(sp->lockp));
 }
@@ -1,11 +1,11 @@
-#include <semaphore.h>
-#include <fcntl.h>
-#include <limits.h>
-#include <sys/stat.h>
+#include "apue.h"
 
+/*
+ * A lock that can be shared by a process and its children.  It lives
+ * in its own shared mapping, and is a futex lock from lib/plock.c.
+ */
 struct slock {
-	sem_t *semp;
-	char name[_POSIX_NAME_MAX];
+	struct plock	*lockp;
 };
 
 struct slock * s_alloc();
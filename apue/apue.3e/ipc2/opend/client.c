@@ -34,6 +34,8 @@ client_add(int fd, uid_t uid)
 again:
 	for (i = 0; i < client_size; i++) {
 		if (client[i].fd == -1) {	/* find an available entry */
+			if ((client[i].bio = bio_alloc(fd, MAXLINE)) == NULL)
+				log_sys("can't alloc request buffer");
 			client[i].fd = fd;
 			client[i].uid = uid;
 			return(i);	/* return index in client[] array */
@@ -56,6 +58,7 @@ client_del(int fd)
 	for (i = 0; i < client_size; i++) {
 		if (client[i].fd == fd) {
 			client[i].fd = -1;
+			bio_free(client[i].bio);
 			return;
 		}
 	}
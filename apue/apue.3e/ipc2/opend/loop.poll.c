@@ -3,6 +3,12 @@
 
 #define NALLOC	10	/* # pollfd structs to alloc/realloc */
 
+/*
+ * Index in client[] of the client using each pollfd entry, since
+ * we pack the pollfd array but not the client array.
+ */
+static int	*clindex;
+
 static struct pollfd *
 grow_pollfd(struct pollfd *pfd, int *maxfd)
 {
@@ -12,6 +18,8 @@ grow_pollfd(struct pollfd *pfd, int *maxfd)
 
 	if ((pfd = realloc(pfd, newmax * sizeof(struct pollfd))) == NULL)
 		err_sys("realloc error");
+	if ((clindex = realloc(clindex, newmax * sizeof(int))) == NULL)
+		err_sys("realloc error");
 	for (i = oldmax; i < newmax; i++) {
 		pfd[i].fd = -1;
 		pfd[i].events = POLLIN;
@@ -24,8 +32,8 @@ grow_pollfd(struct pollfd *pfd, int *maxfd)
 void
 loop(void)
 {
-	int				i, listenfd, clifd, nread;
-	char			buf[MAXLINE];
+	int				i, c, listenfd, clifd, nread;
+	char			*buf;
 	uid_t			uid;
 	struct pollfd	*pollfd;
 	int				numfd = 1;
@@ -33,6 +41,8 @@ loop(void)
 
 	if ((pollfd = malloc(NALLOC * sizeof(struct pollfd))) == NULL)
 		err_sys("malloc error");
+	if ((clindex = malloc(NALLOC * sizeof(int))) == NULL)
+		err_sys("malloc error");
 	for (i = 0; i < NALLOC; i++) {
 		pollfd[i].fd = -1;
 		pollfd[i].events = POLLIN;
@@ -53,7 +63,7 @@ loop(void)
 			/* accept new client request */
 			if ((clifd = serv_accept(listenfd, &uid)) < 0)
 				log_sys("serv_accept error: %d", clifd);
-			client_add(clifd, uid);
+			c = client_add(clifd, uid);
 
 			/* possibly increase the size of the pollfd array */
 			if (numfd == maxfd)
@@ -61,22 +71,28 @@ loop(void)
 			pollfd[numfd].fd = clifd;
 			pollfd[numfd].events = POLLIN;
 			pollfd[numfd].revents = 0;
+			clindex[numfd] = c;
 			numfd++;
 			log_msg("new connection: uid %d, fd %d", uid, clifd);
 		}
 
 		for (i = 1; i < numfd; i++) {
+			c = clindex[i];
 			if (pollfd[i].revents & POLLHUP) {
 				goto hungup;
 			} else if (pollfd[i].revents & POLLIN) {
-				/* read argument buffer from client */
-				if ((nread = read(pollfd[i].fd, buf, MAXLINE)) < 0) {
+				/*
+				 * Read whatever the client has sent.  We know
+				 * it's there, so waiting forever never waits.
+				 */
+				if ((nread = bio_fill(client[c].bio, -1)) < 0 &&
+				  errno != EMSGSIZE) {
 					log_sys("read error on fd %d", pollfd[i].fd);
-				} else if (nread == 0) {
+				} else if (nread <= 0) {	/* closed, or request too long */
 hungup:
 					/* the client closed the connection */
 					log_msg("closed: uid %d, fd %d",
-					  client[i].uid, pollfd[i].fd);
+					  client[c].uid, pollfd[i].fd);
 					client_del(pollfd[i].fd);
 					close(pollfd[i].fd);
 					if (i < (numfd-1)) {
@@ -84,12 +100,15 @@ hungup:
 						pollfd[i].fd = pollfd[numfd-1].fd;
 						pollfd[i].events = pollfd[numfd-1].events;
 						pollfd[i].revents = pollfd[numfd-1].revents;
+						clindex[i] = clindex[numfd-1];
 						i--;	/* recheck this entry */
 					}
 					numfd--;
-				} else {		/* process client's request */
-					handle_request(buf, nread, pollfd[i].fd,
-					  client[i].uid);
+				} else {		/* process each complete request */
+					while ((nread = bio_getrec(client[c].bio, 0, &buf,
+					  BIO_NOREAD)) > 0)
+						handle_request(buf, nread, pollfd[i].fd,
+						  client[c].uid);
 				}
 			}
 		}
@@ -5,7 +5,7 @@ void
 loop(void)
 {
 	int		i, n, maxfd, maxi, listenfd, clifd, nread;
-	char	buf[MAXLINE];
+	char	*buf;
 	uid_t	uid;
 	fd_set	rset, allset;
 
@@ -41,17 +41,23 @@ loop(void)
 			if ((clifd = client[i].fd) < 0)
 				continue;
 			if (FD_ISSET(clifd, &rset)) {
-				/* read argument buffer from client */
-				if ((nread = read(clifd, buf, MAXLINE)) < 0) {
+				/*
+				 * Read whatever the client has sent.  We know
+				 * it's there, so waiting forever never waits.
+				 */
+				if ((nread = bio_fill(client[i].bio, -1)) < 0 &&
+				  errno != EMSGSIZE) {
 					log_sys("read error on fd %d", clifd);
-				} else if (nread == 0) {
+				} else if (nread <= 0) {	/* closed, or request too long */
 					log_msg("closed: uid %d, fd %d",
 					  client[i].uid, clifd);
 					client_del(clifd);	/* client has closed cxn */
 					FD_CLR(clifd, &allset);
 					close(clifd);
-				} else {	/* process client's request */
-					handle_request(buf, nread, clifd, client[i].uid);
+				} else {	/* process each complete request */
+					while ((nread = bio_getrec(client[i].bio, 0, &buf,
+					  BIO_NOREAD)) > 0)
+						handle_request(buf, nread, clifd, client[i].uid);
 				}
 			}
 		}
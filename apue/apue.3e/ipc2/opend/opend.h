@@ -12,6 +12,7 @@ extern char	*pathname;	/* of file to open for client */
 typedef struct {	/* one Client struct per connected client */
   int	fd;			/* fd, or -1 if available */
   uid_t	uid;
+  struct bufio *bio;	/* buffered requests from this client */
 } Client;
 
 extern Client	*client;		/* ptr to malloc'ed array */
@@ -0,0 +1,318 @@
+/*
+ * Asynchronous back end for the log_xxx() routines in errorlog.c.
+ *
+ * Once log_async() has been called, log_doit() no longer calls syslog()
+ * (or writes to stderr) itself.  The message is formatted by the
+ * caller, as before, because the arguments may point at buffers that
+ * are gone by the time anybody else looks at them; it is then copied
+ * into a ring buffer that belongs to the calling thread.  Each ring has
+ * exactly one producer (its thread) and one consumer (whoever holds
+ * drainlock), so no locks are needed to add a message.  A background
+ * thread empties all the rings every LOG_FLUSHMS milliseconds, or
+ * sooner if a ring is filling up, and hands the messages to syslog,
+ * or to a file in a single write() per batch.
+ *
+ * If a ring is full, the message is dropped, or if log_async() was
+ * asked to block, the thread waits for the flusher to make room.  Both
+ * are counted, and log_stats() reports the counts.  log_flush()
+ * empties the rings synchronously, and is called by the fatal
+ * log_xxx() routines and at exit.
+ */
+#include "apue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <syslog.h>
+#include <time.h>
+
+#define	LOG_NSLOTS	256		/* messages per thread; power of 2 */
+#define	LOG_MSGSZ	256		/* longer messages are truncated */
+#define	LOG_FLUSHMS	100		/* flusher wakes up at least this often */
+#define	LOG_BATCHSZ	(64*1024)	/* file output buffer */
+#define	CACHELINE	64
+
+struct logslot {
+	int			priority;
+	int			len;
+	char		msg[LOG_MSGSZ];
+};
+
+/*
+ * The producer only writes tail, the consumer only writes head, and
+ * each sits in its own cache line.  Rings are never freed: when a
+ * thread exits, its ring is marked free and reused by the next thread
+ * that logs.
+ */
+struct logring {
+	unsigned long	tail;		/* next slot to fill */
+	char			pad1[CACHELINE - sizeof(unsigned long)];
+	unsigned long	head;		/* next slot to drain */
+	char			pad2[CACHELINE - sizeof(unsigned long)];
+	int				inuse;		/* owned by a live thread */
+	struct logring	*next;		/* list of all rings */
+	struct logslot	slot[LOG_NSLOTS];
+};
+
+/* defined in errorlog.c; set once we're running */
+extern int	(*log_async_hook)(int, const char *, int);
+extern void	(*log_flush_hook)(void);
+
+static struct logring	*rings;		/* pushed with CAS, never unlinked */
+static pthread_key_t	ringkey;
+
+/*
+ * A thread finds its ring through a thread-local pointer where the
+ * compiler has them, and through the key elsewhere.  The key is set in
+ * either case, so the ring is handed back when the thread exits.
+ */
+#ifdef LINUX
+static __thread struct logring	*myring;
+#define	MYRING()		myring
+#define	SETMYRING(rp)	(myring = (rp))
+#else
+#define	MYRING()		((struct logring *)pthread_getspecific(ringkey))
+#define	SETMYRING(rp)	((void)0)
+#endif
+
+static pthread_mutex_t	drainlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t	waitlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	waitcond = PTHREAD_COND_INITIALIZER;
+static int				flusher_asleep;
+static int				blockfull;	/* wait for room instead of dropping */
+
+static int				logfd = -1;	/* -1: syslog, else file or stderr */
+static char				*batch;		/* under drainlock */
+
+static unsigned long	nqueued, ndropped, nstalled, nwritten;
+
+static int	async_put(int, const char *, int);
+static void	*flusher(void *);
+
+static void
+wake_flusher(void)
+{
+	if (__atomic_load_n(&flusher_asleep, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&waitlock);
+		pthread_cond_signal(&waitcond);
+		pthread_mutex_unlock(&waitlock);
+	}
+}
+
+static void
+ring_release(void *arg)
+{
+	struct logring	*rp = arg;
+
+	__atomic_store_n(&rp->inuse, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Find a ring for this thread: reuse one left behind by a thread
+ * that has exited, or allocate a new one.
+ */
+static struct logring *
+ring_get(void)
+{
+	struct logring	*rp;
+	int				zero;
+
+	for (rp = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); rp != NULL;
+	  rp = rp->next) {
+		zero = 0;
+		if (__atomic_compare_exchange_n(&rp->inuse, &zero, 1, 0,
+		  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			goto found;
+	}
+	if ((rp = calloc(1, sizeof(struct logring))) == NULL)
+		return(NULL);
+	rp->inuse = 1;
+	rp->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rings, &rp->next, rp, 0,
+	  __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+found:
+	SETMYRING(rp);
+	pthread_setspecific(ringkey, rp);
+	return(rp);
+}
+
+/*
+ * Called by log_doit() with a formatted message.  Returns 0 if the
+ * message was queued or dropped, -1 if the caller should log it
+ * synchronously instead.
+ */
+static int
+async_put(int priority, const char *msg, int len)
+{
+	struct logring	*rp;
+	struct logslot	*sp;
+	unsigned long	tail, head;
+
+	if ((rp = MYRING()) == NULL && (rp = ring_get()) == NULL)
+		return(-1);
+	tail = rp->tail;
+	head = __atomic_load_n(&rp->head, __ATOMIC_ACQUIRE);
+	if (tail - head == LOG_NSLOTS) {
+		if (!blockfull) {
+			__atomic_add_fetch(&ndropped, 1, __ATOMIC_RELAXED);
+			return(0);
+		}
+		__atomic_add_fetch(&nstalled, 1, __ATOMIC_RELAXED);
+		do {
+			wake_flusher();
+			sched_yield();
+			head = __atomic_load_n(&rp->head, __ATOMIC_ACQUIRE);
+		} while (tail - head == LOG_NSLOTS);
+	}
+	sp = &rp->slot[tail & (LOG_NSLOTS - 1)];
+	if (len >= LOG_MSGSZ) {
+		len = LOG_MSGSZ - 1;
+		memcpy(sp->msg, msg, len - 1);
+		sp->msg[len - 1] = '\n';
+	} else {
+		memcpy(sp->msg, msg, len);
+	}
+	sp->msg[len] = 0;
+	sp->priority = priority;
+	sp->len = len;
+	__atomic_store_n(&rp->tail, tail + 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&nqueued, 1, __ATOMIC_RELAXED);
+
+	/*
+	 * Only bother the flusher if we're getting close to full.
+	 */
+	if (tail + 1 - head >= LOG_NSLOTS / 2)
+		wake_flusher();
+	return(0);
+}
+
+/*
+ * Empty every ring.  For a file, messages are gathered into batch[]
+ * and written with as few write() calls as possible.
+ */
+void
+log_flush(void)
+{
+	struct logring	*rp;
+	struct logslot	*sp;
+	unsigned long	head, tail;
+	int				n;
+
+	pthread_mutex_lock(&drainlock);
+	n = 0;
+	for (rp = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); rp != NULL;
+	  rp = rp->next) {
+		head = rp->head;
+		tail = __atomic_load_n(&rp->tail, __ATOMIC_ACQUIRE);
+		for ( ; head != tail; head++) {
+			sp = &rp->slot[head & (LOG_NSLOTS - 1)];
+			if (logfd < 0) {
+				syslog(sp->priority, "%s", sp->msg);
+			} else {
+				if (n + sp->len > LOG_BATCHSZ) {
+					writen(logfd, batch, n);
+					n = 0;
+				}
+				memcpy(batch + n, sp->msg, sp->len);
+				n += sp->len;
+			}
+			nwritten++;
+		}
+		__atomic_store_n(&rp->head, head, __ATOMIC_RELEASE);
+	}
+	if (n > 0)
+		writen(logfd, batch, n);
+	pthread_mutex_unlock(&drainlock);
+}
+
+static void
+flush_atexit(void)
+{
+	log_flush();
+}
+
+static void *
+flusher(void *arg)
+{
+	struct timespec	ts;
+
+	for (;;) {
+		log_flush();
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_FLUSHMS * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&waitlock);
+		__atomic_store_n(&flusher_asleep, 1, __ATOMIC_RELAXED);
+		pthread_cond_timedwait(&waitcond, &waitlock, &ts);
+		__atomic_store_n(&flusher_asleep, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&waitlock);
+	}
+	return((void *)0);
+}
+
+/*
+ * Switch the log_xxx() routines to asynchronous mode.  Messages go to
+ * "path" if it's not NULL, to stderr if log_to_stderr is set, and to
+ * syslog otherwise.  If "block" is nonzero, a thread whose ring is
+ * full waits instead of dropping its message.  Call after log_open()
+ * (or daemonize()).  Returns 0 on success, or -1 with errno set.
+ */
+int
+log_async(const char *path, int block)
+{
+	extern int	log_to_stderr;
+	pthread_t	tid;
+	int			err;
+
+	if (log_async_hook != NULL)
+		return(0);			/* already running */
+	if (path != NULL) {
+		if ((logfd = open(path, O_WRONLY | O_CREAT | O_APPEND,
+		  FILE_MODE)) < 0)
+			return(-1);
+	} else if (log_to_stderr) {
+		logfd = STDERR_FILENO;
+	}
+	blockfull = block;
+	if (logfd >= 0 && (batch = malloc(LOG_BATCHSZ)) == NULL)
+		return(-1);
+	if ((err = pthread_key_create(&ringkey, ring_release)) != 0) {
+		errno = err;
+		return(-1);
+	}
+	if ((err = pthread_create(&tid, NULL, flusher, NULL)) != 0) {
+		errno = err;
+		return(-1);
+	}
+	pthread_detach(tid);
+	atexit(flush_atexit);
+	log_flush_hook = log_flush;
+	__atomic_store_n(&log_async_hook, async_put, __ATOMIC_RELEASE);
+	return(0);
+}
+
+/*
+ * Report how many messages have been queued and written, how many
+ * were dropped because a thread's ring was full, and how many times
+ * a thread had to wait for room.  Any pointer may be NULL.
+ */
+void
+log_stats(unsigned long *queuedp, unsigned long *writtenp,
+  unsigned long *droppedp, unsigned long *stalledp)
+{
+	if (queuedp != NULL)
+		*queuedp = __atomic_load_n(&nqueued, __ATOMIC_RELAXED);
+	if (writtenp != NULL) {
+		pthread_mutex_lock(&drainlock);
+		*writtenp = nwritten;
+		pthread_mutex_unlock(&drainlock);
+	}
+	if (droppedp != NULL)
+		*droppedp = __atomic_load_n(&ndropped, __ATOMIC_RELAXED);
+	if (stalledp != NULL)
+		*stalledp = __atomic_load_n(&nstalled, __ATOMIC_RELAXED);
+}
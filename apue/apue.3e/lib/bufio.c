@@ -0,0 +1,275 @@
+/*
+ * Buffered input on a descriptor, for servers that parse requests
+ * and replies out of a byte stream.
+ *
+ * Data is kept in a ring buffer that is refilled with a single readv()
+ * covering all the free space, so a read that wraps around the end of
+ * the buffer still costs one system call.  Records are handed back as
+ * pointers into the buffer instead of being copied out.  A record is
+ * valid until the next call on the same stream.  If a record doesn't
+ * fit, or wraps around the end of the ring, we first make it
+ * contiguous, growing the buffer if needed, but never beyond
+ * BIO_MAXREC bytes: a peer that sends a longer record gets EMSGSIZE.
+ *
+ * Every function that may read takes a timeout in seconds for each
+ * read: -1 waits forever and 0 doesn't wait at all.  BIO_NOREAD doesn't
+ * read: only what's buffered is used, and if that isn't enough, we
+ * fail with EAGAIN.  It's for taking out the complete records that one
+ * read brought in, without reading again once they're gone.
+ */
+#include "apue.h"
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+#ifndef ETIME
+#define ETIME ETIMEDOUT
+#endif
+
+#define BIO_MAXREC	(1024 * 1024)	/* largest record we'll buffer */
+
+struct bufio {
+	int		fd;
+	char	*buf;
+	size_t	size;		/* size of buf[] */
+	size_t	head;		/* offset of first unread byte */
+	size_t	len;		/* # unread bytes, starting at head */
+	size_t	scanned;	/* # unread bytes known not to hold a delimiter */
+	int		eof;		/* read returned 0 */
+};
+
+/*
+ * Allocate a stream for "fd", with an initial buffer of "size" bytes.
+ * We don't take over the descriptor: bio_free() leaves it open.
+ */
+struct bufio *
+bio_alloc(int fd, size_t size)
+{
+	struct bufio	*bp;
+
+	if ((bp = malloc(sizeof(struct bufio))) == NULL)
+		return(NULL);
+	if (size == 0)
+		size = MAXLINE;
+	if ((bp->buf = malloc(size)) == NULL) {
+		free(bp);
+		return(NULL);
+	}
+	bp->fd = fd;
+	bp->size = size;
+	bp->head = bp->len = bp->scanned = 0;
+	bp->eof = 0;
+	return(bp);
+}
+
+void
+bio_free(struct bufio *bp)
+{
+	free(bp->buf);
+	free(bp);
+}
+
+/*
+ * Return the number of bytes buffered but not yet consumed.
+ */
+size_t
+bio_buffered(struct bufio *bp)
+{
+	return(bp->len);
+}
+
+/*
+ * Move the unread data to the start of a buffer of at least "size"
+ * bytes, so any record in it is contiguous.  Returns -1 if we can't
+ * get the memory.
+ */
+static int
+bio_linearize(struct bufio *bp, size_t size)
+{
+	char	*nbuf;
+	size_t	first;
+
+	if (size < bp->size)
+		size = bp->size;
+	if (bp->head == 0 && size == bp->size)
+		return(0);			/* nothing to do */
+	if ((nbuf = malloc(size)) == NULL)
+		return(-1);
+	first = min(bp->len, bp->size - bp->head);
+	memcpy(nbuf, bp->buf + bp->head, first);
+	memcpy(nbuf + first, bp->buf, bp->len - first);
+	free(bp->buf);
+	bp->buf = nbuf;
+	bp->size = size;
+	bp->head = 0;
+	return(0);
+}
+
+/*
+ * Read as much as will fit into the free space of the ring with one
+ * readv().  Returns the number of bytes added, 0 on end of file, or
+ * -1 on error or timeout (errno is ETIME, or EAGAIN for BIO_NOREAD).  If the buffer is full and
+ * already BIO_MAXREC bytes, errno is EMSGSIZE.
+ */
+ssize_t
+bio_fill(struct bufio *bp, int timout)
+{
+	int				niov;
+	size_t			tail;
+	ssize_t			n;
+	struct iovec	iov[2];
+	struct pollfd	pfd;
+
+	if (bp->eof)
+		return(0);
+	if (timout == BIO_NOREAD) {
+		errno = EAGAIN;
+		return(-1);
+	}
+	if (bp->len == 0)
+		bp->head = bp->scanned = 0;	/* keep records contiguous */
+	if (bp->len == bp->size) {		/* full: grow */
+		if (bp->size >= BIO_MAXREC) {
+			errno = EMSGSIZE;
+			return(-1);
+		}
+		if (bio_linearize(bp, min(2 * bp->size, BIO_MAXREC)) < 0)
+			return(-1);
+	}
+	if (timout >= 0) {
+		pfd.fd = bp->fd;
+		pfd.events = POLLIN;
+		while ((n = poll(&pfd, 1, timout * 1000)) < 0 && errno == EINTR)
+			;
+		if (n <= 0) {
+			if (n == 0)
+				errno = ETIME;
+			return(-1);
+		}
+	}
+
+	/*
+	 * The free space is everything from the tail to the end of the
+	 * buffer, plus everything before the head if we've wrapped.
+	 */
+	tail = (bp->head + bp->len) % bp->size;
+	iov[0].iov_base = bp->buf + tail;
+	if (tail >= bp->head) {
+		iov[0].iov_len = bp->size - tail;
+		iov[1].iov_base = bp->buf;
+		iov[1].iov_len = bp->head;
+		niov = (bp->head > 0) ? 2 : 1;
+	} else {
+		iov[0].iov_len = bp->head - tail;
+		niov = 1;
+	}
+	while ((n = readv(bp->fd, iov, niov)) < 0 && errno == EINTR)
+		;
+	if (n == 0)
+		bp->eof = 1;
+	else if (n > 0)
+		bp->len += n;
+	return(n);
+}
+
+/*
+ * Return the next record ending with "delim".  The delimiter is
+ * replaced by a null byte, so the record can be used as a string,
+ * and *recp is set to point to it.  Returns the length of the record
+ * including the delimiter, 0 on end of file (a partial record at the
+ * end of the file is discarded), or -1 on error or timeout.
+ */
+ssize_t
+bio_getrec(struct bufio *bp, int delim, char **recp, int timout)
+{
+	char	*p, *start;
+	size_t	first, n;
+	ssize_t	nr;
+
+	for (;;) {
+		/*
+		 * Look through the bytes we haven't seen yet, in at most
+		 * two pieces if the data wraps around.
+		 */
+		first = min(bp->len, bp->size - bp->head);
+		p = NULL;
+		if (bp->scanned < first) {
+			start = bp->buf + bp->head + bp->scanned;
+			p = memchr(start, delim, first - bp->scanned);
+		}
+		if (p == NULL && bp->len > first) {
+			n = (bp->scanned > first) ? bp->scanned - first : 0;
+			p = memchr(bp->buf + n, delim, bp->len - first - n);
+			if (p != NULL) {
+				/* make it contiguous, then find it again */
+				n = (p - bp->buf) + first;
+				if (bio_linearize(bp, bp->size) < 0)
+					return(-1);
+				p = bp->buf + n;
+			}
+		}
+		if (p != NULL)
+			break;
+		bp->scanned = bp->len;
+		if ((nr = bio_fill(bp, timout)) <= 0)
+			return(nr);
+	}
+	*p = 0;
+	*recp = bp->buf + bp->head;
+	n = p - *recp + 1;
+	bp->head = (bp->head + n) % bp->size;
+	bp->len -= n;
+	bp->scanned = 0;
+	return(n);
+}
+
+/*
+ * Return the next "nbytes" bytes, for length-delimited records.
+ * *spanp is set to point to them.  Returns "nbytes", or what's left
+ * if we hit end of file first, or -1 on error or timeout.
+ */
+ssize_t
+bio_getspan(struct bufio *bp, size_t nbytes, char **spanp, int timout)
+{
+	ssize_t	nr;
+
+	while (bp->len < nbytes) {
+		if ((nr = bio_fill(bp, timout)) < 0)
+			return(-1);
+		if (nr == 0) {
+			nbytes = bp->len;
+			break;
+		}
+	}
+	if (bp->head + nbytes > bp->size) {		/* wraps */
+		if (bio_linearize(bp, bp->size) < 0)
+			return(-1);
+	}
+	*spanp = bp->buf + bp->head;
+	bp->head = (bp->head + nbytes) % bp->size;
+	bp->len -= nbytes;
+	bp->scanned = 0;
+	return(nbytes);
+}
+
+/*
+ * Copy out up to "nbytes" bytes, like read().  We only go to the
+ * descriptor if nothing is buffered.
+ */
+ssize_t
+bio_read(struct bufio *bp, void *buf, size_t nbytes, int timout)
+{
+	size_t	n, first;
+	ssize_t	nr;
+
+	if (bp->len == 0 && (nr = bio_fill(bp, timout)) <= 0)
+		return(nr);
+	n = min(nbytes, bp->len);
+	first = min(n, bp->size - bp->head);
+	memcpy(buf, bp->buf + bp->head, first);
+	memcpy((char *)buf + first, bp->buf, n - first);
+	bp->head = (bp->head + n) % bp->size;
+	bp->len -= n;
+	bp->scanned = 0;
+	return(n);
+}
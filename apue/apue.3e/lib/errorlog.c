@@ -15,6 +15,14 @@ static void	log_doit(int, int, int, const char *, va_list ap);
  */
 extern int	log_to_stderr;
 
+/*
+ * Set by log_async() (asynclog.c) to take over delivery of messages.
+ * They are plain pointers so that programs that don't use the
+ * asynchronous back end don't pull it (and the threads library) in.
+ */
+int		(*log_async_hook)(int, const char *, int);
+void	(*log_flush_hook)(void);
+
 /*
  * Initialize syslog(), if running as daemon.
  */
@@ -51,6 +59,8 @@ log_sys(const char *fmt, ...)
 	va_start(ap, fmt);
 	log_doit(1, errno, LOG_ERR, fmt, ap);
 	va_end(ap);
+	if (log_flush_hook != NULL)
+		(*log_flush_hook)();
 	exit(2);
 }
 
@@ -80,6 +90,8 @@ log_quit(const char *fmt, ...)
 	va_start(ap, fmt);
 	log_doit(0, 0, LOG_ERR, fmt, ap);
 	va_end(ap);
+	if (log_flush_hook != NULL)
+		(*log_flush_hook)();
 	exit(2);
 }
 
@@ -96,6 +108,8 @@ log_exit(int error, const char *fmt, ...)
 	va_start(ap, fmt);
 	log_doit(1, error, LOG_ERR, fmt, ap);
 	va_end(ap);
+	if (log_flush_hook != NULL)
+		(*log_flush_hook)();
 	exit(2);
 }
 
@@ -114,6 +128,9 @@ log_doit(int errnoflag, int error, int priority, const char *fmt,
 		snprintf(buf+strlen(buf), MAXLINE-strlen(buf)-1, ": %s",
 		  strerror(error));
 	strcat(buf, "\n");
+	if (log_async_hook != NULL &&
+	  (*log_async_hook)(priority, buf, strlen(buf)) == 0)
+		return;
 	if (log_to_stderr) {
 		fflush(stdout);
 		fputs(buf, stderr);
@@ -0,0 +1,336 @@
+/*
+ * Locks for processes that share memory, built on futexes.
+ *
+ * A struct plock is a mutex and a struct prwlock is a reader-writer
+ * lock.  Either one can be put anywhere in a shared mapping; a zero-
+ * filled lock is unlocked.  Taking a free lock is a single compare-
+ * and-swap, with no system call.  If the lock is held, we spin for a
+ * while, adapting the number of spins to how long the lock has been
+ * held recently, and then sleep on the futex.  There is no spinning on
+ * a uniprocessor.
+ *
+ * The lock word holds the thread ID of the owner (of the writer, for a
+ * prwlock), in the format the kernel uses for robust futexes.  A waiter
+ * that has slept for PL_CHECKMS milliseconds checks whether the owner
+ * still exists.  If the owner has died, the waiter takes the lock over
+ * and gets EOWNERDEAD instead of 0.  It then owns the lock, and it is
+ * up to the caller to check the data the lock protects.  We can't tell
+ * which readers of a prwlock have died, so only a writer's death is
+ * recovered.  A writer that dies while waiting for a prwlock is noticed
+ * by the readers it was keeping out, as described below.
+ */
+#include "apue.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define	PL_MAXSPIN	100		/* most spins before sleeping */
+#define	PL_CHECKMS	100		/* how often a waiter checks the owner */
+
+#define	PW_WRITER	0x40000000	/* prwlock: held by the writer in low bits */
+#define	PW_MASK		0x3fffffff	/* thread ID or # readers */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define	cpu_relax()	__asm__ __volatile__("pause")
+#else
+#define	cpu_relax()	__asm__ __volatile__("" ::: "memory")
+#endif
+
+static __thread int		mytid;
+static pthread_once_t	initonce = PTHREAD_ONCE_INIT;
+static int				ncpu;
+
+static void
+forget_tid(void)
+{
+	mytid = 0;		/* the child of fork() is a new thread */
+}
+
+static void
+pl_init_once(void)
+{
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_atfork(NULL, NULL, forget_tid);
+}
+
+static int
+pl_tid(void)
+{
+	if (mytid == 0) {
+		pthread_once(&initonce, pl_init_once);
+		mytid = syscall(SYS_gettid);
+	}
+	return(mytid);
+}
+
+static int
+futex_wait(int *uaddr, int val)
+{
+	struct timespec	ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = PL_CHECKMS * 1000000L;
+	return(syscall(SYS_futex, uaddr, FUTEX_WAIT, val, &ts, NULL, 0));
+}
+
+static void
+futex_wake(int *uaddr, int n)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+/*
+ * Does this thread still exist?  kill() accepts a thread ID on Linux.
+ */
+static int
+alive(int tid)
+{
+	return(tid == 0 || kill(tid, 0) == 0 || errno != ESRCH);
+}
+
+/*
+ * Spin until "*uaddr" is no longer held, or we give up.  The number
+ * of spins follows what it took the last few times.  Returns nonzero
+ * if the lock looked free.
+ */
+static int
+spin(int *uaddr, int *spinsp, int busy)
+{
+	int		i, max, v;
+
+	pthread_once(&initonce, pl_init_once);
+	if (ncpu <= 1)
+		return(0);
+	max = min(PL_MAXSPIN, *spinsp * 2 + 10);
+	for (i = 0; i < max; i++) {
+		v = __atomic_load_n(uaddr, __ATOMIC_RELAXED);
+		if ((v & busy) == 0)
+			break;
+		cpu_relax();
+	}
+	*spinsp += (i - *spinsp) / 8;
+	return(i < max);
+}
+
+/*
+ * Lock a mutex.  Returns 0, or EOWNERDEAD if we took it over from an
+ * owner that had died.
+ */
+int
+pl_lock(struct plock *lp)
+{
+	int		tid, v, zero;
+
+	tid = pl_tid();
+	zero = 0;
+	if (__atomic_compare_exchange_n(&lp->pl_word, &zero, tid, 0,
+	  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return(0);
+
+	if (spin(&lp->pl_word, &lp->pl_spins, FUTEX_TID_MASK)) {
+		zero = 0;
+		if (__atomic_compare_exchange_n(&lp->pl_word, &zero, tid, 0,
+		  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return(0);
+	}
+
+	/*
+	 * Sleep.  Once we've waited, we don't know whether anybody else
+	 * is waiting, so we always take the lock with FUTEX_WAITERS set.
+	 */
+	for (;;) {
+		v = __atomic_load_n(&lp->pl_word, __ATOMIC_RELAXED);
+		if (v == 0) {
+			if (__atomic_compare_exchange_n(&lp->pl_word, &v,
+			  tid | FUTEX_WAITERS, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				return(0);
+			continue;
+		}
+		if (!(v & FUTEX_WAITERS)) {
+			if (!__atomic_compare_exchange_n(&lp->pl_word, &v,
+			  v | FUTEX_WAITERS, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				continue;
+			v |= FUTEX_WAITERS;
+		}
+		if (futex_wait(&lp->pl_word, v) < 0 && errno == ETIMEDOUT &&
+		  !alive(v & FUTEX_TID_MASK)) {
+			if (__atomic_compare_exchange_n(&lp->pl_word, &v,
+			  tid | FUTEX_WAITERS, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				return(EOWNERDEAD);
+		}
+	}
+}
+
+/*
+ * Returns 0, EBUSY if somebody else has the lock, or EOWNERDEAD.
+ */
+int
+pl_trylock(struct plock *lp)
+{
+	int		tid, v;
+
+	tid = pl_tid();
+	v = 0;
+	if (__atomic_compare_exchange_n(&lp->pl_word, &v, tid, 0,
+	  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return(0);
+	if (!alive(v & FUTEX_TID_MASK) &&
+	  __atomic_compare_exchange_n(&lp->pl_word, &v, tid | (v & FUTEX_WAITERS),
+	  0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return(EOWNERDEAD);
+	return(EBUSY);
+}
+
+int
+pl_unlock(struct plock *lp)
+{
+	if (__atomic_exchange_n(&lp->pl_word, 0, __ATOMIC_RELEASE) &
+	  FUTEX_WAITERS)
+		futex_wake(&lp->pl_word, 1);
+	return(0);
+}
+
+/*
+ * Reader-writer lock.  The lock word is either a count of readers, or
+ * PW_WRITER plus the thread ID of the writer.  Waiting writers keep new
+ * readers out, so writers aren't starved.  Everybody who waits sleeps
+ * on the lock word, and is woken whenever the lock is released.
+ *
+ * A waiting writer puts its thread ID in prw_wwait, unless another one
+ * already has, and takes it out when it gets the lock; the others put
+ * theirs in on their next time round.  A count of waiting writers would
+ * stay up forever if one of them died, and keep every reader out.  A
+ * thread ID can be checked: a reader that finds prw_wwait set to a
+ * thread that no longer exists clears it and goes ahead.
+ */
+static int
+writer_waiting(struct prwlock *rwp)
+{
+	int		w;
+
+	if ((w = __atomic_load_n(&rwp->prw_wwait, __ATOMIC_RELAXED)) == 0)
+		return(0);
+	if (alive(w))
+		return(1);
+	__atomic_compare_exchange_n(&rwp->prw_wwait, &w, 0, 0,
+	  __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	return(0);
+}
+
+static int
+prw_sleep(struct prwlock *rwp, int v)
+{
+	int		ret = 0;
+
+	__atomic_add_fetch(&rwp->prw_nwait, 1, __ATOMIC_SEQ_CST);
+	if (futex_wait(&rwp->prw_word, v) < 0 && errno == ETIMEDOUT &&
+	  (v & PW_WRITER) && !alive(v & PW_MASK) &&
+	  __atomic_compare_exchange_n(&rwp->prw_word, &v, 0, 0,
+	  __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		ret = EOWNERDEAD;		/* writer died: lock released */
+	__atomic_sub_fetch(&rwp->prw_nwait, 1, __ATOMIC_SEQ_CST);
+	return(ret);
+}
+
+int
+prw_rdlock(struct prwlock *rwp)
+{
+	int		v, ret;
+
+	ret = 0;
+	for (;;) {
+		v = __atomic_load_n(&rwp->prw_word, __ATOMIC_RELAXED);
+		if (!(v & PW_WRITER) && !writer_waiting(rwp)) {
+			if (__atomic_compare_exchange_n(&rwp->prw_word, &v, v + 1, 0,
+			  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				return(ret);
+			continue;
+		}
+		if ((v & PW_WRITER) && spin(&rwp->prw_word, &rwp->prw_spins,
+		  PW_WRITER))
+			continue;
+		if (prw_sleep(rwp, v) == EOWNERDEAD)
+			ret = EOWNERDEAD;
+	}
+}
+
+int
+prw_wrlock(struct prwlock *rwp)
+{
+	int		tid, v, w, ret;
+
+	tid = pl_tid();
+	v = 0;
+	if (__atomic_compare_exchange_n(&rwp->prw_word, &v, PW_WRITER | tid,
+	  0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return(0);
+	ret = 0;
+	for (;;) {
+		w = 0;
+		__atomic_compare_exchange_n(&rwp->prw_wwait, &w, tid, 0,
+		  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		v = __atomic_load_n(&rwp->prw_word, __ATOMIC_RELAXED);
+		if (v == 0) {
+			if (__atomic_compare_exchange_n(&rwp->prw_word, &v,
+			  PW_WRITER | tid, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				break;
+			continue;
+		}
+		if (spin(&rwp->prw_word, &rwp->prw_spins, PW_WRITER | PW_MASK))
+			continue;
+		if (prw_sleep(rwp, v) == EOWNERDEAD)
+			ret = EOWNERDEAD;
+	}
+	w = tid;
+	__atomic_compare_exchange_n(&rwp->prw_wwait, &w, 0, 0,
+	  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	return(ret);
+}
+
+/*
+ * The try versions return EBUSY instead of waiting.
+ */
+int
+prw_tryrdlock(struct prwlock *rwp)
+{
+	int		v;
+
+	v = __atomic_load_n(&rwp->prw_word, __ATOMIC_RELAXED);
+	while (!(v & PW_WRITER) && !writer_waiting(rwp)) {
+		if (__atomic_compare_exchange_n(&rwp->prw_word, &v, v + 1, 0,
+		  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return(0);
+	}
+	return(EBUSY);
+}
+
+int
+prw_trywrlock(struct prwlock *rwp)
+{
+	int		v;
+
+	v = 0;
+	if (__atomic_compare_exchange_n(&rwp->prw_word, &v,
+	  PW_WRITER | pl_tid(), 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return(0);
+	return(EBUSY);
+}
+
+int
+prw_unlock(struct prwlock *rwp)
+{
+	int		v;
+
+	v = __atomic_load_n(&rwp->prw_word, __ATOMIC_RELAXED);
+	if (v & PW_WRITER)
+		__atomic_store_n(&rwp->prw_word, 0, __ATOMIC_SEQ_CST);
+	else if (__atomic_sub_fetch(&rwp->prw_word, 1, __ATOMIC_SEQ_CST) != 0)
+		return(0);				/* still other readers */
+	if (__atomic_load_n(&rwp->prw_nwait, __ATOMIC_SEQ_CST) > 0)
+		futex_wake(&rwp->prw_word, INT_MAX);
+	return(0);
+}
@@ -1,25 +1,73 @@
 #include "apue.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <spawn.h>
 #include <sys/wait.h>
 
 /*
- * Pointer to array allocated at run-time.
+ * popen() and pclose() that don't depend on the size of the descriptor
+ * table.  The child is started with posix_spawn(), which doesn't copy
+ * our address space the way fork() does (glibc uses vfork-style clone).
+ * Both ends of every pipe are created close-on-exec, so the child
+ * doesn't inherit the streams of earlier popen() calls, and needn't
+ * look for them.  The child pid for each stream is kept in a small
+ * hash table keyed by the descriptor, instead of an array of
+ * open_max() entries.
  */
-static pid_t	*childpid = NULL;
+extern char	**environ;
+
+struct pent {
+	struct pent	*next;
+	int			fd;
+	pid_t		pid;
+};
+
+#define	NHASH_INIT	16
+
+static struct pent	**ptab = NULL;	/* hash table, "nhash" chains */
+static int			nhash;
+static int			nent;			/* entries in table */
+
+#define	HASH(fd)	((unsigned int)(fd) & (nhash - 1))
 
 /*
- * From our open_max(), {Prog openmax}.
+ * Double the number of chains once the table averages more than one
+ * entry per chain.
  */
-static int		maxfd;
+static int
+grow(void)
+{
+	int			i, oldn;
+	struct pent	**old, *pp, *next;
+
+	old = ptab;
+	oldn = nhash;
+	nhash = old == NULL ? NHASH_INIT : oldn * 2;
+	if ((ptab = calloc(nhash, sizeof(struct pent *))) == NULL) {
+		ptab = old;
+		nhash = oldn;
+		return(old == NULL ? -1 : 0);	/* a full table still works */
+	}
+	for (i = 0; i < oldn; i++) {
+		for (pp = old[i]; pp != NULL; pp = next) {
+			next = pp->next;
+			pp->next = ptab[HASH(pp->fd)];
+			ptab[HASH(pp->fd)] = pp;
+		}
+	}
+	free(old);
+	return(0);
+}
 
 FILE *
 popen(const char *cmdstring, const char *type)
 {
-	int		i;
-	int		pfd[2];
-	pid_t	pid;
-	FILE	*fp;
+	int							err, fd, pfd[2], ourfd, childfd, stdfd;
+	pid_t						pid;
+	FILE						*fp;
+	struct pent					*pp;
+	posix_spawn_file_actions_t	fa;
+	char						*argv[4];
 
 	/* only allow "r" or "w" */
 	if ((type[0] != 'r' && type[0] != 'w') || type[1] != 0) {
@@ -27,85 +75,120 @@ popen(const char *cmdstring, const char *type)
 		return(NULL);
 	}
 
-	if (childpid == NULL) {		/* first time through */
-		/* allocate zeroed out array for child pids */
-		maxfd = open_max();
-		if ((childpid = calloc(maxfd, sizeof(pid_t))) == NULL)
-			return(NULL);
-	}
+	if ((ptab == NULL || nent >= nhash) && grow() < 0)
+		return(NULL);
+	if ((pp = malloc(sizeof(struct pent))) == NULL)
+		return(NULL);
 
-	if (pipe(pfd) < 0)
+	/*
+	 * Both ends are close-on-exec from the start, so a fork() and
+	 * exec() in another thread can't pick them up in between.  Where
+	 * there's no pipe2(), we set the flag right after pipe(), and a
+	 * child of another thread may still inherit them in that window.
+	 */
+#ifdef LINUX
+	if (pipe2(pfd, O_CLOEXEC) < 0) {
+		free(pp);
+		return(NULL);	/* errno set by pipe2() */
+	}
+#else
+	if (pipe(pfd) < 0) {
+		free(pp);
 		return(NULL);	/* errno set by pipe() */
-	if (pfd[0] >= maxfd || pfd[1] >= maxfd) {
-		close(pfd[0]);
-		close(pfd[1]);
-		errno = EMFILE;
-		return(NULL);
+	}
+	set_cloexec(pfd[0]);
+	set_cloexec(pfd[1]);
+#endif
+	if (*type == 'r') {
+		ourfd = pfd[0];
+		childfd = pfd[1];
+		stdfd = STDOUT_FILENO;
+	} else {
+		ourfd = pfd[1];
+		childfd = pfd[0];
+		stdfd = STDIN_FILENO;
 	}
 
-	if ((pid = fork()) < 0) {
-		return(NULL);	/* errno set by fork() */
-	} else if (pid == 0) {							/* child */
-		if (*type == 'r') {
-			close(pfd[0]);
-			if (pfd[1] != STDOUT_FILENO) {
-				dup2(pfd[1], STDOUT_FILENO);
-				close(pfd[1]);
-			}
-		} else {
-			close(pfd[1]);
-			if (pfd[0] != STDIN_FILENO) {
-				dup2(pfd[0], STDIN_FILENO);
-				close(pfd[0]);
-			}
+	/*
+	 * In the child, dup2() clears close-on-exec on the copy, and the
+	 * original goes away at exec.  Not every posix_spawn() clears the
+	 * flag when the pipe end already is the standard descriptor (our
+	 * own was closed), so move it out of the way first.
+	 */
+	if (childfd == stdfd) {
+		fd = fcntl(childfd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+		close(childfd);
+		if (fd < 0) {
+			err = errno;
+			close(ourfd);
+			free(pp);
+			errno = err;
+			return(NULL);
 		}
-
-		/* close all descriptors in childpid[] */
-		for (i = 0; i < maxfd; i++)
-			if (childpid[i] > 0)
-				close(i);
-
-		execl("/bin/sh", "sh", "-c", cmdstring, (char *)0);
-		_exit(127);
+		childfd = fd;
+	}
+	argv[0] = "sh";
+	argv[1] = "-c";
+	argv[2] = (char *)cmdstring;
+	argv[3] = NULL;
+	if ((err = posix_spawn_file_actions_init(&fa)) == 0) {
+		err = posix_spawn_file_actions_adddup2(&fa, childfd, stdfd);
+		if (err == 0)
+			err = posix_spawn(&pid, "/bin/sh", &fa, NULL, argv, environ);
+		posix_spawn_file_actions_destroy(&fa);
+	}
+	close(childfd);
+	if (err != 0) {
+		close(ourfd);
+		free(pp);
+		errno = err;
+		return(NULL);
 	}
 
-	/* parent continues... */
-	if (*type == 'r') {
-		close(pfd[1]);
-		if ((fp = fdopen(pfd[0], type)) == NULL)
-			return(NULL);
-	} else {
-		close(pfd[0]);
-		if ((fp = fdopen(pfd[1], type)) == NULL)
-			return(NULL);
+	if ((fp = fdopen(ourfd, type)) == NULL) {
+		err = errno;
+		close(ourfd);
+		while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+			;
+		free(pp);
+		errno = err;
+		return(NULL);
 	}
 
-	childpid[fileno(fp)] = pid;	/* remember child pid for this fd */
+	/* remember child pid for this fd */
+	pp->fd = ourfd;
+	pp->pid = pid;
+	pp->next = ptab[HASH(ourfd)];
+	ptab[HASH(ourfd)] = pp;
+	nent++;
 	return(fp);
 }
 
 int
 pclose(FILE *fp)
 {
-	int		fd, stat;
-	pid_t	pid;
+	int			fd, stat;
+	pid_t		pid;
+	struct pent	**ppp, *pp;
 
-	if (childpid == NULL) {
+	if (ptab == NULL) {
 		errno = EINVAL;
 		return(-1);		/* popen() has never been called */
 	}
 
 	fd = fileno(fp);
-	if (fd >= maxfd) {
-		errno = EINVAL;
-		return(-1);		/* invalid file descriptor */
-	}
-	if ((pid = childpid[fd]) == 0) {
+	for (ppp = &ptab[HASH(fd)]; (pp = *ppp) != NULL; ppp = &pp->next)
+		if (pp->fd == fd)
+			break;
+	if (pp == NULL) {
 		errno = EINVAL;
 		return(-1);		/* fp wasn't opened by popen() */
 	}
 
-	childpid[fd] = 0;
+	pid = pp->pid;
+	*ppp = pp->next;
+	free(pp);
+	nent--;
 	if (fclose(fp) == EOF)
 		return(-1);
 
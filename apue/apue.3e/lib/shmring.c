@@ -0,0 +1,498 @@
+/*
+ * Record channels between processes, in shared memory.
+ *
+ * A channel is a ring of fixed-size slots in a shared mapping, made
+ * with memfd_create() (anonymous: inherited across fork and exec) or
+ * shm_open() (named).  Each slot carries a sequence number, which says
+ * whether it is free or full for the current lap around the ring, so a
+ * record is handed over without any system call at all.  With
+ * SHR_MPSC, several producers claim slots with compare-and-swap on the
+ * tail; otherwise there must be one producer.  There is always one
+ * consumer.  The head and tail indices live in separate cache lines.
+ *
+ * A side that has to wait sleeps on a futex in the mapping, and the
+ * other side only makes a wake-up call if somebody is known to be
+ * asleep.  With SHR_EVENTFD, or if futexes aren't available, waits use
+ * a pair of eventfds instead; shr_pollfd() returns the one that is
+ * signalled when there is data, so a consumer can poll() it along with
+ * its other descriptors.  The eventfd numbers are recorded in the
+ * mapping, so they have to reach the other process at the same numbers:
+ * by fork, or by fork and exec without close-on-exec.  That rules them
+ * out for named channels, which unrelated processes open.
+ *
+ * Every function that may wait takes a timeout in seconds: -1 waits
+ * forever and 0 doesn't wait at all.
+ */
+#include "apue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifndef ETIME
+#define ETIME ETIMEDOUT
+#endif
+
+#define	SHR_MAGIC	0x53485231		/* "SHR1" */
+#define	CACHELINE	64
+#define	SLOTALIGN	16
+#define	SHR_SPINS	16		/* yields before going to sleep */
+
+struct shr_slot {
+	unsigned long	seq;		/* == index when free, index+1 when full */
+	unsigned int	len;
+	char			data[4];	/* actually slotsz bytes */
+};
+
+#define	SLOTHDR		offsetof(struct shr_slot, data)
+
+/*
+ * The shared header.  Producers write tail, the consumer writes head,
+ * and each side's wait words are next to what the other side reads.
+ */
+struct shr_hdr {
+	unsigned int	magic;
+	unsigned int	flags;
+	unsigned long	nslots;			/* power of 2 */
+	unsigned long	slotsz;			/* bytes per slot, header included */
+	unsigned long	recsz;			/* max record size */
+	int				datafd;			/* eventfds, if SHR_EVENTFD */
+	int				roomfd;
+	int				closed;			/* shr_shutdown() called */
+	char			pad0[CACHELINE];
+	unsigned long	tail;			/* next slot to fill */
+	int				roomseq;		/* futex: bumped when a slot frees */
+	int				roomwait;		/* # producers asleep */
+	char			pad1[CACHELINE];
+	unsigned long	head;			/* next slot to empty */
+	int				dataseq;		/* futex: bumped when a slot fills */
+	int				datawait;		/* # consumers asleep */
+	char			pad2[CACHELINE];
+};
+
+#define	HDRSZ	((sizeof(struct shr_hdr) + CACHELINE - 1) & ~(CACHELINE - 1))
+
+struct shmring {
+	struct shr_hdr	*hdr;
+	char			*slots;
+	size_t			maplen;
+	int				fd;
+	int				useefd;		/* wait on eventfds, not futexes */
+	int				polling;	/* shr_pollfd() was called */
+};
+
+#define	SLOT(rp, i)	\
+	((struct shr_slot *)((rp)->slots + ((i) & ((rp)->hdr->nslots - 1)) * \
+	  (rp)->hdr->slotsz))
+
+static int
+futex(int *uaddr, int op, int val, const struct timespec *ts)
+{
+	return(syscall(SYS_futex, uaddr, op, val, ts, NULL, 0));
+}
+
+/*
+ * Map a ring that has been set up, and check that it is one of ours.
+ */
+static struct shmring *
+shr_map(int fd)
+{
+	struct shmring	*rp;
+	struct shr_hdr	*hp;
+	struct stat		sbuf;
+	void			*p;
+
+	if (fstat(fd, &sbuf) < 0)
+		return(NULL);
+	if (sbuf.st_size < HDRSZ) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	if ((p = mmap(0, sbuf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	  fd, 0)) == MAP_FAILED)
+		return(NULL);
+	hp = p;
+	if (hp->magic != SHR_MAGIC ||
+	  HDRSZ + hp->nslots * hp->slotsz > sbuf.st_size) {
+		munmap(p, sbuf.st_size);
+		errno = EINVAL;
+		return(NULL);
+	}
+	if ((rp = malloc(sizeof(struct shmring))) == NULL) {
+		munmap(p, sbuf.st_size);
+		return(NULL);
+	}
+	rp->hdr = hp;
+	rp->slots = (char *)p + HDRSZ;
+	rp->maplen = sbuf.st_size;
+	rp->fd = fd;
+	rp->useefd = (hp->flags & SHR_EVENTFD) != 0;
+	rp->polling = 0;
+	return(rp);
+}
+
+/*
+ * Create a channel holding up to "nrecs" records (rounded up to a
+ * power of 2) of up to "recsz" bytes each.  If "name" is NULL, the
+ * channel is anonymous and other processes get at it through the
+ * descriptor returned by shr_fd(); otherwise it is a POSIX shared
+ * memory object, which the caller removes with shm_unlink().  A named
+ * channel can't use eventfds: SHR_EVENTFD gets EINVAL, and so does
+ * creating one without futexes, which would need them.
+ */
+struct shmring *
+shr_create(const char *name, size_t recsz, unsigned long nrecs, int flags)
+{
+	int				fd, err;
+	unsigned long	n;
+	size_t			slotsz, len;
+	struct shr_hdr	*hp;
+	struct shmring	*rp;
+	void			*p;
+
+	if (recsz == 0 || nrecs == 0 || recsz > INT_MAX ||
+	  (name != NULL && (flags & SHR_EVENTFD))) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	for (n = 1; n < nrecs; n <<= 1)
+		;
+	slotsz = (SLOTHDR + recsz + SLOTALIGN - 1) & ~(SLOTALIGN - 1);
+	len = HDRSZ + n * slotsz;
+	if (name == NULL)
+		fd = memfd_create("shmring", 0);
+	else
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, FILE_MODE);
+	if (fd < 0)
+		return(NULL);
+	if (ftruncate(fd, len) < 0)
+		goto errout;
+	if ((p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+	  fd, 0)) == MAP_FAILED)
+		goto errout;
+
+	/*
+	 * The object is zero-filled, so we only need to set what isn't 0.
+	 */
+	hp = p;
+	hp->flags = flags & (SHR_MPSC | SHR_EVENTFD);
+	hp->nslots = n;
+	hp->slotsz = slotsz;
+	hp->recsz = recsz;
+	hp->datafd = hp->roomfd = -1;
+	if (!(flags & SHR_EVENTFD) &&
+	  futex(&hp->dataseq, FUTEX_WAKE, 1, NULL) < 0 && errno == ENOSYS) {
+		if (name != NULL) {
+			munmap(p, len);
+			errno = EINVAL;
+			goto errout;
+		}
+		hp->flags |= SHR_EVENTFD;		/* no futexes: fall back */
+	}
+	if (hp->flags & SHR_EVENTFD) {
+		if ((hp->datafd = eventfd(0, EFD_NONBLOCK)) < 0 ||
+		  (hp->roomfd = eventfd(0, EFD_NONBLOCK)) < 0) {
+			err = errno;
+			if (hp->datafd >= 0)
+				close(hp->datafd);
+			munmap(p, len);
+			errno = err;
+			goto errout;
+		}
+	}
+	for (n = 0; n < hp->nslots; n++)
+		((struct shr_slot *)((char *)p + HDRSZ + n * slotsz))->seq = n;
+	__atomic_store_n(&hp->magic, SHR_MAGIC, __ATOMIC_RELEASE);
+	munmap(p, len);
+	if ((rp = shr_map(fd)) != NULL)
+		return(rp);
+
+errout:
+	err = errno;
+	close(fd);
+	if (name != NULL)
+		shm_unlink(name);
+	errno = err;
+	return(NULL);
+}
+
+/*
+ * Attach to a named channel made by shr_create() in another process.
+ */
+struct shmring *
+shr_open(const char *name)
+{
+	int				fd, err;
+	struct shmring	*rp;
+
+	if ((fd = shm_open(name, O_RDWR, 0)) < 0)
+		return(NULL);
+	if ((rp = shr_map(fd)) == NULL) {
+		err = errno;
+		close(fd);
+		errno = err;
+	}
+	return(rp);
+}
+
+/*
+ * Attach to a channel through a descriptor, say one inherited from
+ * the process that created it.  We take over the descriptor.
+ */
+struct shmring *
+shr_fdopen(int fd)
+{
+	return(shr_map(fd));
+}
+
+/*
+ * Return the descriptor for the mapping, to pass to another process.
+ */
+int
+shr_fd(struct shmring *rp)
+{
+	return(rp->fd);
+}
+
+/*
+ * Return a descriptor that is readable when there may be records to
+ * receive, or -1 if the channel uses futexes.  The consumer should
+ * read() the 8-byte count from it, then call shr_recv() with a
+ * timeout of 0 until it fails with EAGAIN.  From now on producers
+ * signal the descriptor for every record, since they can't tell when
+ * we are in poll().
+ */
+int
+shr_pollfd(struct shmring *rp)
+{
+	if (!rp->useefd)
+		return(-1);
+	if (!rp->polling) {
+		__atomic_add_fetch(&rp->hdr->datawait, 1, __ATOMIC_SEQ_CST);
+		rp->polling = 1;
+	}
+	return(rp->hdr->datafd);
+}
+
+void
+shr_close(struct shmring *rp)
+{
+	munmap(rp->hdr, rp->maplen);
+	close(rp->fd);
+	free(rp);
+}
+
+/*
+ * Sleep until *seqp changes from "val", or the timeout expires.
+ * "efd" is the eventfd to use instead of the futex.
+ */
+static int
+shr_sleep(struct shmring *rp, int *seqp, int val, int efd, int timout)
+{
+	struct timespec	ts;
+	struct pollfd	pfd;
+	uint64_t		cnt;
+	int				n;
+
+	if (rp->useefd) {
+		pfd.fd = efd;
+		pfd.events = POLLIN;
+		if ((n = poll(&pfd, 1, timout < 0 ? -1 : timout * 1000)) < 0)
+			return(-1);
+		if (n == 0) {
+			errno = ETIME;
+			return(-1);
+		}
+		read(efd, &cnt, sizeof(cnt));	/* EAGAIN if somebody beat us */
+		return(0);
+	}
+	ts.tv_sec = timout;
+	ts.tv_nsec = 0;
+	if (futex(seqp, FUTEX_WAIT, val, timout < 0 ? NULL : &ts) < 0) {
+		if (errno == ETIMEDOUT) {
+			errno = ETIME;
+			return(-1);
+		}
+		if (errno != EAGAIN && errno != EINTR)
+			return(-1);
+	}
+	return(0);
+}
+
+/*
+ * Wake whoever is asleep on the other side, if anybody.  The full
+ * barrier orders our update of the ring before the load of the
+ * waiter count, matching the one in shr_wait().
+ */
+static void
+shr_wake(struct shmring *rp, int *seqp, int *waitp, int efd, int nwake)
+{
+	uint64_t	one = 1;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waitp, __ATOMIC_RELAXED) == 0)
+		return;
+	__atomic_add_fetch(seqp, 1, __ATOMIC_SEQ_CST);
+	if (rp->useefd)
+		write(efd, &one, sizeof(one));
+	else
+		futex(seqp, FUTEX_WAKE, nwake, NULL);
+}
+
+/*
+ * Wait for "ready(rp)" to become true.  We announce ourselves in the
+ * waiter count, then check again before going to sleep, so a wake-up
+ * can't slip in between the check and the sleep.
+ */
+static int
+shr_wait(struct shmring *rp, int (*ready)(struct shmring *), int *seqp,
+  int *waitp, int efd, int timout)
+{
+	int		i, val, ret;
+
+	if (timout == 0) {
+		errno = EAGAIN;
+		return(-1);
+	}
+
+	/*
+	 * The other side is usually busy with the ring right now, so
+	 * giving it the CPU for a moment is cheaper than a sleep and a
+	 * wake-up for every record.
+	 */
+	for (i = 0; i < SHR_SPINS; i++) {
+		sched_yield();
+		if ((*ready)(rp))
+			return(0);
+	}
+	__atomic_add_fetch(waitp, 1, __ATOMIC_SEQ_CST);
+	val = __atomic_load_n(seqp, __ATOMIC_SEQ_CST);
+	if ((*ready)(rp) || __atomic_load_n(&rp->hdr->closed, __ATOMIC_ACQUIRE))
+		ret = 0;
+	else
+		ret = shr_sleep(rp, seqp, val, efd, timout);
+	__atomic_sub_fetch(waitp, 1, __ATOMIC_SEQ_CST);
+	return(ret);
+}
+
+static int
+has_room(struct shmring *rp)
+{
+	unsigned long	pos = __atomic_load_n(&rp->hdr->tail, __ATOMIC_RELAXED);
+
+	return(__atomic_load_n(&SLOT(rp, pos)->seq, __ATOMIC_ACQUIRE) == pos);
+}
+
+static int
+has_data(struct shmring *rp)
+{
+	unsigned long	pos = rp->hdr->head;
+
+	return(__atomic_load_n(&SLOT(rp, pos)->seq, __ATOMIC_ACQUIRE) == pos + 1);
+}
+
+/*
+ * Send one record.  Returns 0, or -1 with errno set: EMSGSIZE if
+ * the record is too big for a slot, EPIPE if the channel has been shut
+ * down, EAGAIN if it is full and "timout" is 0, or ETIME.
+ */
+int
+shr_send(struct shmring *rp, const void *buf, size_t nbytes, int timout)
+{
+	struct shr_hdr	*hp = rp->hdr;
+	struct shr_slot	*sp;
+	unsigned long	pos, seq;
+
+	if (nbytes > hp->recsz) {
+		errno = EMSGSIZE;
+		return(-1);
+	}
+	for (;;) {
+		if (__atomic_load_n(&hp->closed, __ATOMIC_ACQUIRE)) {
+			errno = EPIPE;
+			return(-1);
+		}
+		pos = __atomic_load_n(&hp->tail, __ATOMIC_RELAXED);
+		sp = SLOT(rp, pos);
+		seq = __atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {				/* free on this lap */
+			if (!(hp->flags & SHR_MPSC)) {
+				__atomic_store_n(&hp->tail, pos + 1, __ATOMIC_RELAXED);
+				break;
+			}
+			if (__atomic_compare_exchange_n(&hp->tail, &pos, pos + 1, 1,
+			  __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if ((long)(seq - pos) < 0) {	/* full */
+			if (shr_wait(rp, has_room, &hp->roomseq, &hp->roomwait,
+			  hp->roomfd, timout) < 0)
+				return(-1);
+		}
+		/* else another producer took it; try the next one */
+	}
+	memcpy(sp->data, buf, nbytes);
+	sp->len = nbytes;
+	__atomic_store_n(&sp->seq, pos + 1, __ATOMIC_RELEASE);
+	shr_wake(rp, &hp->dataseq, &hp->datawait, hp->datafd, 1);
+	return(0);
+}
+
+/*
+ * Receive one record into "buf", which must hold the largest record
+ * the channel allows.  Returns its length, 0 if the channel has been
+ * shut down and is empty, or -1 with errno set (EAGAIN or ETIME).
+ */
+ssize_t
+shr_recv(struct shmring *rp, void *buf, int timout)
+{
+	struct shr_hdr	*hp = rp->hdr;
+	struct shr_slot	*sp;
+	unsigned long	pos;
+	size_t			n;
+
+	pos = hp->head;
+	sp = SLOT(rp, pos);
+	while (__atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+		if (__atomic_load_n(&hp->closed, __ATOMIC_ACQUIRE) &&
+		  __atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			return(0);
+		if (shr_wait(rp, has_data, &hp->dataseq, &hp->datawait,
+		  hp->datafd, timout) < 0)
+			return(-1);
+	}
+	n = sp->len;
+	memcpy(buf, sp->data, n);
+	__atomic_store_n(&sp->seq, pos + hp->nslots, __ATOMIC_RELEASE);
+	__atomic_store_n(&hp->head, pos + 1, __ATOMIC_RELAXED);
+	shr_wake(rp, &hp->roomseq, &hp->roomwait, hp->roomfd, INT_MAX);
+	return(n);
+}
+
+/*
+ * Mark the channel closed and wake everybody up.  Producers get
+ * EPIPE from then on, and the consumer gets 0 once the ring is empty.
+ */
+void
+shr_shutdown(struct shmring *rp)
+{
+	struct shr_hdr	*hp = rp->hdr;
+	uint64_t		one = 1;
+
+	__atomic_store_n(&hp->closed, 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&hp->dataseq, 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&hp->roomseq, 1, __ATOMIC_SEQ_CST);
+	if (rp->useefd) {
+		write(hp->datafd, &one, sizeof(one));
+		write(hp->roomfd, &one, sizeof(one));
+	} else {
+		futex(&hp->dataseq, FUTEX_WAKE, INT_MAX, NULL);
+		futex(&hp->roomseq, FUTEX_WAKE, INT_MAX, NULL);
+	}
+}
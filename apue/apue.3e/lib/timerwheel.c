@@ -0,0 +1,343 @@
+/*
+ * Timer service: one thread runs every timer in the process, using a
+ * hierarchical timing wheel.
+ *
+ * Time is counted in ticks of TW_TICKMS milliseconds.  The first
+ * wheel has one slot per tick for the next 256 ticks.  Each of the
+ * other four wheels has 64 slots, each slot covering 64 times as much
+ * time as a slot in the wheel below it.  A timer goes on the doubly
+ * linked list of the slot its expiry falls in, so adding and canceling
+ * are O(1).  Every time the first wheel comes round, the next slot of
+ * the second wheel is emptied and its timers are redistributed into
+ * the first wheel, and so on up ("cascading").  All timers that expire
+ * in a tick are taken off the wheel together and run after the lock
+ * is dropped.
+ *
+ * Timers are allocated by the caller, which keeps cancel simple and
+ * allocation-free.  The timer thread is started by the first tw_add().
+ */
+#include "apue.h"
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#define	TW_TICKMS	1
+#define	TVR_BITS	8
+#define	TVN_BITS	6
+#define	TVR_SIZE	(1 << TVR_BITS)
+#define	TVN_SIZE	(1 << TVN_BITS)
+#define	TVR_MASK	(TVR_SIZE - 1)
+#define	TVN_MASK	(TVN_SIZE - 1)
+#define	NLEVELS		4		/* wheels above the first one */
+#define	MAXTICKS	((1UL << (TVR_BITS + NLEVELS * TVN_BITS)) - 1)
+
+/* can twcond wait on the monotonic clock? */
+#if defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION > 0
+#define	TW_CONDCLOCK
+#endif
+
+static struct tw_timer	tv1[TVR_SIZE];			/* list heads */
+static struct tw_timer	tvn[NLEVELS][TVN_SIZE];
+
+static pthread_mutex_t	twlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	twcond;
+static pthread_once_t	twonce = PTHREAD_ONCE_INIT;
+static int				twerr;			/* from starting the thread */
+
+static unsigned long	tw_jiffies;		/* next tick to process */
+static unsigned long	tw_wakeup;		/* tick the thread will wake at */
+static long				tw_pending;		/* # timers on the wheel */
+static struct timespec	tw_base;		/* time of tick 0 */
+
+static void
+list_init(struct tw_timer *head)
+{
+	head->tw_next = head->tw_prev = head;
+}
+
+static void
+list_add(struct tw_timer *head, struct tw_timer *tp)
+{
+	tp->tw_next = head;
+	tp->tw_prev = head->tw_prev;
+	head->tw_prev->tw_next = tp;
+	head->tw_prev = tp;
+}
+
+static void
+list_del(struct tw_timer *tp)
+{
+	tp->tw_prev->tw_next = tp->tw_next;
+	tp->tw_next->tw_prev = tp->tw_prev;
+	tp->tw_next = tp->tw_prev = NULL;
+}
+
+/*
+ * Move all of "from" onto the (empty) list "to".
+ */
+static void
+list_splice(struct tw_timer *from, struct tw_timer *to)
+{
+	if (from->tw_next == from) {
+		list_init(to);
+		return;
+	}
+	to->tw_next = from->tw_next;
+	to->tw_prev = from->tw_prev;
+	to->tw_next->tw_prev = to;
+	to->tw_prev->tw_next = to;
+	list_init(from);
+}
+
+static unsigned long
+current_tick(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return(((now.tv_sec - tw_base.tv_sec) * 1000 +
+	  (now.tv_nsec - tw_base.tv_nsec) / 1000000) / TW_TICKMS);
+}
+
+/*
+ * Set "ts" to the time "ms" milliseconds after tw_base, on the clock
+ * that twcond waits on.  Where a condition variable can't be told to
+ * use the monotonic clock, that's the time of day, and a change to it
+ * makes a wait too long or too short: a timer then fires late, or the
+ * thread wakes up early and waits again.
+ */
+static void
+wake_time(struct timespec *ts, unsigned long ms)
+{
+#ifdef TW_CONDCLOCK
+	ts->tv_sec = tw_base.tv_sec + ms / 1000;
+	ts->tv_nsec = tw_base.tv_nsec + (ms % 1000) * 1000000;
+#else
+	struct timespec	now;
+	long			left;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	left = (long)ms - ((now.tv_sec - tw_base.tv_sec) * 1000 +
+	  (now.tv_nsec - tw_base.tv_nsec) / 1000000);
+	if (left < 0)
+		left = 0;
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += left / 1000;
+	ts->tv_nsec += (left % 1000) * 1000000;
+#endif
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/*
+ * Put a timer in the slot its expiry falls in.
+ * Caller must hold twlock.
+ */
+static void
+internal_add(struct tw_timer *tp)
+{
+	unsigned long	expires = tp->tw_expires;
+	unsigned long	idx = expires - tw_jiffies;
+	int				lvl;
+
+	if ((long)idx < 0) {			/* already due */
+		list_add(&tv1[tw_jiffies & TVR_MASK], tp);
+		return;
+	}
+	if (idx < TVR_SIZE) {
+		list_add(&tv1[expires & TVR_MASK], tp);
+		return;
+	}
+	for (lvl = 0; lvl < NLEVELS; lvl++) {
+		if (idx < 1UL << (TVR_BITS + (lvl + 1) * TVN_BITS) ||
+		  lvl == NLEVELS - 1)
+			break;
+	}
+	list_add(&tvn[lvl][(expires >> (TVR_BITS + lvl * TVN_BITS)) &
+	  TVN_MASK], tp);
+}
+
+/*
+ * Redistribute the timers of one slot in an upper wheel.
+ * Returns the slot index, so the caller knows whether this wheel
+ * has come round too.
+ */
+static int
+cascade(int lvl, int index)
+{
+	struct tw_timer	list, *tp;
+
+	list_splice(&tvn[lvl][index], &list);
+	while ((tp = list.tw_next) != &list) {
+		list_del(tp);
+		internal_add(tp);
+	}
+	return(index);
+}
+
+#define	INDEX(N)	((tw_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+
+/*
+ * Process every tick up to and including "now", collecting expired
+ * timers on "expired".  Caller must hold twlock.
+ */
+static void
+run_ticks(unsigned long now, struct tw_timer *expired)
+{
+	int				index, lvl;
+	struct tw_timer	list;
+
+	while ((long)(now - tw_jiffies) >= 0) {
+		index = tw_jiffies & TVR_MASK;
+		if (index == 0) {
+			for (lvl = 0; lvl < NLEVELS; lvl++) {
+				if (cascade(lvl, INDEX(lvl)) != 0)
+					break;
+			}
+		}
+		list_splice(&tv1[index], &list);
+		if (list.tw_next != &list) {
+			list.tw_next->tw_prev = expired->tw_prev;
+			expired->tw_prev->tw_next = list.tw_next;
+			list.tw_prev->tw_next = expired;
+			expired->tw_prev = list.tw_prev;
+		}
+		tw_jiffies++;
+	}
+}
+
+/*
+ * Find the next tick at which there may be work: the next nonempty
+ * slot in the first wheel, or else the next time it comes round,
+ * when we have to cascade.  Caller must hold twlock.
+ */
+static unsigned long
+next_tick(void)
+{
+	unsigned long	t;
+
+	for (t = tw_jiffies; (t & TVR_MASK) != 0; t++) {
+		if (tv1[t & TVR_MASK].tw_next != &tv1[t & TVR_MASK])
+			return(t);
+	}
+	return(t);
+}
+
+static void *
+tw_thread(void *arg)
+{
+	struct tw_timer	expired, *tp;
+	struct timespec	ts;
+
+	pthread_mutex_lock(&twlock);
+	for (;;) {
+		list_init(&expired);
+		run_ticks(current_tick(), &expired);
+		if (expired.tw_next != &expired) {
+			/*
+			 * Run the batch without the lock, so callbacks can
+			 * add and cancel timers.  A timer still on the batch
+			 * list can be canceled while we're running another.
+			 */
+			while ((tp = expired.tw_next) != &expired) {
+				list_del(tp);
+				tw_pending--;
+				pthread_mutex_unlock(&twlock);
+				(*tp->tw_fn)(tp->tw_arg);	/* may free tp */
+				pthread_mutex_lock(&twlock);
+			}
+			continue;
+		}
+		if (tw_pending == 0) {
+			tw_wakeup = tw_jiffies + MAXTICKS;
+			pthread_cond_wait(&twcond, &twlock);
+			continue;
+		}
+		tw_wakeup = next_tick();
+		wake_time(&ts, tw_wakeup * TW_TICKMS);
+		pthread_cond_timedwait(&twcond, &twlock, &ts);
+	}
+	return((void *)0);
+}
+
+static void
+tw_init(void)
+{
+	int					i, lvl;
+	pthread_t			tid;
+	pthread_condattr_t	attr;
+
+	for (i = 0; i < TVR_SIZE; i++)
+		list_init(&tv1[i]);
+	for (lvl = 0; lvl < NLEVELS; lvl++)
+		for (i = 0; i < TVN_SIZE; i++)
+			list_init(&tvn[lvl][i]);
+	clock_gettime(CLOCK_MONOTONIC, &tw_base);
+	pthread_condattr_init(&attr);
+#ifdef TW_CONDCLOCK
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+	pthread_cond_init(&twcond, &attr);
+	pthread_condattr_destroy(&attr);
+	tw_wakeup = MAXTICKS;
+	if ((twerr = pthread_create(&tid, NULL, tw_thread, NULL)) == 0)
+		pthread_detach(tid);
+}
+
+/*
+ * Call "fn(arg)" from the timer thread "msec" milliseconds from now.
+ * "tp" must stay valid until the timer fires or is canceled.  A timer
+ * that's already pending is moved.  Returns 0, or an error number if
+ * the timer thread couldn't be started.
+ */
+int
+tw_add(struct tw_timer *tp, unsigned long msec, void (*fn)(void *),
+  void *arg)
+{
+	unsigned long	ticks;
+
+	pthread_once(&twonce, tw_init);
+	if (twerr != 0)
+		return(twerr);
+	ticks = (msec + TW_TICKMS - 1) / TW_TICKMS;
+	if (ticks > MAXTICKS)
+		ticks = MAXTICKS;
+	pthread_mutex_lock(&twlock);
+	if (tp->tw_next != NULL) {
+		list_del(tp);
+		tw_pending--;
+	}
+	if (tw_pending == 0)
+		tw_jiffies = current_tick();	/* skip idle time: wheel is empty */
+	tp->tw_fn = fn;
+	tp->tw_arg = arg;
+	tp->tw_expires = current_tick() + ticks + 1;	/* never early */
+	internal_add(tp);
+	tw_pending++;
+	if ((long)(tp->tw_expires - tw_wakeup) < 0)
+		pthread_cond_signal(&twcond);	/* sooner than planned */
+	pthread_mutex_unlock(&twlock);
+	return(0);
+}
+
+/*
+ * Cancel a pending timer.  Returns 1 if it was pending and now won't
+ * run, 0 if it wasn't pending (never added, already run, or running
+ * right now).
+ */
+int
+tw_cancel(struct tw_timer *tp)
+{
+	int		ret = 0;
+
+	pthread_mutex_lock(&twlock);
+	if (tp->tw_next != NULL) {
+		list_del(tp);
+		tw_pending--;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&twlock);
+	return(ret);
+}
@@ -0,0 +1,487 @@
+/*
+ * A work-stealing thread pool.
+ *
+ * Each worker thread has a Chase-Lev deque.  Tasks submitted by a
+ * worker are pushed on the bottom of its own deque.  The worker pops
+ * them from the bottom (newest first, so what it just touched is still
+ * in cache) without a lock.  Workers that run out of work steal from
+ * the top of another worker's deque with a single compare-and-swap.
+ * Tasks submitted by threads outside the pool go on a global injection
+ * queue, as do tasks that don't fit in a full deque.
+ *
+ * A task can also be given to one particular worker.  It then goes on
+ * that worker's mailbox, which nobody else takes from.  This replaces
+ * the j_id field of the job queue in threads/rwlock.c: each worker only
+ * ever looks at its own tasks, instead of searching a shared list for
+ * jobs with its thread ID.
+ *
+ * A worker with nothing to do parks on a futex of its own.  Submitters
+ * wake one parked worker, and only make a system call if a worker is
+ * known to be parked.
+ *
+ * A task may belong to a group.  wq_wait() waits until every task in
+ * the group has finished.  Called by a worker, it runs other tasks
+ * while it waits, so a task can split its work into subtasks and join
+ * them (fork-join) without tying up the thread.
+ */
+#include "apue.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define	CACHELINE	64
+#define	DEQSIZE		4096		/* tasks per deque: a power of 2 */
+
+/*
+ * Chase-Lev deque, with the fixes of Le et al. for weak memory models.
+ * Only the owner changes bottom; thieves race on top.
+ */
+struct deque {
+	long			top;
+	char			pad1[CACHELINE - sizeof(long)];
+	long			bottom;
+	char			pad2[CACHELINE - sizeof(long)];
+	struct wq_task	*slot[DEQSIZE];
+};
+
+/*
+ * A FIFO list with a lock, for the injection queue and the mailboxes.
+ * The count can be read without the lock, to skip empty lists.
+ */
+struct tlist {
+	pthread_mutex_t	lock;
+	struct wq_task	*head;
+	struct wq_task	*tail;
+	int				count;
+};
+
+struct worker {
+	struct deque	dq;
+	struct tlist	mbox;		/* tasks for this worker only */
+	struct workq	*pool;
+	int				index;
+	int				seq;		/* futex: bumped to wake us */
+	int				idle;		/* parked, or about to be */
+	int				joining;	/* parked in wq_wait() */
+	unsigned int	rand;		/* to pick a victim */
+	pthread_t		tid;
+} __attribute__((aligned(CACHELINE)));
+
+struct workq {
+	struct tlist	inject;
+	int				nworkers;
+	int				nidle;		/* # workers parked */
+	int				njoin;		/* # of those in wq_wait() */
+	int				shutdown;
+	struct worker	*workers;
+};
+
+static __thread struct worker	*self;
+
+static void
+futex_wait(int *uaddr, int val)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void
+futex_wake(int *uaddr, int n)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/*
+ * Owner: push a task on the bottom.  Returns -1 if the deque is full.
+ */
+static int
+dq_push(struct deque *dp, struct wq_task *tp)
+{
+	long	b, t;
+
+	b = __atomic_load_n(&dp->bottom, __ATOMIC_RELAXED);
+	t = __atomic_load_n(&dp->top, __ATOMIC_ACQUIRE);
+	if (b - t >= DEQSIZE)
+		return(-1);
+	__atomic_store_n(&dp->slot[b & (DEQSIZE - 1)], tp, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&dp->bottom, b + 1, __ATOMIC_RELAXED);
+	return(0);
+}
+
+/*
+ * Owner: take the task on the bottom.  If it's the last one, we race
+ * the thieves for it.
+ */
+static struct wq_task *
+dq_take(struct deque *dp)
+{
+	long			b, t;
+	struct wq_task	*tp;
+
+	b = __atomic_load_n(&dp->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&dp->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&dp->top, __ATOMIC_RELAXED);
+	if (t > b) {
+		__atomic_store_n(&dp->bottom, b + 1, __ATOMIC_RELAXED);
+		return(NULL);					/* empty */
+	}
+	tp = __atomic_load_n(&dp->slot[b & (DEQSIZE - 1)], __ATOMIC_RELAXED);
+	if (t == b) {
+		if (!__atomic_compare_exchange_n(&dp->top, &t, t + 1, 0,
+		  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			tp = NULL;					/* a thief got it */
+		__atomic_store_n(&dp->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return(tp);
+}
+
+/*
+ * Thief: take the task on the top.  Sets *lostp if we lost a race, in
+ * which case the deque may not be empty.
+ */
+static struct wq_task *
+dq_steal(struct deque *dp, int *lostp)
+{
+	long			b, t;
+	struct wq_task	*tp;
+
+	t = __atomic_load_n(&dp->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&dp->bottom, __ATOMIC_ACQUIRE);
+	if (t >= b)
+		return(NULL);
+	tp = __atomic_load_n(&dp->slot[t & (DEQSIZE - 1)], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&dp->top, &t, t + 1, 0,
+	  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		*lostp = 1;
+		return(NULL);
+	}
+	return(tp);
+}
+
+static void
+tl_put(struct tlist *lp, struct wq_task *tp)
+{
+	tp->wt_next = NULL;
+	pthread_mutex_lock(&lp->lock);
+	if (lp->tail != NULL)
+		lp->tail->wt_next = tp;
+	else
+		lp->head = tp;
+	lp->tail = tp;
+	__atomic_store_n(&lp->count, lp->count + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&lp->lock);
+}
+
+static struct wq_task *
+tl_get(struct tlist *lp)
+{
+	struct wq_task	*tp;
+
+	if (__atomic_load_n(&lp->count, __ATOMIC_RELAXED) == 0)
+		return(NULL);
+	pthread_mutex_lock(&lp->lock);
+	if ((tp = lp->head) != NULL) {
+		if ((lp->head = tp->wt_next) == NULL)
+			lp->tail = NULL;
+		__atomic_store_n(&lp->count, lp->count - 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&lp->lock);
+	return(tp);
+}
+
+static struct wq_task *
+find_task(struct worker *wp)
+{
+	int				i, n, start, lost;
+	struct workq	*qp;
+	struct worker	*vp;
+	struct wq_task	*tp;
+
+	qp = wp->pool;
+	if ((tp = dq_take(&wp->dq)) != NULL ||
+	  (tp = tl_get(&wp->mbox)) != NULL ||
+	  (tp = tl_get(&qp->inject)) != NULL)
+		return(tp);
+
+	/*
+	 * Steal, starting at a random victim so thieves spread out.
+	 */
+	n = qp->nworkers;
+	wp->rand = wp->rand * 1103515245 + 12345;
+	start = (wp->rand >> 16) % n;
+	do {
+		lost = 0;
+		for (i = 0; i < n; i++) {
+			vp = &qp->workers[(start + i) % n];
+			if (vp != wp && (tp = dq_steal(&vp->dq, &lost)) != NULL)
+				return(tp);
+		}
+	} while (lost);
+	return(NULL);
+}
+
+static void
+wake(struct worker *wp)
+{
+	__atomic_add_fetch(&wp->seq, 1, __ATOMIC_SEQ_CST);
+	futex_wake(&wp->seq, 1);
+}
+
+/*
+ * Wake a parked worker, if there is one, to look for new work.  The
+ * caller has already made the work visible.
+ */
+static void
+wake_one(struct workq *qp)
+{
+	int				i, idle;
+	struct worker	*wp;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&qp->nidle, __ATOMIC_RELAXED) == 0)
+		return;
+	for (i = 0; i < qp->nworkers; i++) {
+		wp = &qp->workers[i];
+		idle = 1;
+		if (__atomic_load_n(&wp->idle, __ATOMIC_RELAXED) &&
+		  __atomic_compare_exchange_n(&wp->idle, &idle, 0, 0,
+		  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			wake(wp);
+			return;
+		}
+	}
+}
+
+static void
+run(struct worker *wp, struct wq_task *tp)
+{
+	int				i;
+	struct wq_group	*gp;
+	struct workq	*qp;
+
+	gp = tp->wt_group;			/* tp may be gone once it has run */
+	tp->wt_fn(tp->wt_arg);
+	if (gp == NULL || __atomic_sub_fetch(&gp->wg_pending, 1,
+	  __ATOMIC_SEQ_CST) != 0)
+		return;
+
+	/*
+	 * The group is done.  A thread outside the pool sleeps on the
+	 * count itself.  It may have seen the zero and gone already, but
+	 * a wake-up on memory that has been reused is only spurious.
+	 * Workers wait on their own futex.
+	 */
+	futex_wake(&gp->wg_pending, INT_MAX);
+	qp = wp->pool;
+	if (__atomic_load_n(&qp->njoin, __ATOMIC_SEQ_CST) > 0) {
+		for (i = 0; i < qp->nworkers; i++)
+			if (__atomic_load_n(&qp->workers[i].joining, __ATOMIC_RELAXED))
+				wake(&qp->workers[i]);
+	}
+}
+
+/*
+ * Park until somebody wakes us, unless there turns out to be a task
+ * after all, which we return.  With a group, we also stop when the
+ * group is finished; without one, when the pool is shutting down.
+ */
+static struct wq_task *
+park(struct worker *wp, struct wq_group *gp)
+{
+	int				seq;
+	struct workq	*qp;
+	struct wq_task	*tp;
+
+	qp = wp->pool;
+	seq = __atomic_load_n(&wp->seq, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&wp->idle, 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&qp->nidle, 1, __ATOMIC_SEQ_CST);
+	if (gp != NULL) {
+		__atomic_store_n(&wp->joining, 1, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&qp->njoin, 1, __ATOMIC_SEQ_CST);
+	}
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if ((tp = find_task(wp)) == NULL &&
+	  (gp != NULL ? __atomic_load_n(&gp->wg_pending, __ATOMIC_SEQ_CST) > 0 :
+	  !__atomic_load_n(&qp->shutdown, __ATOMIC_SEQ_CST)))
+		futex_wait(&wp->seq, seq);
+
+	if (gp != NULL) {
+		__atomic_store_n(&wp->joining, 0, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&qp->njoin, 1, __ATOMIC_SEQ_CST);
+	}
+	__atomic_store_n(&wp->idle, 0, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&qp->nidle, 1, __ATOMIC_SEQ_CST);
+	return(tp);
+}
+
+static void *
+worker_main(void *arg)
+{
+	struct worker	*wp = arg;
+	struct wq_task	*tp;
+
+	self = wp;
+	for (;;) {
+		if ((tp = find_task(wp)) == NULL && (tp = park(wp, NULL)) == NULL) {
+			if (__atomic_load_n(&wp->pool->shutdown, __ATOMIC_SEQ_CST) &&
+			  (tp = find_task(wp)) == NULL)
+				break;
+			if (tp == NULL)
+				continue;
+		}
+		run(wp, tp);
+	}
+	return((void *)0);
+}
+
+static void
+tl_init(struct tlist *lp)
+{
+	pthread_mutex_init(&lp->lock, NULL);
+	lp->head = lp->tail = NULL;
+	lp->count = 0;
+}
+
+/*
+ * Start a pool of "nworkers" threads (one per CPU if 0).  With WQ_PIN,
+ * worker i runs only on CPU i (modulo the number of CPUs).  Returns
+ * NULL with errno set on error.
+ */
+struct workq *
+wq_create(int nworkers, int flags)
+{
+	int				i, err, ncpu;
+	struct workq	*qp;
+	struct worker	*wp;
+	cpu_set_t		set;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nworkers <= 0)
+		nworkers = ncpu > 0 ? ncpu : 1;
+	if ((qp = calloc(1, sizeof(struct workq))) == NULL)
+		return(NULL);
+	if ((err = posix_memalign((void **)&qp->workers, CACHELINE,
+	  nworkers * sizeof(struct worker))) != 0) {
+		free(qp);
+		errno = err;
+		return(NULL);
+	}
+	memset(qp->workers, 0, nworkers * sizeof(struct worker));
+	tl_init(&qp->inject);
+	qp->nworkers = nworkers;
+	for (i = 0; i < nworkers; i++) {
+		wp = &qp->workers[i];
+		tl_init(&wp->mbox);
+		wp->pool = qp;
+		wp->index = i;
+		wp->rand = i + 1;
+	}
+	for (i = 0; i < nworkers; i++) {
+		wp = &qp->workers[i];
+		if ((err = pthread_create(&wp->tid, NULL, worker_main, wp)) != 0) {
+			qp->nworkers = i;		/* wq_destroy() stops the ones we have */
+			wq_destroy(qp);
+			errno = err;
+			return(NULL);
+		}
+		if ((flags & WQ_PIN) && ncpu > 0) {
+			CPU_ZERO(&set);
+			CPU_SET(i % ncpu, &set);
+			pthread_setaffinity_np(wp->tid, sizeof(set), &set);
+		}
+	}
+	return(qp);
+}
+
+/*
+ * Run a task.  The caller fills in wt_fn, wt_arg and wt_group, and
+ * keeps the task around until it has run.  If "worker" is not
+ * negative, only that worker will run the task.
+ */
+int
+wq_submit(struct workq *qp, struct wq_task *tp, int worker)
+{
+	struct worker	*wp;
+	int				idle;
+
+	if (worker >= qp->nworkers) {
+		errno = EINVAL;
+		return(-1);
+	}
+	if (tp->wt_group != NULL)
+		__atomic_add_fetch(&tp->wt_group->wg_pending, 1, __ATOMIC_SEQ_CST);
+	if (worker >= 0) {
+		wp = &qp->workers[worker];
+		tl_put(&wp->mbox, tp);
+		if (wp == self)
+			return(0);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		idle = 1;
+		if (__atomic_load_n(&wp->idle, __ATOMIC_RELAXED) &&
+		  __atomic_compare_exchange_n(&wp->idle, &idle, 0, 0,
+		  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			wake(wp);
+		return(0);
+	}
+	if (self == NULL || self->pool != qp || dq_push(&self->dq, tp) < 0)
+		tl_put(&qp->inject, tp);
+	wake_one(qp);
+	return(0);
+}
+
+/*
+ * Wait for all the tasks in a group to finish.
+ */
+void
+wq_wait(struct workq *qp, struct wq_group *gp)
+{
+	int				n;
+	struct wq_task	*tp;
+
+	if (self != NULL && self->pool == qp) {
+		while (__atomic_load_n(&gp->wg_pending, __ATOMIC_ACQUIRE) > 0) {
+			if ((tp = find_task(self)) != NULL ||
+			  (tp = park(self, gp)) != NULL)
+				run(self, tp);
+		}
+	} else {
+		while ((n = __atomic_load_n(&gp->wg_pending, __ATOMIC_ACQUIRE)) > 0)
+			futex_wait(&gp->wg_pending, n);
+	}
+}
+
+/*
+ * Which worker of its pool is the calling thread?  -1 if none.
+ */
+int
+wq_self(void)
+{
+	return(self != NULL ? self->index : -1);
+}
+
+/*
+ * Run what has been submitted, then stop the workers and free the pool.
+ */
+void
+wq_destroy(struct workq *qp)
+{
+	int		i;
+
+	__atomic_store_n(&qp->shutdown, 1, __ATOMIC_SEQ_CST);
+	for (i = 0; i < qp->nworkers; i++)
+		wake(&qp->workers[i]);
+	for (i = 0; i < qp->nworkers; i++)
+		pthread_join(qp->workers[i].tid, NULL);
+	for (i = 0; i < qp->nworkers; i++)
+		pthread_mutex_destroy(&qp->workers[i].mbox.lock);
+	pthread_mutex_destroy(&qp->inject.lock);
+	free(qp->workers);
+	free(qp);
+}
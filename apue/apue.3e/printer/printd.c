@@ -28,6 +28,7 @@ struct job {
 	struct job      *prev;		/* previous in list */
 	int32_t          jobid;		/* job ID */
 	struct printreq  req;		/* copy of print request */
+	struct tw_timer  retry;		/* to requeue a deferred job */
 };
 
 /*
@@ -78,12 +79,12 @@ void		update_jobno(void);
 int32_t	get_newjobno(void);
 void		add_job(struct printreq *, int32_t);
 void		replace_job(struct job *);
+void		retry_job(void *);
 void		remove_job(struct job *);
 void		build_qonstart(void);
 void		*client_thread(void *);
 void		*printer_thread(void *);
 void		*signal_thread(void *);
-ssize_t	readmore(int, char **, int, int *);
 int		printer_status(int, struct job *);
 void		add_worker(pthread_t, int);
 void		kill_workers(void);
@@ -121,6 +122,13 @@ main(int argc, char *argv[])
 	if ((err = pthread_sigmask(SIG_BLOCK, &mask, NULL)) != 0)
 		log_sys("pthread_sigmask failed");
 
+	/*
+	 * Keep syslog() out of the job and printer paths; the
+	 * signal thread's exit() flushes whatever is queued.
+	 */
+	if (log_async(NULL, 0) < 0)
+		log_sys("can't start logging thread");
+
 	n = sysconf(_SC_HOST_NAME_MAX);
 	if (n < 0)	/* best guess */
 		n = HOST_NAME_MAX;
@@ -277,8 +285,8 @@ add_job(struct printreq *reqp, int32_t jobid)
 {
 	struct job	*jp;
 
-	if ((jp = malloc(sizeof(struct job))) == NULL)
-		log_sys("malloc failed");
+	if ((jp = calloc(1, sizeof(struct job))) == NULL)
+		log_sys("calloc failed");
 	memcpy(&jp->req, reqp, sizeof(struct printreq));
 	jp->jobid = jobid;
 	jp->next = NULL;
@@ -312,6 +320,19 @@ replace_job(struct job *jp)
 	pthread_mutex_unlock(&joblock);
 }
 
+/*
+ * Called from the timer thread when a deferred job is due
+ * to be tried again.
+ *
+ * LOCKING: acquires and releases joblock.
+ */
+void
+retry_job(void *arg)
+{
+	replace_job((struct job *)arg);
+	pthread_cond_signal(&jobwait);
+}
+
 /*
  * Remove a job from the list of pending jobs.
  *
@@ -679,7 +700,6 @@ printer_thread(void *arg)
 	char			ibuf[IBUFSZ];
 	char			buf[IOBUFSZ];
 	char			str[64];
-	struct timespec	ts = { 60, 0 };		/* 1 minute */
 
 	for (;;) {
 		/*
@@ -834,188 +854,128 @@ defer:
 		if (sockfd >= 0)
 			close(sockfd);
 		if (jp != NULL) {
-			replace_job(jp);
-			nanosleep(&ts, NULL);
+			/*
+			 * Try this job again in a minute.  Meanwhile,
+			 * go on with the rest of the queue.
+			 */
+			if (tw_add(&jp->retry, 60 * 1000, retry_job, jp) != 0) {
+				replace_job(jp);
+				sleep(60);
+			}
 		}
 	}
 }
 
-/*
- * Read data from the printer, possibly increasing the buffer.
- * Returns offset of end of data in buffer or -1 on failure.
- *
- * LOCKING: none.
- */
-ssize_t
-readmore(int sockfd, char **bpp, int off, int *bszp)
-{
-	ssize_t	nr;
-	char	*bp = *bpp;
-	int		bsz = *bszp;
-
-	if (off >= bsz) {
-		bsz += IOBUFSZ;
-		if ((bp = realloc(*bpp, bsz)) == NULL)
-			log_sys("readmore: can't allocate bigger read buffer");
-		*bszp = bsz;
-		*bpp = bp;
-	}
-	if ((nr = tread(sockfd, &bp[off], bsz-off, 1)) > 0)
-		return(off+nr);
-	else
-		return(-1);
-}
-
 /*
  * Read and parse the response from the printer.  Return 1
  * if the request was successful, and 0 otherwise.
  *
+ * The HTTP header is read a line at a time and the IPP response
+ * header as one Content-Length span, all out of one buffered
+ * stream, so the reply usually costs a single read.
+ *
  * LOCKING: none.
  */
 int
 printer_status(int sfd, struct job *jp)
 {
-	int				i, success, code, len, found, bufsz, datsz;
+	int				i, success, code, len;
 	int32_t			jobid;
 	ssize_t			nr;
-	char			*bp, *cp, *statcode, *reason, *contentlen;
+	char			*line, *cp, *statcode;
+	char			reason[MAXLINE];
+	struct bufio	*bp;
 	struct ipp_hdr	*hp;
 
-	/*
-	 * Read the HTTP header followed by the IPP response header.
-	 * They can be returned in multiple read attempts.  Use the
-	 * Content-Length specifier to determine how much to read.
-	 */
 	success = 0;
-	bufsz = IOBUFSZ;
-	if ((bp = malloc(IOBUFSZ)) == NULL)
+	jobid = jp->jobid;
+	if ((bp = bio_alloc(sfd, IOBUFSZ)) == NULL)
 		log_sys("printer_status: can't allocate read buffer");
 
-	while ((nr = tread(sfd, bp, bufsz, 5)) > 0) {
+	for (;;) {
 		/*
 		 * Find the status.  Response starts with "HTTP/x.y"
 		 * so we can skip the first 8 characters.
 		 */
-		cp = bp + 8;
-		datsz = nr;
+		if ((nr = bio_getrec(bp, '\n', &line, 5)) <= 0)
+			goto out;
+		cp = line + 8;
+		if (nr <= 8 || strncmp(line, "HTTP/", 5) != 0) {
+			log_msg("%s", line);	/* Bad format; log it and move on */
+			continue;
+		}
 		while (isspace((int)*cp))
 			cp++;
 		statcode = cp;
 		while (isdigit((int)*cp))
 			cp++;
-		if (cp == statcode) { /* Bad format; log it and move on */
-			log_msg(bp);
-		} else {
-			*cp++ = '\0';
-			reason = cp;
-			while (*cp != '\r' && *cp != '\n')
-				cp++;
-			*cp = '\0';
-			code = atoi(statcode);
-			if (HTTP_INFO(code))
-				continue;
-			if (!HTTP_SUCCESS(code)) { /* probable error: log it */
-				bp[datsz] = '\0';
-				log_msg("error: %s", reason);
-				break;
-			}
-
-			/*
-			 * HTTP request was okay, but still need to check
-			 * IPP status.  Search for the Content-Length.
-			 */
-			i = cp - bp;
-			for (;;) {
-				while (*cp != 'C' && *cp != 'c' && i < datsz) {
-					cp++;
-					i++;
-				}
-				if (i >= datsz) {	/* get more header */
-					if ((nr = readmore(sfd, &bp, i, &bufsz)) < 0) {
-						goto out;
-					} else {
-						cp = &bp[i];
-						datsz += nr;
-					}
-				}
-
-				if (strncasecmp(cp, "Content-Length:", 15) == 0) {
-					cp += 15;
-					while (isspace((int)*cp))
-						cp++;
-					contentlen = cp;
-					while (isdigit((int)*cp))
-						cp++;
-					*cp++ = '\0';
-					i = cp - bp;
-					len = atoi(contentlen);
-					break;
-				} else {
-					cp++;
-					i++;
-				}
-			}
-			if (i >= datsz) {	/* get more header */
-				if ((nr = readmore(sfd, &bp, i, &bufsz)) < 0) {
-					goto out;
-				} else {
-					cp = &bp[i];
-					datsz += nr;
-				}
-			}
+		if (cp == statcode) {	/* Bad format; log it and move on */
+			log_msg("%s", line);
+			continue;
+		}
+		*cp++ = '\0';
+		code = atoi(statcode);
 
-			found = 0;
-			while (!found) {  /* look for end of HTTP header */
-				while (i < datsz - 2) {
-					if (*cp == '\n' && *(cp + 1) == '\r' &&
-					  *(cp + 2) == '\n') {
-						found = 1;
-						cp += 3;
-						i += 3;
-						break;
-					}
-					cp++;
-					i++;
-				}
-				if (i >= datsz) {	/* get more header */
-					if ((nr = readmore(sfd, &bp, i, &bufsz)) < 0) {
-						goto out;
-					} else {
-						cp = &bp[i];
-						datsz += nr;
-					}
-				}
-			}
+		/*
+		 * The line is only valid until we read the next one,
+		 * so keep a copy of the reason phrase.
+		 */
+		cp[strcspn(cp, "\r")] = '\0';
+		strncpy(reason, cp, sizeof(reason) - 1);
+		reason[sizeof(reason) - 1] = '\0';
 
-			if (datsz - i < len) {	/* get more header */
-				if ((nr = readmore(sfd, &bp, i, &bufsz)) < 0) {
-					goto out;
-				} else {
-					cp = &bp[i];
-					datsz += nr;
-				}
-			}
+		/*
+		 * Read the rest of the HTTP header, up to the empty line,
+		 * looking for the Content-Length.
+		 */
+		len = 0;
+		while ((nr = bio_getrec(bp, '\n', &line, 5)) > 0) {
+			if (line[0] == '\r' || line[0] == '\0')
+				break;
+			if (strncasecmp(line, "Content-Length:", 15) == 0)
+				len = atoi(line + 15);
+		}
+		if (nr <= 0)
+			goto out;
+		if (HTTP_INFO(code))
+			continue;
+		if (!HTTP_SUCCESS(code)) { /* probable error: log it */
+			log_msg("error: %s", reason);
+			break;
+		}
 
-			hp = (struct ipp_hdr *)cp;
-			i = ntohs(hp->status);
-			jobid = ntohl(hp->request_id);
+		/*
+		 * HTTP request was okay, but still need to check
+		 * IPP status.
+		 */
+		if (len < (int)sizeof(struct ipp_hdr))
+			len = sizeof(struct ipp_hdr);
+		if ((nr = bio_getspan(bp, len, &cp, 5)) < len) {
+			if (nr >= 0)
+				errno = EIO;	/* short response */
+			nr = -1;
+			goto out;
+		}
 
-			if (jobid != jp->jobid) {
-				/*
-				 * Different jobs.  Ignore it.
-				 */
-				log_msg("jobid %d status code %d", jobid, i);
-				break;
-			}
+		hp = (struct ipp_hdr *)cp;
+		i = ntohs(hp->status);
+		jobid = ntohl(hp->request_id);
 
-			if (STATCLASS_OK(i))
-				success = 1;
+		if (jobid != jp->jobid) {
+			/*
+			 * Different jobs.  Ignore it.
+			 */
+			log_msg("jobid %d status code %d", jobid, i);
 			break;
 		}
+
+		if (STATCLASS_OK(i))
+			success = 1;
+		break;
 	}
 
 out:
-	free(bp);
+	bio_free(bp);
 	if (nr < 0) {
 		log_msg("jobid %d: error reading printer response: %s",
 		  jobid, strerror(errno));
@@ -1,5 +1,506 @@
 #include "apue.h"
 
+#ifdef LINUX
+
+/*
+ * One process, with no signals, relays any number of pty sessions.
+ * epoll tells us which descriptors are ready.  Each direction of each
+ * session (input -> pty master, pty master -> output) has its own pipe
+ * as a buffer.  Data is moved into and out of the pipe with splice(),
+ * so it is never copied into our address space.  If the kernel can't
+ * splice one of the descriptors, that direction falls back to read()
+ * and write() through an ordinary buffer.
+ *
+ * When a buffer is full we stop reading its source until the other end
+ * catches up, so a slow reader of one session doesn't affect the
+ * others, or make us use more memory.  Regular files can't be polled.
+ * A direction that reads or writes one is simply retried every time
+ * round the loop while it can make progress.
+ *
+ * SIGWINCH is received through a signalfd.  A session whose input is
+ * a terminal gets that terminal's new window size.
+ *
+ * O_NONBLOCK is a file status flag, shared by every descriptor dup()ed
+ * from the same open, so several sessions may write to one stdout and
+ * share its flags.  We count the sessions using each file, and put the
+ * flags back only when the last of them is over.  Descriptors for the
+ * same file are taken to be dups of one another.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+
+#define	BUFFSIZE	65536		/* per direction, pipe or buffer */
+#define	MAXEVENTS	64
+
+struct xfer {
+	int		src, dst;
+	int		pfd[2];			/* splice buffer, or -1 */
+	size_t	npend;			/* bytes in the pipe */
+	char	*buf;			/* copy buffer, if we can't splice */
+	size_t	off, len;		/* data is buf[off] .. buf[off+len-1] */
+	int		eof;			/* EOF or error on src */
+};
+
+/*
+ * The file status flags a file had before the first session using it
+ * made it nonblocking.
+ */
+struct fdflags {
+	struct fdflags	*next;
+	dev_t			dev;
+	ino_t			ino;
+	int				flags;		/* file status flags to restore */
+	int				nref;		/* sessions using the file */
+};
+
+/*
+ * What we register with epoll: one for each descriptor of a session.
+ */
+struct fdent {
+	int				fd;
+	struct session	*sp;
+	unsigned int	events;		/* what we've asked for */
+	int				pollable;	/* epoll accepts it */
+	struct fdflags	*ffp;		/* saved flags, NULL for the pty */
+};
+
+#define	E_IN	0				/* input, usually stdin */
+#define	E_OUT	1				/* output, usually stdout */
+#define	E_PTYM	2
+
+struct session {
+	struct session	*next;
+	int				ptym;
+	int				ignoreeof;
+	struct xfer		in;			/* input to ptym */
+	struct xfer		out;		/* ptym to output */
+	struct fdent	ent[3];
+};
+
+static int				epfd = -1;
+static int				sigfd = -1;
+static struct session	*sessions;
+static struct fdflags	*savedflags;
+
+static size_t
+pending(struct xfer *xp)
+{
+	return(xp->pfd[0] >= 0 ? xp->npend : xp->len);
+}
+
+/*
+ * Make a descriptor nonblocking, remembering the flags its file had
+ * if no other session is using it.
+ */
+static struct fdflags *
+flags_hold(int fd)
+{
+	int				flags;
+	struct stat		sb;
+	struct fdflags	*ffp;
+
+	if (fstat(fd, &sb) < 0)
+		err_sys("fstat error");
+	for (ffp = savedflags; ffp != NULL; ffp = ffp->next) {
+		if (ffp->dev == sb.st_dev && ffp->ino == sb.st_ino) {
+			set_fl(fd, O_NONBLOCK);		/* in case it isn't a dup */
+			ffp->nref++;
+			return(ffp);
+		}
+	}
+	if ((flags = fcntl(fd, F_GETFL, 0)) < 0)
+		err_sys("fcntl F_GETFL error");
+	set_fl(fd, O_NONBLOCK);
+	if ((ffp = malloc(sizeof(struct fdflags))) == NULL)
+		err_sys("malloc error");
+	ffp->dev = sb.st_dev;
+	ffp->ino = sb.st_ino;
+	ffp->flags = flags;
+	ffp->nref = 1;
+	ffp->next = savedflags;
+	savedflags = ffp;
+	return(ffp);
+}
+
+/*
+ * A session is done with a descriptor.  If it was the last one using
+ * the file, put the flags back.
+ */
+static void
+flags_release(int fd, struct fdflags *ffp)
+{
+	struct fdflags	**ffpp;
+
+	if (--ffp->nref > 0)
+		return;
+	fcntl(fd, F_SETFL, ffp->flags);
+	for (ffpp = &savedflags; *ffpp != ffp; ffpp = &(*ffpp)->next)
+		;
+	*ffpp = ffp->next;
+	free(ffp);
+}
+
+static int
+wants_input(struct xfer *xp)
+{
+	return(!xp->eof && pending(xp) < BUFFSIZE);
+}
+
+/*
+ * Give up on splice() for this direction: move whatever is in the
+ * pipe to a buffer, and copy from now on.
+ */
+static int
+use_copy(struct xfer *xp)
+{
+	ssize_t	n;
+
+	if ((xp->buf = malloc(BUFFSIZE)) == NULL)
+		return(-1);
+	xp->off = 0;
+	xp->len = 0;
+	if (xp->npend > 0) {
+		if ((n = read(xp->pfd[0], xp->buf, xp->npend)) < 0)
+			return(-1);
+		xp->len = n;
+	}
+	close(xp->pfd[0]);
+	close(xp->pfd[1]);
+	xp->pfd[0] = xp->pfd[1] = -1;
+	xp->npend = 0;
+	return(0);
+}
+
+/*
+ * Read what we can from the source.  Returns the number of bytes
+ * moved, 0 if none.  EOF and errors end the direction.
+ */
+static ssize_t
+fill(struct xfer *xp)
+{
+	ssize_t	n;
+
+	if (!wants_input(xp))
+		return(0);
+	if (xp->pfd[0] >= 0) {
+		n = splice(xp->src, NULL, xp->pfd[1], NULL, BUFFSIZE - xp->npend,
+		  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n < 0 && errno == EINVAL) {
+			if (use_copy(xp) < 0)
+				n = -1;
+			else
+				return(fill(xp));
+		}
+		if (n > 0)
+			xp->npend += n;
+	} else {
+		if (xp->len == 0)
+			xp->off = 0;
+		else if (xp->off + xp->len == BUFFSIZE) {
+			memmove(xp->buf, xp->buf + xp->off, xp->len);
+			xp->off = 0;
+		}
+		n = read(xp->src, xp->buf + xp->off + xp->len,
+		  BUFFSIZE - xp->off - xp->len);
+		if (n > 0)
+			xp->len += n;
+	}
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+		xp->eof = 1;		/* on a pty master, EIO means EOF */
+	return(n > 0 ? n : 0);
+}
+
+/*
+ * Write what we can to the destination.  Returns the number of bytes
+ * moved, or -1 if the destination is gone.
+ */
+static ssize_t
+flush(struct xfer *xp)
+{
+	ssize_t	n;
+
+	if (pending(xp) == 0)
+		return(0);
+	if (xp->pfd[0] >= 0) {
+		n = splice(xp->pfd[0], NULL, xp->dst, NULL, xp->npend,
+		  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n < 0 && errno == EINVAL) {
+			if (use_copy(xp) < 0)
+				return(-1);
+			return(flush(xp));
+		}
+		if (n > 0)
+			xp->npend -= n;
+	} else {
+		n = write(xp->dst, xp->buf + xp->off, xp->len);
+		if (n > 0) {
+			xp->off += n;
+			xp->len -= n;
+		}
+	}
+	if (n < 0)
+		return((errno == EAGAIN || errno == EINTR) ? 0 : -1);
+	return(n);
+}
+
+/*
+ * Ask epoll for what each descriptor of the session needs now.  A
+ * descriptor that needs nothing is taken out of the set: epoll reports
+ * a hangup or an error even with no events asked for, and a finished
+ * direction would otherwise wake us up over and over.
+ */
+static void
+set_events(struct session *sp)
+{
+	int					i;
+	unsigned int		ev[3];
+	struct epoll_event	epev;
+
+	ev[E_IN] = wants_input(&sp->in) ? EPOLLIN : 0;
+	ev[E_OUT] = pending(&sp->out) > 0 ? EPOLLOUT : 0;
+	ev[E_PTYM] = (wants_input(&sp->out) ? EPOLLIN : 0) |
+	  (pending(&sp->in) > 0 ? EPOLLOUT : 0);
+	for (i = 0; i < 3; i++) {
+		if (!sp->ent[i].pollable || ev[i] == sp->ent[i].events)
+			continue;
+		epev.events = ev[i];
+		epev.data.ptr = &sp->ent[i];
+		if (epoll_ctl(epfd, ev[i] == 0 ? EPOLL_CTL_DEL :
+		  sp->ent[i].events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+		  sp->ent[i].fd, &epev) < 0)
+			err_sys("epoll_ctl error");
+		sp->ent[i].events = ev[i];
+	}
+}
+
+/*
+ * Is the session over?  It is when the pty master has reached EOF and
+ * its output is written, or, unless ignoreeof is set, when the input
+ * has reached EOF and been written to the pty.
+ */
+static int
+finished(struct session *sp)
+{
+	if (sp->out.eof && pending(&sp->out) == 0)
+		return(1);
+	if (!sp->ignoreeof && sp->in.eof && pending(&sp->in) == 0)
+		return(1);
+	return(0);
+}
+
+static void
+end_session(struct session *sp)
+{
+	int				i;
+	struct session	**spp;
+	struct xfer		*xp;
+
+	for (i = 0; i < 3; i++) {
+		if (sp->ent[i].pollable && sp->ent[i].events != 0)
+			epoll_ctl(epfd, EPOLL_CTL_DEL, sp->ent[i].fd, NULL);
+		if (sp->ent[i].ffp != NULL)
+			flags_release(sp->ent[i].fd, sp->ent[i].ffp);
+	}
+	for (xp = &sp->in; xp != NULL; xp = (xp == &sp->in) ? &sp->out : NULL) {
+		if (xp->pfd[0] >= 0) {
+			close(xp->pfd[0]);
+			close(xp->pfd[1]);
+		}
+		free(xp->buf);
+	}
+	close(sp->ptym);
+	for (spp = &sessions; *spp != sp; spp = &(*spp)->next)
+		;
+	*spp = sp->next;
+	free(sp);
+}
+
+/*
+ * Move whatever can be moved in both directions.  Returns nonzero if
+ * we got anywhere.
+ */
+static int
+service(struct session *sp)
+{
+	ssize_t	n, progress;
+
+	progress = 0;
+	if ((n = flush(&sp->in)) < 0)
+		sp->in.eof = 1, sp->in.npend = sp->in.len = 0;
+	progress += n;
+	if ((n = flush(&sp->out)) < 0)
+		err_sys("write error to output");
+	progress += n;
+	progress += fill(&sp->in);
+	progress += fill(&sp->out);
+	if ((n = flush(&sp->in)) > 0)
+		progress += n;
+	if ((n = flush(&sp->out)) < 0)
+		err_sys("write error to output");
+	progress += n;
+	return(progress > 0);
+}
+
+static void
+winch(void)
+{
+	struct signalfd_siginfo	si;
+	struct session			*sp;
+	struct winsize			size;
+
+	while (read(sigfd, &si, sizeof(si)) == sizeof(si))
+		;
+	for (sp = sessions; sp != NULL; sp = sp->next) {
+		if (isatty(sp->in.src) &&
+		  ioctl(sp->in.src, TIOCGWINSZ, (char *)&size) == 0)
+			ioctl(sp->ptym, TIOCSWINSZ, (char *)&size);
+	}
+}
+
+static void
+relay_init(void)
+{
+	sigset_t			mask;
+	struct epoll_event	epev;
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		err_sys("epoll_create1 error");
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGWINCH);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+		err_sys("sigprocmask error");
+	if ((sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+		err_sys("signalfd error");
+	epev.events = EPOLLIN;
+	epev.data.ptr = NULL;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &epev) < 0)
+		err_sys("epoll_ctl error");
+}
+
+static void
+xfer_init(struct xfer *xp, int src, int dst)
+{
+	xp->src = src;
+	xp->dst = dst;
+	xp->npend = xp->off = xp->len = 0;
+	xp->buf = NULL;
+	xp->eof = 0;
+	if (pipe2(xp->pfd, O_NONBLOCK | O_CLOEXEC) < 0)
+		err_sys("pipe2 error");
+	fcntl(xp->pfd[0], F_SETPIPE_SZ, BUFFSIZE);
+}
+
+/*
+ * Add a session: copy "infd" to the pty master, and the pty master
+ * to "outfd".  The descriptors are made nonblocking while the session
+ * lasts, and get their flags back when no session uses them any more.
+ * We close the pty master when the session is over, but not the other
+ * two.
+ */
+void
+relay_add(int infd, int outfd, int ptym, int ignoreeof)
+{
+	int					i;
+	struct session		*sp;
+	struct epoll_event	epev;
+
+	if (epfd < 0)
+		relay_init();
+	if ((sp = malloc(sizeof(struct session))) == NULL)
+		err_sys("malloc error");
+	sp->ptym = ptym;
+	sp->ignoreeof = ignoreeof;
+	xfer_init(&sp->in, infd, ptym);
+	xfer_init(&sp->out, ptym, outfd);
+	sp->ent[E_IN].fd = infd;
+	sp->ent[E_OUT].fd = outfd;
+	sp->ent[E_PTYM].fd = ptym;
+	for (i = 0; i < 3; i++) {
+		sp->ent[i].sp = sp;
+		sp->ent[i].events = 0;
+		if (i == E_PTYM) {
+			sp->ent[i].ffp = NULL;		/* ours; closed at the end */
+			set_fl(sp->ent[i].fd, O_NONBLOCK);
+		} else {
+			sp->ent[i].ffp = flags_hold(sp->ent[i].fd);
+		}
+		/*
+		 * See whether epoll takes the descriptor.  set_events()
+		 * adds it for real once it needs something.
+		 */
+		epev.events = 0;
+		epev.data.ptr = &sp->ent[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, sp->ent[i].fd, &epev) == 0) {
+			epoll_ctl(epfd, EPOLL_CTL_DEL, sp->ent[i].fd, NULL);
+			sp->ent[i].pollable = 1;
+		} else if (errno == EPERM)
+			sp->ent[i].pollable = 0;	/* regular file: always ready */
+		else
+			err_sys("epoll_ctl error");
+	}
+	sp->next = sessions;
+	sessions = sp;
+	set_events(sp);
+}
+
+/*
+ * Relay until every session is over.
+ */
+void
+relay_run(void)
+{
+	int					i, n, timeout;
+	struct epoll_event	ev[MAXEVENTS];
+	struct fdent		*ep;
+	struct session		*sp, *next;
+
+	timeout = 0;
+	while (sessions != NULL) {
+		if ((n = epoll_wait(epfd, ev, MAXEVENTS, timeout)) < 0) {
+			if (errno == EINTR)
+				continue;
+			err_sys("epoll_wait error");
+		}
+		for (i = 0; i < n; i++) {
+			if ((ep = ev[i].data.ptr) == NULL) {
+				winch();
+				continue;
+			}
+			service(ep->sp);
+		}
+
+		/*
+		 * Sessions with a regular file don't get events for it; keep
+		 * them going while they're getting somewhere.  Then retire
+		 * the sessions that are over.
+		 */
+		timeout = -1;
+		for (sp = sessions; sp != NULL; sp = next) {
+			next = sp->next;
+			if ((!sp->ent[E_IN].pollable || !sp->ent[E_OUT].pollable) &&
+			  service(sp))
+				timeout = 0;
+			if (finished(sp))
+				end_session(sp);
+			else
+				set_events(sp);
+		}
+	}
+}
+
+void
+loop(int ptym, int ignoreeof)
+{
+	relay_add(STDIN_FILENO, STDOUT_FILENO, ptym, ignoreeof);
+	relay_run();
+}
+
+#else	/* !LINUX */
+
 #define	BUFFSIZE	512
 
 static void	sig_term(int);
@@ -68,3 +569,5 @@ sig_term(int signo)
 {
 	sigcaught = 1;		/* just set flag and return */
 }
+
+#endif	/* LINUX */
@@ -0,0 +1,158 @@
+#include "apue.h"
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * Run many scripted sessions, each on its own pty, with a single
+ * process relaying all of them (loop.c).  Each line of "cmdfile" is
+ *
+ *		infile outfile command
+ *
+ * "command" is run by the shell on the pty slave.  Its input comes
+ * from "infile" and what it writes to the terminal goes to "outfile";
+ * "-" means /dev/null for the input and our stdout for the output.
+ * A session lasts until the command closes the pty, as with pty -i.
+ *
+ * usage: ptymux [-e] cmdfile
+ */
+#define	MAXLINE2	(MAXLINE * 4)
+
+void	relay_add(int, int, int, int);	/* in the file loop.c */
+void	relay_run(void);				/* in the file loop.c */
+
+struct child {
+	pid_t	pid;
+	int		infd, outfd;
+	char	*cmd;
+};
+
+static void
+set_noecho(int fd)
+{
+	struct termios	stermios;
+
+	if (tcgetattr(fd, &stermios) < 0)
+		err_sys("tcgetattr error");
+	stermios.c_lflag &= ~(ECHO | ECHOE | ECHOK | ECHONL);
+	stermios.c_oflag &= ~(ONLCR);
+	if (tcsetattr(fd, TCSANOW, &stermios) < 0)
+		err_sys("tcsetattr error");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int				c, fdm, noecho, n, nchild, nalloc, status;
+	char			line[MAXLINE2], infile[MAXLINE2], outfile[MAXLINE2];
+	char			*cmd;
+	pid_t			pid;
+	FILE			*fp;
+	struct child	*children;
+	struct rlimit	rl;
+	struct timespec	start, end;
+
+	noecho = 0;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "e")) != EOF) {
+		switch (c) {
+		case 'e':
+			noecho = 1;
+			break;
+		case '?':
+			err_quit("unrecognized option: -%c", optopt);
+		}
+	}
+	if (optind != argc - 1)
+		err_quit("usage: ptymux [-e] cmdfile");
+	if ((fp = fopen(argv[optind], "r")) == NULL)
+		err_sys("can't open %s", argv[optind]);
+	set_cloexec(fileno(fp));
+
+	/*
+	 * Each session takes 7 descriptors: the pty master, the input
+	 * and output, and a pipe for each direction.
+	 */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	children = NULL;
+	nchild = nalloc = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (fgets(line, MAXLINE2, fp) != NULL) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		n = 0;
+		if (sscanf(line, "%s %s %n", infile, outfile, &n) < 2 || n == 0)
+			err_quit("bad line: %s", line);
+		cmd = line + n;
+		cmd[strcspn(cmd, "\n")] = 0;
+		if (nchild == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 16;
+			if ((children = realloc(children,
+			  nalloc * sizeof(struct child))) == NULL)
+				err_sys("realloc error");
+		}
+		/*
+		 * Everything we open stays open while later sessions are
+		 * forked, so it all has to be close-on-exec, or each child
+		 * would inherit the descriptors of the sessions before it.
+		 */
+		if ((children[nchild].infd = open(strcmp(infile, "-") == 0 ?
+		  "/dev/null" : infile, O_RDONLY | O_CLOEXEC)) < 0)
+			err_sys("can't open %s", infile);
+		if (strcmp(outfile, "-") == 0)
+			children[nchild].outfd = fcntl(STDOUT_FILENO,
+			  F_DUPFD_CLOEXEC, 0);
+		else
+			children[nchild].outfd = open(outfile,
+			  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, FILE_MODE);
+		if (children[nchild].outfd < 0)
+			err_sys("can't open %s", outfile);
+		if ((children[nchild].cmd = strdup(cmd)) == NULL)
+			err_sys("strdup error");
+
+		if ((pid = pty_fork(&fdm, NULL, 0, NULL, NULL)) < 0) {
+			err_sys("fork error");
+		} else if (pid == 0) {		/* child */
+			execl("/bin/sh", "sh", "-c", cmd, (char *)0);
+			err_sys("can't execute: %s", cmd);
+		}
+		children[nchild].pid = pid;
+		set_cloexec(fdm);
+
+		/*
+		 * On Linux, the termios calls on the master act on the
+		 * slave.  Turning off echo here, before we write anything
+		 * to the master, means none of the input can be echoed.
+		 */
+		if (noecho)
+			set_noecho(fdm);
+		relay_add(children[nchild].infd, children[nchild].outfd, fdm, 1);
+		nchild++;
+	}
+	fclose(fp);
+
+	relay_run();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (n = 0; n < nchild; n++) {
+		if (waitpid(children[n].pid, &status, 0) < 0)
+			err_sys("waitpid error");
+		if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+			fprintf(stderr, "%s: exit status %d\n", children[n].cmd,
+			  WEXITSTATUS(status));
+		else if (WIFSIGNALED(status))
+			fprintf(stderr, "%s: signal %d\n", children[n].cmd,
+			  WTERMSIG(status));
+		close(children[n].infd);
+		close(children[n].outfd);
+	}
+	fprintf(stderr, "%d sessions in %.3f s\n", nchild,
+	  (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+	exit(0);
+}
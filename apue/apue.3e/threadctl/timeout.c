@@ -3,19 +3,14 @@
 #include <time.h>
 #include <sys/time.h>
 
-extern int makethread(void *(*)(void *), void *);
-
 struct to_info {
 	void	      (*to_fn)(void *);	/* function */
 	void           *to_arg;			/* argument */
-	struct timespec to_wait;		/* time to wait */
+	struct tw_timer	to_timer;		/* on the timer wheel */
 };
 
 #define SECTONSEC  1000000000	/* seconds to nanoseconds */
-
-#if !defined(CLOCK_REALTIME) || defined(BSD)
-#define clock_nanosleep(ID, FL, REQ, REM)	nanosleep((REQ), (REM))
-#endif
+#define MSECTONSEC 1000000		/* milliseconds to nanoseconds */
 
 #ifndef CLOCK_REALTIME
 #define CLOCK_REALTIME 0
@@ -32,41 +27,39 @@ clock_gettime(int id, struct timespec *tsp)
 }
 #endif
 
-void *
+void
 timeout_helper(void *arg)
 {
 	struct to_info	*tip;
 
 	tip = (struct to_info *)arg;
-	clock_nanosleep(CLOCK_REALTIME, 0, &tip->to_wait, NULL);
 	(*tip->to_fn)(tip->to_arg);
 	free(arg);
-	return(0);
 }
 
+/*
+ * Instead of a thread per timeout, sleeping until its time comes,
+ * all timeouts share the one thread that runs the timer wheel.
+ */
 void
 timeout(const struct timespec *when, void (*func)(void *), void *arg)
 {
 	struct timespec	now;
 	struct to_info	*tip;
+	unsigned long	msec;
 	int				err;
 
 	clock_gettime(CLOCK_REALTIME, &now);
 	if ((when->tv_sec > now.tv_sec) ||
 	  (when->tv_sec == now.tv_sec && when->tv_nsec > now.tv_nsec)) {
-		tip = malloc(sizeof(struct to_info));
+		tip = calloc(1, sizeof(struct to_info));
 		if (tip != NULL) {
 			tip->to_fn = func;
 			tip->to_arg = arg;
-			tip->to_wait.tv_sec = when->tv_sec - now.tv_sec;
-			if (when->tv_nsec >= now.tv_nsec) {
-				tip->to_wait.tv_nsec = when->tv_nsec - now.tv_nsec;
-			} else {
-				tip->to_wait.tv_sec--;
-				tip->to_wait.tv_nsec = SECTONSEC - now.tv_nsec +
-				  when->tv_nsec;
-			}
-			err = makethread(timeout_helper, (void *)tip);
+			msec = (when->tv_sec - now.tv_sec) * 1000 +
+			  (when->tv_nsec - now.tv_nsec) / MSECTONSEC;
+			err = tw_add(&tip->to_timer, msec, timeout_helper,
+			  (void *)tip);
 			if (err == 0)
 				return;
 			else
@@ -76,7 +69,8 @@ timeout(const struct timespec *when, void (*func)(void *), void *arg)
 
 	/*
 	 * We get here if (a) when <= now, or (b) malloc fails, or
-	 * (c) we can't make a thread, so we just call the function now.
+	 * (c) we can't start the timer thread, so we just call the
+	 * function now.
 	 */
 	(*func)(arg);
 }
@@ -0,0 +1,126 @@
+#include "apue.h"
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Measure the timer wheel in lib/timerwheel.c with many timers
+ * pending at once: the cost of adding and canceling a timer, and
+ * how late timers fire when they all have to be run.
+ *
+ * usage: timerbench [-n ntimers] [-s spread_msec]
+ */
+struct btimer {
+	struct tw_timer	tm;
+	struct timespec	due;
+};
+
+static pthread_mutex_t	donelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	donecond = PTHREAD_COND_INITIALIZER;
+static long				nfired;
+static double			latesum, latemax;
+
+static double
+elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return((to->tv_sec - from->tv_sec) * 1e9 +
+	  (to->tv_nsec - from->tv_nsec));
+}
+
+static void
+noop(void *arg)
+{
+}
+
+static void
+fired(void *arg)
+{
+	struct btimer	*bp = arg;
+	struct timespec	now;
+	double			late;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	late = elapsed(&bp->due, &now);
+	pthread_mutex_lock(&donelock);
+	latesum += late;
+	if (late > latemax)
+		latemax = late;
+	nfired++;
+	pthread_mutex_unlock(&donelock);
+	pthread_cond_signal(&donecond);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int				c, err;
+	long			i, n, spread;
+	unsigned long	ms;
+	struct btimer	*timers;
+	struct timespec	start, end;
+
+	n = 100000;
+	spread = 2000;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "n:s:")) != EOF) {
+		switch (c) {
+		case 'n':
+			n = atol(optarg);
+			break;
+		case 's':
+			spread = atol(optarg);
+			break;
+		case '?':
+			err_quit("unrecognized option: -%c", optopt);
+		}
+	}
+	if (n < 1 || spread < 1)
+		err_quit("usage: timerbench [-n ntimers] [-s spread_msec]");
+	if ((timers = calloc(n, sizeof(struct btimer))) == NULL)
+		err_sys("calloc error");
+	srandom(getpid());
+
+	/*
+	 * Add and cancel timers far enough out that none fire,
+	 * spread across all the levels of the wheel.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++) {
+		ms = 60000 + random() % (3600 * 1000);
+		if ((err = tw_add(&timers[i].tm, ms, noop, NULL)) != 0)
+			err_exit(err, "tw_add error");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("add:    %ld timers, %.0f ns/op\n", n, elapsed(&start, &end) / n);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++) {
+		if (tw_cancel(&timers[i].tm) != 1)
+			err_quit("timer %ld wasn't pending", i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("cancel: %ld timers, %.0f ns/op\n", n,
+	  elapsed(&start, &end) / n);
+
+	/*
+	 * Now let them all fire, within "spread" milliseconds.
+	 */
+	for (i = 0; i < n; i++) {
+		ms = 1 + random() % spread;
+		clock_gettime(CLOCK_MONOTONIC, &timers[i].due);
+		timers[i].due.tv_sec += ms / 1000;
+		timers[i].due.tv_nsec += (ms % 1000) * 1000000;
+		if (timers[i].due.tv_nsec >= 1000000000) {
+			timers[i].due.tv_sec++;
+			timers[i].due.tv_nsec -= 1000000000;
+		}
+		if ((err = tw_add(&timers[i].tm, ms, fired, &timers[i])) != 0)
+			err_exit(err, "tw_add error");
+	}
+	pthread_mutex_lock(&donelock);
+	while (nfired < n)
+		pthread_cond_wait(&donecond, &donelock);
+	pthread_mutex_unlock(&donelock);
+	printf("expire: %ld timers, late by %.0f us avg, %.0f us max\n", n,
+	  latesum / n / 1000, latemax / 1000);
+	exit(0);
+}
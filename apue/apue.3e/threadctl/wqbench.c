@@ -0,0 +1,351 @@
+#include "apue.h"
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Benchmark for the work-stealing pool of lib/workq.c.
+ *
+ * fork-join: compute fib(n) by splitting every call above a cutoff
+ * into two tasks and joining them, against the same recursion in one
+ * thread.
+ *
+ * producer/consumer: "nprod" threads outside the pool submit "njobs"
+ * small jobs each.  Each job is meant for one worker, round robin.  We
+ * run this through the pool, with and without giving each job to its
+ * worker, and through the job queue of threads/rwlock.c: one list
+ * under a reader-writer lock, where workers search for jobs with their
+ * thread ID.
+ *
+ * usage: wqbench [-p] [-t nthreads] [-f n] [-c cutoff] [-P nprod]
+ *                [-j njobs] [-w work]
+ */
+static struct workq	*wq;
+static int			cutoff = 20;
+static int			work = 100;
+
+static double
+elapsed(struct timespec *start)
+{
+	struct timespec	end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return((end.tv_sec - start->tv_sec) +
+	  (end.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static void
+spin(void)
+{
+	volatile int	i;
+
+	for (i = 0; i < work; i++)
+		;
+}
+
+/*
+ * Fork-join.
+ */
+struct fib {
+	struct wq_task	task;
+	int				n;
+	long			result;
+};
+
+static long
+fib_serial(int n)
+{
+	return(n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2));
+}
+
+static void
+fib_task(void *arg)
+{
+	struct fib		*fp = arg;
+	struct fib		child;
+	struct wq_group	group;
+
+	if (fp->n < cutoff) {
+		fp->result = fib_serial(fp->n);
+		return;
+	}
+	memset(&group, 0, sizeof(group));
+	child.task.wt_fn = fib_task;
+	child.task.wt_arg = &child;
+	child.task.wt_group = &group;
+	child.n = fp->n - 1;
+	if (wq_submit(wq, &child.task, -1) < 0)
+		err_sys("wq_submit error");
+	fp->n -= 2;
+	fib_task(fp);					/* do the other half ourselves */
+	wq_wait(wq, &group);
+	fp->result += child.result;
+}
+
+/*
+ * Producer/consumer.  A job of the rwlock.c queue.
+ */
+struct job {
+	struct job		*j_next;
+	struct job		*j_prev;
+	pthread_t		j_id;			/* tells which thread handles this job */
+	struct wq_task	j_task;			/* for the pool */
+	int				j_worker;
+};
+
+struct queue {
+	struct job			*q_head;
+	struct job			*q_tail;
+	pthread_rwlock_t	q_lock;
+	pthread_mutex_t		q_mutex;	/* for sleeping */
+	pthread_cond_t		q_cond;
+	long				q_done;
+};
+
+static struct queue	queue;
+static struct job	*jobs;
+static int			nprod = 2;
+static long			njobs = 100000;
+static int			nthreads;
+static int			affine;			/* pool: give jobs to their workers */
+static pthread_t	*tids;
+static long			total;
+static struct wq_group	pcgroup;
+
+static void
+job_append(struct queue *qp, struct job *jp)
+{
+	pthread_rwlock_wrlock(&qp->q_lock);
+	jp->j_next = NULL;
+	jp->j_prev = qp->q_tail;
+	if (qp->q_tail != NULL)
+		qp->q_tail->j_next = jp;
+	else
+		qp->q_head = jp;
+	qp->q_tail = jp;
+	pthread_rwlock_unlock(&qp->q_lock);
+	pthread_mutex_lock(&qp->q_mutex);
+	pthread_cond_broadcast(&qp->q_cond);
+	pthread_mutex_unlock(&qp->q_mutex);
+}
+
+/*
+ * Find and remove a job for the given thread, as job_find() and
+ * job_remove() do in rwlock.c.
+ */
+static struct job *
+job_get(struct queue *qp, pthread_t id)
+{
+	struct job	*jp;
+
+	pthread_rwlock_rdlock(&qp->q_lock);
+	for (jp = qp->q_head; jp != NULL; jp = jp->j_next)
+		if (pthread_equal(jp->j_id, id))
+			break;
+	pthread_rwlock_unlock(&qp->q_lock);
+	if (jp == NULL)
+		return(NULL);
+	pthread_rwlock_wrlock(&qp->q_lock);
+	if (jp == qp->q_head) {
+		qp->q_head = jp->j_next;
+		if (qp->q_tail == jp)
+			qp->q_tail = NULL;
+		else
+			jp->j_next->j_prev = jp->j_prev;
+	} else if (jp == qp->q_tail) {
+		qp->q_tail = jp->j_prev;
+		jp->j_prev->j_next = jp->j_next;
+	} else {
+		jp->j_prev->j_next = jp->j_next;
+		jp->j_next->j_prev = jp->j_prev;
+	}
+	pthread_rwlock_unlock(&qp->q_lock);
+	return(jp);
+}
+
+static void *
+queue_worker(void *arg)
+{
+	struct job	*jp;
+	pthread_t	me = pthread_self();
+
+	for (;;) {
+		if ((jp = job_get(&queue, me)) != NULL) {
+			spin();
+			pthread_mutex_lock(&queue.q_mutex);
+			if (++queue.q_done == total)
+				pthread_cond_broadcast(&queue.q_cond);
+			pthread_mutex_unlock(&queue.q_mutex);
+			continue;
+		}
+		pthread_mutex_lock(&queue.q_mutex);
+		if (queue.q_done == total) {
+			pthread_mutex_unlock(&queue.q_mutex);
+			return((void *)0);
+		}
+		pthread_rwlock_rdlock(&queue.q_lock);
+		for (jp = queue.q_head; jp != NULL; jp = jp->j_next)
+			if (pthread_equal(jp->j_id, me))
+				break;
+		pthread_rwlock_unlock(&queue.q_lock);
+		if (jp == NULL)
+			pthread_cond_wait(&queue.q_cond, &queue.q_mutex);
+		pthread_mutex_unlock(&queue.q_mutex);
+	}
+}
+
+static void
+job_task(void *arg)
+{
+	spin();
+}
+
+static void *
+producer(void *arg)
+{
+	long		i, p;
+	struct job	*jp;
+
+	p = (long)arg;
+	for (i = 0; i < njobs; i++) {
+		jp = &jobs[p * njobs + i];
+		if (wq == NULL) {
+			jp->j_id = tids[jp->j_worker];
+			job_append(&queue, jp);
+		} else {
+			jp->j_task.wt_fn = job_task;
+			jp->j_task.wt_arg = jp;
+			jp->j_task.wt_group = &pcgroup;
+			if (wq_submit(wq, &jp->j_task, affine ? jp->j_worker : -1) < 0)
+				err_sys("wq_submit error");
+		}
+	}
+	return((void *)0);
+}
+
+static void
+prodcons(const char *name)
+{
+	int				i, err;
+	long			n;
+	pthread_t		*ptids;
+	struct timespec	start;
+	double			secs;
+
+	if ((ptids = malloc(nprod * sizeof(pthread_t))) == NULL)
+		err_sys("malloc error");
+	for (n = 0; n < total; n++)
+		jobs[n].j_worker = n % nthreads;
+	memset(&pcgroup, 0, sizeof(pcgroup));
+	queue.q_done = 0;
+	if (wq == NULL) {
+		for (i = 0; i < nthreads; i++)
+			if ((err = pthread_create(&tids[i], NULL, queue_worker,
+			  NULL)) != 0)
+				err_exit(err, "can't create thread");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nprod; i++)
+		if ((err = pthread_create(&ptids[i], NULL, producer,
+		  (void *)(long)i)) != 0)
+			err_exit(err, "can't create thread");
+	for (i = 0; i < nprod; i++)
+		pthread_join(ptids[i], NULL);
+	if (wq == NULL) {
+		for (i = 0; i < nthreads; i++)
+			pthread_join(tids[i], NULL);
+	} else {
+		wq_wait(wq, &pcgroup);
+	}
+	secs = elapsed(&start);
+	printf("%-24s %10.0f jobs/s\n", name, total / secs);
+	free(ptids);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int				c, fibn, flags;
+	long			expect;
+	struct fib		top;
+	struct timespec	start;
+	double			serial, pool;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	fibn = 36;
+	flags = 0;
+	opterr = 0;
+	while ((c = getopt(argc, argv, "c:f:j:pP:t:w:")) != EOF) {
+		switch (c) {
+		case 'c':
+			cutoff = atoi(optarg);
+			break;
+		case 'f':
+			fibn = atoi(optarg);
+			break;
+		case 'j':
+			njobs = atol(optarg);
+			break;
+		case 'p':
+			flags |= WQ_PIN;
+			break;
+		case 'P':
+			nprod = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'w':
+			work = atoi(optarg);
+			break;
+		case '?':
+			err_quit("usage: wqbench [-p] [-t nthreads] [-f n] [-c cutoff] "
+			  "[-P nprod] [-j njobs] [-w work]");
+		}
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	if (cutoff < 2)
+		cutoff = 2;
+	printf("%d workers\n", nthreads);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	expect = fib_serial(fibn);
+	serial = elapsed(&start);
+
+	if ((wq = wq_create(nthreads, flags)) == NULL)
+		err_sys("wq_create error");
+	top.n = fibn;
+	top.result = 0;
+	top.task.wt_fn = fib_task;
+	top.task.wt_arg = &top;
+	top.task.wt_group = &pcgroup;
+	memset(&pcgroup, 0, sizeof(pcgroup));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (wq_submit(wq, &top.task, -1) < 0)
+		err_sys("wq_submit error");
+	wq_wait(wq, &pcgroup);
+	pool = elapsed(&start);
+	if (top.result != expect)
+		err_quit("fib(%d): got %ld, should be %ld", fibn, top.result, expect);
+	printf("fork-join fib(%d), cutoff %d: serial %.3f s, pool %.3f s, "
+	  "speedup %.2f\n", fibn, cutoff, serial, pool, serial / pool);
+
+	total = (long)nprod * njobs;
+	if ((jobs = calloc(total, sizeof(struct job))) == NULL ||
+	  (tids = malloc(nthreads * sizeof(pthread_t))) == NULL)
+		err_sys("malloc error");
+	printf("producer/consumer: %d producers, %ld jobs, work %d\n", nprod,
+	  total, work);
+	affine = 0;
+	prodcons("pool");
+	affine = 1;
+	prodcons("pool, job per worker");
+	wq_destroy(wq);
+	wq = NULL;
+
+	pthread_rwlock_init(&queue.q_lock, NULL);
+	pthread_mutex_init(&queue.q_mutex, NULL);
+	pthread_cond_init(&queue.q_cond, NULL);
+	prodcons("rwlock queue, j_id");
+	exit(0);
+}